@@ -12,6 +12,36 @@ KWStyle.exe -xml kws.xml -html .kws_report src/universal/ktxtexture.h
 KWStyle.exe -xml kws.xml -html .kws_report src/universal/ktxtexture.cpp
 KWStyle.exe -xml kws.xml -html .kws_report src/universal/volume.h
 KWStyle.exe -xml kws.xml -html .kws_report src/universal/volume.cpp
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/parallel.h
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/parallel.cpp
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/resample.h
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/resample.cpp
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/arena.h
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/arena.cpp
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/pnmio.h
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/pnmio.cpp
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/volview.h
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/volview.cpp
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/reslice.h
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/reslice.cpp
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/rankfilter.h
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/rankfilter.cpp
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/guided.h
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/guided.cpp
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/polyphase.h
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/polyphase.cpp
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/halffloat.h
+KWStyle.exe -xml kws.xml -html .kws_report src/universal/halffloat.cpp
 
 KWStyle.exe -xml kws.xml -html .kws_report src/dwnsmpl/dsample2d.h
-KWStyle.exe -xml kws.xml -html .kws_report src/dwnsmpl/dsample2d.cpp
\ No newline at end of file
+KWStyle.exe -xml kws.xml -html .kws_report src/dwnsmpl/dsample2d.cpp
+
+KWStyle.exe -xml kws.xml -html .kws_report src/batch/jobspec.h
+KWStyle.exe -xml kws.xml -html .kws_report src/batch/jobspec.cpp
+KWStyle.exe -xml kws.xml -html .kws_report src/batch/workqueue.h
+KWStyle.exe -xml kws.xml -html .kws_report src/batch/workqueue.cpp
+KWStyle.exe -xml kws.xml -html .kws_report src/batch/dsample_batch_main.cpp
+
+KWStyle.exe -xml kws.xml -html .kws_report src/bench/benchstat.h
+KWStyle.exe -xml kws.xml -html .kws_report src/bench/benchstat.cpp
+KWStyle.exe -xml kws.xml -html .kws_report src/bench/dsample_bench_main.cpp
\ No newline at end of file
@@ -0,0 +1,562 @@
+// ****************************************************************************
+// File: dsample_batch_main.cpp
+// Purpose: Headless batch driver: process image / volume files by job spec
+// ****************************************************************************
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "memtrack.h"
+#include "arena.h"
+#include "parallel.h"
+#include "pnmio.h"
+#include "ktxtexture.h"
+#include "dsample2d.h"
+#include "jobspec.h"
+#include "workqueue.h"
+
+// ****************************************************************************
+// Types
+// ****************************************************************************
+
+enum InputType
+{
+  INPUT_TYPE_NA     = -1,
+  INPUT_TYPE_PNM    = 0,
+  INPUT_TYPE_RAW    = 1,
+  INPUT_TYPE_KTX    = 2
+};
+
+struct BatchState
+{
+  const JobSpec          *m_spec;
+  WorkQueue              *m_queue;
+  std::atomic<int>        m_numOk;
+  std::atomic<int>        m_numFailed;
+};
+
+// ****************************************************************************
+// Methods
+// ****************************************************************************
+
+static int _memTrackCallbackPrint(
+                                  const void *memPtr,
+                                  const int   memSize,
+                                  const char *fileNameSrc,
+                                  const int   fileLineNumber
+                                 )
+{
+  printf("Leak: %p, size = %d, file = %s, line = %d\n",
+    memPtr, memSize, fileNameSrc, fileLineNumber);
+  return 1;
+}
+
+static const char *_getFileExt(const char *fileName)
+{
+  const char *dot = strrchr(fileName, '.');
+  const char *slash = strrchr(fileName, '/');
+  const char *slashBack = strrchr(fileName, '\\');
+  if (!dot || (slash && (slash > dot)) || (slashBack && (slashBack > dot)))
+    return "";
+  return dot + 1;
+}
+
+static int _strEqualNoCase(const char *a, const char *b)
+{
+  for (; *a && *b; a++, b++)
+  {
+    char ca = (*a >= 'A' && *a <= 'Z') ? (char)(*a - 'A' + 'a') : *a;
+    char cb = (*b >= 'A' && *b <= 'Z') ? (char)(*b - 'A' + 'a') : *b;
+    if (ca != cb)
+      return 0;
+  }
+  return (*a == *b) ? 1 : 0;
+}
+
+static InputType _getInputType(const char *fileName)
+{
+  const char *ext = _getFileExt(fileName);
+  if (_strEqualNoCase(ext, "pgm") || _strEqualNoCase(ext, "pnm") ||
+      _strEqualNoCase(ext, "ppm"))
+    return INPUT_TYPE_PNM;
+  if (_strEqualNoCase(ext, "raw"))
+    return INPUT_TYPE_RAW;
+  if (_strEqualNoCase(ext, "ktx"))
+    return INPUT_TYPE_KTX;
+  return INPUT_TYPE_NA;
+}
+
+static int _isDirectory(const char *path)
+{
+  struct stat st;
+  if (stat(path, &st) != 0)
+    return 0;
+  return (st.st_mode & S_IFDIR) ? 1 : 0;
+}
+
+static void _listDirectory(const char *dirName, std::vector<std::string> &files)
+{
+#if defined(_WIN32)
+  std::string mask = std::string(dirName) + "\\*";
+  WIN32_FIND_DATAA findData;
+  HANDLE handle = FindFirstFileA(mask.c_str(), &findData);
+  if (handle == INVALID_HANDLE_VALUE)
+    return;
+  do
+  {
+    if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+      continue;
+    if (_getInputType(findData.cFileName) != INPUT_TYPE_NA)
+      files.push_back(std::string(dirName) + "/" + findData.cFileName);
+  } while (FindNextFileA(handle, &findData));
+  FindClose(handle);
+#else
+  DIR *dir = opendir(dirName);
+  if (!dir)
+    return;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL)
+  {
+    if (_getInputType(entry->d_name) == INPUT_TYPE_NA)
+      continue;
+    std::string path = std::string(dirName) + "/" + entry->d_name;
+    if (!_isDirectory(path.c_str()))
+      files.push_back(path);
+  }
+  closedir(dir);
+#endif
+  // stable processing order and output log
+  std::sort(files.begin(), files.end());
+}
+
+// output name: output dir + input base name + new extension
+static std::string _getOutputName(
+                                  const JobSpec &spec,
+                                  const char    *fileNameIn,
+                                  const char    *extNew
+                                 )
+{
+  const char *base = fileNameIn;
+  const char *slash = strrchr(base, '/');
+  if (slash)
+    base = slash + 1;
+  const char *slashBack = strrchr(base, '\\');
+  if (slashBack)
+    base = slashBack + 1;
+  std::string name(base);
+  const size_t dot = name.rfind('.');
+  if (dot != std::string::npos)
+    name.resize(dot);
+  return std::string(spec.m_output) + "/" + name + "." + extNew;
+}
+
+static int _getDimDst(const int dimSrc, const int dimSpec, const float scale)
+{
+  if (dimSpec > 0)
+    return dimSpec;
+  int dim = (int)(dimSrc * scale);
+  return (dim > 0) ? dim : 1;
+}
+
+static int _processImage(
+                          const JobSpec &spec,
+                          const char    *fileNameIn,
+                          const InputType inputType
+                        )
+{
+  int w = 0, h = 0;
+  MUint32 *pixels;
+  if (inputType == INPUT_TYPE_RAW)
+  {
+    w = spec.m_rawWidth;
+    h = spec.m_rawHeight;
+    pixels = PnmIo::readRaw(fileNameIn, w, h);
+  }
+  else
+    pixels = PnmIo::readImage(fileNameIn, &w, &h);
+  if (!pixels)
+  {
+    printf("Can not read image %s\n", fileNameIn);
+    return -1;
+  }
+  const int wDst = _getDimDst(w, spec.m_width, spec.m_scale);
+  const int hDst = _getDimDst(h, spec.m_height, spec.m_scale);
+  if ((wDst >= w) || (hDst >= h))
+  {
+    printf("Destination %d x %d is not less than source %s (%d x %d)\n",
+      wDst, hDst, fileNameIn, w, h);
+    delete [] pixels;
+    return -1;
+  }
+
+  Downsample2d downSampler;
+  int ok = downSampler.create(w, h, pixels, wDst, hDst, MemArena::getCurrent());
+  delete [] pixels;
+  if (!ok)
+    return -1;
+  if (spec.m_sigmaPos > 0.0f)
+    downSampler.setSigmaBilateralPos(spec.m_sigmaPos);
+  if (spec.m_sigmaVal > 0.0f)
+    downSampler.setSigmaBilateralVal(spec.m_sigmaVal);
+  if (spec.m_operation == JOB_OPERATION_MEDIAN)
+  {
+    downSampler.setMedianRadius(spec.m_medianRadius);
+    downSampler.setMedianPercentile(spec.m_percentile);
+    if (!downSampler.performMedian())
+      return -1;
+  }
+  else if (spec.m_operation == JOB_OPERATION_GUIDED)
+  {
+    downSampler.setGuidedRadius(spec.m_guidedRadius);
+    downSampler.setGuidedEps(spec.m_guidedEps);
+    if (!downSampler.performGuided())
+      return -1;
+  }
+
+  // other methods are computed by image getter, only the one needed
+  const float *pixelsDst = NULL;
+  switch (spec.m_operation)
+  {
+    case JOB_OPERATION_DOWNSAMPLE:
+      pixelsDst = downSampler.getImageDownSampled();
+      break;
+    case JOB_OPERATION_SUBSAMPLE:
+      pixelsDst = downSampler.getImageSubSample();
+      break;
+    case JOB_OPERATION_GAUSS:
+      pixelsDst = downSampler.getImageGauss();
+      break;
+    case JOB_OPERATION_BILATERAL:
+      pixelsDst = downSampler.getImageBilaterail();
+      break;
+    case JOB_OPERATION_MEDIAN:
+      pixelsDst = downSampler.getImageMedian();
+      break;
+    case JOB_OPERATION_GUIDED:
+      pixelsDst = downSampler.getImageGuided();
+      break;
+    default:
+      assert(spec.m_operation < -5555);
+      return -1;
+  }
+  if (!pixelsDst)
+  {
+    printf("Can not downsample image %s\n", fileNameIn);
+    return -1;
+  }
+  std::string fileNameOut = _getOutputName(spec, fileNameIn, "pgm");
+  ok = PnmIo::writeImageGrey(fileNameOut.c_str(), pixelsDst, wDst, hDst);
+  if (ok < 0)
+    printf("Can not write image %s\n", fileNameOut.c_str());
+  return ok;
+}
+
+static int _loadVolume(
+                        const JobSpec   &spec,
+                        const char      *fileNameIn,
+                        const InputType  inputType,
+                        KtxTexture      &tex
+                      )
+{
+  FILE *file = fopen(fileNameIn, "rb");
+  if (!file)
+    return -1;
+  int ok = 1;
+  if (inputType == INPUT_TYPE_KTX)
+  {
+    ok = (tex.loadFromFileContent(file) == KTX_ERROR_OK) ? 1 : -1;
+  }
+  else
+  {
+    ok = (tex.create3D(spec.m_rawWidth, spec.m_rawHeight, spec.m_rawDepth, 1)
+      == KTX_ERROR_OK) ? 1 : -1;
+    if (ok > 0)
+    {
+      const size_t sizeVolume = tex.getDataSize();
+      if (fread(tex.getData(), 1, sizeVolume, file) != sizeVolume)
+        ok = -1;
+    }
+  }
+  fclose(file);
+  return ok;
+}
+
+static int _processVolume(
+                          const JobSpec   &spec,
+                          const char      *fileNameIn,
+                          const InputType  inputType
+                         )
+{
+  KtxTexture tex;
+  if (_loadVolume(spec, fileNameIn, inputType, tex) < 0)
+  {
+    printf("Can not read volume %s\n", fileNameIn);
+    return -1;
+  }
+  if (tex.getGlFormat() != KTX_GL_RED)
+  {
+    printf("Only 1 byte per voxel volumes are supported: %s\n", fileNameIn);
+    return -1;
+  }
+  const int xDst = _getDimDst(tex.getWidth(),  spec.m_width,  spec.m_scale);
+  const int yDst = _getDimDst(tex.getHeight(), spec.m_height, spec.m_scale);
+  const int zDst = _getDimDst(tex.getDepth(),  spec.m_depth,  spec.m_scale);
+
+  int ok = 1;
+  switch (spec.m_operation)
+  {
+    case JOB_OPERATION_VOLUME_GAUSS:
+      ok = tex.gaussSmooth(spec.m_gaussRadius, spec.m_gaussSigma);
+      break;
+    case JOB_OPERATION_VOLUME_GAUSS_IIR:
+      ok = tex.gaussSmoothRecursive(spec.m_gaussSigma);
+      break;
+    case JOB_OPERATION_VOLUME_MEDIAN:
+      if ((xDst > tex.getWidth()) || (yDst > tex.getHeight()) ||
+          (zDst > tex.getDepth()))
+      {
+        printf("Destination is larger than source %s\n", fileNameIn);
+        return -1;
+      }
+      ok = tex.scaleDownMedian(xDst, yDst, zDst, spec.m_medianRadius,
+        spec.m_percentile);
+      break;
+    case JOB_OPERATION_VOLUME_LABELS:
+      if ((xDst > tex.getWidth()) || (yDst > tex.getHeight()) ||
+          (zDst > tex.getDepth()))
+      {
+        printf("Destination is larger than source %s\n", fileNameIn);
+        return -1;
+      }
+      ok = tex.scaleDownLabels(xDst, yDst, zDst);
+      break;
+    case JOB_OPERATION_VOLUME_GUIDED:
+      if ((xDst > tex.getWidth()) || (yDst > tex.getHeight()) ||
+          (zDst > tex.getDepth()))
+      {
+        printf("Destination is larger than source %s\n", fileNameIn);
+        return -1;
+      }
+      ok = tex.scaleDownGuided(xDst, yDst, zDst, spec.m_guidedRadius,
+        spec.m_guidedEps);
+      break;
+    case JOB_OPERATION_VOLUME_BOX:
+      tex.boxFilter3d(spec.m_boxRadius);
+      break;
+    case JOB_OPERATION_VOLUME_RESCALE:
+      ok = tex.rescale(xDst, yDst, zDst, spec.m_filter);
+      break;
+    case JOB_OPERATION_VOLUME_SCALE_DOWN:
+      if ((xDst >= tex.getWidth()) || (yDst >= tex.getHeight()) ||
+          (zDst >= tex.getDepth()))
+      {
+        printf("Destination is not less than source %s\n", fileNameIn);
+        return -1;
+      }
+      ok = tex.scaleDownToSize(xDst, yDst, zDst);
+      break;
+    default:
+      assert(spec.m_operation < -5555);
+      return -1;
+  }
+  if (ok < 0)
+    return -1;
+
+  std::string fileNameOut = _getOutputName(spec, fileNameIn, "ktx");
+  FILE *file = fopen(fileNameOut.c_str(), "wb");
+  if (!file)
+  {
+    printf("Can not write volume %s\n", fileNameOut.c_str());
+    return -1;
+  }
+  KtxError err = tex.saveToFileContent(file);
+  fclose(file);
+  return (err == KTX_ERROR_OK) ? 1 : -1;
+}
+
+static int _processFile(const JobSpec &spec, const char *fileNameIn)
+{
+  const InputType inputType = _getInputType(fileNameIn);
+  if ((inputType == INPUT_TYPE_RAW) &&
+      ((spec.m_rawWidth <= 0) || (spec.m_rawHeight <= 0)))
+  {
+    printf("raw_width and raw_height are required for %s\n", fileNameIn);
+    return -1;
+  }
+  const int isVolumeInput = (inputType == INPUT_TYPE_KTX) ||
+    ((inputType == INPUT_TYPE_RAW) && (spec.m_rawDepth > 1));
+  if (isVolumeInput != JobSpec::isVolumeOperation(spec.m_operation))
+  {
+    printf("Operation %s can not be applied to %s\n",
+      JobSpec::getOperationName(spec.m_operation), fileNameIn);
+    return -1;
+  }
+  if (isVolumeInput)
+    return _processVolume(spec, fileNameIn, inputType);
+  return _processImage(spec, fileNameIn, inputType);
+}
+
+static void _workerRun(BatchState *state)
+{
+  const JobSpec &spec = *state->m_spec;
+  MemArena arena;
+  const int isArenaOk = (arena.create((size_t)spec.m_arenaMb * 1024 * 1024,
+    spec.m_hugePages) > 0);
+  if (!isArenaOk)
+    printf("Can not allocate %d MB arena\n", spec.m_arenaMb);
+  std::string fileName;
+  while (state->m_queue->pop(fileName))
+  {
+    // keep taking files, otherwise producer waits on full queue forever
+    if (!isArenaOk)
+    {
+      state->m_numFailed++;
+      printf("FAILED %s\n", fileName.c_str());
+      continue;
+    }
+    std::chrono::steady_clock::time_point timeStart =
+      std::chrono::steady_clock::now();
+    int ok;
+    {
+      // all job temporaries are released here
+      MemArenaScope scope(&arena);
+      ok = _processFile(spec, fileName.c_str());
+    }
+    const double ms = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - timeStart).count();
+    if (ok > 0)
+    {
+      state->m_numOk++;
+      printf("ok     %s (%.1f ms)\n", fileName.c_str(), ms);
+    }
+    else
+    {
+      state->m_numFailed++;
+      printf("FAILED %s\n", fileName.c_str());
+    }
+  }
+}
+
+static void _printUsage()
+{
+  printf("Usage: dsample_batch [job_spec_file] [key=value ...]\n");
+  printf("  keys: input output operation scale width height depth\n");
+  printf("        raw_width raw_height raw_depth filter gauss_radius\n");
+  printf("        gauss_sigma box_radius median_radius percentile\n");
+  printf("        guided_radius guided_eps\n");
+  printf("        sigma_pos sigma_val threads queue_size arena_mb\n");
+  printf("        huge_pages\n");
+  printf("  see src/batch/jobspec.h for details\n");
+}
+
+static int _runBatch(const JobSpec &spec)
+{
+  std::vector<std::string> files;
+  if (_isDirectory(spec.m_input))
+    _listDirectory(spec.m_input, files);
+  else
+    files.push_back(spec.m_input);
+  if (files.empty())
+  {
+    printf("No input files found in %s\n", spec.m_input);
+    return -1;
+  }
+
+  // files are distributed between workers, the rest of cores are given
+  // to parallel loops inside operations
+  int numThreads = (spec.m_numThreads > 0) ?
+    spec.m_numThreads : Parallel::getNumThreads();
+  int numWorkers = (numThreads < (int)files.size()) ?
+    numThreads : (int)files.size();
+  Parallel::setNumThreads((numThreads / numWorkers > 1) ?
+    numThreads / numWorkers : 1);
+  const int queueSize = (spec.m_queueSize > 0) ?
+    spec.m_queueSize : 2 * numWorkers;
+
+  WorkQueue queue(queueSize);
+  BatchState state;
+  state.m_spec      = &spec;
+  state.m_queue     = &queue;
+  state.m_numOk     = 0;
+  state.m_numFailed = 0;
+
+  printf("%s: %d files, %d workers, %d threads per worker\n",
+    JobSpec::getOperationName(spec.m_operation), (int)files.size(),
+    numWorkers, Parallel::getNumThreads());
+  std::vector<std::thread> workers;
+  for (int t = 0; t < numWorkers; t++)
+    workers.push_back(std::thread(_workerRun, &state));
+  for (size_t i = 0; i < files.size(); i++)
+    queue.push(files[i].c_str());
+  queue.close();
+  for (size_t t = 0; t < workers.size(); t++)
+    workers[t].join();
+
+  const int numOk = state.m_numOk;
+  const int numFailed = state.m_numFailed;
+  printf("Done: %d ok, %d failed\n", numOk, numFailed);
+  return (numOk == (int)files.size()) ? 1 : -1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    _printUsage();
+    return -1;
+  }
+
+  MemTrackStart();
+
+  int ok = 1;
+  {
+    JobSpec spec;
+    for (int i = 1; (i < argc) && (ok > 0); i++)
+    {
+      if (strchr(argv[i], '='))
+      {
+        ok = spec.setValue(argv[i]);
+        if (ok < 0)
+          printf("Wrong argument: %s\n", argv[i]);
+      }
+      else
+        ok = spec.loadFromFile(argv[i]);
+    }
+    if (ok > 0)
+      ok = spec.validate();
+    if (ok > 0)
+      ok = _runBatch(spec);
+  }
+
+  int memAllocatedSize = MemTrackGetSize(NULL);
+  MemTrackStop();
+  if (memAllocatedSize > 0)
+  {
+    printf("Allocation leak found with %d bytes!!!\n", memAllocatedSize);
+    MemTrackForAll(_memTrackCallbackPrint);
+  }
+  return (ok > 0) ? 0 : 1;
+}
@@ -0,0 +1,326 @@
+// ****************************************************************************
+// File: jobspec.cpp
+// Purpose: Batch job description: what to read, how to process, where to save
+// ****************************************************************************
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "volume.h"
+#include "rankfilter.h"
+#include "guided.h"
+#include "jobspec.h"
+
+// ****************************************************************************
+// Defines
+// ****************************************************************************
+
+#define JOB_SPEC_MAX_LINE     (JOB_SPEC_MAX_PATH + 64)
+
+// ****************************************************************************
+// Vars
+// ****************************************************************************
+
+static const char *s_operationNames[JOB_OPERATION_COUNT] =
+{
+  "downsample",
+  "subsample",
+  "gauss",
+  "bilateral",
+  "median",
+  "guided",
+  "volume_gauss",
+  "volume_box",
+  "volume_rescale",
+  "volume_scale_down",
+  "volume_gauss_iir",
+  "volume_median",
+  "volume_labels",
+  "volume_guided",
+};
+
+static const char *s_filterNames[RESAMPLE_FILTER_COUNT] =
+{
+  "nearest",
+  "linear",
+  "cubic",
+  "lanczos",
+};
+
+// ****************************************************************************
+// Methods
+// ****************************************************************************
+
+JobSpec::JobSpec()
+{
+  m_input[0]      = 0;
+  m_output[0]     = 0;
+  m_operation     = JOB_OPERATION_DOWNSAMPLE;
+  // the same as in demo application
+  m_scale         = 0.35f;
+  m_width         = 0;
+  m_height        = 0;
+  m_depth         = 0;
+  m_rawWidth      = 0;
+  m_rawHeight     = 0;
+  m_rawDepth      = 1;
+  m_filter        = RESAMPLE_FILTER_LINEAR;
+  m_gaussRadius   = 1;
+  m_gaussSigma    = 0.8f;
+  m_boxRadius     = 1;
+  m_medianRadius  = 0;
+  m_percentile    = 0.5f;
+  m_guidedRadius  = 0;
+  m_guidedEps     = GUIDED_EPS_DEFAULT;
+  m_sigmaPos      = 0.0f;
+  m_sigmaVal      = 0.0f;
+  m_numThreads    = 0;
+  m_queueSize     = 0;
+  m_arenaMb       = 64;
+  m_hugePages     = 0;
+}
+
+const char *JobSpec::getOperationName(const JobOperation op)
+{
+  if ((op < 0) || (op >= JOB_OPERATION_COUNT))
+    return "na";
+  return s_operationNames[op];
+}
+
+int JobSpec::isVolumeOperation(const JobOperation op)
+{
+  return (op >= JOB_OPERATION_VOLUME_GAUSS) ? 1 : 0;
+}
+
+static void _trim(char *str)
+{
+  char *src = str;
+  while (isspace((unsigned char)*src))
+    src++;
+  char *dst = str;
+  while (*src)
+    *dst++ = *src++;
+  *dst = 0;
+  while ((dst > str) && isspace((unsigned char)dst[-1]))
+    *(--dst) = 0;
+}
+
+static int _parseInt(const char *str, int *val)
+{
+  char *end;
+  long v = strtol(str, &end, 10);
+  if ((end == str) || (*end != 0))
+    return -1;
+  *val = (int)v;
+  return 1;
+}
+
+static int _parseFloat(const char *str, float *val)
+{
+  char *end;
+  double v = strtod(str, &end);
+  if ((end == str) || (*end != 0))
+    return -1;
+  *val = (float)v;
+  return 1;
+}
+
+int JobSpec::setValue(const char *keyValue)
+{
+  char key[JOB_SPEC_MAX_LINE];
+  const char *eq = strchr(keyValue, '=');
+  if (!eq || (eq - keyValue >= JOB_SPEC_MAX_LINE))
+    return -1;
+  memcpy(key, keyValue, eq - keyValue);
+  key[eq - keyValue] = 0;
+  _trim(key);
+  char value[JOB_SPEC_MAX_LINE];
+  if (strlen(eq + 1) >= JOB_SPEC_MAX_LINE)
+    return -1;
+  strcpy(value, eq + 1);
+  _trim(value);
+
+  int ok = -1;
+  if (strcmp(key, "input") == 0)
+  {
+    if (strlen(value) < JOB_SPEC_MAX_PATH)
+    {
+      strcpy(m_input, value);
+      ok = 1;
+    }
+  }
+  else if (strcmp(key, "output") == 0)
+  {
+    if (strlen(value) < JOB_SPEC_MAX_PATH)
+    {
+      strcpy(m_output, value);
+      ok = 1;
+    }
+  }
+  else if (strcmp(key, "operation") == 0)
+  {
+    for (int i = 0; i < JOB_OPERATION_COUNT; i++)
+    {
+      if (strcmp(value, s_operationNames[i]) == 0)
+      {
+        m_operation = (JobOperation)i;
+        ok = 1;
+      }
+    }
+  }
+  else if (strcmp(key, "filter") == 0)
+  {
+    for (int i = 0; i < RESAMPLE_FILTER_COUNT; i++)
+    {
+      if (strcmp(value, s_filterNames[i]) == 0)
+      {
+        m_filter = (ResampleFilter)i;
+        ok = 1;
+      }
+    }
+  }
+  else if (strcmp(key, "scale") == 0)
+    ok = _parseFloat(value, &m_scale);
+  else if (strcmp(key, "width") == 0)
+    ok = _parseInt(value, &m_width);
+  else if (strcmp(key, "height") == 0)
+    ok = _parseInt(value, &m_height);
+  else if (strcmp(key, "depth") == 0)
+    ok = _parseInt(value, &m_depth);
+  else if (strcmp(key, "raw_width") == 0)
+    ok = _parseInt(value, &m_rawWidth);
+  else if (strcmp(key, "raw_height") == 0)
+    ok = _parseInt(value, &m_rawHeight);
+  else if (strcmp(key, "raw_depth") == 0)
+    ok = _parseInt(value, &m_rawDepth);
+  else if (strcmp(key, "gauss_radius") == 0)
+    ok = _parseInt(value, &m_gaussRadius);
+  else if (strcmp(key, "gauss_sigma") == 0)
+    ok = _parseFloat(value, &m_gaussSigma);
+  else if (strcmp(key, "box_radius") == 0)
+    ok = _parseInt(value, &m_boxRadius);
+  else if (strcmp(key, "median_radius") == 0)
+    ok = _parseInt(value, &m_medianRadius);
+  else if (strcmp(key, "percentile") == 0)
+    ok = _parseFloat(value, &m_percentile);
+  else if (strcmp(key, "guided_radius") == 0)
+    ok = _parseInt(value, &m_guidedRadius);
+  else if (strcmp(key, "guided_eps") == 0)
+    ok = _parseFloat(value, &m_guidedEps);
+  else if (strcmp(key, "sigma_pos") == 0)
+    ok = _parseFloat(value, &m_sigmaPos);
+  else if (strcmp(key, "sigma_val") == 0)
+    ok = _parseFloat(value, &m_sigmaVal);
+  else if (strcmp(key, "threads") == 0)
+    ok = _parseInt(value, &m_numThreads);
+  else if (strcmp(key, "queue_size") == 0)
+    ok = _parseInt(value, &m_queueSize);
+  else if (strcmp(key, "arena_mb") == 0)
+    ok = _parseInt(value, &m_arenaMb);
+  else if (strcmp(key, "huge_pages") == 0)
+    ok = _parseInt(value, &m_hugePages);
+  return ok;
+}
+
+int JobSpec::loadFromFile(const char *fileName)
+{
+  FILE *file = fopen(fileName, "rt");
+  if (!file)
+  {
+    printf("Can not open job spec file %s\n", fileName);
+    return -1;
+  }
+  char line[JOB_SPEC_MAX_LINE];
+  int numLine = 0;
+  int ok = 1;
+  while (fgets(line, sizeof(line), file))
+  {
+    numLine++;
+    char *comment = strchr(line, '#');
+    if (comment)
+      *comment = 0;
+    _trim(line);
+    if (line[0] == 0)
+      continue;
+    if (setValue(line) < 0)
+    {
+      printf("%s(%d): wrong line: %s\n", fileName, numLine, line);
+      ok = -1;
+    }
+  }
+  fclose(file);
+  return ok;
+}
+
+int JobSpec::validate() const
+{
+  if (m_input[0] == 0)
+  {
+    printf("Job spec: input is not set\n");
+    return -1;
+  }
+  if (m_output[0] == 0)
+  {
+    printf("Job spec: output is not set\n");
+    return -1;
+  }
+  const int hasSize = (m_width > 0) && (m_height > 0);
+  if (!hasSize && ((m_scale <= 0.0f) || (m_scale > 16.0f)))
+  {
+    printf("Job spec: need width/height or scale in (0..16]\n");
+    return -1;
+  }
+  if (!isVolumeOperation(m_operation) && (m_scale >= 1.0f) && !hasSize)
+  {
+    printf("Job spec: 2d operations only reduce image size\n");
+    return -1;
+  }
+  if ((m_operation == JOB_OPERATION_VOLUME_BOX) &&
+      ((m_boxRadius < 1) || (m_boxRadius > 15)))
+  {
+    printf("Job spec: box_radius should be in [1..15]\n");
+    return -1;
+  }
+  if ((m_operation == JOB_OPERATION_VOLUME_GAUSS) &&
+      ((m_gaussRadius < 1) || (m_gaussRadius > 6) || (m_gaussSigma <= 0.0f)))
+  {
+    printf("Job spec: gauss_radius should be in [1..6], gauss_sigma > 0\n");
+    return -1;
+  }
+  if ((m_operation == JOB_OPERATION_VOLUME_GAUSS_IIR) &&
+      (m_gaussSigma < VOL_IIR_SIGMA_MIN))
+  {
+    printf("Job spec: gauss_sigma should be at least 0.5 voxels\n");
+    return -1;
+  }
+  if (((m_operation == JOB_OPERATION_MEDIAN) ||
+       (m_operation == JOB_OPERATION_VOLUME_MEDIAN)) &&
+      ((m_medianRadius < 0) || (m_medianRadius > RANK_MAX_RADIUS) ||
+       (m_percentile < 0.0f) || (m_percentile > 1.0f)))
+  {
+    printf("Job spec: median_radius should be in [0..64], "
+      "percentile in [0..1]\n");
+    return -1;
+  }
+  if (((m_operation == JOB_OPERATION_GUIDED) ||
+       (m_operation == JOB_OPERATION_VOLUME_GUIDED)) &&
+      ((m_guidedRadius < 0) || (m_guidedEps <= 0.0f)))
+  {
+    printf("Job spec: guided_radius should be >= 0, guided_eps > 0\n");
+    return -1;
+  }
+  if ((m_arenaMb < 0) || (m_numThreads < 0) || (m_queueSize < 0))
+  {
+    printf("Job spec: negative threads, queue_size or arena_mb\n");
+    return -1;
+  }
+  return 1;
+}
@@ -0,0 +1,129 @@
+// ****************************************************************************
+// File: jobspec.h
+// Purpose: Batch job description: what to read, how to process, where to save
+// ****************************************************************************
+
+#ifndef  __jobspec_h
+#define  __jobspec_h
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include "mtypes.h"
+#include "resample.h"
+
+// ****************************************************************************
+// Defines
+// ****************************************************************************
+
+#define JOB_SPEC_MAX_PATH     1024
+
+// ****************************************************************************
+// Types
+// ****************************************************************************
+
+enum JobOperation
+{
+  JOB_OPERATION_NA              = -1,
+
+  // 2d image operations, via Downsample2d
+  JOB_OPERATION_DOWNSAMPLE      = 0,
+  JOB_OPERATION_SUBSAMPLE       = 1,
+  JOB_OPERATION_GAUSS           = 2,
+  JOB_OPERATION_BILATERAL       = 3,
+  JOB_OPERATION_MEDIAN          = 4,
+  JOB_OPERATION_GUIDED          = 5,
+
+  // volume operations, via KtxTexture
+  JOB_OPERATION_VOLUME_GAUSS    = 6,
+  JOB_OPERATION_VOLUME_BOX      = 7,
+  JOB_OPERATION_VOLUME_RESCALE  = 8,
+  JOB_OPERATION_VOLUME_SCALE_DOWN = 9,
+  JOB_OPERATION_VOLUME_GAUSS_IIR  = 10,
+  JOB_OPERATION_VOLUME_MEDIAN     = 11,
+  JOB_OPERATION_VOLUME_LABELS     = 12,
+  JOB_OPERATION_VOLUME_GUIDED     = 13,
+
+  JOB_OPERATION_COUNT
+};
+
+// ****************************************************************************
+// Class
+// ****************************************************************************
+
+/**
+* \class JobSpec parameters of batch job.
+* Job spec file is a text of "key = value" lines, # starts comment.
+* The same "key=value" pairs are accepted from command line.
+*
+* Keys:
+*   input         file or directory (all .pgm .pnm .ppm .raw .ktx inside)
+*   output        directory for results
+*   operation     downsample | subsample | gauss | bilateral | median |
+*                 guided | volume_gauss | volume_box | volume_rescale |
+*                 volume_scale_down | volume_gauss_iir | volume_median |
+*                 volume_labels (most frequent label of block) |
+*                 volume_guided
+*   scale         destination size factor, if sizes are not given (0.35)
+*   width, height, depth    destination size
+*   raw_width, raw_height, raw_depth    size of .raw inputs (8 bit);
+*                 raw_depth > 1 means volume
+*   filter        nearest | linear | cubic | lanczos (volume_rescale)
+*   gauss_radius, gauss_sigma   volume_gauss parameters (1, 0.8)
+*                 volume_gauss_iir uses gauss_sigma only, in voxels
+*   box_radius    volume_box radius (1)
+*   median_radius, percentile   median and volume_median window radius
+*                 (0 is by size ratio) and percentile (0.5 is median)
+*   guided_radius, guided_eps   guided and volume_guided window radius
+*                 (0 is by size ratio) and regularization (0.01)
+*   sigma_pos, sigma_val    bilateral sigmas for 2d operations
+*   threads       worker threads, 0 is all cores
+*   queue_size    max files waiting in queue, 0 is 2 per worker
+*   arena_mb      per worker temporary memory arena size (64)
+*   huge_pages    1 to back arenas with large pages
+*/
+
+class JobSpec
+{
+public:
+  JobSpec();
+
+  //! Return 1 if ok, -1 if file is missing or has wrong lines
+  int           loadFromFile(const char *fileName);
+  //! Parse "key=value". Return 1 if ok, -1 if key or value is wrong
+  int           setValue(const char *keyValue);
+  //! Check consistency. Return 1 if ok, -1 (with message) if not
+  int           validate() const;
+
+  static const char *getOperationName(const JobOperation op);
+  static int         isVolumeOperation(const JobOperation op);
+
+public:
+  char            m_input[JOB_SPEC_MAX_PATH];
+  char            m_output[JOB_SPEC_MAX_PATH];
+  JobOperation    m_operation;
+  float           m_scale;
+  int             m_width;
+  int             m_height;
+  int             m_depth;
+  int             m_rawWidth;
+  int             m_rawHeight;
+  int             m_rawDepth;
+  ResampleFilter  m_filter;
+  int             m_gaussRadius;
+  float           m_gaussSigma;
+  int             m_boxRadius;
+  int             m_medianRadius;
+  float           m_percentile;
+  int             m_guidedRadius;
+  float           m_guidedEps;
+  float           m_sigmaPos;
+  float           m_sigmaVal;
+  int             m_numThreads;
+  int             m_queueSize;
+  int             m_arenaMb;
+  int             m_hugePages;
+};
+
+#endif
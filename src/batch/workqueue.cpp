@@ -0,0 +1,53 @@
+// ****************************************************************************
+// File: workqueue.cpp
+// Purpose: Bounded blocking queue of file names between producer and workers
+// ****************************************************************************
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include <assert.h>
+
+#include "workqueue.h"
+
+// ****************************************************************************
+// Methods
+// ****************************************************************************
+
+WorkQueue::WorkQueue(const int capacity)
+{
+  assert(capacity > 0);
+  m_capacity = capacity;
+  m_isClosed = 0;
+}
+
+void WorkQueue::push(const char *item)
+{
+  std::unique_lock<std::mutex> lock(m_lock);
+  while (((int)m_items.size() >= m_capacity) && !m_isClosed)
+    m_notFull.wait(lock);
+  m_items.push_back(item);
+  m_notEmpty.notify_one();
+}
+
+int WorkQueue::pop(std::string &item)
+{
+  std::unique_lock<std::mutex> lock(m_lock);
+  while (m_items.empty() && !m_isClosed)
+    m_notEmpty.wait(lock);
+  if (m_items.empty())
+    return 0;
+  item = m_items.front();
+  m_items.pop_front();
+  m_notFull.notify_one();
+  return 1;
+}
+
+void WorkQueue::close()
+{
+  std::unique_lock<std::mutex> lock(m_lock);
+  m_isClosed = 1;
+  m_notEmpty.notify_all();
+  m_notFull.notify_all();
+}
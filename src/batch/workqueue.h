@@ -0,0 +1,48 @@
+// ****************************************************************************
+// File: workqueue.h
+// Purpose: Bounded blocking queue of file names between producer and workers
+// ****************************************************************************
+
+#ifndef  __workqueue_h
+#define  __workqueue_h
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <string>
+
+// ****************************************************************************
+// Class
+// ****************************************************************************
+
+/**
+* \class WorkQueue producer waits while queue is full, so number of
+* jobs in flight stays bounded whatever directory size is.
+*/
+
+class WorkQueue
+{
+public:
+  WorkQueue(const int capacity);
+
+  //! Wait for free place and add item
+  void      push(const char *item);
+  //! Wait for item. Return 1 if item is taken, 0 if queue is closed and empty
+  int       pop(std::string &item);
+  //! No more items will be pushed, wake up all waiting workers
+  void      close();
+
+private:
+  int                       m_capacity;
+  int                       m_isClosed;
+  std::deque<std::string>   m_items;
+  std::mutex                m_lock;
+  std::condition_variable   m_notFull;
+  std::condition_variable   m_notEmpty;
+};
+
+#endif
@@ -0,0 +1,103 @@
+// ****************************************************************************
+// File: benchstat.cpp
+// Purpose: Benchmark timing samples, percentiles and JSON report
+// ****************************************************************************
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include <assert.h>
+
+#include <chrono>
+#include <algorithm>
+
+#include "benchstat.h"
+
+// ****************************************************************************
+// Methods
+// ****************************************************************************
+
+double BenchTimer::getTimeMs()
+{
+  std::chrono::steady_clock::duration t =
+    std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration<double, std::milli>(t).count();
+}
+
+double BenchStat::getPercentileMs(const double percent) const
+{
+  assert(!m_timesMs.empty());
+  std::vector<double> times(m_timesMs);
+  std::sort(times.begin(), times.end());
+  const double pos = percent * 0.01 * (double)(times.size() - 1);
+  const int    ind = (int)pos;
+  if (ind + 1 >= (int)times.size())
+    return times[times.size() - 1];
+  const double t = pos - (double)ind;
+  return times[ind] * (1.0 - t) + times[ind + 1] * t;
+}
+
+double BenchStat::getMeanMs() const
+{
+  assert(!m_timesMs.empty());
+  double sum = 0.0;
+  for (size_t i = 0; i < m_timesMs.size(); i++)
+    sum += m_timesMs[i];
+  return sum / (double)m_timesMs.size();
+}
+
+BenchReport::BenchReport(FILE *file)
+{
+  m_file = file;
+  m_numCases = 0;
+}
+
+void BenchReport::begin(const int numRepeat, const int numThreads)
+{
+  fprintf(m_file, "{\n");
+  fprintf(m_file, "  \"benchmark\": \"dsample_bench\",\n");
+  fprintf(m_file, "  \"repeat\": %d,\n", numRepeat);
+  fprintf(m_file, "  \"threads\": %d,\n", numThreads);
+  fprintf(m_file, "  \"cases\": [");
+  m_numCases = 0;
+}
+
+void BenchReport::addCase(
+                          const char      *group,
+                          const char      *method,
+                          const int        xDim,
+                          const int        yDim,
+                          const int        zDim,
+                          const float      scale,
+                          const BenchStat &stat
+                         )
+{
+  const double msMin  = stat.getPercentileMs(0.0);
+  const double msP50  = stat.getPercentileMs(50.0);
+  const double msP90  = stat.getPercentileMs(90.0);
+  const double msMax  = stat.getPercentileMs(100.0);
+  const double msMean = stat.getMeanMs();
+  // throughput by source elements and median time
+  const double numMega = (double)xDim * yDim * zDim * 1.0e-6;
+  const double perSec = (msP50 > 0.0) ? numMega * 1000.0 / msP50 : 0.0;
+  const int isVolume = (zDim > 1) ? 1 : 0;
+
+  fprintf(m_file, "%s\n    {", (m_numCases > 0) ? "," : "");
+  fprintf(m_file, "\"group\": \"%s\", \"method\": \"%s\", ", group, method);
+  fprintf(m_file, "\"dims\": [%d, %d, %d], \"scale\": %.3f,\n", xDim, yDim,
+    zDim, scale);
+  fprintf(m_file, "     \"runs\": %d, \"ms\": {\"min\": %.3f, \"p50\": %.3f, "
+    "\"p90\": %.3f, \"max\": %.3f, \"mean\": %.3f},\n", stat.getNumRuns(),
+    msMin, msP50, msP90, msMax, msMean);
+  fprintf(m_file, "     \"%s\": %.3f}", isVolume ? "mvox_per_s" : "mpix_per_s",
+    perSec);
+  fflush(m_file);
+  m_numCases++;
+}
+
+void BenchReport::end()
+{
+  fprintf(m_file, "\n  ]\n}\n");
+  fflush(m_file);
+}
@@ -0,0 +1,87 @@
+// ****************************************************************************
+// File: benchstat.h
+// Purpose: Benchmark timing samples, percentiles and JSON report
+// ****************************************************************************
+
+#ifndef  __benchstat_h
+#define  __benchstat_h
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "mtypes.h"
+
+// ****************************************************************************
+// Class
+// ****************************************************************************
+
+/**
+* \class BenchTimer monotonic high resolution clock
+*/
+
+class BenchTimer
+{
+public:
+  //! Milliseconds from some fixed point, never goes back
+  static double getTimeMs();
+};
+
+/**
+* \class BenchStat run times of one benchmark case
+*/
+
+class BenchStat
+{
+public:
+  void    clear()                   { m_timesMs.clear(); }
+  void    addTimeMs(const double ms){ m_timesMs.push_back(ms); }
+  int     getNumRuns() const        { return (int)m_timesMs.size(); }
+
+  //! Percentile in [0..100] with linear interpolation between runs
+  double  getPercentileMs(const double percent) const;
+  double  getMeanMs() const;
+
+private:
+  std::vector<double>   m_timesMs;
+};
+
+/**
+* \class BenchReport writes results as JSON array of cases
+*/
+
+class BenchReport
+{
+public:
+  BenchReport(FILE *file);
+
+  void    begin(const int numRepeat, const int numThreads);
+  /*!
+   * \brief Add one case
+   * \param group "image2d" or "volume"
+   * \param method Name of measured operation
+   * \param xDim, yDim, zDim Source size (zDim = 1 for images)
+   * \param scale Destination / source size, 1 if size is not changed
+   * \param stat Run times
+   */
+  void    addCase(
+                  const char      *group,
+                  const char      *method,
+                  const int        xDim,
+                  const int        yDim,
+                  const int        zDim,
+                  const float      scale,
+                  const BenchStat &stat
+                 );
+  void    end();
+
+private:
+  FILE   *m_file;
+  int     m_numCases;
+};
+
+#endif
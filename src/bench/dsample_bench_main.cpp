@@ -0,0 +1,606 @@
+// ****************************************************************************
+// File: dsample_bench_main.cpp
+// Purpose: Reproducible timings of all downsampling methods, JSON report
+// ****************************************************************************
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "memtrack.h"
+#include "parallel.h"
+#include "ktxtexture.h"
+#include "volume.h"
+#include "dsample2d.h"
+#include "guided.h"
+#include "benchstat.h"
+
+// ****************************************************************************
+// Defines
+// ****************************************************************************
+
+#define BENCH_DEFAULT_REPEAT        7
+#define BENCH_NOISE_SEED            0x2545f491
+#define BENCH_STACK_SLICES          16
+#define BENCH_PYRAMID_LEVELS        4
+
+// ****************************************************************************
+// Types
+// ****************************************************************************
+
+struct BenchOptions
+{
+  int           m_repeat;
+  int           m_quick;
+  int           m_numThreads;
+  const char   *m_fileNameOut;
+  const char   *m_fileNameTemp;
+};
+
+/**
+* \class BenchDownsample2d gives access to single stages of Downsample2d
+*/
+
+class BenchDownsample2d : public Downsample2d
+{
+public:
+  int   runSubSample()      { return performSubSample();    }
+  int   runBilateral()      { return performBilateral();    }
+  int   runDownSample()     { return performDownSample();   }
+};
+
+enum BenchMethod2d
+{
+  BENCH_METHOD_2D_SUBSAMPLE     = 0,
+  BENCH_METHOD_2D_GAUSS_SLOW    = 1,
+  BENCH_METHOD_2D_GAUSS_FAST    = 2,
+  BENCH_METHOD_2D_BILATERAL     = 3,
+  BENCH_METHOD_2D_DOWNSAMPLE    = 4,
+  BENCH_METHOD_2D_ALL           = 5,
+  BENCH_METHOD_2D_MEDIAN        = 6,
+  BENCH_METHOD_2D_GUIDED        = 7,
+  BENCH_METHOD_2D_FIXED         = 8,
+  BENCH_METHOD_2D_FP16          = 9,
+  BENCH_METHOD_2D_PYRAMID       = 10,
+  BENCH_METHOD_2D_STACK         = 11,
+
+  BENCH_METHOD_2D_COUNT
+};
+
+enum BenchMethod3d
+{
+  BENCH_METHOD_3D_GAUSS_SLOW    = 0,
+  BENCH_METHOD_3D_GAUSS_FAST    = 1,
+  BENCH_METHOD_3D_GAUSS_SMOOTH  = 2,
+  BENCH_METHOD_3D_BOX           = 3,
+  BENCH_METHOD_3D_RESCALE       = 4,
+  BENCH_METHOD_3D_SCALE_DOWN    = 5,
+  BENCH_METHOD_3D_SAVE          = 6,
+  BENCH_METHOD_3D_LOAD          = 7,
+  BENCH_METHOD_3D_SLICES_X      = 8,
+  BENCH_METHOD_3D_SLICES_Y      = 9,
+  BENCH_METHOD_3D_SLICES_Z      = 10,
+  BENCH_METHOD_3D_GAUSS_IIR     = 11,
+  BENCH_METHOD_3D_MEDIAN        = 12,
+  BENCH_METHOD_3D_GUIDED        = 13,
+  BENCH_METHOD_3D_LABELS        = 14,
+
+  BENCH_METHOD_3D_COUNT
+};
+
+// Objects of one image size and scale
+struct BenchImage2d
+{
+  BenchDownsample2d   m_downSampler;
+  // the same image with FP16 storage
+  BenchDownsample2d   m_downSamplerHalf;
+  // BENCH_STACK_SLICES copies of 8 bit image and their results
+  MUint8             *m_slicesSrc;
+  MUint8             *m_slicesDst;
+  int                 m_dimSrc;
+  int                 m_dimDst;
+};
+
+// ****************************************************************************
+// Vars
+// ****************************************************************************
+
+static const char *s_namesMethod2d[BENCH_METHOD_2D_COUNT] =
+{
+  "subsample",
+  "gauss_slow",
+  "gauss_fast",
+  "bilateral",
+  "downsample",
+  "all",
+  "median",
+  "guided",
+  "downsample_fixed",
+  "downsample_fp16",
+  "pyramid",
+  "stack"
+};
+
+static const char *s_namesFilter[RESAMPLE_FILTER_COUNT] =
+{
+  "rescale_nearest",
+  "rescale_linear",
+  "rescale_cubic",
+  "rescale_lanczos"
+};
+
+// ****************************************************************************
+// Methods
+// ****************************************************************************
+
+static int _memTrackCallbackPrint(
+                                  const void *memPtr,
+                                  const int   memSize,
+                                  const char *fileNameSrc,
+                                  const int   fileLineNumber
+                                 )
+{
+  fprintf(stderr, "Leak: %p, size = %d, file = %s, line = %d\n",
+    memPtr, memSize, fileNameSrc, fileLineNumber);
+  return 1;
+}
+
+// xorshift32: the same noise on every platform and every run
+static MUint32 _getNextRandom(MUint32 &state)
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+// disc on gradient with noise: has flat areas, edges and texture
+static MUint32 *_createImage(const int w, const int h)
+{
+  MUint32 *pixels = M_NEW(MUint32[w * h]);
+  if (!pixels)
+    return NULL;
+  MUint32 state = BENCH_NOISE_SEED;
+  const int xc = w / 2, yc = h / 2;
+  const int r2 = (w / 3) * (w / 3);
+  for (int y = 0; y < h; y++)
+  {
+    for (int x = 0; x < w; x++)
+    {
+      const int dx = x - xc, dy = y - yc;
+      int val = (dx * dx + dy * dy < r2) ? 200 : (x * 128 / w);
+      val += (int)(_getNextRandom(state) & 31) - 16;
+      val = (val < 0) ? 0 : ((val > 255) ? 255 : val);
+      pixels[x + y * w] = 0xff000000 | (val << 16) | (val << 8) | val;
+    } // for (x)
+  } // for (y)
+  return pixels;
+}
+
+static void _addVolumeNoise(KtxTexture &tex)
+{
+  MUint8 *data = tex.getData();
+  const int numVoxels = tex.getWidth() * tex.getHeight() * tex.getDepth();
+  MUint32 state = BENCH_NOISE_SEED;
+  for (int i = 0; i < numVoxels; i++)
+  {
+    int val = (int)data[i] + (int)(_getNextRandom(state) & 31) - 16;
+    data[i] = (MUint8)((val < 0) ? 0 : ((val > 255) ? 255 : val));
+  }
+}
+
+static int _runCase2d(
+                      BenchImage2d        &image,
+                      const BenchMethod2d  method
+                     )
+{
+  BenchDownsample2d &downSampler = image.m_downSampler;
+  switch (method)
+  {
+    case BENCH_METHOD_2D_SUBSAMPLE:
+      return downSampler.runSubSample();
+    case BENCH_METHOD_2D_GAUSS_SLOW:
+      return downSampler.performGaussSlow(downSampler.getImageSrc(),
+        downSampler.getImageGauss());
+    case BENCH_METHOD_2D_GAUSS_FAST:
+      return downSampler.performGaussFast(downSampler.getImageSrc(),
+        downSampler.getImageGauss());
+    case BENCH_METHOD_2D_BILATERAL:
+      return downSampler.runBilateral();
+    case BENCH_METHOD_2D_DOWNSAMPLE:
+      return downSampler.runDownSample();
+    case BENCH_METHOD_2D_ALL:
+      return downSampler.performDownSamplingAll();
+    case BENCH_METHOD_2D_MEDIAN:
+      return downSampler.performMedian();
+    case BENCH_METHOD_2D_GUIDED:
+      return downSampler.performGuided();
+    case BENCH_METHOD_2D_FIXED:
+    {
+      downSampler.setFixedPoint(1);
+      const int ok = downSampler.runDownSample();
+      downSampler.setFixedPoint(0);
+      return ok;
+    }
+    case BENCH_METHOD_2D_FP16:
+      return image.m_downSamplerHalf.runDownSample();
+    case BENCH_METHOD_2D_PYRAMID:
+      return downSampler.performPyramid(BENCH_PYRAMID_LEVELS);
+    case BENCH_METHOD_2D_STACK:
+      return downSampler.performStack(image.m_slicesSrc, image.m_dimSrc,
+        image.m_dimSrc, BENCH_STACK_SLICES, image.m_slicesDst,
+        image.m_dimDst, image.m_dimDst, DS_METHOD_ADVANCED);
+    default:
+      assert(method < -5555);
+  }
+  return 0;
+}
+
+static int _createImage2d(
+                          BenchImage2d   &image,
+                          const MUint32  *pixels,
+                          const int       dim,
+                          const int       dimDst
+                         )
+{
+  image.m_dimSrc = dim;
+  image.m_dimDst = dimDst;
+  image.m_slicesSrc = NULL;
+  image.m_slicesDst = NULL;
+  if (!image.m_downSampler.create(dim, dim, pixels, dimDst, dimDst))
+    return -1;
+  image.m_downSamplerHalf.setStorage(DS_STORAGE_FP16);
+  if (!image.m_downSamplerHalf.create(dim, dim, pixels, dimDst, dimDst))
+    return -1;
+  const int numPixels = dim * dim;
+  image.m_slicesSrc = M_NEW(MUint8[numPixels * BENCH_STACK_SLICES]);
+  image.m_slicesDst = M_NEW(MUint8[dimDst * dimDst * BENCH_STACK_SLICES]);
+  if (!image.m_slicesSrc || !image.m_slicesDst)
+    return -1;
+  for (int i = 0; i < numPixels * BENCH_STACK_SLICES; i++)
+    image.m_slicesSrc[i] = (MUint8)(pixels[i % numPixels] & 0xff);
+  return 1;
+}
+
+static void _destroyImage2d(BenchImage2d &image)
+{
+  if (image.m_slicesSrc)
+    delete [] image.m_slicesSrc;
+  if (image.m_slicesDst)
+    delete [] image.m_slicesDst;
+  image.m_slicesSrc = NULL;
+  image.m_slicesDst = NULL;
+}
+
+static int _benchImages(const BenchOptions &opt, BenchReport &report)
+{
+  static const int   sizes[] = { 256, 512, 1024 };
+  static const float scales[] = { 0.5f, 0.35f, 0.25f };
+  const int numSizes = opt.m_quick ? 1 : (int)(sizeof(sizes) / sizeof(int));
+  const int numScales = (int)(sizeof(scales) / sizeof(float));
+
+  for (int s = 0; s < numSizes; s++)
+  {
+    const int dim = sizes[s];
+    MUint32 *pixels = _createImage(dim, dim);
+    if (!pixels)
+      return -1;
+    for (int k = 0; k < numScales; k++)
+    {
+      const int dimDst = (int)(dim * scales[k]);
+      BenchImage2d image;
+      if (_createImage2d(image, pixels, dim, dimDst) < 0)
+      {
+        _destroyImage2d(image);
+        delete [] pixels;
+        return -1;
+      }
+      for (int m = 0; m < BENCH_METHOD_2D_COUNT; m++)
+      {
+        const BenchMethod2d method = (BenchMethod2d)m;
+        // pyramid does not depend on destination size
+        if ((method == BENCH_METHOD_2D_PYRAMID) && (k > 0))
+          continue;
+        fprintf(stderr, "image %4d -> %4d %s\n", dim, dimDst,
+          s_namesMethod2d[m]);
+        // stages read only source and write own destination,
+        // so repeated runs on the same object are equal
+        BenchStat stat;
+        for (int r = -1; r < opt.m_repeat; r++)
+        {
+          const double timeStart = BenchTimer::getTimeMs();
+          _runCase2d(image, method);
+          const double timeEnd = BenchTimer::getTimeMs();
+          // run -1 is warm up
+          if (r >= 0)
+            stat.addTimeMs(timeEnd - timeStart);
+        }
+        const int isStack = (method == BENCH_METHOD_2D_STACK);
+        const int isPyramid = (method == BENCH_METHOD_2D_PYRAMID);
+        report.addCase("image2d", s_namesMethod2d[m], dim, dim,
+          isStack ? BENCH_STACK_SLICES : 1, isPyramid ? 0.5f : scales[k],
+          stat);
+      } // for (m)
+      _destroyImage2d(image);
+    } // for (k)
+    delete [] pixels;
+  } // for (s)
+  return 1;
+}
+
+// run one volume operation on texture copy, return time in ms or -1
+static double _runCase3d(
+                          const BenchOptions   &opt,
+                          const KtxTexture     &texSrc,
+                          KtxTexture           &texWork,
+                          const BenchMethod3d   method,
+                          const ResampleFilter  filter
+                        )
+{
+  const int xDim = texSrc.getWidth();
+  const int yDim = texSrc.getHeight();
+  const int zDim = texSrc.getDepth();
+  // copy is prepared out of timed region
+  if (texWork.createAsCopy(&texSrc) != KTX_ERROR_OK)
+    return -1.0;
+  if (method == BENCH_METHOD_3D_LOAD)
+  {
+    FILE *file = fopen(opt.m_fileNameTemp, "wb");
+    if (!file)
+      return -1.0;
+    KtxError err = texWork.saveToFileContent(file);
+    fclose(file);
+    if (err != KTX_ERROR_OK)
+      return -1.0;
+  }
+
+  int ok = 1;
+  const double timeStart = BenchTimer::getTimeMs();
+  switch (method)
+  {
+    case BENCH_METHOD_3D_GAUSS_SLOW:
+      ok = VolumeTools::performGaussSlow(texSrc.getData(), xDim, yDim, zDim,
+        texWork.getData());
+      break;
+    case BENCH_METHOD_3D_GAUSS_FAST:
+      ok = VolumeTools::performGaussFast(texSrc.getData(), xDim, yDim, zDim,
+        texWork.getData());
+      break;
+    case BENCH_METHOD_3D_GAUSS_SMOOTH:
+      ok = texWork.gaussSmooth(1, 0.8f);
+      break;
+    case BENCH_METHOD_3D_BOX:
+      texWork.boxFilter3d(1);
+      break;
+    case BENCH_METHOD_3D_RESCALE:
+      ok = texWork.rescale(xDim / 2, yDim / 2, zDim / 2, filter);
+      break;
+    case BENCH_METHOD_3D_SCALE_DOWN:
+      ok = texWork.scaleDownToSize(xDim / 2, yDim / 2, zDim / 2);
+      break;
+    case BENCH_METHOD_3D_SAVE:
+    case BENCH_METHOD_3D_LOAD:
+    {
+      const int isSave = (method == BENCH_METHOD_3D_SAVE);
+      FILE *file = fopen(opt.m_fileNameTemp, isSave ? "wb" : "rb");
+      if (!file)
+        return -1.0;
+      KtxError err = isSave ? texWork.saveToFileContent(file) :
+        texWork.loadFromFileContent(file);
+      fclose(file);
+      ok = (err == KTX_ERROR_OK) ? 1 : -1;
+      break;
+    }
+    case BENCH_METHOD_3D_SLICES_X:
+    case BENCH_METHOD_3D_SLICES_Y:
+    case BENCH_METHOD_3D_SLICES_Z:
+    {
+      // all slices along axis, written over work copy
+      const KtxSliceAxis axis =
+        (KtxSliceAxis)(method - BENCH_METHOD_3D_SLICES_X);
+      const int numSlices = (axis == KTX_SLICE_AXIS_X) ? xDim :
+        ((axis == KTX_SLICE_AXIS_Y) ? yDim : zDim);
+      ok = texSrc.getSlab(axis, 0, numSlices, texWork.getData());
+      break;
+    }
+    case BENCH_METHOD_3D_GAUSS_IIR:
+      ok = texWork.gaussSmoothRecursive(2.0f);
+      break;
+    case BENCH_METHOD_3D_MEDIAN:
+      ok = texWork.scaleDownMedian(xDim / 2, yDim / 2, zDim / 2, 0, 0.5f);
+      break;
+    case BENCH_METHOD_3D_GUIDED:
+      ok = texWork.scaleDownGuided(xDim / 2, yDim / 2, zDim / 2, 0,
+        GUIDED_EPS_DEFAULT);
+      break;
+    case BENCH_METHOD_3D_LABELS:
+      ok = texWork.scaleDownLabels(xDim / 2, yDim / 2, zDim / 2);
+      break;
+    default:
+      assert(method < -5555);
+  }
+  const double timeEnd = BenchTimer::getTimeMs();
+  return (ok > 0) ? (timeEnd - timeStart) : -1.0;
+}
+
+static int _benchVolumes(const BenchOptions &opt, BenchReport &report)
+{
+  static const int sizes[] = { 64, 128 };
+  const int numSizes = opt.m_quick ? 1 : (int)(sizeof(sizes) / sizeof(int));
+
+  for (int s = 0; s < numSizes; s++)
+  {
+    const int dim = sizes[s];
+    KtxTexture texSrc;
+    if (texSrc.createAsSingleSphere(dim) != KTX_ERROR_OK)
+      return -1;
+    _addVolumeNoise(texSrc);
+
+    for (int m = 0; m < BENCH_METHOD_3D_COUNT; m++)
+    {
+      const BenchMethod3d method = (BenchMethod3d)m;
+      const int numFilters =
+        (method == BENCH_METHOD_3D_RESCALE) ? RESAMPLE_FILTER_COUNT : 1;
+      for (int f = 0; f < numFilters; f++)
+      {
+        const char *name = NULL;
+        float scale = 1.0f;
+        switch (method)
+        {
+          case BENCH_METHOD_3D_GAUSS_SLOW:   name = "gauss_slow";   break;
+          case BENCH_METHOD_3D_GAUSS_FAST:   name = "gauss_fast";   break;
+          case BENCH_METHOD_3D_GAUSS_SMOOTH: name = "gauss_smooth"; break;
+          case BENCH_METHOD_3D_BOX:          name = "box";          break;
+          case BENCH_METHOD_3D_RESCALE:
+            name = s_namesFilter[f];
+            scale = 0.5f;
+            break;
+          case BENCH_METHOD_3D_SCALE_DOWN:
+            name = "scale_down";
+            scale = 0.5f;
+            break;
+          case BENCH_METHOD_3D_SAVE:         name = "ktx_save";     break;
+          case BENCH_METHOD_3D_LOAD:         name = "ktx_load";     break;
+          case BENCH_METHOD_3D_SLICES_X:     name = "slices_x";     break;
+          case BENCH_METHOD_3D_SLICES_Y:     name = "slices_y";     break;
+          case BENCH_METHOD_3D_SLICES_Z:     name = "slices_z";     break;
+          case BENCH_METHOD_3D_GAUSS_IIR:    name = "gauss_iir";    break;
+          case BENCH_METHOD_3D_MEDIAN:
+            name = "median";
+            scale = 0.5f;
+            break;
+          case BENCH_METHOD_3D_GUIDED:
+            name = "guided";
+            scale = 0.5f;
+            break;
+          case BENCH_METHOD_3D_LABELS:
+            name = "labels";
+            scale = 0.5f;
+            break;
+          default:
+            assert(method < -5555);
+            return -1;
+        }
+        fprintf(stderr, "volume %4d %s\n", dim, name);
+
+        BenchStat stat;
+        for (int r = -1; r < opt.m_repeat; r++)
+        {
+          KtxTexture texWork;
+          const double ms = _runCase3d(opt, texSrc, texWork, method,
+            (ResampleFilter)f);
+          if (ms < 0.0)
+          {
+            fprintf(stderr, "volume %s failed\n", name);
+            remove(opt.m_fileNameTemp);
+            return -1;
+          }
+          if (r >= 0)
+            stat.addTimeMs(ms);
+        } // for (r)
+        report.addCase("volume", name, dim, dim, dim, scale, stat);
+      } // for (f)
+    } // for (m)
+  } // for (s)
+  remove(opt.m_fileNameTemp);
+  return 1;
+}
+
+static void _printUsage()
+{
+  printf("Usage: dsample_bench [key=value ...]\n");
+  printf("  repeat=N      timed runs per case, after one warm up (%d)\n",
+    BENCH_DEFAULT_REPEAT);
+  printf("  quick=1       only smallest image and volume\n");
+  printf("  threads=N     threads for parallel loops, 0 is all cores\n");
+  printf("  group=G       image2d | volume | all\n");
+  printf("  out=FILE      JSON report file, stdout if not given\n");
+  printf("  temp=FILE     temporary file for KTX I/O (dsample_bench.tmp)\n");
+}
+
+int main(int argc, char **argv)
+{
+  BenchOptions opt;
+  opt.m_repeat        = BENCH_DEFAULT_REPEAT;
+  opt.m_quick         = 0;
+  opt.m_numThreads    = 0;
+  opt.m_fileNameOut   = NULL;
+  opt.m_fileNameTemp  = "dsample_bench.tmp";
+  const char *group = "all";
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    const char *val = strchr(arg, '=');
+    if (!val)
+    {
+      _printUsage();
+      return 1;
+    }
+    val++;
+    if (strncmp(arg, "repeat=", 7) == 0)
+      opt.m_repeat = atoi(val);
+    else if (strncmp(arg, "quick=", 6) == 0)
+      opt.m_quick = atoi(val);
+    else if (strncmp(arg, "threads=", 8) == 0)
+      opt.m_numThreads = atoi(val);
+    else if (strncmp(arg, "group=", 6) == 0)
+      group = val;
+    else if (strncmp(arg, "out=", 4) == 0)
+      opt.m_fileNameOut = val;
+    else if (strncmp(arg, "temp=", 5) == 0)
+      opt.m_fileNameTemp = val;
+    else
+    {
+      _printUsage();
+      return 1;
+    }
+  }
+  if (opt.m_repeat < 1)
+    opt.m_repeat = 1;
+  if (opt.m_numThreads > 0)
+    Parallel::setNumThreads(opt.m_numThreads);
+
+  FILE *fileOut = stdout;
+  if (opt.m_fileNameOut)
+  {
+    fileOut = fopen(opt.m_fileNameOut, "wt");
+    if (!fileOut)
+    {
+      fprintf(stderr, "Can not write %s\n", opt.m_fileNameOut);
+      return 1;
+    }
+  }
+
+  MemTrackStart();
+
+  int ok = 1;
+  {
+    BenchReport report(fileOut);
+    report.begin(opt.m_repeat, Parallel::getNumThreads());
+    if (strcmp(group, "volume") != 0)
+      ok = _benchImages(opt, report);
+    if ((ok > 0) && (strcmp(group, "image2d") != 0))
+      ok = _benchVolumes(opt, report);
+    report.end();
+  }
+
+  int memAllocatedSize = MemTrackGetSize(NULL);
+  MemTrackStop();
+  if (memAllocatedSize > 0)
+  {
+    fprintf(stderr, "Allocation leak found with %d bytes!!!\n",
+      memAllocatedSize);
+    MemTrackForAll(_memTrackCallbackPrint);
+  }
+  if (fileOut != stdout)
+    fclose(fileOut);
+  return (ok > 0) ? 0 : 1;
+}
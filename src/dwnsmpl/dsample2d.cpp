@@ -19,10 +19,23 @@
 #include <memory.h>
 #include <math.h>
 #include <assert.h>
+#include <atomic>
 
 
 #include "memtrack.h"
 #include "dsample2d.h"
+#include "rankfilter.h"
+#include "guided.h"
+#include "halffloat.h"
+#include "parallel.h"
+#include "ktxtexture.h"
+
+// SSE2 is always present on x64 and on x86 builds with /arch:SSE2
+#if defined(__SSE2__) || defined(_M_X64) || \
+  (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define DS_USE_SSE2
+#include <emmintrin.h>
+#endif
 
 //  *****************************************************************
 //  Defines
@@ -31,6 +44,29 @@
 // for deep debug
 //#define PERFORM_ONLY_DOWN_SAMPLING
 
+//  *****************************************************************
+//  Types
+//  *****************************************************************
+
+// Image read by kernels: float, 8 bit or 16 bit float, exactly one of
+// pointers is not NULL
+struct DsPlane
+{
+  const float   *m_float;
+  const MUint8  *m_bytes;
+  const MUint16 *m_half;
+  HalfFormat     m_format;
+};
+
+// Rectangle [m_x0, m_x1) * [m_y0, m_y1) of image computed by kernel
+struct DsRect
+{
+  int            m_x0;
+  int            m_y0;
+  int            m_x1;
+  int            m_y1;
+};
+
 //  *****************************************************************
 //  Data
 //  *****************************************************************
@@ -50,15 +86,53 @@ Downsample2d::Downsample2d()
   m_pixelsSubSample = NULL;
   m_pixelsBilateral = NULL;
   m_pixelsRestored = NULL;
+  m_halfRestored = NULL;
+  m_pixelsMedian = NULL;
+  m_pixelsGuided = NULL;
+  m_pixelsPyramid = NULL;
+  m_numPixelsPyramid = 0;
+  m_numPyramidLevels = 0;
+  m_stackInterleave = 1;
+  m_fixedPoint = 0;
+  m_flatTolerance = 0;
+  m_tilesValid = NULL;
+  m_numTilesX = m_numTilesY = 0;
+  m_storage = DS_STORAGE_FLOAT;
+  m_bytesSrc = NULL;
+  m_arena = NULL;
+  m_numChannels = 1;
+  m_colorWeights = DS_COLOR_WEIGHTS_LUMA;
+  m_colorSrc = m_colorSubSample = m_colorGauss = NULL;
+  m_colorBilateral = m_colorDownSampled = m_colorRestored = NULL;
 
   m_sigmaBilateralPos = 0.10f;
   m_sigmaBilateralVal = 0.51f;
+  m_medianRadius = 0;
+  m_medianPercentile = 0.5f;
+  m_guidedRadius = 0;
+  m_guidedEps = GUIDED_EPS_DEFAULT;
   const float STRANGE = 55555.55555f;
   for (int i = 0; i < DS_MAX_NEIB_DIA * DS_MAX_NEIB_DIA; i++)
     m_filter[i] = STRANGE;
 }
 void    Downsample2d::destroy()
 {
+  if (m_arena)
+  {
+    // arena memory is released with arena
+    m_pixelsSrc = m_pixelsGauss = m_pixelsDownSampled = NULL;
+    m_pixelsSubSample = m_pixelsBilateral = m_pixelsRestored = NULL;
+    m_pixelsMedian = m_pixelsGuided = m_pixelsPyramid = NULL;
+    m_bytesSrc = NULL;
+    m_halfRestored = NULL;
+    m_colorSrc = m_colorSubSample = m_colorGauss = NULL;
+    m_colorBilateral = m_colorDownSampled = m_colorRestored = NULL;
+    m_tilesValid = NULL;
+    m_numPixelsPyramid = 0;
+    m_numPyramidLevels = 0;
+    m_arena = NULL;
+    return;
+  }
   if (m_pixelsSrc)
     delete [] m_pixelsSrc;
   if (m_pixelsGauss)
@@ -71,6 +145,30 @@ void    Downsample2d::destroy()
     delete [] m_pixelsBilateral;
   if (m_pixelsRestored)
     delete [] m_pixelsRestored;
+  if (m_pixelsMedian)
+    delete [] m_pixelsMedian;
+  if (m_pixelsGuided)
+    delete [] m_pixelsGuided;
+  if (m_pixelsPyramid)
+    delete [] m_pixelsPyramid;
+  if (m_bytesSrc)
+    delete [] m_bytesSrc;
+  if (m_halfRestored)
+    delete [] m_halfRestored;
+  if (m_colorSrc)
+    delete [] m_colorSrc;
+  if (m_colorSubSample)
+    delete [] m_colorSubSample;
+  if (m_colorGauss)
+    delete [] m_colorGauss;
+  if (m_colorBilateral)
+    delete [] m_colorBilateral;
+  if (m_colorDownSampled)
+    delete [] m_colorDownSampled;
+  if (m_colorRestored)
+    delete [] m_colorRestored;
+  if (m_tilesValid)
+    delete [] m_tilesValid;
 
   m_pixelsSrc           = NULL;
   m_pixelsGauss         = NULL;
@@ -78,6 +176,85 @@ void    Downsample2d::destroy()
   m_pixelsSubSample     = NULL;
   m_pixelsBilateral     = NULL;
   m_pixelsRestored      = NULL;
+  m_pixelsMedian        = NULL;
+  m_pixelsGuided        = NULL;
+  m_pixelsPyramid       = NULL;
+  m_bytesSrc            = NULL;
+  m_halfRestored        = NULL;
+  m_colorSrc            = NULL;
+  m_colorSubSample      = NULL;
+  m_colorGauss          = NULL;
+  m_colorBilateral      = NULL;
+  m_colorDownSampled    = NULL;
+  m_colorRestored       = NULL;
+  m_tilesValid          = NULL;
+  m_numPixelsPyramid    = 0;
+  m_numPyramidLevels    = 0;
+}
+
+static float *_allocImage(MemArena *arena, const int numPixels)
+{
+  if (arena)
+    return (float*)arena->allocate(numPixels * sizeof(float));
+  return M_NEW(float[numPixels]);
+}
+
+// luminance of R, G, B (Rec. 601)
+static const float DS_LUMA[3] = { 0.299f, 0.587f, 0.114f };
+
+static void _getLumaPlanes(const float *planes, const int numPixels,
+  float *luma)
+{
+  for (int i = 0; i < numPixels; i++)
+    luma[i] = DS_LUMA[0] * planes[i] + DS_LUMA[1] * planes[i + numPixels] +
+      DS_LUMA[2] * planes[i + 2 * numPixels];
+}
+
+static DsRect _getRect(const int x0, const int y0, const int x1,
+  const int y1)
+{
+  DsRect rect = { x0, y0, x1, y1 };
+  return rect;
+}
+
+// ARGB pixels of source rect into float source (if kept) and bytes.
+// Colour source gets R, G, B (, A) planes, grey source is luminance
+static void _convertSource(
+                            const MUint32 *pixels,
+                            const int      wSrc,
+                            const int      hSrc,
+                            const int      numChannels,
+                            float         *colorSrc,
+                            float         *pixelsSrc,
+                            MUint8        *bytesSrc,
+                            const DsRect  &rect
+                          )
+{
+  const int numPixelsSrc = wSrc * hSrc;
+  for (int y = rect.m_y0; y < rect.m_y1; y++)
+  {
+    for (int i = rect.m_x0 + y * wSrc; i < rect.m_x1 + y * wSrc; i++)
+    {
+      const MUint32 val = pixels[i];
+      if (numChannels == 1)
+      {
+        if (pixelsSrc)
+          pixelsSrc[i] = (val & 0xff) * (1.0f / 255.0f);
+        bytesSrc[i] = (MUint8)(val & 0xff);
+        continue;
+      }
+      float *planes = colorSrc + i;
+      planes[0] = ((val >> 16) & 0xff) * (1.0f / 255.0f);
+      planes[numPixelsSrc] = ((val >> 8) & 0xff) * (1.0f / 255.0f);
+      planes[2 * numPixelsSrc] = (val & 0xff) * (1.0f / 255.0f);
+      if (numChannels == DS_MAX_CHANNELS)
+        planes[3 * numPixelsSrc] = (val >> 24) * (1.0f / 255.0f);
+      pixelsSrc[i] = DS_LUMA[0] * planes[0] +
+        DS_LUMA[1] * planes[numPixelsSrc] +
+        DS_LUMA[2] * planes[2 * numPixelsSrc];
+      bytesSrc[i] = (MUint8)(pixelsSrc[i] * 255.0f + 0.5f);
+    } // for (i)
+  } // for (y)
 }
 
 Downsample2d::~Downsample2d()
@@ -90,40 +267,86 @@ int Downsample2d::create(
                           const int       hSrc,
                           const MUint32  *pixels,
                           const int       wDst,
-                          const int       hDst
+                          const int       hDst,
+                          MemArena       *arena
                         )
 {
-  if (m_pixelsSrc)
-    delete[] m_pixelsSrc;
+  destroy();
+  m_arena = arena;
   m_wSrc = wSrc;
   m_hSrc = hSrc;
 
   m_wDst = wDst;
   m_hDst = hDst;
 
-  const int numPixelsSrc = wSrc * hSrc;
-  m_pixelsSrc = M_NEW(float[numPixelsSrc]);
-  if (!m_pixelsSrc)
+  const int numChannels = m_numChannels;
+  if ((numChannels != 1) && (numChannels != 3) &&
+      (numChannels != DS_MAX_CHANNELS))
+    return 0;
+  // colour kernels read float planes only
+  if ((numChannels > 1) && (m_storage != DS_STORAGE_FLOAT))
     return 0;
-  m_pixelsRestored = M_NEW(float[numPixelsSrc]);
-  if (!m_pixelsRestored)
+  const int numPixelsSrc = wSrc * hSrc;
+  if (m_storage == DS_STORAGE_FLOAT)
+  {
+    m_pixelsSrc = _allocImage(arena, numPixelsSrc);
+    m_pixelsRestored = _allocImage(arena, numPixelsSrc);
+    if (!m_pixelsSrc || !m_pixelsRestored)
+      return 0;
+  }
+  else
+  {
+    // source is read from bytes, restored image is 16 bit
+    m_halfRestored = (arena) ?
+      (MUint16*)arena->allocate(numPixelsSrc * sizeof(MUint16)) :
+      M_NEW(MUint16[numPixelsSrc]);
+    if (!m_halfRestored)
+      return 0;
+  }
+  m_bytesSrc = (arena) ? (MUint8*)arena->allocate(numPixelsSrc) :
+    M_NEW(MUint8[numPixelsSrc]);
+  if (!m_bytesSrc)
     return 0;
 
-  // convert source image ARGB format into greyscale image (float)
-  int i;
-  for (i = 0; i < numPixelsSrc; i++)
+  if (numChannels > 1)
   {
-    MUint32 val = pixels[i] & 0xff;
-    m_pixelsSrc[i] = val * (1.0f / 255.0f);
+    m_colorSrc = _allocImage(arena, numChannels * numPixelsSrc);
+    if (!m_colorSrc)
+      return 0;
   }
+  _convertSource(pixels, wSrc, hSrc, numChannels, m_colorSrc, m_pixelsSrc,
+    m_bytesSrc, _getRect(0, 0, wSrc, hSrc));
   // allocate memory for destination images
   const int numPixelsDst = wDst * hDst;
-  m_pixelsGauss         = M_NEW(float[numPixelsDst]);
-  m_pixelsDownSampled   = M_NEW(float[numPixelsDst]);
-  m_pixelsSubSample     = M_NEW(float[numPixelsDst]);
-  m_pixelsBilateral     = M_NEW(float[numPixelsDst]);
-  if (!m_pixelsBilateral)
+  if (numChannels > 1)
+  {
+    m_colorSubSample    = _allocImage(arena, numChannels * numPixelsDst);
+    m_colorGauss        = _allocImage(arena, numChannels * numPixelsDst);
+    m_colorBilateral    = _allocImage(arena, numChannels * numPixelsDst);
+    m_colorDownSampled  = _allocImage(arena, numChannels * numPixelsDst);
+    if (!m_colorSubSample || !m_colorGauss || !m_colorBilateral ||
+        !m_colorDownSampled)
+      return 0;
+  }
+  m_pixelsGauss         = _allocImage(arena, numPixelsDst);
+  m_pixelsDownSampled   = _allocImage(arena, numPixelsDst);
+  m_pixelsSubSample     = _allocImage(arena, numPixelsDst);
+  m_pixelsBilateral     = _allocImage(arena, numPixelsDst);
+  m_pixelsMedian        = _allocImage(arena, numPixelsDst);
+  m_pixelsGuided        = _allocImage(arena, numPixelsDst);
+  if (!m_pixelsGauss || !m_pixelsDownSampled || !m_pixelsSubSample ||
+      !m_pixelsBilateral || !m_pixelsMedian || !m_pixelsGuided)
+    return 0;
+
+  // no tile of any method is computed yet
+  m_numTilesX = (wDst + DS_TILE_SIZE - 1) / DS_TILE_SIZE;
+  m_numTilesY = (hDst + DS_TILE_SIZE - 1) / DS_TILE_SIZE;
+  const int numTiles = DS_METHOD_COUNT * m_numTilesX * m_numTilesY;
+  m_tilesValid = (arena) ? (MUint8*)arena->allocate(numTiles) :
+    M_NEW(MUint8[numTiles]);
+  if (!m_tilesValid)
     return 0;
+  memset(m_tilesValid, 0, numTiles);
   return 1;
 } // craete
 
@@ -138,181 +361,802 @@ int   Downsample2d::performDownSamplingAll()
   return 1;
 }
 
-int   Downsample2d::performSubSample()
+int   Downsample2d::updateDownSamplingAll()
 {
-  for (int cy = 0; cy < m_hDst; cy++)
+  // advanced method makes gauss image too, so it goes first
+  int ok = updateMethod(DS_METHOD_ADVANCED);
+#if !defined(PERFORM_ONLY_DOWN_SAMPLING)
+  ok &= updateMethod(DS_METHOD_SUBSAMPLE);
+  ok &= updateMethod(DS_METHOD_GAUSS);
+  ok &= updateMethod(DS_METHOD_BILATERAL);
+#endif
+  return ok;
+}
+
+static DsPlane _getPlaneFloat(const float *pixels)
+{
+  DsPlane plane = { pixels, NULL, NULL, HALF_FORMAT_FP16 };
+  return plane;
+}
+
+static DsPlane _getPlaneBytes(const MUint8 *pixels)
+{
+  DsPlane plane = { NULL, pixels, NULL, HALF_FORMAT_FP16 };
+  return plane;
+}
+
+static DsPlane _getPlaneHalf(const MUint16 *pixels, const HalfFormat format)
+{
+  DsPlane plane = { NULL, NULL, pixels, format };
+  return plane;
+}
+
+// Source given to method or own source: float one, or bytes when float
+// source is not kept (compact storage)
+static DsPlane _getPlaneSrc(const float *pixels, const MUint8 *bytes)
+{
+  return (pixels) ? _getPlaneFloat(pixels) : _getPlaneBytes(bytes);
+}
+
+static inline float _getPlaneValue(const DsPlane &plane, const int off)
+{
+  if (plane.m_float)
+    return plane.m_float[off];
+  if (plane.m_bytes)
+    return plane.m_bytes[off] * (1.0f / 255.0f);
+  return HalfFloat::toFloat(plane.m_half[off], plane.m_format);
+}
+
+// Float values [kStart, kEnd) of row part starting from off: float
+// image row itself or values converted to buf
+static inline const float *_getPlaneRow(
+                                        const DsPlane &plane,
+                                        const int      off,
+                                        const int      kStart,
+                                        const int      kEnd,
+                                        float         *buf
+                                      )
+{
+  if (plane.m_float)
+    return plane.m_float + off;
+  if (plane.m_bytes)
   {
-    const int cySrc = m_hSrc * cy / m_hDst;
-    const int cySrcOff = cySrc * m_wSrc;
-    const int cyDstOff = cy * m_wDst;
+    for (int k = kStart; k < kEnd; k++)
+      buf[k] = plane.m_bytes[off + k] * (1.0f / 255.0f);
+  }
+  else
+    HalfFloat::toFloatRow(plane.m_half + off + kStart, buf + kStart,
+      kEnd - kStart, plane.m_format);
+  return buf;
+}
 
-    for (int cx = 0; cx < m_wDst; cx++)
+static void _performSubSample(
+                              const DsPlane &pixelsSrc,
+                              const int      wSrc,
+                              const int      hSrc,
+                              float         *pixelsDst,
+                              const int      wDst,
+                              const int      hDst,
+                              const DsRect  &rect
+                             )
+{
+  assert((rect.m_x1 <= wDst) && (rect.m_y1 <= hDst));
+  for (int cy = rect.m_y0; cy < rect.m_y1; cy++)
+  {
+    const int cySrc = hSrc * cy / hDst;
+    const int cySrcOff = cySrc * wSrc;
+    const int cyDstOff = cy * wDst;
+
+    for (int cx = rect.m_x0; cx < rect.m_x1; cx++)
     {
-      const int cxSrc = m_wSrc * cx / m_wDst;
-      const float valSrc = m_pixelsSrc[cxSrc + cySrcOff];
-      m_pixelsSubSample[cx + cyDstOff] = valSrc;
+      const int cxSrc = wSrc * cx / wDst;
+      const float valSrc = _getPlaneValue(pixelsSrc, cxSrc + cySrcOff);
+      pixelsDst[cx + cyDstOff] = valSrc;
     } // for (cx)
   } // for (cy)
-  return 1;
+}
+
+int   Downsample2d::performSubSample()
+{
+  int ok = 1;
+  if (m_numChannels > 1)
+    ok = performSubSampleColor();
+  else
+    _performSubSample(_getPlaneSrc(m_pixelsSrc, m_bytesSrc), m_wSrc, m_hSrc,
+      m_pixelsSubSample, m_wDst, m_hDst, _getRect(0, 0, m_wDst, m_hDst));
+  setTilesValid(DS_METHOD_SUBSAMPLE, ok);
+  return ok;
 }
 
 const int   SIMPLE_GAUSS_RADIUS = 5;
 const float SIMPLE_GAUSS_SIGMA = 0.2f;
 
-int Downsample2d::performGaussSlow(const float *pixelsSrc, float *pixelsDst)
+// Build kernel tables of both axes, koef is for distance in source pixels
+static int _createTaps(
+                        PolyphaseTaps  *tapsX,
+                        PolyphaseTaps  *tapsY,
+                        const int       wSrc,
+                        const int       hSrc,
+                        const int       wDst,
+                        const int       hDst,
+                        const int       radius,
+                        const float     koef
+                      )
 {
-  // more sigma => more blurring
-  const float SIMPLE_KOEF =
-    1.0f / (2.0f * M_PI * SIMPLE_GAUSS_SIGMA * SIMPLE_GAUSS_SIGMA);
+  assert(2 * radius + 2 <= DS_MAX_NEIB_DIA);
+  if (tapsX->create(wSrc, wDst, radius, koef) < 0)
+    return 0;
+  if (tapsY->create(hSrc, hDst, radius, koef) < 0)
+    return 0;
+  return 1;
+}
 
-  for (int cy = 0; cy < m_hDst; cy++)
-  {
-    const int cySrc = m_hSrc * cy / m_hDst;
-    const int cyDstOff = cy * m_wDst;
+// Range [*kStart, *kEnd) of taps inside source image
+static inline void _getTapsRange(const int first, const int numTaps,
+  const int dimSrc, int *kStart, int *kEnd)
+{
+  *kStart = (first < 0) ? -first : 0;
+  *kEnd = (first + numTaps > dimSrc) ? (dimSrc - first) : numTaps;
+}
 
-    for (int cx = 0; cx < m_wDst; cx++)
+// Source range [*srcStart, *srcEnd) read by destination samples
+// [dstStart, dstEnd)
+static void _getSrcRange(const PolyphaseTaps &taps, const int dstStart,
+  const int dstEnd, const int dimSrc, int *srcStart, int *srcEnd)
+{
+  const int first = taps.getFirst(dstStart);
+  const int last = taps.getFirst(dstEnd - 1) + taps.getNumTaps();
+  *srcStart = (first > 0) ? first : 0;
+  *srcEnd = (last < dimSrc) ? last : dimSrc;
+}
+
+// Flat window test of advanced method: prefix sums along row of values
+// (and squared values) of 8 bit image summed over rows [yStart, yEnd),
+// sums[x] is for columns [xStart, xStart + x). Sum of window is
+// difference of two.
+static void _getFlatBand(
+                          const MUint8  *pixels,
+                          const int      w,
+                          const int      yStart,
+                          const int      yEnd,
+                          const int      xStart,
+                          const int      xEnd,
+                          MUint64       *sums,
+                          MUint64       *sums2
+                        )
+{
+  const int numCols = xEnd - xStart;
+  int x;
+  for (x = 0; x <= numCols; x++)
+    sums[x] = sums2[x] = 0;
+  // column sums into [x + 1], then prefix
+  for (int y = yStart; y < yEnd; y++)
+  {
+    const MUint8 *row = pixels + y * w + xStart;
+    for (x = 0; x < numCols; x++)
     {
-      const int cxSrc = m_wSrc * cx / m_wDst;
+      const MUint32 val = row[x];
+      sums[x + 1] += val;
+      sums2[x + 1] += val * val;
+    }
+  }
+  for (x = 0; x < numCols; x++)
+  {
+    sums[x + 1] += sums[x];
+    sums2[x + 1] += sums2[x];
+  }
+}
 
-      // accumulate sum around pixel [cxSrc, cySrc] with 
-      // neighborhood SIMPLE_GAUSS_RADIUS
-      float sum = 0.0f;
-      float sumWeights = 0.0f;
+// 1 if window of band columns [xStart, xEnd) has variance up to
+// tolerance ^ 2, *sum gets sum of window values
+static inline int _isFlatWindow(
+                                const MUint64 *sums,
+                                const MUint64 *sums2,
+                                const int      xStart,
+                                const int      xEnd,
+                                const int      numRows,
+                                const int      tolerance,
+                                MUint32       *sum
+                              )
+{
+  const MUint64 num = (MUint64)(xEnd - xStart) * numRows;
+  const MUint64 s = sums[xEnd] - sums[xStart];
+  const MUint64 s2 = sums2[xEnd] - sums2[xStart];
+  *sum = (MUint32)s;
+  // num * num * variance, exact in integers
+  const MUint64 var = num * s2 - s * s;
+  return (var <= (MUint64)tolerance * tolerance * num * num) ? 1 : 0;
+}
+
+// Scratch of flat window test for image width w: sums and squared
+// sums, 2 * (w + 1) values. *sums gets NULL if test is off.
+// Return 1 if ok, 0 if no memory
+static int _allocFlatBand(MemArenaFrame *frame, const int w,
+  const int tolerance, MUint64 **sums)
+{
+  *sums = NULL;
+  if (tolerance < 0)
+    return 1;
+  *sums = (MUint64*)frame->allocate(2 * (w + 1) * sizeof(MUint64));
+  return (*sums) ? 1 : 0;
+}
+
+static HalfFormat _getHalfFormat(const DsStorage storage)
+{
+  return (storage == DS_STORAGE_BFLOAT16) ? HALF_FORMAT_BFLOAT16 :
+    HALF_FORMAT_FP16;
+}
+
+// Bilinear source value at fractional position
+static float _getValueAt(const DsPlane &pixels, const int w, const int h,
+  float x, float y)
+{
+  x = (x > 0.0f) ? x : 0.0f;
+  y = (y > 0.0f) ? y : 0.0f;
+  int ix = (int)x;
+  int iy = (int)y;
+  ix = (ix < w - 1) ? ix : (w - 1);
+  iy = (iy < h - 1) ? iy : (h - 1);
+  const float tx = (ix < w - 1) ? (x - ix) : 0.0f;
+  const float ty = (iy < h - 1) ? (y - iy) : 0.0f;
+  const int ixNext = (ix < w - 1) ? (ix + 1) : ix;
+  const int iyNext = (iy < h - 1) ? (iy + 1) : iy;
+  const float valL = _getPlaneValue(pixels, ix + iy * w) * (1.0f - ty) +
+    _getPlaneValue(pixels, ix + iyNext * w) * ty;
+  const float valR = _getPlaneValue(pixels, ixNext + iy * w) * (1.0f - ty) +
+    _getPlaneValue(pixels, ixNext + iyNext * w) * ty;
+  return valL * (1.0f - tx) + valR * tx;
+}
 
-      for (int dy = -SIMPLE_GAUSS_RADIUS; dy <= +SIMPLE_GAUSS_RADIUS; dy++)
+//  *****************************************************************
+//  Fixed point kernels
+//  *****************************************************************
+
+// Q8 images (MUint16): 8 bit value v is v << DS_FIXED_Q8_BITS, sums of
+// fixed point kernel weights are about 1 << POLY_FIXED_BITS, so
+// weighted sums of Q8 values fit into 32 bits
+#define DS_FIXED_Q8_BITS        8
+
+static inline float _getFloatQ8(const MUint32 val)
+{
+  return val * (1.0f / (255.0f * (1 << DS_FIXED_Q8_BITS)));
+}
+
+static inline MUint8 _getByteQ8(const MUint32 val)
+{
+  return (MUint8)((val + (1 << (DS_FIXED_Q8_BITS - 1))) >> DS_FIXED_Q8_BITS);
+}
+
+// Separable gauss of 8 bit image into Q8 image: rows into Q8 scratch of
+// wDst * hSrc, then columns. Return 1 if ok, 0 if no memory
+static int _performGaussFixed(
+                              const MUint8        *pixelsSrc,
+                              const int            wSrc,
+                              const int            hSrc,
+                              MUint16             *pixelsDst,
+                              const int            wDst,
+                              const int            hDst,
+                              const PolyphaseTaps &tapsX,
+                              const PolyphaseTaps &tapsY
+                             )
+{
+  MemArenaFrame frame;
+  MUint16 *pixelsRows = (MUint16*)frame.allocate((size_t)wDst * hSrc *
+    sizeof(MUint16));
+  MUint32 *sums = (MUint32*)frame.allocate(wDst * sizeof(MUint32));
+  if (!pixelsRows || !sums)
+    return 0;
+  const int numTaps = tapsX.getNumTaps();
+  int cx, cy, k;
+
+  for (int y = 0; y < hSrc; y++)
+  {
+    const MUint8 *rowSrc = pixelsSrc + y * wSrc;
+    MUint16 *rowDst = pixelsRows + y * wDst;
+    for (cx = 0; cx < wDst; cx++)
+    {
+      const int xFirst = tapsX.getFirst(cx);
+      const MUint16 *weights = tapsX.getWeightsFixed(cx);
+      int kStart, kEnd;
+      _getTapsRange(xFirst, numTaps, wSrc, &kStart, &kEnd);
+      MUint32 sum = 0, sumWeights = 0;
+      for (k = kStart; k < kEnd; k++)
       {
-        const int y = cySrc + dy;
-        if (y < 0)
-          continue;
-        if (y >= m_hSrc)
-          break;
-        const int yOff = y * m_wSrc;
-        const float ty = (float)dy / SIMPLE_GAUSS_RADIUS;
+        sum += (MUint32)weights[k] * rowSrc[xFirst + k];
+        sumWeights += weights[k];
+      }
+      rowDst[cx] = (MUint16)(((sum << DS_FIXED_Q8_BITS) + sumWeights / 2) /
+        sumWeights);
+    } // for (cx)
+  }   // for (y)
 
-        for (int dx = -SIMPLE_GAUSS_RADIUS; dx <= +SIMPLE_GAUSS_RADIUS; dx++)
-        {
-          const int x = cxSrc + dx;
-          if (x < 0)
-            continue;
-          if (x >= m_wSrc)
-            break;
-          const float tx = (float)dx / SIMPLE_GAUSS_RADIUS;
+  for (cy = 0; cy < hDst; cy++)
+  {
+    const int yFirst = tapsY.getFirst(cy);
+    const MUint16 *weights = tapsY.getWeightsFixed(cy);
+    int kStart, kEnd;
+    _getTapsRange(yFirst, numTaps, hSrc, &kStart, &kEnd);
+    MUint32 sumWeights = 0;
+    for (cx = 0; cx < wDst; cx++)
+      sums[cx] = 0;
+    for (k = kStart; k < kEnd; k++)
+    {
+      const MUint16 *row = pixelsRows + (yFirst + k) * wDst;
+      const MUint32 weight = weights[k];
+      for (cx = 0; cx < wDst; cx++)
+        sums[cx] += weight * row[cx];
+      sumWeights += weight;
+    }
+    MUint16 *rowDst = pixelsDst + cy * wDst;
+    for (cx = 0; cx < wDst; cx++)
+      rowDst[cx] = (MUint16)((sums[cx] + sumWeights / 2) / sumWeights);
+  }   // for (cy)
+  return 1;
+}
 
-          const float dist2 = tx * tx + ty * ty;
-          const float gaussWeight = expf( -dist2 * SIMPLE_KOEF);
+// Bilinear Q8 value of 8 bit image at fractional position
+static MUint32 _getValueAtFixed(const MUint8 *pixels, const int w,
+  const int h, const float x, const float y)
+{
+  const float Q8_ONE = (float)(1 << DS_FIXED_Q8_BITS);
+  int ix = (int)((x > 0.0f) ? x : 0.0f);
+  int iy = (int)((y > 0.0f) ? y : 0.0f);
+  ix = (ix < w - 1) ? ix : (w - 1);
+  iy = (iy < h - 1) ? iy : (h - 1);
+  const MUint32 tx = (ix < w - 1) && (x > 0.0f) ?
+    (MUint32)((x - ix) * Q8_ONE + 0.5f) : 0;
+  const MUint32 ty = (iy < h - 1) && (y > 0.0f) ?
+    (MUint32)((y - iy) * Q8_ONE + 0.5f) : 0;
+  const int ixNext = (ix < w - 1) ? (ix + 1) : ix;
+  const int iyNext = (iy < h - 1) ? (iy + 1) : iy;
+  const MUint32 ONE = 1 << DS_FIXED_Q8_BITS;
+  const MUint32 valL = pixels[ix + iy * w] * (ONE - ty) +
+    pixels[ix + iyNext * w] * ty;
+  const MUint32 valR = pixels[ixNext + iy * w] * (ONE - ty) +
+    pixels[ixNext + iyNext * w] * ty;
+  return (valL * (ONE - tx) + valR * tx + ONE / 2) >> DS_FIXED_Q8_BITS;
+}
 
-          const int offSrc = x + yOff;
-          const float valSrc = pixelsSrc[offSrc];
+// Bilateral of 8 bit image into Q8 image, range weights from table of
+// 256 value differences (Q15)
+static void _performBilateralFixed(
+                                    const MUint8        *pixelsSrc,
+                                    const int            wSrc,
+                                    const int            hSrc,
+                                    MUint16             *pixelsDst,
+                                    const int            wDst,
+                                    const int            hDst,
+                                    const PolyphaseTaps &tapsX,
+                                    const PolyphaseTaps &tapsY,
+                                    const float          sigmaVal
+                                  )
+{
+  const float VAL_KOEF = 1.0f / (2.0f * M_PI * sigmaVal * sigmaVal);
+  MUint32 weightsVal[DSMPL_NUM_COLORS];
+  int i;
+  for (i = 0; i < DSMPL_NUM_COLORS; i++)
+  {
+    const float deltaVal = i * (1.0f / 255.0f);
+    weightsVal[i] = (MUint32)(expf(-deltaVal * deltaVal * VAL_KOEF) *
+      32767.0f + 0.5f);
+  }
+  const int numTaps = tapsX.getNumTaps();
 
-          sum += valSrc * gaussWeight;
-          sumWeights += gaussWeight;
+  for (int cy = 0; cy < hDst; cy++)
+  {
+    const float cySrc = tapsY.getCenter(cy);
+    const int yFirst = tapsY.getFirst(cy);
+    const MUint16 *weightsY = tapsY.getWeightsFixed(cy);
+    int kyStart, kyEnd;
+    _getTapsRange(yFirst, numTaps, hSrc, &kyStart, &kyEnd);
 
-        }  // for (dx)
-      }  // for (dy)
-      const float valDst = sum / sumWeights;
-      pixelsDst[cx + cyDstOff] = valDst;
+    for (int cx = 0; cx < wDst; cx++)
+    {
+      const float cxSrc = tapsX.getCenter(cx);
+      const int xFirst = tapsX.getFirst(cx);
+      const MUint16 *weightsX = tapsX.getWeightsFixed(cx);
+      int kxStart, kxEnd;
+      _getTapsRange(xFirst, numTaps, wSrc, &kxStart, &kxEnd);
+      const int valCenter =
+        (int)_getValueAtFixed(pixelsSrc, wSrc, hSrc, cxSrc, cySrc);
+
+      MUint64 sum = 0;
+      MUint32 sumWeights = 0;
+      for (int ky = kyStart; ky < kyEnd; ky++)
+      {
+        const MUint8 *row = pixelsSrc + (yFirst + ky) * wSrc + xFirst;
+        for (int kx = kxStart; kx < kxEnd; kx++)
+        {
+          const MUint32 posWeight = ((MUint32)weightsX[kx] * weightsY[ky] +
+            (1 << (POLY_FIXED_BITS - 1))) >> POLY_FIXED_BITS;
+          if (posWeight == 0)
+            continue;
+          // value difference rounded to 8 bits
+          int delta = ((int)row[kx] << DS_FIXED_Q8_BITS) - valCenter;
+          delta = (delta >= 0) ? delta : -delta;
+          const int index = (delta + (1 << (DS_FIXED_Q8_BITS - 1))) >>
+            DS_FIXED_Q8_BITS;
+          const MUint32 weight = (posWeight * weightsVal[index]) >> 15;
+          sum += (MUint64)weight * row[kx];
+          sumWeights += weight;
+        }  // for (kx)
+      }  // for (ky)
+      pixelsDst[cx + cy * wDst] = (sumWeights > 0) ?
+        (MUint16)(((sum << DS_FIXED_Q8_BITS) + sumWeights / 2) / sumWeights) :
+        (MUint16)valCenter;
     } // for (cx)
   }  // for (cy)
-  return 1;
 }
 
-int   Downsample2d::performGaussFast(const float *pixelsSrc, float *pixelsDst)
+// Bilinear restore of Q8 small image into Q8 image of source size
+static void _restoreBilinearFixed(
+                                  const MUint16 *pixelsSmall,
+                                  const int      wDst,
+                                  const int      hDst,
+                                  MUint16       *pixelsRestored,
+                                  const int      wSrc,
+                                  const int      hSrc
+                                 )
 {
-  const int SIMPLE_GAUSS_DIAMETER = (2 * SIMPLE_GAUSS_RADIUS + 1);
-  static float gaussWeights[SIMPLE_GAUSS_DIAMETER * SIMPLE_GAUSS_DIAMETER];
+  const MUint32 ONE = 1 << DS_FIXED_Q8_BITS;
+  int ind = 0;
+  for (int yLar = 0; yLar < hSrc; yLar++)
+  {
+    float ySmall = ((float)yLar + 0.5f) * hDst / hSrc - 0.5f;
+    ySmall = (ySmall > 0.0f) ? ySmall : 0.0f;
+    const int iySmall = (int)(ySmall);
+    const MUint32 ty = (MUint32)((ySmall - iySmall) * ONE + 0.5f);
+    const int iySmallNext = (iySmall + 1 < hDst) ?
+      (iySmall + 1) : (hDst - 1);
+    const MUint16 *rowA = pixelsSmall + iySmall * wDst;
+    const MUint16 *rowC = pixelsSmall + iySmallNext * wDst;
 
-  const float SIMPLE_KOEF =
-    1.0f / (2.0f * M_PI * SIMPLE_GAUSS_SIGMA * SIMPLE_GAUSS_SIGMA);
+    for (int xLar = 0; xLar < wSrc; xLar++)
+    {
+      float xSmall = ((float)xLar + 0.5f) * wDst / wSrc - 0.5f;
+      xSmall = (xSmall > 0.0f) ? xSmall : 0.0f;
+      const int ixSmall = (int)(xSmall);
+      const MUint32 tx = (MUint32)((xSmall - ixSmall) * ONE + 0.5f);
+      const int ixSmallNext = (ixSmall + 1 < wDst) ?
+        (ixSmall + 1) : (wDst - 1);
+      // Q8 values with Q8 fractions fit into 32 bits
+      const MUint32 valL = rowA[ixSmall] * (ONE - ty) + rowC[ixSmall] * ty;
+      const MUint32 valR = rowA[ixSmallNext] * (ONE - ty) +
+        rowC[ixSmallNext] * ty;
+      const MUint32 valLr = ((valL + ONE / 2) >> DS_FIXED_Q8_BITS) *
+        (ONE - tx) + ((valR + ONE / 2) >> DS_FIXED_Q8_BITS) * tx;
+      pixelsRestored[ind++] =
+        (MUint16)((valLr + ONE / 2) >> DS_FIXED_Q8_BITS);
+    } // for (xLar)
+  } // for (yLar)
+}
 
-  // fill weights
-  int indexWeight = 0;
-  for (int dy = -SIMPLE_GAUSS_RADIUS; dy <= +SIMPLE_GAUSS_RADIUS; dy++)
+// Advanced method second pass on 8 bit source and Q8 restored image.
+// Window without any difference from restored image (0 / 0 in float)
+// takes gauss value of small image. With scratch sums (see
+// _allocFlatBand) flat window takes its mean
+static void _performAdvancedFixed(
+                                  const MUint8        *pixelsSrc,
+                                  const MUint16       *pixelsRestored,
+                                  const int            wSrc,
+                                  const int            hSrc,
+                                  const MUint16       *pixelsSmall,
+                                  MUint16             *pixelsDst,
+                                  const int            wDst,
+                                  const int            hDst,
+                                  const PolyphaseTaps &tapsX,
+                                  const PolyphaseTaps &tapsY,
+                                  const int            flatTolerance,
+                                  MUint64             *sums
+                                 )
+{
+  const int numTaps = tapsX.getNumTaps();
+  for (int ySmall = 0; ySmall < hDst; ySmall++)
   {
-    const float ty = (float)dy / SIMPLE_GAUSS_RADIUS;
-    for (int dx = -SIMPLE_GAUSS_RADIUS; dx <= +SIMPLE_GAUSS_RADIUS; dx++)
+    const int yFirst = tapsY.getFirst(ySmall);
+    const MUint16 *weightsY = tapsY.getWeightsFixed(ySmall);
+    int kyStart, kyEnd;
+    _getTapsRange(yFirst, numTaps, hSrc, &kyStart, &kyEnd);
+    if (sums)
+      _getFlatBand(pixelsSrc, wSrc, yFirst + kyStart, yFirst + kyEnd, 0,
+        wSrc, sums, sums + wSrc + 1);
+    for (int xSmall = 0; xSmall < wDst; xSmall++)
     {
-      const float tx = (float)dx / SIMPLE_GAUSS_RADIUS;
-      const float dist2 = tx * tx + ty * ty;
-      const float gaussWeight = expf(-dist2 * SIMPLE_KOEF);
-      gaussWeights[indexWeight++] = gaussWeight;
-    } // for (dx)
-  }  // for (dy)
+      const int xFirst = tapsX.getFirst(xSmall);
+      const MUint16 *weightsX = tapsX.getWeightsFixed(xSmall);
+      int kxStart, kxEnd;
+      _getTapsRange(xFirst, numTaps, wSrc, &kxStart, &kxEnd);
+      const int off = xSmall + ySmall * wDst;
+      MUint32 sumFlat;
+      if (sums && _isFlatWindow(sums, sums + wSrc + 1, xFirst + kxStart,
+        xFirst + kxEnd, kyEnd - kyStart, flatTolerance, &sumFlat))
+      {
+        const MUint32 num = (kxEnd - kxStart) * (kyEnd - kyStart);
+        pixelsDst[off] = (MUint16)(((sumFlat << DS_FIXED_Q8_BITS) +
+          num / 2) / num);
+        continue;
+      }
+
+      // weight is gauss (Q21) * squared difference (Q8)
+      MUint64 sum = 0, sumWeights = 0;
+      for (int ky = kyStart; ky < kyEnd; ky++)
+      {
+        const int yOff = (yFirst + ky) * wSrc + xFirst;
+        for (int kx = kxStart; kx < kxEnd; kx++)
+        {
+          const MUint32 val = pixelsSrc[yOff + kx];
+          int delta = (int)(val << DS_FIXED_Q8_BITS) -
+            (int)pixelsRestored[yOff + kx];
+          delta = (delta >= 0) ? delta : -delta;
+          const MUint32 filterWeight =
+            ((MUint32)delta * (MUint32)delta) >> DS_FIXED_Q8_BITS;
+          const MUint32 gaussWeight = (MUint32)weightsX[kx] * weightsY[ky];
+          const MUint64 weight =
+            (MUint64)(gaussWeight >> (POLY_FIXED_BITS / 2)) * filterWeight;
+          sum += weight * val;
+          sumWeights += weight;
+        } // for (kx)
+      } // for (ky)
+      if (sumWeights == 0)
+      {
+        pixelsDst[off] = pixelsSmall[off];
+        continue;
+      }
+      // sum has no room for 8 more bits: integer and fraction separately
+      const MUint64 valInt = sum / sumWeights;
+      const MUint64 rem = sum - valInt * sumWeights;
+      pixelsDst[off] = (MUint16)((valInt << DS_FIXED_Q8_BITS) +
+        ((rem << DS_FIXED_Q8_BITS) + sumWeights / 2) / sumWeights);
+    } // for (xSmall)
+  } // for (ySmall)
+}
+
+// Advanced method on 8 bit source, all steps in fixed point, Q8 scratch
+// images are given by caller. Return 1 if ok, 0 if no memory
+static int _performDownSampleFixed(
+                                    const MUint8        *pixelsSrc,
+                                    MUint16             *pixelsRestored,
+                                    const int            wSrc,
+                                    const int            hSrc,
+                                    MUint16             *pixelsSmall,
+                                    MUint16             *pixelsDst,
+                                    const int            wDst,
+                                    const int            hDst,
+                                    const PolyphaseTaps &tapsGaussX,
+                                    const PolyphaseTaps &tapsGaussY,
+                                    const PolyphaseTaps &tapsX,
+                                    const PolyphaseTaps &tapsY,
+                                    const int            flatTolerance,
+                                    MUint64             *sumsFlat
+                                  )
+{
+  if (!_performGaussFixed(pixelsSrc, wSrc, hSrc, pixelsSmall, wDst, hDst,
+    tapsGaussX, tapsGaussY))
+    return 0;
+  _restoreBilinearFixed(pixelsSmall, wDst, hDst, pixelsRestored, wSrc, hSrc);
+  _performAdvancedFixed(pixelsSrc, pixelsRestored, wSrc, hSrc, pixelsSmall,
+    pixelsDst, wDst, hDst, tapsX, tapsY, flatTolerance, sumsFlat);
+  return 1;
+}
+
+int Downsample2d::performGaussSlow(const float *pixelsSrc, float *pixelsDst)
+{
+  // more sigma => more blurring
+  const float SIMPLE_KOEF =
+    1.0f / (2.0f * M_PI * SIMPLE_GAUSS_SIGMA * SIMPLE_GAUSS_SIGMA);
+  const float SIMPLE_KOEF_PIXEL =
+    SIMPLE_KOEF / (SIMPLE_GAUSS_RADIUS * SIMPLE_GAUSS_RADIUS);
+
+  // tables give kernel centers only, weights are computed here
+  if (!_createTaps(&m_tapsGaussX, &m_tapsGaussY, m_wSrc, m_hSrc, m_wDst,
+    m_hDst, SIMPLE_GAUSS_RADIUS, SIMPLE_KOEF_PIXEL))
+    return 0;
+  if (pixelsDst == m_pixelsGauss)
+    setTilesValid(DS_METHOD_GAUSS, (pixelsSrc == m_pixelsSrc) ? 1 : 0);
+  const int numTaps = m_tapsGaussX.getNumTaps();
+  const DsPlane src = _getPlaneSrc(pixelsSrc, m_bytesSrc);
 
   for (int cy = 0; cy < m_hDst; cy++)
   {
-    const int cySrc = m_hSrc * cy / m_hDst;
+    const float cySrc = m_tapsGaussY.getCenter(cy);
+    const int yFirst = m_tapsGaussY.getFirst(cy);
     const int cyDstOff = cy * m_wDst;
 
     for (int cx = 0; cx < m_wDst; cx++)
     {
-      const int cxSrc = m_wSrc * cx / m_wDst;
+      const float cxSrc = m_tapsGaussX.getCenter(cx);
+      const int xFirst = m_tapsGaussX.getFirst(cx);
+      int kxStart, kxEnd;
+      _getTapsRange(xFirst, numTaps, m_wSrc, &kxStart, &kxEnd);
 
-      // accumulate sum around pixel [cxSrc, cySrc] with
+      // accumulate sum around point [cxSrc, cySrc] with 
       // neighborhood SIMPLE_GAUSS_RADIUS
       float sum = 0.0f;
       float sumWeights = 0.0f;
+      float rowBuf[DS_MAX_NEIB_DIA];
 
-      for (int dy = -SIMPLE_GAUSS_RADIUS; dy <= +SIMPLE_GAUSS_RADIUS; dy++)
+      for (int y = yFirst; y < yFirst + numTaps; y++)
       {
-        const int y = cySrc + dy;
         if (y < 0)
           continue;
         if (y >= m_hSrc)
           break;
-        const int yOff = y * m_wSrc;
+        const float ty = (y - cySrc) / SIMPLE_GAUSS_RADIUS;
+        if ((ty < -1.0f) || (ty > 1.0f))
+          continue;
+        const float *row = _getPlaneRow(src, y * m_wSrc + xFirst, kxStart,
+          kxEnd, rowBuf);
 
-        for (int dx = -SIMPLE_GAUSS_RADIUS; dx <= +SIMPLE_GAUSS_RADIUS; dx++)
+        for (int x = xFirst; x < xFirst + numTaps; x++)
         {
-          const int x = cxSrc + dx;
           if (x < 0)
             continue;
           if (x >= m_wSrc)
             break;
+          const float tx = (x - cxSrc) / SIMPLE_GAUSS_RADIUS;
+          if ((tx < -1.0f) || (tx > 1.0f))
+            continue;
 
-          const int indexWeightX = dx + SIMPLE_GAUSS_RADIUS;
-          const int indexWeightY = dy + SIMPLE_GAUSS_RADIUS;
-          const int offWeight =
-            indexWeightX + indexWeightY * SIMPLE_GAUSS_DIAMETER;
-          const float gaussWeight = gaussWeights[offWeight];
+          const float dist2 = tx * tx + ty * ty;
+          const float gaussWeight = expf( -dist2 * SIMPLE_KOEF);
 
-          const int offSrc = x + yOff;
-          const float valSrc = pixelsSrc[offSrc];
+          const float valSrc = row[x - xFirst];
 
           sum += valSrc * gaussWeight;
           sumWeights += gaussWeight;
 
-        }  // for (dx)
-      }  // for (dy)
+        }  // for (x)
+      }  // for (y)
       const float valDst = sum / sumWeights;
       pixelsDst[cx + cyDstOff] = valDst;
     } // for (cx)
   }  // for (cy)
-
   return 1;
 }
 
-int   Downsample2d::performBilateral()
+// Separable gauss of source window around every destination pixel
+// of rect
+static void _performGaussTaps(
+                              const DsPlane       &pixelsSrc,
+                              const int            wSrc,
+                              const int            hSrc,
+                              float               *pixelsDst,
+                              const int            wDst,
+                              const int            hDst,
+                              const PolyphaseTaps &tapsX,
+                              const PolyphaseTaps &tapsY,
+                              const DsRect        &rect
+                             )
 {
-  const int NEIB_RADIUS = 8;
-  // more sigma => more blurring
-  const float POS_SIGMA   = m_sigmaBilateralPos;
-  const float POS_KOEF    = 1.0f / (2.0f * M_PI * POS_SIGMA * POS_SIGMA);
+  const int numTaps = tapsX.getNumTaps();
+  assert((rect.m_x1 <= wDst) && (rect.m_y1 <= hDst));
 
-  const float VAL_SIGMA   = m_sigmaBilateralVal;
-  const float VAL_KOEF    = 1.0f / (2.0f * M_PI * VAL_SIGMA * VAL_SIGMA);
+  for (int cy = rect.m_y0; cy < rect.m_y1; cy++)
+  {
+    const int yFirst = tapsY.getFirst(cy);
+    const float *weightsY = tapsY.getWeights(cy);
+    int kyStart, kyEnd;
+    _getTapsRange(yFirst, numTaps, hSrc, &kyStart, &kyEnd);
+    float sumWeightsY = 0.0f;
+    int kx, ky;
+    for (ky = kyStart; ky < kyEnd; ky++)
+      sumWeightsY += weightsY[ky];
+    const int cyDstOff = cy * wDst;
+
+    for (int cx = rect.m_x0; cx < rect.m_x1; cx++)
+    {
+      const int xFirst = tapsX.getFirst(cx);
+      const float *weightsX = tapsX.getWeights(cx);
+      int kxStart, kxEnd;
+      _getTapsRange(xFirst, numTaps, wSrc, &kxStart, &kxEnd);
+      float sumWeightsX = 0.0f;
+      for (kx = kxStart; kx < kxEnd; kx++)
+        sumWeightsX += weightsX[kx];
+
+      // accumulate sum around center with neighborhood
+      // SIMPLE_GAUSS_RADIUS, row by row
+      float sum = 0.0f;
+      float rowBuf[DS_MAX_NEIB_DIA];
+      for (ky = kyStart; ky < kyEnd; ky++)
+      {
+        const float *row = _getPlaneRow(pixelsSrc,
+          (yFirst + ky) * wSrc + xFirst, kxStart, kxEnd, rowBuf);
+        float sumRow = 0.0f;
+        for (kx = kxStart; kx < kxEnd; kx++)
+          sumRow += row[kx] * weightsX[kx];
+        sum += sumRow * weightsY[ky];
+      }  // for (ky)
+      const float valDst = sum / (sumWeightsX * sumWeightsY);
+      pixelsDst[cx + cyDstOff] = valDst;
+    } // for (cx)
+  }  // for (cy)
+}
 
-  for (int cy = 0; cy < m_hDst; cy++)
+int   Downsample2d::performGaussFast(const float *pixelsSrc, float *pixelsDst)
+{
+  const float SIMPLE_KOEF =
+    1.0f / (2.0f * M_PI * SIMPLE_GAUSS_SIGMA * SIMPLE_GAUSS_SIGMA);
+  const float SIMPLE_KOEF_PIXEL =
+    SIMPLE_KOEF / (SIMPLE_GAUSS_RADIUS * SIMPLE_GAUSS_RADIUS);
+
+  // gauss is separable: weight is product of x and y phase kernels
+  if (!_createTaps(&m_tapsGaussX, &m_tapsGaussY, m_wSrc, m_hSrc, m_wDst,
+    m_hDst, SIMPLE_GAUSS_RADIUS, SIMPLE_KOEF_PIXEL))
+    return 0;
+  // gauss image is valid again only when made from source completely
+  if (pixelsDst == m_pixelsGauss)
+    setTilesValid(DS_METHOD_GAUSS, 0);
+  if (m_fixedPoint && (pixelsSrc == m_pixelsSrc))
   {
-    const int cySrc = m_hSrc * cy / m_hDst;
-    const int cySrcOff = cySrc * m_wSrc;
-    const int cyDstOff = cy * m_wDst;
+    MemArenaFrame frame;
+    const int numPixelsDst = m_wDst * m_hDst;
+    MUint16 *pixelsQ8 = (MUint16*)frame.allocate(numPixelsDst *
+      sizeof(MUint16));
+    if (!pixelsQ8)
+      return 0;
+    if (!_performGaussFixed(m_bytesSrc, m_wSrc, m_hSrc, pixelsQ8, m_wDst,
+      m_hDst, m_tapsGaussX, m_tapsGaussY))
+      return 0;
+    for (int i = 0; i < numPixelsDst; i++)
+      pixelsDst[i] = _getFloatQ8(pixelsQ8[i]);
+  }
+  else
+    _performGaussTaps(_getPlaneSrc(pixelsSrc, m_bytesSrc), m_wSrc, m_hSrc,
+      pixelsDst, m_wDst, m_hDst, m_tapsGaussX, m_tapsGaussY,
+      _getRect(0, 0, m_wDst, m_hDst));
+  if ((pixelsDst == m_pixelsGauss) && (pixelsSrc == m_pixelsSrc))
+    setTilesValid(DS_METHOD_GAUSS, 1);
+  return 1;
+}
 
-    for (int cx = 0; cx < m_wDst; cx++)
-    {
-      const int cxSrc = m_wSrc * cx / m_wDst;
+const int   BILATERAL_RADIUS = 8;
+
+// Position weights of bilateral method, more sigma => more blurring
+static int _createTapsBilateral(PolyphaseTaps *tapsX, PolyphaseTaps *tapsY,
+  const int wSrc, const int hSrc, const int wDst, const int hDst,
+  const float sigmaPos)
+{
+  const float POS_KOEF = 1.0f / (2.0f * M_PI * sigmaPos * sigmaPos);
+  return _createTaps(tapsX, tapsY, wSrc, hSrc, wDst, hDst, BILATERAL_RADIUS,
+    POS_KOEF / (BILATERAL_RADIUS * BILATERAL_RADIUS));
+}
+
+static void _performBilateralTaps(
+                                  const DsPlane       &pixelsSrc,
+                                  const int            wSrc,
+                                  const int            hSrc,
+                                  float               *pixelsDst,
+                                  const int            wDst,
+                                  const int            hDst,
+                                  const PolyphaseTaps &tapsX,
+                                  const PolyphaseTaps &tapsY,
+                                  const float          sigmaVal,
+                                  const DsRect        &rect
+                                 )
+{
+  const float VAL_KOEF = 1.0f / (2.0f * M_PI * sigmaVal * sigmaVal);
+  const int numTaps = tapsX.getNumTaps();
+  assert((rect.m_x1 <= wDst) && (rect.m_y1 <= hDst));
 
-      // accumulate sum around pixel [cxSrc, cySrc]
-      // with neighborhood SIMPLE_GAUSS_RADIUS
+  for (int cy = rect.m_y0; cy < rect.m_y1; cy++)
+  {
+    const float cySrc = tapsY.getCenter(cy);
+    const int yFirst = tapsY.getFirst(cy);
+    const float *weightsY = tapsY.getWeights(cy);
+    int kyStart, kyEnd;
+    _getTapsRange(yFirst, numTaps, hSrc, &kyStart, &kyEnd);
+    const int cyDstOff = cy * wDst;
+
+    for (int cx = rect.m_x0; cx < rect.m_x1; cx++)
+    {
+      const float cxSrc = tapsX.getCenter(cx);
+      const int xFirst = tapsX.getFirst(cx);
+      const float *weightsX = tapsX.getWeights(cx);
+      int kxStart, kxEnd;
+      _getTapsRange(xFirst, numTaps, wSrc, &kxStart, &kxEnd);
+
+      // accumulate sum around point [cxSrc, cySrc]
+      // with neighborhood BILATERAL_RADIUS
       float sum = 0.0f;
       float sumWeights = 0.0f;
 
@@ -320,32 +1164,20 @@ int   Downsample2d::performBilateral()
       // if ( (cx == 153) && (cy == 131))
       // sum = 0.0f; // break here
 
-      const float valSrcCenter = m_pixelsSrc[cxSrc + cySrcOff];
+      const float valSrcCenter =
+        _getValueAt(pixelsSrc, wSrc, hSrc, cxSrc, cySrc);
 
-      for (int dy = -NEIB_RADIUS; dy <= +NEIB_RADIUS; dy++)
+      float rowBuf[DS_MAX_NEIB_DIA];
+      for (int ky = kyStart; ky < kyEnd; ky++)
       {
-        const int y = cySrc + dy;
-        if (y < 0)
-          continue;
-        if (y >= m_hSrc)
-          break;
-        const int yOff = y * m_wSrc;
-        const float ty = (float)dy / NEIB_RADIUS;
-
-        for (int dx = -NEIB_RADIUS; dx <= +NEIB_RADIUS; dx++)
+        const float *row = _getPlaneRow(pixelsSrc,
+          (yFirst + ky) * wSrc + xFirst, kxStart, kxEnd, rowBuf);
+        for (int kx = kxStart; kx < kxEnd; kx++)
         {
-          const int x = cxSrc + dx;
-          if (x < 0)
+          const float posWeight = weightsX[kx] * weightsY[ky];
+          if (posWeight == 0.0f)
             continue;
-          if (x >= m_wSrc)
-            break;
-          const float tx = (float)dx / NEIB_RADIUS;
-
-          const int offSrc = x + yOff;
-          const float valSrc = m_pixelsSrc[offSrc];
-
-          const float dist2 = tx * tx + ty * ty;
-          const float posWeight = expf(-dist2 * POS_KOEF);
+          const float valSrc = row[kx];
 
           const float deltaVal = valSrc - valSrcCenter;
           const float valWeight = expf(-deltaVal * deltaVal * VAL_KOEF);
@@ -353,165 +1185,1589 @@ int   Downsample2d::performBilateral()
           sum += valSrc * posWeight * valWeight;
           sumWeights += posWeight * valWeight;
 
-        }  // for (dx)
-      }  // for (dy)
+        }  // for (kx)
+      }  // for (ky)
       const float valDst = sum / sumWeights;
-      m_pixelsBilateral[cx + cyDstOff] = valDst;
+      pixelsDst[cx + cyDstOff] = valDst;
 
     } // for (cx)
   }  // for (cy)
-  return 1;
 }
 
-//
-// Based on article
-// J.Diaz-Garcia, P.Brunet, I.Navazo, P.Vazquez, 
-// "Downsampling Methods for Medical Datasets", 2017
-//
-// web ref:
-// upcommons.upc.edu/bitstream/handle/2117/111411/IADIS-CGVCV2017-.pdf;jsessionid=876F408154FD5973D28806BF5BDB635C?sequence=1
-//
-int   Downsample2d::performDownSample()
+int   Downsample2d::performBilateral()
 {
-  performGaussFast(m_pixelsSrc, m_pixelsGauss);
-
-  // restore original resolution image via bilinear
-  // interpolation from diminished gauss image
-
-  int ind = 0;
-  for (int yLar = 0; yLar < m_hSrc; yLar++)
+  // image is valid again only when computed completely
+  setTilesValid(DS_METHOD_BILATERAL, 0);
+  if (m_numChannels > 1)
   {
-    const float ySmall = (float)m_hDst * yLar / m_hSrc;
-    const int iySmall = (int)(ySmall);
-    const float ty = ySmall - (float)iySmall;
-    const int iySmallNext = (iySmall + 1 < m_hDst) ?
-      (iySmall + 1) : (m_hDst - 1);
-
-    for (int xLar = 0; xLar < m_wSrc; xLar++)
-    {
-      const float xSmall = (float)m_wDst * xLar / m_wSrc;
+    const int ok = performBilateralColor();
+    setTilesValid(DS_METHOD_BILATERAL, ok);
+    return ok;
+  }
+  if (!_createTapsBilateral(&m_tapsBilateralX, &m_tapsBilateralY, m_wSrc,
+    m_hSrc, m_wDst, m_hDst, m_sigmaBilateralPos))
+    return 0;
+  if (m_fixedPoint)
+  {
+    MemArenaFrame frame;
+    const int numPixelsDst = m_wDst * m_hDst;
+    MUint16 *pixelsQ8 = (MUint16*)frame.allocate(numPixelsDst *
+      sizeof(MUint16));
+    if (!pixelsQ8)
+      return 0;
+    _performBilateralFixed(m_bytesSrc, m_wSrc, m_hSrc, pixelsQ8, m_wDst,
+      m_hDst, m_tapsBilateralX, m_tapsBilateralY, m_sigmaBilateralVal);
+    for (int i = 0; i < numPixelsDst; i++)
+      m_pixelsBilateral[i] = _getFloatQ8(pixelsQ8[i]);
+  }
+  else
+    _performBilateralTaps(_getPlaneSrc(m_pixelsSrc, m_bytesSrc), m_wSrc,
+      m_hSrc, m_pixelsBilateral, m_wDst, m_hDst, m_tapsBilateralX,
+      m_tapsBilateralY, m_sigmaBilateralVal, _getRect(0, 0, m_wDst, m_hDst));
+  setTilesValid(DS_METHOD_BILATERAL, 1);
+  return 1;
+}
+
+int   Downsample2d::performMedian()
+{
+  // source came from 8 bit pixels, so byte images are exact
+  MemArenaFrame frame;
+  const int numPixelsDst = m_wDst * m_hDst;
+  MUint8 *bytesDst = (MUint8*)frame.allocate(numPixelsDst);
+  if (!bytesDst)
+    return 0;
+  const int ok = RankFilter::downsample2d(m_bytesSrc, m_wSrc, m_hSrc,
+    bytesDst, m_wDst, m_hDst, m_medianRadius, m_medianPercentile);
+  if (ok < 0)
+    return 0;
+  for (int i = 0; i < numPixelsDst; i++)
+    m_pixelsMedian[i] = bytesDst[i] * (1.0f / 255.0f);
+  setTilesValid(DS_METHOD_MEDIAN, 1);
+  return 1;
+}
+
+int   Downsample2d::performGuided()
+{
+  // filter has float images of source size anyway
+  MemArenaFrame frame;
+  const float *pixelsSrc = m_pixelsSrc;
+  if (!pixelsSrc)
+  {
+    const int numPixelsSrc = m_wSrc * m_hSrc;
+    float *pixels = (float*)frame.allocate(numPixelsSrc * sizeof(float));
+    if (!pixels)
+      return 0;
+    for (int i = 0; i < numPixelsSrc; i++)
+      pixels[i] = m_bytesSrc[i] * (1.0f / 255.0f);
+    pixelsSrc = pixels;
+  }
+  const int ok = GuidedFilter::downsample2d(pixelsSrc, m_wSrc, m_hSrc,
+    m_pixelsGuided, m_wDst, m_hDst, m_guidedRadius, m_guidedEps);
+  if (ok < 0)
+    return 0;
+  setTilesValid(DS_METHOD_GUIDED, 1);
+  return 1;
+}
+
+//
+// Based on article
+// J.Diaz-Garcia, P.Brunet, I.Navazo, P.Vazquez, 
+// "Downsampling Methods for Medical Datasets", 2017
+//
+// web ref:
+// upcommons.upc.edu/bitstream/handle/2117/111411/IADIS-CGVCV2017-.pdf;jsessionid=876F408154FD5973D28806BF5BDB635C?sequence=1
+//
+
+const int   DS_RADIUS = 8;
+const float DS_GAUSS_SIGMA = 1.5f;
+
+// Position of large image sample in small image, the same alignment
+// of sample centers as in kernel tables
+static inline float _getSmallPos(const int large, const int dimSmall,
+  const int dimLarge)
+{
+  const float pos = ((float)large + 0.5f) * dimSmall / dimLarge - 0.5f;
+  return (pos > 0.0f) ? pos : 0.0f;
+}
+
+// Small image range [*smallStart, *smallEnd) read by restore of large
+// image range [largeStart, largeEnd)
+static void _getSmallRange(const int largeStart, const int largeEnd,
+  const int dimSmall, const int dimLarge, int *smallStart, int *smallEnd)
+{
+  *smallStart = (int)_getSmallPos(largeStart, dimSmall, dimLarge);
+  const int last = (int)_getSmallPos(largeEnd - 1, dimSmall, dimLarge) + 1;
+  *smallEnd = (last < dimSmall) ? (last + 1) : dimSmall;
+}
+
+// Restore rect of source resolution image via bilinear interpolation
+// from diminished gauss image. Goes to 16 bit image if pixelsRestored
+// is NULL. Return 1 if ok, 0 if no memory
+static int _restoreBilinear(
+                              const float *pixelsSmall,
+                              const int    wDst,
+                              const int    hDst,
+                              float       *pixelsRestored,
+                              MUint16     *pixelsRestoredHalf,
+                              const HalfFormat format,
+                              const int    wSrc,
+                              const int    hSrc,
+                              const DsRect &rect
+                            )
+{
+  MemArenaFrame frame;
+  float *rowHalf = NULL;
+  if (!pixelsRestored)
+  {
+    rowHalf = (float*)frame.allocate(wSrc * sizeof(float));
+    if (!rowHalf)
+      return 0;
+  }
+  for (int yLar = rect.m_y0; yLar < rect.m_y1; yLar++)
+  {
+    const float ySmall = _getSmallPos(yLar, hDst, hSrc);
+    const int iySmall = (int)(ySmall);
+    const float ty = ySmall - (float)iySmall;
+    const int iySmallNext = (iySmall + 1 < hDst) ?
+      (iySmall + 1) : (hDst - 1);
+    float *row = (rowHalf) ? rowHalf : (pixelsRestored + yLar * wSrc);
+
+    for (int xLar = rect.m_x0; xLar < rect.m_x1; xLar++)
+    {
+      const float xSmall = _getSmallPos(xLar, wDst, wSrc);
       const int ixSmall = (int)(xSmall);
       const float tx = xSmall - (float)ixSmall;
-      const int ixSmallNext = (ixSmall + 1 < m_wDst) ?
-        (ixSmall + 1) : (m_wDst - 1);
+      const int ixSmallNext = (ixSmall + 1 < wDst) ?
+        (ixSmall + 1) : (wDst - 1);
 
       // Neibs valued for bilinear interpolatoin
       //
       // A B
       // C D
       //
-      const float valA = m_pixelsGauss[ixSmall + iySmall * m_wDst];
-      const float valB = m_pixelsGauss[ixSmallNext + iySmall * m_wDst];
-      const float valC = m_pixelsGauss[ixSmall + iySmallNext * m_wDst];
-      const float valD = m_pixelsGauss[ixSmallNext + iySmallNext * m_wDst];
+      const float valA = pixelsSmall[ixSmall + iySmall * wDst];
+      const float valB = pixelsSmall[ixSmallNext + iySmall * wDst];
+      const float valC = pixelsSmall[ixSmall + iySmallNext * wDst];
+      const float valD = pixelsSmall[ixSmallNext + iySmallNext * wDst];
 
       const float valL = valA * (1.0f - ty) + valC * ty;
       const float valR = valB * (1.0f - ty) + valD * ty;
       const float val = valL * (1.0f - tx) + valR * tx;
 
-      m_pixelsRestored[ind++] = val;
+      row[xLar] = val;
     } // for (xLar)
+    if (rowHalf)
+      HalfFloat::fromFloatRow(rowHalf + rect.m_x0,
+        pixelsRestoredHalf + yLar * wSrc + rect.m_x0, rect.m_x1 - rect.m_x0,
+        format);
   } // for (yLar)
+  return 1;
+}
 
-  // process large image => small image
-
-  const int DS_RADIUS = 8;
-  const float DS_GAUSS_SIGMA = 1.5f;
-  const float DS_KOEF_GAUSS = 
-    1.0f / (2.0f * M_PI * DS_GAUSS_SIGMA * DS_GAUSS_SIGMA);
-
-  assert(DS_RADIUS <= DS_MAX_NEIB_RAD);
-  const int DS_NUM_ELEMS_FILTER = (2 * DS_RADIUS + 1) * (2 * DS_RADIUS + 1);
-  int indDstSmall = 0;
-  for (int ySmall = 0; ySmall < m_hDst; ySmall++)
+// Large image => small image (rect of it): source pixels weighted by
+// their difference from restored image and by gauss.
+// Window equal to restored image (no weights) takes gauss value of
+// small image. With 8 bit copy of source (bytesFlat) and scratch sums
+// (see _allocFlatBand) flat windows take their mean
+static void _performAdvancedTaps(
+                                  const DsPlane       &pixelsSrc,
+                                  const DsPlane       &pixelsRestored,
+                                  const int            wSrc,
+                                  const int            hSrc,
+                                  const float         *pixelsSmall,
+                                  float               *pixelsDst,
+                                  const int            wDst,
+                                  const int            hDst,
+                                  const PolyphaseTaps &tapsX,
+                                  const PolyphaseTaps &tapsY,
+                                  float               *filter,
+                                  const MUint8        *bytesFlat,
+                                  const int            flatTolerance,
+                                  MUint64             *sums,
+                                  const DsRect        &rect
+                                )
+{
+  const int numTaps = tapsX.getNumTaps();
+  const int DS_NUM_ELEMS_FILTER = numTaps * numTaps;
+  assert((rect.m_x1 <= wDst) && (rect.m_y1 <= hDst));
+  sums = (bytesFlat) ? sums : NULL;
+  // band of flat window test covers source columns of rect
+  int xBandStart, xBandEnd;
+  _getSrcRange(tapsX, rect.m_x0, rect.m_x1, wSrc, &xBandStart, &xBandEnd);
+  for (int ySmall = rect.m_y0; ySmall < rect.m_y1; ySmall++)
   {
-    const int ySrc = m_hSrc * ySmall / m_hDst;
-    for (int xSmall = 0; xSmall < m_wDst; xSmall++)
+    const int yFirst = tapsY.getFirst(ySmall);
+    const float *weightsY = tapsY.getWeights(ySmall);
+    int kyStart, kyEnd;
+    _getTapsRange(yFirst, numTaps, hSrc, &kyStart, &kyEnd);
+    if (sums)
+      _getFlatBand(bytesFlat, wSrc, yFirst + kyStart, yFirst + kyEnd,
+        xBandStart, xBandEnd, sums, sums + wSrc + 1);
+    for (int xSmall = rect.m_x0; xSmall < rect.m_x1; xSmall++)
     {
-      const int xSrc = m_wSrc * xSmall / m_wDst;
-      // center in point (xSrc, ySrc) from large image
+      const int indDstSmall = xSmall + ySmall * wDst;
+      const int xFirst = tapsX.getFirst(xSmall);
+      const float *weightsX = tapsX.getWeights(xSmall);
+      int kxStart, kxEnd;
+      _getTapsRange(xFirst, numTaps, wSrc, &kxStart, &kxEnd);
+      MUint32 sumFlat;
+      if (sums && _isFlatWindow(sums, sums + wSrc + 1,
+        xFirst + kxStart - xBandStart, xFirst + kxEnd - xBandStart,
+        kyEnd - kyStart, flatTolerance, &sumFlat))
+      {
+        // constant window gives its value exactly
+        const int num = (kxEnd - kxStart) * (kyEnd - kyStart);
+        pixelsDst[indDstSmall] = ((float)sumFlat / (float)num) *
+          (1.0f / 255.0f);
+        continue;
+      }
+      // window starts in point (xFirst, yFirst) from large image
 
       // clear filter
       for (int i = 0; i < DS_NUM_ELEMS_FILTER; i++)
-        m_filter[i] = 0.0f;
+        filter[i] = 0.0f;
 
       float weightsSum = 0.0f;
+      float rowBufSrc[DS_MAX_NEIB_DIA], rowBufSmo[DS_MAX_NEIB_DIA];
 
-      int dx, dy;
+      int kx, ky;
       // create image val weights
-      for (dy = -DS_RADIUS; dy <= +DS_RADIUS; dy++)
+      for (ky = kyStart; ky < kyEnd; ky++)
       {
-        const int y = ySrc + dy;
-        if (y < 0)
-          continue;
-        if (y >= m_hSrc)
-          break;
-        const int yOff = y * m_wSrc;
-        for (dx = -DS_RADIUS; dx <= +DS_RADIUS; dx++)
+        const int off = (yFirst + ky) * wSrc + xFirst;
+        const float *rowSrc = _getPlaneRow(pixelsSrc, off, kxStart, kxEnd,
+          rowBufSrc);
+        const float *rowSmo = _getPlaneRow(pixelsRestored, off, kxStart,
+          kxEnd, rowBufSmo);
+        for (kx = kxStart; kx < kxEnd; kx++)
         {
-          const int x = xSrc + dx;
-          if (x < 0)
-            continue;
-          if (x >= m_wSrc)
-            break;
-          const float valSrc = m_pixelsSrc[x + yOff];
-          const float valSmo = m_pixelsRestored[x + yOff];
+          const float valSrc = rowSrc[kx];
+          const float valSmo = rowSmo[kx];
           const float deltaVal = (valSrc - valSmo >= 0.0f) ?
             (valSrc - valSmo) : -(valSrc - valSmo);
           const float weight = deltaVal * deltaVal;
 
           weightsSum += weight;
-          const int indFilterY = dy + DS_RADIUS;
-          const int indFilterX = dx + DS_RADIUS;
-          m_filter[indFilterX + indFilterY * (2 * DS_RADIUS + 1)] = weight;
-        } // for (dx)
-      } // for (dy)
+          filter[kx + ky * numTaps] = weight;
+        } // for (kx)
+      } // for (ky)
 
+      if (weightsSum == 0.0f)
+      {
+        pixelsDst[indDstSmall] = pixelsSmall[indDstSmall];
+        continue;
+      }
       // normalize filter
       const float scaleFilter = 1.0f / weightsSum;
       for (int i = 0; i < DS_NUM_ELEMS_FILTER; i++)
-        m_filter[i] *= scaleFilter;
+        filter[i] *= scaleFilter;
 
-      // get source pixels around (xSrc, ySrc) using filter and
+      // get source pixels around center using filter and
       // gaussian smoothing
       float sum = 0.0f;
       float sumW = 0.0f;
-      for (dy = -DS_RADIUS; dy <= +DS_RADIUS; dy++)
+      for (ky = kyStart; ky < kyEnd; ky++)
       {
-        const int y = ySrc + dy;
-        if (y < 0)
-          continue;
-        if (y >= m_hSrc)
-          break;
-        const int yOff = y * m_wSrc;
-        const float ty = (float)dy / DS_RADIUS;
-        for (dx = -DS_RADIUS; dx <= +DS_RADIUS; dx++)
+        const float *rowSrc = _getPlaneRow(pixelsSrc,
+          (yFirst + ky) * wSrc + xFirst, kxStart, kxEnd, rowBufSrc);
+        for (kx = kxStart; kx < kxEnd; kx++)
         {
-          const int x = xSrc + dx;
-          if (x < 0)
-            continue;
-          if (x >= m_wSrc)
-            break;
-          const float tx = (float)dx / DS_RADIUS;
+          const float gaussWeight = weightsX[kx] * weightsY[ky];
+          const float filterWeight = filter[kx + ky * numTaps];
 
-          const float dist2 = tx * tx + ty *ty;
-          const float gaussWeight = expf(-dist2 / DS_KOEF_GAUSS);
-
-          const int indFilterY = dy + DS_RADIUS;
-          const int indFilterX = dx + DS_RADIUS;
-          const int offWe = indFilterX + indFilterY * (2 * DS_RADIUS + 1);
-          const float filterWeight = m_filter[offWe];
-
-          const float val = m_pixelsSrc[x + yOff];
+          const float val = rowSrc[kx];
           sum += val * gaussWeight * filterWeight;
           sumW += gaussWeight * filterWeight;
-        } // for (dx)
-      } // for (dy)
+        } // for (kx)
+      } // for (ky)
 
-      const float valFiltered = sum / sumW;
-      m_pixelsDownSampled[indDstSmall++] = valFiltered;
+      const float valFiltered = (sumW > 0.0f) ? (sum / sumW) :
+        pixelsSmall[indDstSmall];
+      pixelsDst[indDstSmall] = valFiltered;
     } // for (xSmall)
   } // for (ySmall)
+}
+
+// Gauss weights exp(-(d / DS_RADIUS) ^ 2 / DS_KOEF_GAUSS) of advanced method
+static int _createTapsAdvanced(PolyphaseTaps *tapsX, PolyphaseTaps *tapsY,
+  const int wSrc, const int hSrc, const int wDst, const int hDst)
+{
+  const float DS_KOEF_GAUSS = 
+    1.0f / (2.0f * M_PI * DS_GAUSS_SIGMA * DS_GAUSS_SIGMA);
+  assert(DS_RADIUS <= DS_MAX_NEIB_RAD);
+  return _createTaps(tapsX, tapsY, wSrc, hSrc, wDst, hDst, DS_RADIUS,
+    1.0f / (DS_KOEF_GAUSS * DS_RADIUS * DS_RADIUS));
+}
 
+int   Downsample2d::performDownSample()
+{
+  // image is valid again only when computed completely
+  setTilesValid(DS_METHOD_ADVANCED, 0);
+  if ((m_numChannels > 1) || m_fixedPoint)
+  {
+    const int ok = (m_numChannels > 1) ? performDownSampleColor() :
+      performDownSampleFixed();
+    setTilesValid(DS_METHOD_ADVANCED, ok);
+    return ok;
+  }
+  if (!performGaussFast(m_pixelsSrc, m_pixelsGauss))
+    return 0;
+  const HalfFormat format = _getHalfFormat(m_storage);
+  if (!_restoreBilinear(m_pixelsGauss, m_wDst, m_hDst, m_pixelsRestored,
+    m_halfRestored, format, m_wSrc, m_hSrc, _getRect(0, 0, m_wSrc, m_hSrc)))
+    return 0;
+  if (!_createTapsAdvanced(&m_tapsDownX, &m_tapsDownY, m_wSrc, m_hSrc,
+    m_wDst, m_hDst))
+    return 0;
+  const DsPlane restored = (m_pixelsRestored) ?
+    _getPlaneFloat(m_pixelsRestored) : _getPlaneHalf(m_halfRestored, format);
+  // scratch of flat window test is taken by callers: frame object inside
+  // of _performAdvancedTaps makes gcc code of its loops twice slower
+  MemArenaFrame frame;
+  MUint64 *sumsFlat;
+  if (!_allocFlatBand(&frame, m_wSrc, m_flatTolerance, &sumsFlat))
+    return 0;
+  _performAdvancedTaps(_getPlaneSrc(m_pixelsSrc, m_bytesSrc), restored,
+    m_wSrc, m_hSrc, m_pixelsGauss, m_pixelsDownSampled, m_wDst, m_hDst,
+    m_tapsDownX, m_tapsDownY, m_filter, m_bytesSrc, m_flatTolerance,
+    sumsFlat, _getRect(0, 0, m_wDst, m_hDst));
+  setTilesValid(DS_METHOD_ADVANCED, 1);
   return 1;
 }
+
+int   Downsample2d::performDownSampleFixed()
+{
+  const float SIMPLE_KOEF =
+    1.0f / (2.0f * M_PI * SIMPLE_GAUSS_SIGMA * SIMPLE_GAUSS_SIGMA);
+  const float SIMPLE_KOEF_PIXEL =
+    SIMPLE_KOEF / (SIMPLE_GAUSS_RADIUS * SIMPLE_GAUSS_RADIUS);
+  if (!_createTaps(&m_tapsGaussX, &m_tapsGaussY, m_wSrc, m_hSrc, m_wDst,
+    m_hDst, SIMPLE_GAUSS_RADIUS, SIMPLE_KOEF_PIXEL))
+    return 0;
+  if (!_createTapsAdvanced(&m_tapsDownX, &m_tapsDownY, m_wSrc, m_hSrc,
+    m_wDst, m_hDst))
+    return 0;
+
+  // Q8 images: restored, small gauss and result, as one block
+  MemArenaFrame frame;
+  const int numPixelsSrc = m_wSrc * m_hSrc;
+  const int numPixelsDst = m_wDst * m_hDst;
+  MUint16 *pixelsRestored = (MUint16*)frame.allocate((numPixelsSrc +
+    2 * numPixelsDst) * sizeof(MUint16));
+  MUint64 *sumsFlat;
+  if (!pixelsRestored || !_allocFlatBand(&frame, m_wSrc, m_flatTolerance,
+    &sumsFlat))
+    return 0;
+  MUint16 *pixelsSmall = pixelsRestored + numPixelsSrc;
+  MUint16 *pixelsDst = pixelsSmall + numPixelsDst;
+  if (!_performDownSampleFixed(m_bytesSrc, pixelsRestored, m_wSrc, m_hSrc,
+    pixelsSmall, pixelsDst, m_wDst, m_hDst, m_tapsGaussX, m_tapsGaussY,
+    m_tapsDownX, m_tapsDownY, m_flatTolerance, sumsFlat))
+    return 0;
+  setTilesValid(DS_METHOD_GAUSS, 1);
+  for (int i = 0; i < numPixelsDst; i++)
+  {
+    m_pixelsGauss[i] = _getFloatQ8(pixelsSmall[i]);
+    m_pixelsDownSampled[i] = _getFloatQ8(pixelsDst[i]);
+  }
+  return 1;
+}
+
+//  *****************************************************************
+// Regions
+//  *****************************************************************
+
+void  Downsample2d::setTilesValid(const DsMethod method, const int valid)
+{
+  if (!m_tilesValid)
+    return;
+  const int numTiles = m_numTilesX * m_numTilesY;
+  memset(m_tilesValid + method * numTiles, valid, numTiles);
+}
+
+void  Downsample2d::invalidateTiles()
+{
+  if (m_tilesValid)
+    memset(m_tilesValid, 0, DS_METHOD_COUNT * m_numTilesX * m_numTilesY);
+}
+
+int   Downsample2d::isMethodValid(const DsMethod method) const
+{
+  if (!m_tilesValid)
+    return 0;
+  const int numTiles = m_numTilesX * m_numTilesY;
+  return memchr(m_tilesValid + method * numTiles, 0, numTiles) ? 0 : 1;
+}
+
+int   Downsample2d::updateMethod(const DsMethod method)
+{
+  // nothing to compute before create
+  if (!m_tilesValid || isMethodValid(method))
+    return 1;
+  // tiles kept by performRegion are not computed again, if method
+  // supports regions
+  const int numTiles = m_numTilesX * m_numTilesY;
+  if (memchr(m_tilesValid + method * numTiles, 1, numTiles) &&
+      performRegion(method, 0, 0, m_wDst, m_hDst))
+    return 1;
+  int ok = 0;
+  switch (method)
+  {
+    case DS_METHOD_SUBSAMPLE:
+      ok = performSubSample();
+      break;
+    case DS_METHOD_GAUSS:
+      ok = performGaussFast(m_pixelsSrc, m_pixelsGauss);
+      break;
+    case DS_METHOD_BILATERAL:
+      ok = performBilateral();
+      break;
+    case DS_METHOD_ADVANCED:
+      ok = performDownSample();
+      break;
+    case DS_METHOD_MEDIAN:
+      ok = performMedian();
+      break;
+    case DS_METHOD_GUIDED:
+      ok = performGuided();
+      break;
+    default:
+      assert(method < -5555);
+  }
+  // failed method is tried again on next access
+  if (!ok)
+    setTilesValid(method, 0);
+  return ok;
+}
+
+int   Downsample2d::performRegion(
+                                    const DsMethod  method,
+                                    const int       xDst,
+                                    const int       yDst,
+                                    const int       wRegion,
+                                    const int       hRegion
+                                  )
+{
+  if (!m_tilesValid || (m_numChannels > 1) || m_fixedPoint)
+    return 0;
+  if ((method != DS_METHOD_SUBSAMPLE) && (method != DS_METHOD_GAUSS) &&
+      (method != DS_METHOD_BILATERAL) && (method != DS_METHOD_ADVANCED))
+    return 0;
+  if ((xDst < 0) || (yDst < 0) || (wRegion <= 0) || (hRegion <= 0) ||
+      (xDst + wRegion > m_wDst) || (yDst + hRegion > m_hDst))
+    return 0;
+
+  // tables of whole image, built once
+  const float SIMPLE_KOEF =
+    1.0f / (2.0f * M_PI * SIMPLE_GAUSS_SIGMA * SIMPLE_GAUSS_SIGMA);
+  const float SIMPLE_KOEF_PIXEL =
+    SIMPLE_KOEF / (SIMPLE_GAUSS_RADIUS * SIMPLE_GAUSS_RADIUS);
+  if ((method == DS_METHOD_GAUSS) || (method == DS_METHOD_ADVANCED))
+  {
+    if (!_createTaps(&m_tapsGaussX, &m_tapsGaussY, m_wSrc, m_hSrc, m_wDst,
+      m_hDst, SIMPLE_GAUSS_RADIUS, SIMPLE_KOEF_PIXEL))
+      return 0;
+  }
+  if ((method == DS_METHOD_BILATERAL) && !_createTapsBilateral(
+    &m_tapsBilateralX, &m_tapsBilateralY, m_wSrc, m_hSrc, m_wDst, m_hDst,
+    m_sigmaBilateralPos))
+    return 0;
+  if ((method == DS_METHOD_ADVANCED) && !_createTapsAdvanced(&m_tapsDownX,
+    &m_tapsDownY, m_wSrc, m_hSrc, m_wDst, m_hDst))
+    return 0;
+  MemArenaFrame frame;
+  MUint64 *sumsFlat;
+  if (!_allocFlatBand(&frame, m_wSrc, m_flatTolerance, &sumsFlat))
+    return 0;
+
+  const DsPlane src = _getPlaneSrc(m_pixelsSrc, m_bytesSrc);
+  const HalfFormat format = _getHalfFormat(m_storage);
+  const DsPlane restored = (m_pixelsRestored) ?
+    _getPlaneFloat(m_pixelsRestored) : _getPlaneHalf(m_halfRestored, format);
+  const int numTiles = m_numTilesX * m_numTilesY;
+  MUint8 *tilesValid = m_tilesValid + method * numTiles;
+  MUint8 *tilesGauss = m_tilesValid + DS_METHOD_GAUSS * numTiles;
+  const int txEnd = (xDst + wRegion - 1) / DS_TILE_SIZE + 1;
+  const int tyEnd = (yDst + hRegion - 1) / DS_TILE_SIZE + 1;
+  for (int ty = yDst / DS_TILE_SIZE; ty < tyEnd; ty++)
+  {
+    for (int tx = xDst / DS_TILE_SIZE; tx < txEnd; tx++)
+    {
+      const int indTile = tx + ty * m_numTilesX;
+      if (tilesValid[indTile])
+        continue;
+      const int x0 = tx * DS_TILE_SIZE;
+      const int y0 = ty * DS_TILE_SIZE;
+      const DsRect rect = _getRect(x0, y0,
+        (x0 + DS_TILE_SIZE < m_wDst) ? (x0 + DS_TILE_SIZE) : m_wDst,
+        (y0 + DS_TILE_SIZE < m_hDst) ? (y0 + DS_TILE_SIZE) : m_hDst);
+      if (method == DS_METHOD_SUBSAMPLE)
+        _performSubSample(src, m_wSrc, m_hSrc, m_pixelsSubSample, m_wDst,
+          m_hDst, rect);
+      else if (method == DS_METHOD_GAUSS)
+        _performGaussTaps(src, m_wSrc, m_hSrc, m_pixelsGauss, m_wDst,
+          m_hDst, m_tapsGaussX, m_tapsGaussY, rect);
+      else if (method == DS_METHOD_BILATERAL)
+        _performBilateralTaps(src, m_wSrc, m_hSrc, m_pixelsBilateral,
+          m_wDst, m_hDst, m_tapsBilateralX, m_tapsBilateralY,
+          m_sigmaBilateralVal, rect);
+      else
+      {
+        // source window of tile, its restored image needs gauss of
+        // small window (at least the tile itself, for degenerate windows)
+        DsRect rectSrc, rectSmall;
+        _getSrcRange(m_tapsDownX, rect.m_x0, rect.m_x1, m_wSrc,
+          &rectSrc.m_x0, &rectSrc.m_x1);
+        _getSrcRange(m_tapsDownY, rect.m_y0, rect.m_y1, m_hSrc,
+          &rectSrc.m_y0, &rectSrc.m_y1);
+        _getSmallRange(rectSrc.m_x0, rectSrc.m_x1, m_wDst, m_wSrc,
+          &rectSmall.m_x0, &rectSmall.m_x1);
+        _getSmallRange(rectSrc.m_y0, rectSrc.m_y1, m_hDst, m_hSrc,
+          &rectSmall.m_y0, &rectSmall.m_y1);
+        rectSmall.m_x0 = (rect.m_x0 < rectSmall.m_x0) ? rect.m_x0 :
+          rectSmall.m_x0;
+        rectSmall.m_y0 = (rect.m_y0 < rectSmall.m_y0) ? rect.m_y0 :
+          rectSmall.m_y0;
+        rectSmall.m_x1 = (rect.m_x1 > rectSmall.m_x1) ? rect.m_x1 :
+          rectSmall.m_x1;
+        rectSmall.m_y1 = (rect.m_y1 > rectSmall.m_y1) ? rect.m_y1 :
+          rectSmall.m_y1;
+        _performGaussTaps(src, m_wSrc, m_hSrc, m_pixelsGauss, m_wDst,
+          m_hDst, m_tapsGaussX, m_tapsGaussY, rectSmall);
+        if (!_restoreBilinear(m_pixelsGauss, m_wDst, m_hDst,
+          m_pixelsRestored, m_halfRestored, format, m_wSrc, m_hSrc, rectSrc))
+          return 0;
+        _performAdvancedTaps(src, restored, m_wSrc, m_hSrc, m_pixelsGauss,
+          m_pixelsDownSampled, m_wDst, m_hDst, m_tapsDownX, m_tapsDownY,
+          m_filter, m_bytesSrc, m_flatTolerance, sumsFlat, rect);
+        tilesGauss[indTile] = 1;
+      }
+      tilesValid[indTile] = 1;
+    }   // for (tx)
+  }     // for (ty)
+  return 1;
+}
+
+//  *****************************************************************
+// Source update
+//  *****************************************************************
+
+// Destination range [*dstStart, *dstEnd) of samples reading source
+// range [srcStart, srcEnd), kernel footprints move monotonically
+static void _getDstRange(const PolyphaseTaps &taps, const int srcStart,
+  const int srcEnd, const int dimDst, int *dstStart, int *dstEnd)
+{
+  const int numTaps = taps.getNumTaps();
+  int d = 0;
+  while ((d < dimDst) && (taps.getFirst(d) + numTaps <= srcStart))
+    d++;
+  *dstStart = d;
+  while ((d < dimDst) && (taps.getFirst(d) < srcEnd))
+    d++;
+  *dstEnd = d;
+}
+
+// Same for subsample: destination samples taking source [start, end)
+static void _getDstRangeSubSample(const int srcStart, const int srcEnd,
+  const int dimSrc, const int dimDst, int *dstStart, int *dstEnd)
+{
+  int d = 0;
+  while ((d < dimDst) && (dimSrc * d / dimDst < srcStart))
+    d++;
+  *dstStart = d;
+  while ((d < dimDst) && (dimSrc * d / dimDst < srcEnd))
+    d++;
+  *dstEnd = d;
+}
+
+// Large image range [*largeStart, *largeEnd) restored (bilinear) from
+// small image range [smallStart, smallEnd)
+static void _getLargeRange(const int smallStart, const int smallEnd,
+  const int dimSmall, const int dimLarge, int *largeStart, int *largeEnd)
+{
+  int l = 0;
+  for (; l < dimLarge; l++)
+  {
+    const int s = (int)_getSmallPos(l, dimSmall, dimLarge);
+    const int sNext = (s + 1 < dimSmall) ? (s + 1) : (dimSmall - 1);
+    if (sNext >= smallStart)
+      break;
+  }
+  *largeStart = l;
+  while ((l < dimLarge) &&
+         ((int)_getSmallPos(l, dimSmall, dimLarge) < smallEnd))
+    l++;
+  *largeEnd = l;
+}
+
+static inline int _isRectEmpty(const DsRect &rect)
+{
+  return ((rect.m_x0 >= rect.m_x1) || (rect.m_y0 >= rect.m_y1)) ? 1 : 0;
+}
+
+static DsRect _getRectUnion(const DsRect &a, const DsRect &b)
+{
+  if (_isRectEmpty(a))
+    return b;
+  if (_isRectEmpty(b))
+    return a;
+  return _getRect((a.m_x0 < b.m_x0) ? a.m_x0 : b.m_x0,
+    (a.m_y0 < b.m_y0) ? a.m_y0 : b.m_y0,
+    (a.m_x1 > b.m_x1) ? a.m_x1 : b.m_x1,
+    (a.m_y1 > b.m_y1) ? a.m_y1 : b.m_y1);
+}
+
+// Clear flags of tiles intersecting destination rect
+static void _clearTiles(MUint8 *tiles, const int numTilesX,
+  const DsRect &rect)
+{
+  if (_isRectEmpty(rect))
+    return;
+  for (int ty = rect.m_y0 / DS_TILE_SIZE;
+       ty <= (rect.m_y1 - 1) / DS_TILE_SIZE; ty++)
+  {
+    for (int tx = rect.m_x0 / DS_TILE_SIZE;
+         tx <= (rect.m_x1 - 1) / DS_TILE_SIZE; tx++)
+      tiles[tx + ty * numTilesX] = 0;
+  }
+}
+
+int   Downsample2d::updateSource(
+                                  const MUint32  *pixels,
+                                  const int       xSrc,
+                                  const int       ySrc,
+                                  const int       wRegion,
+                                  const int       hRegion
+                                )
+{
+  if (!m_tilesValid || !pixels)
+    return 0;
+  if ((xSrc < 0) || (ySrc < 0) || (wRegion <= 0) || (hRegion <= 0) ||
+      (xSrc + wRegion > m_wSrc) || (ySrc + hRegion > m_hSrc))
+    return 0;
+  const DsRect rectDirty = _getRect(xSrc, ySrc, xSrc + wRegion,
+    ySrc + hRegion);
+  _convertSource(pixels, m_wSrc, m_hSrc, m_numChannels, m_colorSrc,
+    m_pixelsSrc, m_bytesSrc, rectDirty);
+  setTilesValid(DS_METHOD_MEDIAN, 0);
+  setTilesValid(DS_METHOD_GUIDED, 0);
+  // colour and fixed point methods work on whole image only
+  if ((m_numChannels > 1) || m_fixedPoint)
+  {
+    invalidateTiles();
+    return 1;
+  }
+
+  const float SIMPLE_KOEF =
+    1.0f / (2.0f * M_PI * SIMPLE_GAUSS_SIGMA * SIMPLE_GAUSS_SIGMA);
+  const float SIMPLE_KOEF_PIXEL =
+    SIMPLE_KOEF / (SIMPLE_GAUSS_RADIUS * SIMPLE_GAUSS_RADIUS);
+  if (!_createTaps(&m_tapsGaussX, &m_tapsGaussY, m_wSrc, m_hSrc, m_wDst,
+    m_hDst, SIMPLE_GAUSS_RADIUS, SIMPLE_KOEF_PIXEL) ||
+    !_createTapsBilateral(&m_tapsBilateralX, &m_tapsBilateralY, m_wSrc,
+    m_hSrc, m_wDst, m_hDst, m_sigmaBilateralPos) ||
+    !_createTapsAdvanced(&m_tapsDownX, &m_tapsDownY, m_wSrc, m_hSrc,
+    m_wDst, m_hDst))
+  {
+    invalidateTiles();
+    return 0;
+  }
+
+  // destination pixels with footprint intersecting dirty rect. Advanced
+  // method also reads restored image, changed where it comes from
+  // changed gauss pixels; gauss pixel is taken by degenerate windows
+  DsRect rects[DS_METHOD_COUNT];
+  DsRect rectRestored;
+  _getDstRangeSubSample(rectDirty.m_x0, rectDirty.m_x1, m_wSrc, m_wDst,
+    &rects[DS_METHOD_SUBSAMPLE].m_x0, &rects[DS_METHOD_SUBSAMPLE].m_x1);
+  _getDstRangeSubSample(rectDirty.m_y0, rectDirty.m_y1, m_hSrc, m_hDst,
+    &rects[DS_METHOD_SUBSAMPLE].m_y0, &rects[DS_METHOD_SUBSAMPLE].m_y1);
+  const PolyphaseTaps *tapsX[DS_METHOD_ADVANCED + 1] = { NULL,
+    &m_tapsGaussX, &m_tapsBilateralX, &m_tapsDownX };
+  const PolyphaseTaps *tapsY[DS_METHOD_ADVANCED + 1] = { NULL,
+    &m_tapsGaussY, &m_tapsBilateralY, &m_tapsDownY };
+  int m;
+  for (m = DS_METHOD_GAUSS; m <= DS_METHOD_BILATERAL; m++)
+  {
+    _getDstRange(*tapsX[m], rectDirty.m_x0, rectDirty.m_x1, m_wDst,
+      &rects[m].m_x0, &rects[m].m_x1);
+    _getDstRange(*tapsY[m], rectDirty.m_y0, rectDirty.m_y1, m_hDst,
+      &rects[m].m_y0, &rects[m].m_y1);
+  }
+  const DsRect &rectGauss = rects[DS_METHOD_GAUSS];
+  _getLargeRange(rectGauss.m_x0, rectGauss.m_x1, m_wDst, m_wSrc,
+    &rectRestored.m_x0, &rectRestored.m_x1);
+  _getLargeRange(rectGauss.m_y0, rectGauss.m_y1, m_hDst, m_hSrc,
+    &rectRestored.m_y0, &rectRestored.m_y1);
+  const DsRect rectRead = _getRectUnion(rectDirty, rectRestored);
+  DsRect &rectDown = rects[DS_METHOD_ADVANCED];
+  _getDstRange(m_tapsDownX, rectRead.m_x0, rectRead.m_x1, m_wDst,
+    &rectDown.m_x0, &rectDown.m_x1);
+  _getDstRange(m_tapsDownY, rectRead.m_y0, rectRead.m_y1, m_hDst,
+    &rectDown.m_y0, &rectDown.m_y1);
+  rectDown = _getRectUnion(rectDown, rectGauss);
+
+  // valid methods compute changed pixels now. Partially computed ones
+  // forget changed tiles, also advanced one without valid gauss image
+  // (its restored image would come from other values)
+  const int numTiles = m_numTilesX * m_numTilesY;
+  int recompute[DS_METHOD_ADVANCED + 1];
+  for (m = DS_METHOD_SUBSAMPLE; m <= DS_METHOD_ADVANCED; m++)
+  {
+    recompute[m] = isMethodValid((DsMethod)m);
+    if ((m == DS_METHOD_ADVANCED) && !isMethodValid(DS_METHOD_GAUSS))
+      recompute[m] = 0;
+    if (!recompute[m])
+      _clearTiles(m_tilesValid + m * numTiles, m_numTilesX, rects[m]);
+  }
+  const DsPlane src = _getPlaneSrc(m_pixelsSrc, m_bytesSrc);
+  if (recompute[DS_METHOD_SUBSAMPLE])
+    _performSubSample(src, m_wSrc, m_hSrc, m_pixelsSubSample, m_wDst,
+      m_hDst, rects[DS_METHOD_SUBSAMPLE]);
+  if (recompute[DS_METHOD_GAUSS])
+    _performGaussTaps(src, m_wSrc, m_hSrc, m_pixelsGauss, m_wDst, m_hDst,
+      m_tapsGaussX, m_tapsGaussY, rectGauss);
+  if (recompute[DS_METHOD_BILATERAL])
+    _performBilateralTaps(src, m_wSrc, m_hSrc, m_pixelsBilateral, m_wDst,
+      m_hDst, m_tapsBilateralX, m_tapsBilateralY, m_sigmaBilateralVal,
+      rects[DS_METHOD_BILATERAL]);
+  if (!recompute[DS_METHOD_ADVANCED] || _isRectEmpty(rectDown))
+    return 1;
+  const HalfFormat format = _getHalfFormat(m_storage);
+  MemArenaFrame frame;
+  MUint64 *sumsFlat;
+  if (!_allocFlatBand(&frame, m_wSrc, m_flatTolerance, &sumsFlat) ||
+      (!_isRectEmpty(rectRestored) && !_restoreBilinear(m_pixelsGauss,
+      m_wDst, m_hDst, m_pixelsRestored, m_halfRestored, format, m_wSrc,
+      m_hSrc, rectRestored)))
+  {
+    setTilesValid(DS_METHOD_ADVANCED, 0);
+    return 0;
+  }
+  const DsPlane restored = (m_pixelsRestored) ?
+    _getPlaneFloat(m_pixelsRestored) : _getPlaneHalf(m_halfRestored, format);
+  _performAdvancedTaps(src, restored, m_wSrc, m_hSrc, m_pixelsGauss,
+    m_pixelsDownSampled, m_wDst, m_hDst, m_tapsDownX, m_tapsDownY,
+    m_filter, m_bytesSrc, m_flatTolerance, sumsFlat, rectDown);
+  return 1;
+}
+
+//  *****************************************************************
+// Colour
+//  *****************************************************************
+
+// Gauss of every plane, the same operations as _performGaussTaps, tap
+// weights are loaded once for all channels
+static void _performGaussTapsColor(
+                                    const float         *planesSrc,
+                                    const int            numChannels,
+                                    const int            wSrc,
+                                    const int            hSrc,
+                                    float               *planesDst,
+                                    const int            wDst,
+                                    const int            hDst,
+                                    const PolyphaseTaps &tapsX,
+                                    const PolyphaseTaps &tapsY
+                                  )
+{
+  const int numTaps = tapsX.getNumTaps();
+  const int numPixelsSrc = wSrc * hSrc;
+  const int numPixelsDst = wDst * hDst;
+  for (int cy = 0; cy < hDst; cy++)
+  {
+    const int yFirst = tapsY.getFirst(cy);
+    const float *weightsY = tapsY.getWeights(cy);
+    int kyStart, kyEnd;
+    _getTapsRange(yFirst, numTaps, hSrc, &kyStart, &kyEnd);
+    float sumWeightsY = 0.0f;
+    int kx, ky, c;
+    for (ky = kyStart; ky < kyEnd; ky++)
+      sumWeightsY += weightsY[ky];
+
+    for (int cx = 0; cx < wDst; cx++)
+    {
+      const int xFirst = tapsX.getFirst(cx);
+      const float *weightsX = tapsX.getWeights(cx);
+      int kxStart, kxEnd;
+      _getTapsRange(xFirst, numTaps, wSrc, &kxStart, &kxEnd);
+      float sumWeightsX = 0.0f;
+      for (kx = kxStart; kx < kxEnd; kx++)
+        sumWeightsX += weightsX[kx];
+
+      float sums[DS_MAX_CHANNELS];
+      for (c = 0; c < numChannels; c++)
+        sums[c] = 0.0f;
+      for (ky = kyStart; ky < kyEnd; ky++)
+      {
+        const float *row = planesSrc + (yFirst + ky) * wSrc + xFirst;
+        for (c = 0; c < numChannels; c++, row += numPixelsSrc)
+        {
+          float sumRow = 0.0f;
+          for (kx = kxStart; kx < kxEnd; kx++)
+            sumRow += row[kx] * weightsX[kx];
+          sums[c] += sumRow * weightsY[ky];
+        }
+      }  // for (ky)
+      const float sumWeights = sumWeightsX * sumWeightsY;
+      for (c = 0; c < numChannels; c++)
+        planesDst[c * numPixelsDst + cx + cy * wDst] = sums[c] / sumWeights;
+    } // for (cx)
+  }  // for (cy)
+}
+
+// Bilateral of every plane with value weights computed once per sample
+// from numGuide guide planes (luminance or R, G, B): mean squared
+// difference from guide values at kernel center
+static void _performBilateralTapsColor(
+                                        const float         *planesSrc,
+                                        const int            numChannels,
+                                        const float         *planesGuide,
+                                        const int            numGuide,
+                                        const int            wSrc,
+                                        const int            hSrc,
+                                        float               *planesDst,
+                                        const int            wDst,
+                                        const int            hDst,
+                                        const PolyphaseTaps &tapsX,
+                                        const PolyphaseTaps &tapsY,
+                                        const float          sigmaVal
+                                      )
+{
+  const float VAL_KOEF = 1.0f / (2.0f * M_PI * sigmaVal * sigmaVal) /
+    numGuide;
+  const int numTaps = tapsX.getNumTaps();
+  const int numPixelsSrc = wSrc * hSrc;
+  const int numPixelsDst = wDst * hDst;
+  for (int cy = 0; cy < hDst; cy++)
+  {
+    const float cySrc = tapsY.getCenter(cy);
+    const int yFirst = tapsY.getFirst(cy);
+    const float *weightsY = tapsY.getWeights(cy);
+    int kyStart, kyEnd;
+    _getTapsRange(yFirst, numTaps, hSrc, &kyStart, &kyEnd);
+
+    for (int cx = 0; cx < wDst; cx++)
+    {
+      const float cxSrc = tapsX.getCenter(cx);
+      const int xFirst = tapsX.getFirst(cx);
+      const float *weightsX = tapsX.getWeights(cx);
+      int kxStart, kxEnd;
+      _getTapsRange(xFirst, numTaps, wSrc, &kxStart, &kxEnd);
+      float valsCenter[DS_MAX_CHANNELS];
+      int c, g;
+      for (g = 0; g < numGuide; g++)
+        valsCenter[g] = _getValueAt(_getPlaneFloat(planesGuide +
+          g * numPixelsSrc), wSrc, hSrc, cxSrc, cySrc);
+
+      float sums[DS_MAX_CHANNELS];
+      for (c = 0; c < numChannels; c++)
+        sums[c] = 0.0f;
+      float sumWeights = 0.0f;
+      for (int ky = kyStart; ky < kyEnd; ky++)
+      {
+        const int off = (yFirst + ky) * wSrc + xFirst;
+        for (int kx = kxStart; kx < kxEnd; kx++)
+        {
+          const float posWeight = weightsX[kx] * weightsY[ky];
+          if (posWeight == 0.0f)
+            continue;
+          float deltaVal2 = 0.0f;
+          for (g = 0; g < numGuide; g++)
+          {
+            const float deltaVal =
+              planesGuide[g * numPixelsSrc + off + kx] - valsCenter[g];
+            deltaVal2 += deltaVal * deltaVal;
+          }
+          const float weight = posWeight * expf(-deltaVal2 * VAL_KOEF);
+          for (c = 0; c < numChannels; c++)
+            sums[c] += planesSrc[c * numPixelsSrc + off + kx] * weight;
+          sumWeights += weight;
+        }  // for (kx)
+      }  // for (ky)
+      for (c = 0; c < numChannels; c++)
+        planesDst[c * numPixelsDst + cx + cy * wDst] = sums[c] / sumWeights;
+    } // for (cx)
+  }  // for (cy)
+}
+
+// Advanced method second pass for every plane: window weights (filter)
+// come from guide planes and their restored images once, as in
+// _performAdvancedTaps (without flat window test)
+static void _performAdvancedTapsColor(
+                                      const float         *planesSrc,
+                                      const int            numChannels,
+                                      const float         *planesGuide,
+                                      const float         *planesRestored,
+                                      const int            numGuide,
+                                      const int            wSrc,
+                                      const int            hSrc,
+                                      const float         *planesSmall,
+                                      float               *planesDst,
+                                      const int            wDst,
+                                      const int            hDst,
+                                      const PolyphaseTaps &tapsX,
+                                      const PolyphaseTaps &tapsY,
+                                      float               *filter
+                                    )
+{
+  const int numTaps = tapsX.getNumTaps();
+  const int numPixelsSrc = wSrc * hSrc;
+  const int numPixelsDst = wDst * hDst;
+  const float scaleGuide = 1.0f / numGuide;
+  for (int ySmall = 0; ySmall < hDst; ySmall++)
+  {
+    const int yFirst = tapsY.getFirst(ySmall);
+    const float *weightsY = tapsY.getWeights(ySmall);
+    int kyStart, kyEnd;
+    _getTapsRange(yFirst, numTaps, hSrc, &kyStart, &kyEnd);
+    for (int xSmall = 0; xSmall < wDst; xSmall++)
+    {
+      const int xFirst = tapsX.getFirst(xSmall);
+      const float *weightsX = tapsX.getWeights(xSmall);
+      int kxStart, kxEnd;
+      _getTapsRange(xFirst, numTaps, wSrc, &kxStart, &kxEnd);
+
+      int kx, ky, c;
+      float weightsSum = 0.0f;
+      for (ky = kyStart; ky < kyEnd; ky++)
+      {
+        const int off = (yFirst + ky) * wSrc + xFirst;
+        for (kx = kxStart; kx < kxEnd; kx++)
+        {
+          float weight = 0.0f;
+          for (int g = 0; g < numGuide; g++)
+          {
+            const int offGuide = g * numPixelsSrc + off + kx;
+            const float deltaVal = planesGuide[offGuide] -
+              planesRestored[offGuide];
+            weight += deltaVal * deltaVal;
+          }
+          weight *= scaleGuide;
+          weightsSum += weight;
+          filter[kx + ky * numTaps] = weight;
+        } // for (kx)
+      } // for (ky)
+      if (weightsSum == 0.0f)
+      {
+        // window equal to restored image: gauss values
+        for (c = 0; c < numChannels; c++)
+        {
+          const int off = c * numPixelsDst + xSmall + ySmall * wDst;
+          planesDst[off] = planesSmall[off];
+        }
+        continue;
+      }
+      const float scaleFilter = 1.0f / weightsSum;
+
+      float sums[DS_MAX_CHANNELS];
+      for (c = 0; c < numChannels; c++)
+        sums[c] = 0.0f;
+      float sumW = 0.0f;
+      for (ky = kyStart; ky < kyEnd; ky++)
+      {
+        const int off = (yFirst + ky) * wSrc + xFirst;
+        for (kx = kxStart; kx < kxEnd; kx++)
+        {
+          const float weight = weightsX[kx] * weightsY[ky] *
+            (filter[kx + ky * numTaps] * scaleFilter);
+          for (c = 0; c < numChannels; c++)
+            sums[c] += planesSrc[c * numPixelsSrc + off + kx] * weight;
+          sumW += weight;
+        } // for (kx)
+      } // for (ky)
+      for (c = 0; c < numChannels; c++)
+      {
+        const int off = c * numPixelsDst + xSmall + ySmall * wDst;
+        planesDst[off] = (sumW > 0.0f) ? (sums[c] / sumW) : planesSmall[off];
+      }
+    } // for (xSmall)
+  } // for (ySmall)
+}
+
+int   Downsample2d::performSubSampleColor()
+{
+  const int numPixelsSrc = m_wSrc * m_hSrc;
+  const int numPixelsDst = m_wDst * m_hDst;
+  for (int cy = 0; cy < m_hDst; cy++)
+  {
+    const int cySrcOff = (m_hSrc * cy / m_hDst) * m_wSrc;
+    for (int cx = 0; cx < m_wDst; cx++)
+    {
+      const int offSrc = m_wSrc * cx / m_wDst + cySrcOff;
+      for (int c = 0; c < m_numChannels; c++)
+        m_colorSubSample[c * numPixelsDst + cx + cy * m_wDst] =
+          m_colorSrc[c * numPixelsSrc + offSrc];
+    } // for (cx)
+  } // for (cy)
+  _getLumaPlanes(m_colorSubSample, numPixelsDst, m_pixelsSubSample);
+  return 1;
+}
+
+int   Downsample2d::performBilateralColor()
+{
+  if (!_createTapsBilateral(&m_tapsBilateralX, &m_tapsBilateralY, m_wSrc,
+    m_hSrc, m_wDst, m_hDst, m_sigmaBilateralPos))
+    return 0;
+  const int isLuma = (m_colorWeights == DS_COLOR_WEIGHTS_LUMA) ? 1 : 0;
+  _performBilateralTapsColor(m_colorSrc, m_numChannels,
+    (isLuma) ? m_pixelsSrc : m_colorSrc, (isLuma) ? 1 : 3, m_wSrc, m_hSrc,
+    m_colorBilateral, m_wDst, m_hDst, m_tapsBilateralX, m_tapsBilateralY,
+    m_sigmaBilateralVal);
+  _getLumaPlanes(m_colorBilateral, m_wDst * m_hDst, m_pixelsBilateral);
+  return 1;
+}
+
+int   Downsample2d::performDownSampleColor()
+{
+  const float SIMPLE_KOEF =
+    1.0f / (2.0f * M_PI * SIMPLE_GAUSS_SIGMA * SIMPLE_GAUSS_SIGMA);
+  const float SIMPLE_KOEF_PIXEL =
+    SIMPLE_KOEF / (SIMPLE_GAUSS_RADIUS * SIMPLE_GAUSS_RADIUS);
+  if (!_createTaps(&m_tapsGaussX, &m_tapsGaussY, m_wSrc, m_hSrc, m_wDst,
+    m_hDst, SIMPLE_GAUSS_RADIUS, SIMPLE_KOEF_PIXEL))
+    return 0;
+  if (!_createTapsAdvanced(&m_tapsDownX, &m_tapsDownY, m_wSrc, m_hSrc,
+    m_wDst, m_hDst))
+    return 0;
+  const int numPixelsSrc = m_wSrc * m_hSrc;
+  const int numPixelsDst = m_wDst * m_hDst;
+  _performGaussTapsColor(m_colorSrc, m_numChannels, m_wSrc, m_hSrc,
+    m_colorGauss, m_wDst, m_hDst, m_tapsGaussX, m_tapsGaussY);
+  _getLumaPlanes(m_colorGauss, numPixelsDst, m_pixelsGauss);
+  setTilesValid(DS_METHOD_GAUSS, 1);
+
+  // guide: luminance or R, G, B with their restored images
+  const float *planesGuide = m_pixelsSrc;
+  const float *planesRestored = m_pixelsRestored;
+  int numGuide = 1;
+  const DsRect rectSrc = _getRect(0, 0, m_wSrc, m_hSrc);
+  if (m_colorWeights == DS_COLOR_WEIGHTS_LUMA)
+    _restoreBilinear(m_pixelsGauss, m_wDst, m_hDst, m_pixelsRestored, NULL,
+      HALF_FORMAT_FP16, m_wSrc, m_hSrc, rectSrc);
+  else
+  {
+    if (!m_colorRestored)
+      m_colorRestored = _allocImage(m_arena, 3 * numPixelsSrc);
+    if (!m_colorRestored)
+      return 0;
+    for (int g = 0; g < 3; g++)
+      _restoreBilinear(m_colorGauss + g * numPixelsDst, m_wDst, m_hDst,
+        m_colorRestored + g * numPixelsSrc, NULL, HALF_FORMAT_FP16, m_wSrc,
+        m_hSrc, rectSrc);
+    planesGuide = m_colorSrc;
+    planesRestored = m_colorRestored;
+    numGuide = 3;
+  }
+  _performAdvancedTapsColor(m_colorSrc, m_numChannels, planesGuide,
+    planesRestored, numGuide, m_wSrc, m_hSrc, m_colorGauss,
+    m_colorDownSampled, m_wDst, m_hDst, m_tapsDownX, m_tapsDownY, m_filter);
+  _getLumaPlanes(m_colorDownSampled, numPixelsDst, m_pixelsDownSampled);
+  return 1;
+}
+
+void  Downsample2d::packImageArgb(const float *imageColor,
+  MUint32 *pixelsArgb) const
+{
+  const int numPixelsDst = m_wDst * m_hDst;
+  for (int i = 0; i < numPixelsDst; i++)
+  {
+    MUint32 vals[DS_MAX_CHANNELS];
+    for (int c = 0; c < DS_MAX_CHANNELS; c++)
+    {
+      float val = (c < m_numChannels) ?
+        (imageColor[c * numPixelsDst + i] * 255.0f + 0.5f) : 255.0f;
+      val = (val >= 0.0f) ? val : 0.0f;
+      val = (val <= 255.0f) ? val : 255.0f;
+      vals[c] = (MUint32)val;
+    }
+    pixelsArgb[i] = (vals[3] << 24) | (vals[0] << 16) | (vals[1] << 8) |
+      vals[2];
+  }
+}
+
+//  *****************************************************************
+// Pyramid
+//  *****************************************************************
+
+int   Downsample2d::performPyramid(
+                                    const int             numLevels,
+                                    const DsPyramidMethod method
+                                  )
+{
+  if ((numLevels < 1) || (numLevels > DS_MAX_PYRAMID_LEVELS))
+    return 0;
+  if ((method != DS_PYRAMID_GAUSS) && (method != DS_PYRAMID_ADVANCED))
+    return 0;
+
+  // level sizes, all levels are in one buffer
+  int wLevel = m_wSrc;
+  int hLevel = m_hSrc;
+  int numPixelsAll = 0;
+  int level;
+  for (level = 0; level < numLevels; level++)
+  {
+    wLevel = (wLevel > 1) ? (wLevel / 2) : 1;
+    hLevel = (hLevel > 1) ? (hLevel / 2) : 1;
+    m_pyramidWidths[level] = wLevel;
+    m_pyramidHeights[level] = hLevel;
+    m_pyramidOffsets[level] = numPixelsAll;
+    numPixelsAll += wLevel * hLevel;
+  }
+  // buffer is kept for next calls, only more levels take new one: arena
+  // memory is not released until arena is rewound
+  if (numPixelsAll > m_numPixelsPyramid)
+  {
+    if (m_pixelsPyramid && !m_arena)
+      delete [] m_pixelsPyramid;
+    m_pixelsPyramid = _allocImage(m_arena, numPixelsAll);
+    m_numPixelsPyramid = (m_pixelsPyramid) ? numPixelsAll : 0;
+  }
+  m_numPyramidLevels = (m_pixelsPyramid) ? numLevels : 0;
+  if (!m_pixelsPyramid)
+    return 0;
+
+  // scratch: gauss of level and restored previous level, both are the
+  // largest for level 0. Restored image is 16 bit for compact storage
+  MemArenaFrame frame;
+  const int numPixelsFirst = m_pyramidWidths[0] * m_pyramidHeights[0];
+  const HalfFormat format = _getHalfFormat(m_storage);
+  const size_t sizeRestored = (size_t)m_wSrc * m_hSrc *
+    ((m_storage == DS_STORAGE_FLOAT) ? sizeof(float) : sizeof(MUint16));
+  float *pixelsGauss = (float*)frame.allocate(numPixelsFirst * sizeof(float));
+  void *pixelsRestored = frame.allocate(sizeRestored);
+  MUint64 *sumsFlat;
+  if (!pixelsGauss || !pixelsRestored ||
+      !_allocFlatBand(&frame, m_wSrc, m_flatTolerance, &sumsFlat))
+    return 0;
+  float *pixelsRestoredFloat = (m_storage == DS_STORAGE_FLOAT) ?
+    (float*)pixelsRestored : NULL;
+  const DsPlane restored = (pixelsRestoredFloat) ?
+    _getPlaneFloat(pixelsRestoredFloat) :
+    _getPlaneHalf((const MUint16*)pixelsRestored, format);
+
+  const float SIMPLE_KOEF =
+    1.0f / (2.0f * M_PI * SIMPLE_GAUSS_SIGMA * SIMPLE_GAUSS_SIGMA);
+  const float SIMPLE_KOEF_PIXEL =
+    SIMPLE_KOEF / (SIMPLE_GAUSS_RADIUS * SIMPLE_GAUSS_RADIUS);
+  PolyphaseTaps tapsX, tapsY;
+
+  // every level is made from previous one, only level 0 reads source
+  DsPlane pixelsPrev = _getPlaneSrc(m_pixelsSrc, m_bytesSrc);
+  int wPrev = m_wSrc;
+  int hPrev = m_hSrc;
+  for (level = 0; level < numLevels; level++)
+  {
+    const int w = m_pyramidWidths[level];
+    const int h = m_pyramidHeights[level];
+    float *pixelsLevel = m_pixelsPyramid + m_pyramidOffsets[level];
+    if (!_createTaps(&tapsX, &tapsY, wPrev, hPrev, w, h,
+      SIMPLE_GAUSS_RADIUS, SIMPLE_KOEF_PIXEL))
+      return 0;
+    const DsRect rect = _getRect(0, 0, w, h);
+    if (method == DS_PYRAMID_GAUSS)
+      _performGaussTaps(pixelsPrev, wPrev, hPrev, pixelsLevel, w, h, tapsX,
+        tapsY, rect);
+    else
+    {
+      _performGaussTaps(pixelsPrev, wPrev, hPrev, pixelsGauss, w, h, tapsX,
+        tapsY, rect);
+      if (!_restoreBilinear(pixelsGauss, w, h, pixelsRestoredFloat,
+        (MUint16*)pixelsRestored, format, wPrev, hPrev,
+        _getRect(0, 0, wPrev, hPrev)))
+        return 0;
+      if (!_createTapsAdvanced(&tapsX, &tapsY, wPrev, hPrev, w, h))
+        return 0;
+      // level 0 has 8 bit source for flat window test
+      _performAdvancedTaps(pixelsPrev, restored, wPrev, hPrev, pixelsGauss,
+        pixelsLevel, w, h, tapsX, tapsY, m_filter,
+        (level == 0) ? m_bytesSrc : NULL, m_flatTolerance, sumsFlat, rect);
+    }
+    pixelsPrev = _getPlaneFloat(pixelsLevel);
+    wPrev = w;
+    hPrev = h;
+  }   // for (level)
+  return 1;
+}
+
+//  *****************************************************************
+// Slice stacks
+//  *****************************************************************
+
+struct DsStackJob
+{
+  const MUint8        *m_slicesSrc;
+  MUint8              *m_slicesDst;
+  int                  m_numSlices;
+  int                  m_wSrc;
+  int                  m_hSrc;
+  int                  m_wDst;
+  int                  m_hDst;
+  DsMethod             m_method;
+  // gauss (bilateral for bilateral method) kernels
+  const PolyphaseTaps *m_tapsX;
+  const PolyphaseTaps *m_tapsY;
+  // gauss kernels of advanced method second pass
+  const PolyphaseTaps *m_tapsDownX;
+  const PolyphaseTaps *m_tapsDownY;
+  float                m_sigmaVal;
+  int                  m_medianRadius;
+  float                m_medianPercentile;
+  int                  m_guidedRadius;
+  float                m_guidedEps;
+  int                  m_fixedPoint;
+  int                  m_flatTolerance;
+  // set by any slice callback, read after the loop
+  std::atomic<int>     m_failed;
+};
+
+static inline MUint8 _getByte(const float val)
+{
+  float valByte = val * 255.0f + 0.5f;
+  valByte = (valByte >= 0.0f) ? valByte : 0.0f;
+  valByte = (valByte <= 255.0f) ? valByte : 255.0f;
+  return (MUint8)valByte;
+}
+
+// One slice by any method, scratch images are given by caller
+static int _performStackSlice(
+                              const DsStackJob *job,
+                              const MUint8     *sliceSrc,
+                              MUint8           *sliceDst,
+                              float            *pixelsSrc,
+                              float            *pixelsDst,
+                              float            *pixelsSmall,
+                              float            *pixelsRestored,
+                              float            *filter,
+                              MUint64          *sumsFlat
+                             )
+{
+  const int wSrc = job->m_wSrc;
+  const int hSrc = job->m_hSrc;
+  const int wDst = job->m_wDst;
+  const int hDst = job->m_hDst;
+  const int numPixelsSrc = wSrc * hSrc;
+  const int numPixelsDst = wDst * hDst;
+  int i;
+
+  // byte methods
+  if (job->m_method == DS_METHOD_SUBSAMPLE)
+  {
+    for (int cy = 0; cy < hDst; cy++)
+    {
+      const MUint8 *rowSrc = sliceSrc + (hSrc * cy / hDst) * wSrc;
+      for (int cx = 0; cx < wDst; cx++)
+        sliceDst[cx + cy * wDst] = rowSrc[wSrc * cx / wDst];
+    }
+    return 1;
+  }
+  if (job->m_method == DS_METHOD_MEDIAN)
+    return RankFilter::downsample2d(sliceSrc, wSrc, hSrc, sliceDst, wDst,
+      hDst, job->m_medianRadius, job->m_medianPercentile);
+
+  if (job->m_fixedPoint && (job->m_method != DS_METHOD_GUIDED))
+  {
+    // Q8 images take the first halves of float scratch images
+    MUint16 *pixelsDstQ8 = (MUint16*)pixelsDst;
+    if (job->m_method == DS_METHOD_GAUSS)
+    {
+      if (!_performGaussFixed(sliceSrc, wSrc, hSrc, pixelsDstQ8, wDst, hDst,
+        *job->m_tapsX, *job->m_tapsY))
+        return -1;
+    }
+    else if (job->m_method == DS_METHOD_BILATERAL)
+      _performBilateralFixed(sliceSrc, wSrc, hSrc, pixelsDstQ8, wDst, hDst,
+        *job->m_tapsX, *job->m_tapsY, job->m_sigmaVal);
+    else if (!_performDownSampleFixed(sliceSrc, (MUint16*)pixelsRestored,
+      wSrc, hSrc, (MUint16*)pixelsSmall, pixelsDstQ8, wDst, hDst,
+      *job->m_tapsX, *job->m_tapsY, *job->m_tapsDownX, *job->m_tapsDownY,
+      job->m_flatTolerance, sumsFlat))
+      return -1;
+    for (i = 0; i < numPixelsDst; i++)
+      sliceDst[i] = _getByteQ8(pixelsDstQ8[i]);
+    return 1;
+  }
+  // kernels read bytes of slice, guided filter needs float image
+  const DsPlane src = _getPlaneBytes(sliceSrc);
+  const DsRect rect = _getRect(0, 0, wDst, hDst);
+  switch (job->m_method)
+  {
+    case DS_METHOD_GAUSS:
+      _performGaussTaps(src, wSrc, hSrc, pixelsDst, wDst, hDst,
+        *job->m_tapsX, *job->m_tapsY, rect);
+      break;
+    case DS_METHOD_BILATERAL:
+      _performBilateralTaps(src, wSrc, hSrc, pixelsDst, wDst, hDst,
+        *job->m_tapsX, *job->m_tapsY, job->m_sigmaVal, rect);
+      break;
+    case DS_METHOD_ADVANCED:
+      _performGaussTaps(src, wSrc, hSrc, pixelsSmall, wDst, hDst,
+        *job->m_tapsX, *job->m_tapsY, rect);
+      _restoreBilinear(pixelsSmall, wDst, hDst, pixelsRestored, NULL,
+        HALF_FORMAT_FP16, wSrc, hSrc, _getRect(0, 0, wSrc, hSrc));
+      _performAdvancedTaps(src, _getPlaneFloat(pixelsRestored), wSrc, hSrc,
+        pixelsSmall, pixelsDst, wDst, hDst, *job->m_tapsDownX,
+        *job->m_tapsDownY, filter, sliceSrc, job->m_flatTolerance, sumsFlat,
+        rect);
+      break;
+    case DS_METHOD_GUIDED:
+      for (i = 0; i < numPixelsSrc; i++)
+        pixelsSrc[i] = sliceSrc[i] * (1.0f / 255.0f);
+      if (GuidedFilter::downsample2d(pixelsSrc, wSrc, hSrc, pixelsDst, wDst,
+        hDst, job->m_guidedRadius, job->m_guidedEps) < 0)
+        return -1;
+      break;
+    default:
+      assert(job->m_method < -5555);
+      return -1;
+  }
+  for (i = 0; i < numPixelsDst; i++)
+    sliceDst[i] = _getByte(pixelsDst[i]);
+  return 1;
+}
+
+static void _stackCallback(
+                            void       *userData,
+                            const int   itemStart,
+                            const int   itemEnd
+                          )
+{
+  DsStackJob *job = (DsStackJob*)userData;
+  const int numPixelsSrc = job->m_wSrc * job->m_hSrc;
+  const int numPixelsDst = job->m_wDst * job->m_hDst;
+  // scratch is taken once for all slices of chunk, as one block:
+  // sums of flat window test, then float images
+  MemArenaFrame frame;
+  const size_t numSums = 2 * ((size_t)job->m_wSrc + 1);
+  const size_t numFloats = 2 * (size_t)numPixelsSrc +
+    2 * (size_t)numPixelsDst + DS_MAX_NEIB_DIA * DS_MAX_NEIB_DIA;
+  MUint64 *sums = (MUint64*)frame.allocate(numSums * sizeof(MUint64) +
+    numFloats * sizeof(float));
+  if (!sums)
+  {
+    job->m_failed = 1;
+    return;
+  }
+  MUint64 *sumsFlat = (job->m_flatTolerance >= 0) ? sums : NULL;
+  float *pixelsSrc = (float*)(sums + numSums);
+  float *pixelsRestored = pixelsSrc + numPixelsSrc;
+  float *pixelsDst = pixelsRestored + numPixelsSrc;
+  float *pixelsSmall = pixelsDst + numPixelsDst;
+  float *filter = pixelsSmall + numPixelsDst;
+  for (int s = itemStart; s < itemEnd; s++)
+  {
+    const int ok = _performStackSlice(job,
+      job->m_slicesSrc + (size_t)s * numPixelsSrc,
+      job->m_slicesDst + (size_t)s * numPixelsDst,
+      pixelsSrc, pixelsDst, pixelsSmall, pixelsRestored, filter, sumsFlat);
+    if (ok < 0)
+      job->m_failed = 1;
+  }
+}
+
+// Gauss of DS_STACK_LANES interleaved slices, the same operations as
+// _performGaussTaps for every lane
+static void _performGaussTapsLanes(
+                                    const float         *pixelsSrc,
+                                    const int            wSrc,
+                                    const int            hSrc,
+                                    float               *pixelsDst,
+                                    const int            wDst,
+                                    const int            hDst,
+                                    const PolyphaseTaps &tapsX,
+                                    const PolyphaseTaps &tapsY
+                                  )
+{
+  const int numTaps = tapsX.getNumTaps();
+  for (int cy = 0; cy < hDst; cy++)
+  {
+    const int yFirst = tapsY.getFirst(cy);
+    const float *weightsY = tapsY.getWeights(cy);
+    int kyStart, kyEnd;
+    _getTapsRange(yFirst, numTaps, hSrc, &kyStart, &kyEnd);
+    float sumWeightsY = 0.0f;
+    int kx, ky;
+    for (ky = kyStart; ky < kyEnd; ky++)
+      sumWeightsY += weightsY[ky];
+
+    for (int cx = 0; cx < wDst; cx++)
+    {
+      const int xFirst = tapsX.getFirst(cx);
+      const float *weightsX = tapsX.getWeights(cx);
+      int kxStart, kxEnd;
+      _getTapsRange(xFirst, numTaps, wSrc, &kxStart, &kxEnd);
+      float sumWeightsX = 0.0f;
+      for (kx = kxStart; kx < kxEnd; kx++)
+        sumWeightsX += weightsX[kx];
+      const float sumWeights = sumWeightsX * sumWeightsY;
+      float *dst = pixelsDst + (cx + cy * wDst) * DS_STACK_LANES;
+
+#if defined(DS_USE_SSE2)
+      __m128 sum = _mm_setzero_ps();
+      for (ky = kyStart; ky < kyEnd; ky++)
+      {
+        const float *row = pixelsSrc +
+          ((yFirst + ky) * wSrc + xFirst) * DS_STACK_LANES;
+        __m128 sumRow = _mm_setzero_ps();
+        for (kx = kxStart; kx < kxEnd; kx++)
+          sumRow = _mm_add_ps(sumRow, _mm_mul_ps(
+            _mm_loadu_ps(row + kx * DS_STACK_LANES),
+            _mm_set1_ps(weightsX[kx])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(sumRow, _mm_set1_ps(weightsY[ky])));
+      }  // for (ky)
+      _mm_storeu_ps(dst, _mm_div_ps(sum, _mm_set1_ps(sumWeights)));
+#else
+      float sum[DS_STACK_LANES];
+      int l;
+      for (l = 0; l < DS_STACK_LANES; l++)
+        sum[l] = 0.0f;
+      for (ky = kyStart; ky < kyEnd; ky++)
+      {
+        const float *row = pixelsSrc +
+          ((yFirst + ky) * wSrc + xFirst) * DS_STACK_LANES;
+        float sumRow[DS_STACK_LANES];
+        for (l = 0; l < DS_STACK_LANES; l++)
+          sumRow[l] = 0.0f;
+        for (kx = kxStart; kx < kxEnd; kx++)
+          for (l = 0; l < DS_STACK_LANES; l++)
+            sumRow[l] += row[kx * DS_STACK_LANES + l] * weightsX[kx];
+        for (l = 0; l < DS_STACK_LANES; l++)
+          sum[l] += sumRow[l] * weightsY[ky];
+      }  // for (ky)
+      for (l = 0; l < DS_STACK_LANES; l++)
+        dst[l] = sum[l] / sumWeights;
+#endif
+    } // for (cx)
+  }  // for (cy)
+}
+
+// Gauss of interleaved slice groups: item is group of DS_STACK_LANES slices
+static void _stackLanesCallback(
+                                void       *userData,
+                                const int   itemStart,
+                                const int   itemEnd
+                              )
+{
+  DsStackJob *job = (DsStackJob*)userData;
+  const int numPixelsSrc = job->m_wSrc * job->m_hSrc;
+  const int numPixelsDst = job->m_wDst * job->m_hDst;
+  MemArenaFrame frame;
+  float *pixelsSrc = (float*)frame.allocate(numPixelsSrc * DS_STACK_LANES *
+    sizeof(float));
+  float *pixelsDst = (float*)frame.allocate(numPixelsDst * DS_STACK_LANES *
+    sizeof(float));
+  if (!pixelsSrc || !pixelsDst)
+  {
+    job->m_failed = 1;
+    return;
+  }
+  for (int group = itemStart; group < itemEnd; group++)
+  {
+    const int sliceFirst = group * DS_STACK_LANES;
+    int numLanes = job->m_numSlices - sliceFirst;
+    numLanes = (numLanes < DS_STACK_LANES) ? numLanes : DS_STACK_LANES;
+    int i, l;
+    // missed lanes of last group repeat its first slice
+    for (l = 0; l < DS_STACK_LANES; l++)
+    {
+      const MUint8 *sliceSrc = job->m_slicesSrc +
+        (size_t)(sliceFirst + ((l < numLanes) ? l : 0)) * numPixelsSrc;
+      for (i = 0; i < numPixelsSrc; i++)
+        pixelsSrc[i * DS_STACK_LANES + l] = sliceSrc[i] * (1.0f / 255.0f);
+    }
+    _performGaussTapsLanes(pixelsSrc, job->m_wSrc, job->m_hSrc, pixelsDst,
+      job->m_wDst, job->m_hDst, *job->m_tapsX, *job->m_tapsY);
+    for (l = 0; l < numLanes; l++)
+    {
+      MUint8 *sliceDst = job->m_slicesDst +
+        (size_t)(sliceFirst + l) * numPixelsDst;
+      for (i = 0; i < numPixelsDst; i++)
+        sliceDst[i] = _getByte(pixelsDst[i * DS_STACK_LANES + l]);
+    }
+  }   // for (group)
+}
+
+int   Downsample2d::performStack(
+                                  const MUint8   *slicesSrc,
+                                  const int       wSrc,
+                                  const int       hSrc,
+                                  const int       numSlices,
+                                  MUint8         *slicesDst,
+                                  const int       wDst,
+                                  const int       hDst,
+                                  const DsMethod  method
+                                )
+{
+  if ((wSrc <= 0) || (hSrc <= 0) || (numSlices <= 0) || (wDst <= 0) ||
+      (hDst <= 0) || (method < 0) || (method >= DS_METHOD_COUNT))
+    return 0;
+
+  DsStackJob job;
+  job.m_slicesSrc         = slicesSrc;
+  job.m_slicesDst         = slicesDst;
+  job.m_numSlices         = numSlices;
+  job.m_wSrc              = wSrc;
+  job.m_hSrc              = hSrc;
+  job.m_wDst              = wDst;
+  job.m_hDst              = hDst;
+  job.m_method            = method;
+  job.m_tapsX             = &m_tapsGaussX;
+  job.m_tapsY             = &m_tapsGaussY;
+  job.m_tapsDownX         = &m_tapsDownX;
+  job.m_tapsDownY         = &m_tapsDownY;
+  job.m_sigmaVal          = m_sigmaBilateralVal;
+  job.m_medianRadius      = m_medianRadius;
+  job.m_medianPercentile  = m_medianPercentile;
+  job.m_guidedRadius      = m_guidedRadius;
+  job.m_guidedEps         = m_guidedEps;
+  job.m_fixedPoint        = m_fixedPoint;
+  job.m_flatTolerance     = m_flatTolerance;
+  job.m_failed            = 0;
+
+  // kernel tables are built once for all slices
+  const float SIMPLE_KOEF =
+    1.0f / (2.0f * M_PI * SIMPLE_GAUSS_SIGMA * SIMPLE_GAUSS_SIGMA);
+  const float SIMPLE_KOEF_PIXEL =
+    SIMPLE_KOEF / (SIMPLE_GAUSS_RADIUS * SIMPLE_GAUSS_RADIUS);
+  int ok = 1;
+  if ((method == DS_METHOD_GAUSS) || (method == DS_METHOD_ADVANCED))
+    ok = _createTaps(&m_tapsGaussX, &m_tapsGaussY, wSrc, hSrc, wDst, hDst,
+      SIMPLE_GAUSS_RADIUS, SIMPLE_KOEF_PIXEL);
+  if (ok && (method == DS_METHOD_ADVANCED))
+    ok = _createTapsAdvanced(&m_tapsDownX, &m_tapsDownY, wSrc, hSrc, wDst,
+      hDst);
+  if (method == DS_METHOD_BILATERAL)
+  {
+    ok = _createTapsBilateral(&m_tapsBilateralX, &m_tapsBilateralY, wSrc,
+      hSrc, wDst, hDst, m_sigmaBilateralPos);
+    job.m_tapsX = &m_tapsBilateralX;
+    job.m_tapsY = &m_tapsBilateralY;
+  }
+  if (!ok)
+    return 0;
+
+  // fixed point gauss goes slice by slice
+  if ((method == DS_METHOD_GAUSS) && m_stackInterleave && !m_fixedPoint)
+  {
+    const int numGroups = (numSlices + DS_STACK_LANES - 1) / DS_STACK_LANES;
+    Parallel::forRange(numGroups, _stackLanesCallback, &job, 1);
+  }
+  else
+    Parallel::forRange(numSlices, _stackCallback, &job, 1);
+  return job.m_failed ? 0 : 1;
+}
+
+int   Downsample2d::performStack(
+                                  const KtxTexture *tex,
+                                  MUint8           *slicesDst,
+                                  const int         wDst,
+                                  const int         hDst,
+                                  const DsMethod    method
+                                )
+{
+  if (tex->getGlFormat() != KTX_GL_RED)
+    return 0;
+  // 2d texture has zero depth
+  const int numSlices = (tex->getDepth() > 0) ? tex->getDepth() : 1;
+  return performStack(tex->getData(), tex->getWidth(), tex->getHeight(),
+    numSlices, slicesDst, wDst, hDst, method);
+}
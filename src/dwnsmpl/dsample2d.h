@@ -11,6 +11,9 @@
 //  *****************************************************************
 
 #include "mtypes.h"
+#include "arena.h"
+#include "halffloat.h"
+#include "polyphase.h"
 
 //  *****************************************************************
 //  Defines
@@ -23,18 +26,74 @@
 #define DS_MAX_NEIB_RAD      12
 #define DS_MAX_NEIB_DIA      (2 * DS_MAX_NEIB_RAD + 1)
 
+// max number of pyramid levels
+#define DS_MAX_PYRAMID_LEVELS   16
+
+// slices processed together by interleaved (SoA) stack gauss
+#define DS_STACK_LANES          4
+
+// max number of planes of colour image
+#define DS_MAX_CHANNELS         4
+
+// side of destination tiles kept by performRegion
+#define DS_TILE_SIZE            64
+
 
 //  *****************************************************************
 //  Types
 //  *****************************************************************
 
+// how every pyramid level is made from previous one
+enum DsPyramidMethod
+{
+  DS_PYRAMID_GAUSS      = 0,
+  DS_PYRAMID_ADVANCED   = 1
+};
+
+// method applied to every slice of stack
+enum DsMethod
+{
+  DS_METHOD_SUBSAMPLE   = 0,
+  DS_METHOD_GAUSS       = 1,
+  DS_METHOD_BILATERAL   = 2,
+  DS_METHOD_ADVANCED    = 3,
+  DS_METHOD_MEDIAN      = 4,
+  DS_METHOD_GUIDED      = 5,
+
+  DS_METHOD_COUNT
+};
+
+// storage of source size images
+enum DsStorage
+{
+  DS_STORAGE_FLOAT      = 0,
+  DS_STORAGE_FP16       = 1,
+  DS_STORAGE_BFLOAT16   = 2
+};
+
+// what adaptive weights of colour image are computed from
+enum DsColorWeights
+{
+  DS_COLOR_WEIGHTS_LUMA     = 0,
+  DS_COLOR_WEIGHTS_VECTOR   = 1
+};
+
+class KtxTexture;
+
 //  *****************************************************************
 //  Classes
 //  *****************************************************************
 
 /**
 * \class Downsample2d used for different 2d image downsampling
-* approaches
+* approaches.
+* Gauss, bilateral and advanced methods center kernels at true source
+* position of destination pixel center, (x + 0.5) * wSrc / wDst - 0.5,
+* and take gauss weights from per phase tables (see PolyphaseTaps).
+* Method images are computed lazily: getters of destination images
+* compute method on first access, parameter setters invalidate only
+* methods depending on changed parameter, so next access recomputes
+* them. perform* calls always compute.
 */
 
 class Downsample2d
@@ -43,12 +102,60 @@ public:
   Downsample2d();
   ~Downsample2d();
 
-  int     create(const int wSrc, const int hSrc, const MUint32 *pixels, const int wDst, const int hDst);
+  // If arena is given, all images are taken from it and stay valid
+  // until arena is rewound or reset (destroy() does not free them)
+  int     create(const int wSrc, const int hSrc, const MUint32 *pixels, const int wDst, const int hDst,
+                 MemArena *arena = NULL);
   void    destroy();
 
+  // Storage of source size images, used by next create().
+  // Float source and restored image take 8 bytes per source pixel.
+  // FP16 and bfloat16 keep no float source (methods read 8 bit copy
+  // of it, getImageSrc() returns NULL) and store restored image of
+  // advanced method in 16 bits: 2 bytes per pixel. Arithmetic stays
+  // in float, so only advanced method (and pyramid) results change:
+  // by about 0.1 grey level for FP16, up to 1 for bfloat16
+  DsStorage getStorage() const {
+    return m_storage;
+  }
+  void      setStorage(const DsStorage storage) {
+    m_storage = storage;
+  }
+  // Number of channels taken from ARGB source by next create():
+  // 1 (blue byte, default), 3 (R, G, B) or 4 (R, G, B, A).
+  // Colour images are planar: channel c of pixel i is [c * w * h + i].
+  // Subsample, bilateral and advanced methods compute value weights
+  // once per source sample (see setColorWeights) and apply them to
+  // all channels in one pass; gauss of colour image comes with
+  // advanced method. Grey images of these methods get luminance
+  // of colour results. Colour needs float storage. Fixed point,
+  // median, guided, pyramid and stack methods work on luminance
+  int       getNumChannels() const {
+    return m_numChannels;
+  }
+  void      setNumChannels(const int numChannels) {
+    m_numChannels = numChannels;
+  }
+  // Luma: weights from luminance difference (the same as grey image).
+  // Vector: from mean squared R, G, B difference, keeps edges between
+  // colours of equal luminance
+  DsColorWeights getColorWeights() const {
+    return m_colorWeights;
+  }
+  void      setColorWeights(const DsColorWeights colorWeights) {
+    if (colorWeights != m_colorWeights)
+    {
+      setTilesValid(DS_METHOD_BILATERAL, 0);
+      setTilesValid(DS_METHOD_ADVANCED, 0);
+    }
+    m_colorWeights = colorWeights;
+  }
+
   int     getWidthSrc() const {
     return m_wSrc;
   }
+  // NULL for 16 bit storage. Methods taking source image take NULL
+  // as own source
   float *getImageSrc() const {
     return m_pixelsSrc;
   }
@@ -57,18 +164,58 @@ public:
     return m_hSrc;
   }
 
-  float *getImageSubSample() const {
-    return m_pixelsSubSample;
+  // method images below are computed here if not valid, NULL if
+  // computation fails (no memory)
+  float *getImageSubSample() {
+    return updateMethod(DS_METHOD_SUBSAMPLE) ? m_pixelsSubSample : NULL;
   }
 
-  float   *getImageGauss() const {
-    return m_pixelsGauss;
+  // gauss is the fast one, also made by advanced method
+  float   *getImageGauss() {
+    return updateMethod(DS_METHOD_GAUSS) ? m_pixelsGauss : NULL;
+  }
+  float   *getImageBilaterail() {
+    return updateMethod(DS_METHOD_BILATERAL) ? m_pixelsBilateral : NULL;
+  }
+  float   *getImageDownSampled() {
+    return updateMethod(DS_METHOD_ADVANCED) ? m_pixelsDownSampled : NULL;
+  }
+  float   *getImageMedian() {
+    return updateMethod(DS_METHOD_MEDIAN) ? m_pixelsMedian : NULL;
+  }
+  float   *getImageGuided() {
+    return updateMethod(DS_METHOD_GUIDED) ? m_pixelsGuided : NULL;
   }
-  float   *getImageBilaterail() const {
-    return m_pixelsBilateral;
+  // planar colour images, NULL for 1 channel
+  float   *getImageColorSubSample() {
+    return updateMethod(DS_METHOD_SUBSAMPLE) ? m_colorSubSample : NULL;
   }
-  float   *getImageDownSampled() const {
-    return m_pixelsDownSampled;
+  float   *getImageColorGauss() {
+    return updateMethod(DS_METHOD_ADVANCED) ? m_colorGauss : NULL;
+  }
+  float   *getImageColorBilateral() {
+    return updateMethod(DS_METHOD_BILATERAL) ? m_colorBilateral : NULL;
+  }
+  float   *getImageColorDownSampled() {
+    return updateMethod(DS_METHOD_ADVANCED) ? m_colorDownSampled : NULL;
+  }
+  // Destination size colour image into ARGB pixels, alpha is 0xff
+  // for 3 channels
+  void      packImageArgb(const float *imageColor,
+                          MUint32 *pixelsArgb) const;
+  // pyramid level 0 is half of source, every next level is half
+  // of previous one
+  int       getNumPyramidLevels() const {
+    return m_numPyramidLevels;
+  }
+  float   *getImagePyramid(const int level) const {
+    return m_pixelsPyramid + m_pyramidOffsets[level];
+  }
+  int       getWidthPyramid(const int level) const {
+    return m_pyramidWidths[level];
+  }
+  int       getHeightPyramid(const int level) const {
+    return m_pyramidHeights[level];
   }
 
   float     getSigmaBilateralPos() const {
@@ -78,43 +225,244 @@ public:
     return m_sigmaBilateralVal;
   }
   void      setSigmaBilateralPos(const float sigma) {
+    if (sigma != m_sigmaBilateralPos)
+      setTilesValid(DS_METHOD_BILATERAL, 0);
     m_sigmaBilateralPos = sigma;
   }
   void      setSigmaBilateralVal(const float sigma) {
+    if (sigma != m_sigmaBilateralVal)
+      setTilesValid(DS_METHOD_BILATERAL, 0);
     m_sigmaBilateralVal = sigma;
   }
+  // median (percentile) window radius, 0 is auto (by size ratio)
+  int       getMedianRadius() const {
+    return m_medianRadius;
+  }
+  void      setMedianRadius(const int radius) {
+    if (radius != m_medianRadius)
+      setTilesValid(DS_METHOD_MEDIAN, 0);
+    m_medianRadius = radius;
+  }
+  // 0.5 is median
+  float     getMedianPercentile() const {
+    return m_medianPercentile;
+  }
+  void      setMedianPercentile(const float percentile) {
+    if (percentile != m_medianPercentile)
+      setTilesValid(DS_METHOD_MEDIAN, 0);
+    m_medianPercentile = percentile;
+  }
+  // guided filter window radius, 0 is auto (by size ratio)
+  int       getGuidedRadius() const {
+    return m_guidedRadius;
+  }
+  void      setGuidedRadius(const int radius) {
+    if (radius != m_guidedRadius)
+      setTilesValid(DS_METHOD_GUIDED, 0);
+    m_guidedRadius = radius;
+  }
+  // guided filter regularization, larger value smooths stronger edges
+  float     getGuidedEps() const {
+    return m_guidedEps;
+  }
+  void      setGuidedEps(const float eps) {
+    if (eps != m_guidedEps)
+      setTilesValid(DS_METHOD_GUIDED, 0);
+    m_guidedEps = eps;
+  }
+  // stack gauss processes DS_STACK_LANES interleaved slices at once,
+  // so SIMD lanes map to slices (on by default)
+  int       getStackInterleave() const {
+    return m_stackInterleave;
+  }
+  void      setStackInterleave(const int interleave) {
+    m_stackInterleave = interleave;
+  }
+  // gauss, bilateral and advanced methods (also for stacks) run in
+  // integer arithmetic on 8 bit source: Q14 kernel weights, 16 bit
+  // intermediate images with 8 fractional bits, table of bilateral value
+  // weights. Off by default. Results differ from float ones by at most
+  // 1 grey level, except for advanced method windows equal to restored
+  // image, which take gauss value instead of undefined 0 / 0
+  int       getFixedPoint() const {
+    return m_fixedPoint;
+  }
+  void      setFixedPoint(const int fixedPoint) {
+    if (fixedPoint != m_fixedPoint)
+    {
+      setTilesValid(DS_METHOD_GAUSS, 0);
+      setTilesValid(DS_METHOD_BILATERAL, 0);
+      setTilesValid(DS_METHOD_ADVANCED, 0);
+    }
+    m_fixedPoint = fixedPoint;
+  }
+  // advanced method (also fixed point, pyramid level 0 and stacks)
+  // takes source windows with standard deviation up to tolerance grey
+  // levels as flat: result is window mean, adaptive filter is skipped.
+  // Window variance comes from row prefix sums of 8 bit source.
+  // 0 (default) takes only constant windows, so results do not change;
+  // negative value turns the test off. Colour images are not tested
+  int       getFlatTolerance() const {
+    return m_flatTolerance;
+  }
+  void      setFlatTolerance(const int tolerance) {
+    if (tolerance != m_flatTolerance)
+      setTilesValid(DS_METHOD_ADVANCED, 0);
+    m_flatTolerance = tolerance;
+  }
 
   int   performDownSamplingAll();
+  // Same for methods of performDownSamplingAll not valid now, e.g.
+  // only bilateral one after bilateral sigma change
+  int   updateDownSamplingAll();
   int   performGaussSlow(const float *pixelsSrc, float *pixelsDst);
   int   performGaussFast(const float *pixelsSrc, float *pixelsDst);
+  // Median and guided methods are not a part of performDownSamplingAll.
+  // Rank based (median / percentile) downsampling, see RankFilter
+  int   performMedian();
+  // edge preserving guided filter downsampling, see GuidedFilter.
+  // Bilateral alternative, cost does not depend on radius
+  int   performGuided();
+  // numLevels halved images in one call, see getImagePyramid.
+  // Every level is made from previous level by gauss or advanced
+  // method, so full resolution source is read only once.
+  // Independent of destination size given to create
+  int   performPyramid(const int numLevels,
+                       const DsPyramidMethod method = DS_PYRAMID_ADVANCED);
+  // Downsample every slice of 8 bit stack (numSlices slices of
+  // wSrc * hSrc one after another) into caller stack of wDst * hDst
+  // slices. Does not need create(). Kernel tables and parameters
+  // (sigmas, median and guided settings) are shared by all slices,
+  // slices go to worker threads with scratch images from thread arenas,
+  // nothing is allocated per slice
+  int   performStack(const MUint8 *slicesSrc, const int wSrc,
+                     const int hSrc, const int numSlices,
+                     MUint8 *slicesDst, const int wDst, const int hDst,
+                     const DsMethod method);
+  // Same for all slices of 1 byte per voxel texture
+  int   performStack(const KtxTexture *tex, MUint8 *slicesDst,
+                     const int wDst, const int hDst,
+                     const DsMethod method);
+  // Compute only destination rectangle [xDst, xDst + wRegion) *
+  // [yDst, yDst + hRegion) of subsample, gauss, bilateral or advanced
+  // method image, for viewport. Rectangle is extended to tiles of
+  // DS_TILE_SIZE pixels, tiles computed before (by region or by whole
+  // method) are kept and reused, so panning computes new tiles only.
+  // Advanced method reads and restores source window of tile (with
+  // halo) only. Values are the same as of whole image method (gauss
+  // is the fast one). Returns 0 for other methods, colour images, fixed
+  // point or rectangle out of image
+  int   performRegion(const DsMethod method, const int xDst,
+                      const int yDst, const int wRegion,
+                      const int hRegion);
+  // Forget computed tiles of all methods, so all images are computed
+  // again on access. Needed after source image is changed in place,
+  // parameter setters invalidate dependent methods themselves
+  void  invalidateTiles();
+  // Take source rectangle [xSrc, xSrc + wRegion) * [ySrc, ySrc + hRegion)
+  // from pixels (whole source image of create size, the rest is not
+  // read). Valid subsample, gauss, bilateral and advanced images get
+  // only destination pixels with kernel footprint intersecting the
+  // rectangle computed again, advanced one through gauss pixels and
+  // their restored source pixels. Partially computed images forget
+  // changed tiles. Median, guided, colour and fixed point images are
+  // invalidated as a whole, pyramid is not changed.
+  // Returns 0 for rectangle out of image or no memory
+  int   updateSource(const MUint32 *pixels, const int xSrc,
+                     const int ySrc, const int wRegion, const int hRegion);
 
 protected:
   int   performSubSample();
   int   performBilateral();
   int   performDownSample();
+  int   performDownSampleFixed();
+  int   performSubSampleColor();
+  int   performBilateralColor();
+  int   performDownSampleColor();
 
 private:
+  // mark all tiles of method computed (valid = 1) or not
+  void  setTilesValid(const DsMethod method, const int valid);
+  // 1 if all tiles of method are computed
+  int   isMethodValid(const DsMethod method) const;
+  // compute tiles of method not valid now
+  int   updateMethod(const DsMethod method);
+
   int       m_wSrc;
   int       m_hSrc;
 
   int       m_wDst;
   int       m_hDst;
 
+  // images owner, NULL for heap
+  MemArena *m_arena;
+
   // source image float repsentation [0..1]
   float    *m_pixelsSrc;
+  // source image bytes, for fixed point methods
+  MUint8   *m_bytesSrc;
 
   float    *m_pixelsSubSample;
   float    *m_pixelsGauss;
   float    *m_pixelsBilateral;
   float    *m_pixelsDownSampled;
   float    *m_pixelsRestored;
+  // restored image for 16 bit storage
+  MUint16  *m_halfRestored;
+  float    *m_pixelsMedian;
+  float    *m_pixelsGuided;
+
+  // planar colour images of numChannels planes, NULL for 1 channel
+  int       m_numChannels;
+  DsColorWeights m_colorWeights;
+  float    *m_colorSrc;
+  float    *m_colorSubSample;
+  float    *m_colorGauss;
+  float    *m_colorBilateral;
+  float    *m_colorDownSampled;
+  // R, G, B restored images of vector weights, made on first use
+  float    *m_colorRestored;
+
+  // computed flags of destination tiles, DS_METHOD_COUNT sets of
+  // m_numTilesX * m_numTilesY
+  MUint8   *m_tilesValid;
+  int       m_numTilesX;
+  int       m_numTilesY;
+
+  // all pyramid levels in one buffer of m_numPixelsPyramid floats
+  float    *m_pixelsPyramid;
+  int       m_numPixelsPyramid;
+  int       m_numPyramidLevels;
+  int       m_pyramidWidths[DS_MAX_PYRAMID_LEVELS];
+  int       m_pyramidHeights[DS_MAX_PYRAMID_LEVELS];
+  int       m_pyramidOffsets[DS_MAX_PYRAMID_LEVELS];
+
+  int       m_stackInterleave;
+  int       m_fixedPoint;
+  int       m_flatTolerance;
+  DsStorage m_storage;
 
   float     m_sigmaBilateralPos;
   float     m_sigmaBilateralVal;
 
+  int       m_medianRadius;
+  float     m_medianPercentile;
+
+  int       m_guidedRadius;
+  float     m_guidedEps;
+
   // store precalculated neib pixel weights here
   float     m_filter[DS_MAX_NEIB_DIA * DS_MAX_NEIB_DIA];
 
+  // per phase gauss kernels of gauss, bilateral and advanced methods,
+  // rebuilt only when sizes or parameters change
+  PolyphaseTaps m_tapsGaussX;
+  PolyphaseTaps m_tapsGaussY;
+  PolyphaseTaps m_tapsBilateralX;
+  PolyphaseTaps m_tapsBilateralY;
+  PolyphaseTaps m_tapsDownX;
+  PolyphaseTaps m_tapsDownY;
+
 };
 
 #endif
@@ -11,6 +11,8 @@
 #include <time.h>
 #include <assert.h>
 
+#include <new>
+
 
 // disable warning 'hides class member' for GdiPlus
 #pragma warning( push )
@@ -34,6 +36,13 @@
 #include "volume.h"
 #include "dump.h"
 #include "memtrack.h"
+#include "arena.h"
+#include "pnmio.h"
+#include "parallel.h"
+#include "volview.h"
+#include "reslice.h"
+#include "rankfilter.h"
+#include "guided.h"
 
 #include "imgload.h"
 
@@ -401,6 +410,2612 @@ DESCRIBE(testLoadVolume, "void testLoadVolume()")
 
 END_DESCRIBE
 
+DESCRIBE(testKtxSize64, "void testKtxSize64()")
+  IT("load volume with 64 bit image size field")
+  {
+    const int DIM = 24;
+    const char *fileName = "test_size64.ktx";
+    const size_t SIZE_VOLUME = DIM * DIM * DIM;
+    KtxTexture *volSrc = M_NEW(KtxTexture);
+    volSrc->createAsSingleSphere(DIM);
+
+    // take header from usual 32 bit size file
+    FILE *file = fopen(fileName, "wb");
+    KtxError err = volSrc->saveToFileContent(file);
+    fclose(file);
+    SHOULD_BE_TRUE(err == KTX_ERROR_OK);
+    KtxHeader header;
+    file = fopen(fileName, "rb");
+    const size_t numRead = fread(&header, 1, sizeof(header), file);
+    fclose(file);
+    SHOULD_BE_TRUE(numRead == sizeof(header));
+
+    // large volume layout: header, KTX_IMAGE_SIZE_64, 64 bit size, voxels
+    const MUint32 sizeMarker = KTX_IMAGE_SIZE_64;
+    const MUint64 sizeVolume = SIZE_VOLUME;
+    file = fopen(fileName, "wb");
+    fwrite(&header, 1, sizeof(header), file);
+    fwrite(&sizeMarker, 1, sizeof(sizeMarker), file);
+    fwrite(&sizeVolume, 1, sizeof(sizeVolume), file);
+    fwrite(volSrc->getData(), 1, SIZE_VOLUME, file);
+    fclose(file);
+
+    KtxTexture *volDst = M_NEW(KtxTexture);
+    file = fopen(fileName, "rb");
+    err = volDst->loadFromFileContent(file);
+    fclose(file);
+    SHOULD_BE_TRUE(err == KTX_ERROR_OK);
+    SHOULD_BE_TRUE(volDst->getDataSize() == SIZE_VOLUME);
+    const int cmp = memcmp(volDst->getData(), volSrc->getData(), SIZE_VOLUME);
+    SHOULD_EQUAL(cmp, 0);
+
+    delete volDst;
+    delete volSrc;
+    remove(fileName);
+  }
+  END_IT
+
+  IT("reject image size which does not match dimensions")
+  {
+    const int DIM = 16;
+    const char *fileName = "test_size_wrong.ktx";
+    KtxTexture *volSrc = M_NEW(KtxTexture);
+    volSrc->createAsSingleSphere(DIM);
+    // one slice less than header says
+    volSrc->setDepth(DIM - 1);
+    FILE *file = fopen(fileName, "wb");
+    KtxError err = volSrc->saveToFileContent(file);
+    fclose(file);
+    SHOULD_BE_TRUE(err == KTX_ERROR_OK);
+    volSrc->setDepth(DIM);
+
+    // patch header depth back, so size field is smaller than volume
+    file = fopen(fileName, "r+b");
+    KtxHeader header;
+    size_t numRead = fread(&header, 1, sizeof(header), file);
+    SHOULD_BE_TRUE(numRead == sizeof(header));
+    header.m_pixelDepth = DIM;
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, 1, sizeof(header), file);
+    fclose(file);
+
+    KtxTexture *volDst = M_NEW(KtxTexture);
+    file = fopen(fileName, "rb");
+    err = volDst->loadFromFileContent(file);
+    fclose(file);
+    SHOULD_BE_TRUE(err == KTX_ERROR_WRONG_FORMAT);
+    delete volDst;
+    delete volSrc;
+    remove(fileName);
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testResampleVolume, "void testResampleVolume()")
+  IT("resample with same size keeps volume unchanged")
+  {
+    const int DIM = 48;
+    KtxTexture *volSrc = M_NEW(KtxTexture);
+    KtxError errCreate = volSrc->createAsSingleSphere(DIM);
+    SHOULD_BE_TRUE(errCreate == KTX_ERROR_OK);
+
+    for (int f = 0; f < RESAMPLE_FILTER_COUNT; f++)
+    {
+      KtxTexture *volDst = M_NEW(KtxTexture);
+      KtxError err = volDst->createAsResampled(volSrc, DIM, DIM, DIM,
+        (ResampleFilter)f);
+      SHOULD_BE_TRUE(err == KTX_ERROR_OK);
+      const int cmp = memcmp(volDst->getData(), volSrc->getData(),
+        DIM * DIM * DIM);
+      SHOULD_EQUAL(cmp, 0);
+      delete volDst;
+    }
+    delete volSrc;
+  }
+  END_IT
+
+  IT("separable passes give the same result as 3d kernel")
+  {
+    // checkerboard: cubic and lanczos overshoot [0..255] between passes
+    const int X_SRC = 12, Y_SRC = 10, Z_SRC = 9;
+    const int X_DST = 17, Y_DST = 15, Z_DST = 13;
+    MUint8 *volSrc = M_NEW(MUint8[X_SRC * Y_SRC * Z_SRC]);
+    MUint8 *volDst = M_NEW(MUint8[X_DST * Y_DST * Z_DST]);
+    int x, y, z;
+    for (z = 0; z < Z_SRC; z++)
+      for (y = 0; y < Y_SRC; y++)
+        for (x = 0; x < X_SRC; x++)
+          volSrc[x + (y + z * Y_SRC) * X_SRC] =
+            (MUint8)(((x + y + z) & 1) ? 255 : 0);
+    for (int f = RESAMPLE_FILTER_CUBIC; f < RESAMPLE_FILTER_COUNT; f++)
+    {
+      const ResampleFilter filter = (ResampleFilter)f;
+      const int ok = Resampler3d::resample(volSrc, X_SRC, Y_SRC, Z_SRC,
+        volDst, X_DST, Y_DST, Z_DST, filter);
+      SHOULD_EQUAL(ok, 1);
+      ResampleTaps tapsX, tapsY, tapsZ;
+      tapsX.create(X_SRC, X_DST, filter);
+      tapsY.create(Y_SRC, Y_DST, filter);
+      tapsZ.create(Z_SRC, Z_DST, filter);
+      const int numTaps = tapsX.getNumTaps();
+      int difMax = 0;
+      for (int i = 0; i < X_DST * Y_DST * Z_DST; i++)
+      {
+        // taps of destination voxel along every axis
+        const int tx0 = (i % X_DST) * numTaps;
+        const int ty0 = ((i / X_DST) % Y_DST) * numTaps;
+        const int tz0 = (i / (X_DST * Y_DST)) * numTaps;
+        float sum = 0.0f;
+        for (int t = 0; t < numTaps * numTaps * numTaps; t++)
+        {
+          const int tx = tx0 + t % numTaps;
+          const int ty = ty0 + (t / numTaps) % numTaps;
+          const int tz = tz0 + t / (numTaps * numTaps);
+          const int off = tapsX.getIndices()[tx] +
+            (tapsY.getIndices()[ty] + tapsZ.getIndices()[tz] * Y_SRC) * X_SRC;
+          sum += tapsX.getWeights()[tx] * tapsY.getWeights()[ty] *
+            tapsZ.getWeights()[tz] * volSrc[off];
+        }
+        sum = (sum > 0.0f) ? sum : 0.0f;
+        sum = (sum < 255.0f) ? sum : 255.0f;
+        const int dif = abs((int)(sum + 0.5f) - (int)volDst[i]);
+        difMax = (dif > difMax) ? dif : difMax;
+      }
+      // float sums in other order may round to other level
+      SHOULD_BE_TRUE(difMax <= 1);
+    }
+    delete [] volDst;
+    delete [] volSrc;
+  }
+  END_IT
+
+  IT("xy slices made by z pass workers do not depend on threads")
+  {
+    // z down and up scale, chunks of workers share source slices
+    const int X_SRC = 21, Y_SRC = 18, Z_SRC = 37;
+    const int X_DST = 17, Y_DST = 21;
+    const int DIMS_Z_DST[2] = { 11, 70 };
+    const int numThreads = Parallel::getNumThreads();
+    MUint8 *volSrc = M_NEW(MUint8[X_SRC * Y_SRC * Z_SRC]);
+    MUint8 *volA = M_NEW(MUint8[X_DST * Y_DST * DIMS_Z_DST[1]]);
+    MUint8 *volB = M_NEW(MUint8[X_DST * Y_DST * DIMS_Z_DST[1]]);
+    for (int i = 0; i < X_SRC * Y_SRC * Z_SRC; i++)
+      volSrc[i] = (MUint8)(i * 29 + (i >> 7));
+    int numDif = 0;
+    for (int k = 0; k < 2; k++)
+    {
+      const int zDst = DIMS_Z_DST[k];
+      Parallel::setNumThreads(1);
+      Resampler3d::resample(volSrc, X_SRC, Y_SRC, Z_SRC, volA, X_DST, Y_DST,
+        zDst, RESAMPLE_FILTER_LANCZOS);
+      Parallel::setNumThreads(4);
+      Resampler3d::resample(volSrc, X_SRC, Y_SRC, Z_SRC, volB, X_DST, Y_DST,
+        zDst, RESAMPLE_FILTER_LANCZOS);
+      numDif += memcmp(volA, volB, X_DST * Y_DST * zDst) ? 1 : 0;
+    }
+    Parallel::setNumThreads(numThreads);
+    SHOULD_EQUAL(numDif, 0);
+    delete [] volB;
+    delete [] volA;
+    delete [] volSrc;
+  }
+  END_IT
+
+  IT("non integer z scale and back is close to source")
+  {
+    const int DIM = 48;
+    // anisotropic spacing: 0.7 mm in plane, 2.5 mm between slices
+    const int Z_DIM_UP = (int)(DIM * 2.5f / 0.7f);
+    KtxTexture *volSrc = M_NEW(KtxTexture);
+    volSrc->createAsSingleSphere(DIM);
+
+    for (int f = RESAMPLE_FILTER_LINEAR; f < RESAMPLE_FILTER_COUNT; f++)
+    {
+      KtxTexture *vol = M_NEW(KtxTexture);
+      vol->createAsCopy(volSrc);
+      int ok = vol->scaleUpZ(Z_DIM_UP, (ResampleFilter)f);
+      SHOULD_EQUAL(ok, 1);
+      SHOULD_EQUAL(vol->getDepth(), Z_DIM_UP);
+      ok = vol->rescale(DIM, DIM, DIM, (ResampleFilter)f);
+      SHOULD_EQUAL(ok, 1);
+
+      const MUint8 *pixelsA = volSrc->getData();
+      const MUint8 *pixelsB = vol->getData();
+      float difSum = 0.0f;
+      for (int i = 0; i < DIM * DIM * DIM; i++)
+        difSum += fabsf((float)pixelsA[i] - (float)pixelsB[i]);
+      const float difAverage = difSum / (DIM * DIM * DIM);
+      SHOULD_BE_TRUE(difAverage < 1.0f);
+      delete vol;
+    }
+    delete volSrc;
+  }
+  END_IT
+
+  IT("power of two by max side equals scale then align")
+  {
+    const int DIM = 40;
+    const int MAX_DIM = 25;
+    KtxTexture *volSrc = M_NEW(KtxTexture);
+    volSrc->createAsSingleSphere(DIM);
+
+    KtxTexture *volSmall = M_NEW(KtxTexture);
+    KtxError err = volSmall->createAs1ByteLessSize(volSrc, MAX_DIM, MAX_DIM,
+      MAX_DIM);
+    SHOULD_BE_TRUE(err == KTX_ERROR_OK);
+    KtxTexture *volAlign = M_NEW(KtxTexture);
+    err = volAlign->createAs1ByteCopyPowerOfTwo(volSmall);
+    SHOULD_BE_TRUE(err == KTX_ERROR_OK);
+
+    KtxTexture *volPow = M_NEW(KtxTexture);
+    err = volPow->createAs1BytePowerByMaxSide(volSrc, MAX_DIM, 0, 1);
+    SHOULD_BE_TRUE(err == KTX_ERROR_OK);
+    SHOULD_EQUAL(volPow->getWidth(), 32);
+    SHOULD_EQUAL(volPow->getDepth(), 32);
+    const int cmp = memcmp(volPow->getData(), volAlign->getData(),
+      32 * 32 * 32);
+    SHOULD_EQUAL(cmp, 0);
+
+    delete volPow;
+    delete volAlign;
+    delete volSmall;
+    delete volSrc;
+  }
+  END_IT
+
+  IT("power of two by max side does not depend on threads")
+  {
+    const int DIM = 40;
+    KtxTexture *volSrc = M_NEW(KtxTexture);
+    volSrc->createAsSingleSphere(DIM);
+    const int numThreads = Parallel::getNumThreads();
+
+    for (int smooth = 0; smooth < 2; smooth++)
+    {
+      KtxTexture *volA = M_NEW(KtxTexture);
+      KtxTexture *volB = M_NEW(KtxTexture);
+      Parallel::setNumThreads(1);
+      volA->createAs1BytePowerByMaxSide(volSrc, 50, 0, smooth);
+      Parallel::setNumThreads(4);
+      volB->createAs1BytePowerByMaxSide(volSrc, 50, 0, smooth);
+      SHOULD_EQUAL(volA->getWidth(), 64);
+      const int cmp = memcmp(volA->getData(), volB->getData(),
+        64 * 64 * 64);
+      SHOULD_EQUAL(cmp, 0);
+      delete volB;
+      delete volA;
+    }
+    Parallel::setNumThreads(numThreads);
+    delete volSrc;
+  }
+  END_IT
+END_DESCRIBE
+
+// items of concurrent allocation test, every one has blocks
+static const int MEM_TEST_ITEMS   = 64;
+static const int MEM_TEST_BLOCKS  = 32;
+static const int MEM_TEST_SIZE    = 1000;
+
+static void _memTrackAllocCallback(void *userData, const int indexStart,
+  const int indexEnd)
+{
+  MUint8 **blocks = (MUint8**)userData;
+  for (int i = indexStart * MEM_TEST_BLOCKS; i < indexEnd * MEM_TEST_BLOCKS;
+       i++)
+    blocks[i] = M_NEW(MUint8[MEM_TEST_SIZE]);
+}
+
+// Free blocks of mirrored item, allocated by other thread mostly
+static void _memTrackFreeCallback(void *userData, const int indexStart,
+  const int indexEnd)
+{
+  MUint8 **blocks = (MUint8**)userData;
+  for (int item = indexStart; item < indexEnd; item++)
+  {
+    const int itemFree = MEM_TEST_ITEMS - 1 - item;
+    for (int i = 0; i < MEM_TEST_BLOCKS; i++)
+      delete [] blocks[itemFree * MEM_TEST_BLOCKS + i];
+  }
+}
+
+DESCRIBE(testMemTrackStats, "void testMemTrackStats()")
+  IT("counts allocations and size classes")
+  {
+    const int NUM_BLOCKS = 8;
+    const int BLOCK_SIZE = 100;
+    MemTrackStats statsBefore, statsAfter;
+    void *blocks[NUM_BLOCKS];
+
+    MemTrackGetStats(&statsBefore);
+    for (int i = 0; i < NUM_BLOCKS; i++)
+      blocks[i] = MemTrackAllocate(BLOCK_SIZE, __FILE__, __LINE__);
+    MemTrackGetStats(&statsAfter);
+    SHOULD_EQUAL((int)(statsAfter.m_numAllocs - statsBefore.m_numAllocs),
+      NUM_BLOCKS);
+    SHOULD_EQUAL((int)(statsAfter.m_bytesCurrent - statsBefore.m_bytesCurrent),
+      NUM_BLOCKS * BLOCK_SIZE);
+    // 100 is in [64, 128)
+    SHOULD_EQUAL((int)(statsAfter.m_sizeClassAllocs[6] -
+      statsBefore.m_sizeClassAllocs[6]), NUM_BLOCKS);
+
+    for (int i = 0; i < NUM_BLOCKS; i++)
+      MemTrackFree(blocks[i]);
+    MemTrackGetStats(&statsAfter);
+    SHOULD_EQUAL((int)(statsAfter.m_numFrees - statsBefore.m_numFrees),
+      NUM_BLOCKS);
+    SHOULD_BE_TRUE(statsAfter.m_bytesCurrent == statsBefore.m_bytesCurrent);
+  }
+  END_IT
+
+  IT("tracks only sampled blocks")
+  {
+    const int NUM_BLOCKS = 8;
+    const int SAMPLE_RATE = 4;
+    MemTrackStats statsBefore, statsAfter;
+    void *blocks[NUM_BLOCKS];
+    const int sampleRate = MemTrackGetSampleRate();
+
+    MemTrackSetSampleRate(SAMPLE_RATE);
+    MemTrackGetStats(&statsBefore);
+    for (int i = 0; i < NUM_BLOCKS; i++)
+      blocks[i] = MemTrackAllocate(16, __FILE__, __LINE__);
+    MemTrackGetStats(&statsAfter);
+    SHOULD_EQUAL((int)(statsAfter.m_numBlocksTracked -
+      statsBefore.m_numBlocksTracked), NUM_BLOCKS / SAMPLE_RATE);
+    SHOULD_EQUAL((int)(statsAfter.m_numAllocs - statsBefore.m_numAllocs),
+      NUM_BLOCKS);
+    for (int i = 0; i < NUM_BLOCKS; i++)
+      MemTrackFree(blocks[i]);
+    MemTrackSetSampleRate(sampleRate);
+    MemTrackGetStats(&statsAfter);
+    SHOULD_BE_TRUE(statsAfter.m_numBlocksTracked ==
+      statsBefore.m_numBlocksTracked);
+  }
+  END_IT
+
+  IT("keeps counts with allocations from several threads")
+  {
+    const int NUM_ITEMS = MEM_TEST_ITEMS;
+    const int NUM_BLOCKS = MEM_TEST_BLOCKS;
+    const int BLOCK_SIZE = MEM_TEST_SIZE;
+    MemTrackStats statsBefore, statsAfter;
+    const int sampleRate = MemTrackGetSampleRate();
+    const int numThreads = Parallel::getNumThreads();
+    Parallel::setNumThreads(4);
+    // counting only and tracked blocks (shard rings under lock)
+    for (int rate = 0; rate <= 1; rate++)
+    {
+      MemTrackSetSampleRate(rate);
+      MemTrackGetStats(&statsBefore);
+      MUint8 **blocks = M_NEW(MUint8*[NUM_ITEMS * NUM_BLOCKS]);
+      Parallel::forRange(NUM_ITEMS, _memTrackAllocCallback, blocks);
+      MemTrackGetStats(&statsAfter);
+      // thread pool may allocate too
+      SHOULD_BE_TRUE(statsAfter.m_numAllocs - statsBefore.m_numAllocs >=
+        NUM_ITEMS * NUM_BLOCKS + 1);
+      SHOULD_BE_TRUE(statsAfter.m_bytesCurrent - statsBefore.m_bytesCurrent
+        >= (long long)NUM_ITEMS * NUM_BLOCKS * BLOCK_SIZE);
+      SHOULD_BE_TRUE(statsAfter.m_bytesPeak >= statsBefore.m_bytesCurrent +
+        (long long)NUM_ITEMS * NUM_BLOCKS * BLOCK_SIZE);
+      SHOULD_EQUAL((int)(statsAfter.m_numBlocksTracked -
+        statsBefore.m_numBlocksTracked), rate * (NUM_ITEMS * NUM_BLOCKS + 1));
+      // blocks are freed by other threads than allocated them
+      Parallel::forRange(NUM_ITEMS, _memTrackFreeCallback, blocks);
+      delete [] blocks;
+      MemTrackGetStats(&statsAfter);
+      SHOULD_BE_TRUE(statsAfter.m_numFrees - statsBefore.m_numFrees >=
+        NUM_ITEMS * NUM_BLOCKS + 1);
+      SHOULD_BE_TRUE(statsAfter.m_bytesCurrent == statsBefore.m_bytesCurrent);
+      SHOULD_BE_TRUE(statsAfter.m_numBlocksTracked ==
+        statsBefore.m_numBlocksTracked);
+    }
+    MemTrackSetSampleRate(sampleRate);
+    Parallel::setNumThreads(numThreads);
+  }
+  END_IT
+
+  IT("throws from usual new and gives NULL from M_NEW without memory")
+  {
+    const size_t SIZE_HUGE = (size_t)1 << (sizeof(size_t) * 8 - 2);
+    char *volatile mem = M_NEW(char[SIZE_HUGE]);
+    SHOULD_BE_TRUE(mem == NULL);
+    int isThrown = 0;
+    try
+    {
+      mem = new char[SIZE_HUGE];
+    }
+    catch (const std::bad_alloc &)
+    {
+      isThrown = 1;
+    }
+    SHOULD_EQUAL(isThrown, 1);
+    if (mem)
+      delete [] mem;
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testMemArena, "void testMemArena()")
+  IT("returns aligned blocks and grows to high water on reset")
+  {
+    MemArena arena;
+    int ok = arena.create(1024);
+    SHOULD_EQUAL(ok, 1);
+    {
+      MemArenaScope scope(&arena);
+      MemArenaFrame frame;
+      for (int i = 0; i < 8; i++)
+      {
+        MUint8 *p = (MUint8*)frame.allocate(100 + i);
+        SHOULD_BE_TRUE(p != NULL);
+        SHOULD_EQUAL((int)((size_t)p % MEM_ARENA_ALIGN), 0);
+        memset(p, 0xcc, 100 + i);
+      }
+      // does not fit into 1024 bytes
+      MUint8 *pLarge = (MUint8*)frame.allocate(64 * 1024);
+      SHOULD_BE_TRUE(pLarge != NULL);
+      SHOULD_EQUAL((int)((size_t)pLarge % MEM_ARENA_ALIGN), 0);
+      memset(pLarge, 0xcc, 64 * 1024);
+    }
+    SHOULD_EQUAL((int)arena.getUsed(), 0);
+    SHOULD_BE_TRUE(arena.getCapacity() >= arena.getHighWater());
+    MemTrackStats stats;
+    MemTrackGetStats(&stats);
+    SHOULD_BE_TRUE(stats.m_arenaBytesHighWater >= 64 * 1024);
+    arena.destroy();
+  }
+  END_IT
+
+  IT("gauss smooth with arena gives the same volume")
+  {
+    const int DIM = 32;
+    KtxTexture *volA = M_NEW(KtxTexture);
+    KtxTexture *volB = M_NEW(KtxTexture);
+    KtxError err = volA->createAsSingleSphere(DIM);
+    SHOULD_BE_TRUE(err == KTX_ERROR_OK);
+    err = volB->createAsCopy(volA);
+    SHOULD_BE_TRUE(err == KTX_ERROR_OK);
+
+    volA->gaussSmooth(1, 0.8f);
+    MemArena arena;
+    int ok = arena.create(DIM * DIM * DIM, 1);
+    SHOULD_EQUAL(ok, 1);
+    {
+      MemArenaScope scope(&arena);
+      volB->gaussSmooth(1, 0.8f);
+      // ring of (gaussNeigh + 1) slices, not whole volume copy
+      SHOULD_BE_TRUE(arena.getHighWater() >= 2 * DIM * DIM);
+      SHOULD_BE_TRUE(arena.getHighWater() < DIM * DIM * DIM);
+    }
+    const int cmp = memcmp(volA->getData(), volB->getData(), DIM * DIM * DIM);
+    SHOULD_EQUAL(cmp, 0);
+    delete volA;
+    delete volB;
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testPnmIo, "void testPnmIo()")
+  IT("write and read back grey image")
+  {
+    const int W = 37;
+    const int H = 21;
+    const char *fileName = "test_pnmio.pgm";
+    MUint8 *pixels = M_NEW(MUint8[W * H]);
+    for (int i = 0; i < W * H; i++)
+      pixels[i] = (MUint8)(i * 7);
+    int ok = PnmIo::writeImageGrey(fileName, pixels, W, H);
+    SHOULD_EQUAL(ok, 1);
+
+    int w = 0, h = 0;
+    MUint32 *pixelsRead = PnmIo::readImage(fileName, &w, &h);
+    SHOULD_BE_TRUE(pixelsRead != NULL);
+    SHOULD_EQUAL(w, W);
+    SHOULD_EQUAL(h, H);
+    int numDif = 0;
+    for (int i = 0; i < W * H; i++)
+      numDif += ((pixelsRead[i] & 0xff) != pixels[i]) ? 1 : 0;
+    SHOULD_EQUAL(numDif, 0);
+    delete [] pixelsRead;
+    delete [] pixels;
+    remove(fileName);
+  }
+  END_IT
+
+  IT("reject image sizes overflowing pixel count")
+  {
+    const char *fileName = "test_pnmio_large.pgm";
+    FILE *file = fopen(fileName, "wb");
+    fprintf(file, "P5\n65536 65536\n255\n");
+    fputc(0, file);
+    fclose(file);
+    int w = 0, h = 0;
+    SHOULD_BE_TRUE(PnmIo::readImage(fileName, &w, &h) == NULL);
+    file = fopen(fileName, "wb");
+    fprintf(file, "P5\n46341 46341\n255\n");
+    fputc(0, file);
+    fclose(file);
+    SHOULD_BE_TRUE(PnmIo::readImage(fileName, &w, &h) == NULL);
+    SHOULD_BE_TRUE(PnmIo::readRaw(fileName, 65536, 65536) == NULL);
+    SHOULD_BE_TRUE(PnmIo::readRaw(fileName, 0x7fffffff, 2) == NULL);
+    remove(fileName);
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testVolumeView, "void testVolumeView()")
+  IT("crop view reads source voxels without copy")
+  {
+    const int DIM = 40;
+    KtxTexture *vol = M_NEW(KtxTexture);
+    vol->createAsSingleSphere(DIM);
+    const MUint8 *pixels = vol->getData();
+
+    VolumeView viewVol, viewCrop;
+    viewVol.createFromTexture(vol);
+    V3d vMin, vSize;
+    vMin.x = 5; vMin.y = 6; vMin.z = 7;
+    vSize.x = 10; vSize.y = 11; vSize.z = 12;
+    int ok = viewCrop.createAsCrop(viewVol, vMin, vSize);
+    SHOULD_EQUAL(ok, 1);
+    SHOULD_EQUAL(viewCrop.isCompact(), 0);
+    const MUint8 *origin = pixels + 5 + 6 * DIM + 7 * DIM * DIM;
+    SHOULD_BE_TRUE(viewCrop.getRow(0, 0) == origin);
+
+    KtxTexture *volCrop = M_NEW(KtxTexture);
+    KtxError err = viewCrop.materialize(volCrop);
+    SHOULD_BE_TRUE(err == KTX_ERROR_OK);
+    SHOULD_EQUAL(volCrop->getWidth(), 10);
+    SHOULD_EQUAL(volCrop->getDepth(), 12);
+    int numDif = 0;
+    for (int z = 0; z < 12; z++)
+      for (int y = 0; y < 11; y++)
+        for (int x = 0; x < 10; x++)
+        {
+          const MUint8 valSrc = pixels[(x + 5) + (y + 6) * DIM +
+            (z + 7) * DIM * DIM];
+          const MUint8 valDst = volCrop->getData()[x + y * 10 + z * 110];
+          numDif += (valSrc != valDst) ? 1 : 0;
+        }
+    SHOULD_EQUAL(numDif, 0);
+
+    // box out of volume
+    vMin.x = DIM - 5;
+    ok = viewCrop.createAsCrop(viewVol, vMin, vSize);
+    SHOULD_EQUAL(ok, -1);
+
+    delete volCrop;
+    delete vol;
+  }
+  END_IT
+
+  IT("gauss and writer accept cropped view")
+  {
+    const int DIM = 32;
+    KtxTexture *vol = M_NEW(KtxTexture);
+    vol->createAsSingleSphere(DIM);
+
+    VolumeView viewVol, viewCrop, viewCompact;
+    viewVol.createFromTexture(vol);
+    V3d vMin, vMax;
+    vMin.x = 3; vMin.y = 4; vMin.z = 5;
+    vMax.x = 20; vMax.y = 25; vMax.z = 22;
+    viewCrop.createAsBox(viewVol, vMin, vMax);
+    KtxTexture *volCrop = M_NEW(KtxTexture);
+    viewCrop.materialize(volCrop);
+    viewCompact.createFromTexture(volCrop);
+    SHOULD_EQUAL(viewCompact.isCompact(), 1);
+
+    const int numVoxels = (int)viewCrop.getNumVoxels();
+    MUint8 *pixelsA = M_NEW(MUint8[numVoxels]);
+    MUint8 *pixelsB = M_NEW(MUint8[numVoxels]);
+    VolumeTools::performGaussFast(viewCrop, pixelsA);
+    VolumeTools::performGaussFast(volCrop->getData(), volCrop->getWidth(),
+      volCrop->getHeight(), volCrop->getDepth(), pixelsB);
+    SHOULD_EQUAL(memcmp(pixelsA, pixelsB, numVoxels), 0);
+
+    const char *fileName = "test_volview.pgm";
+    int ok = PnmIo::writeImageGrey(fileName, viewCrop, 9);
+    SHOULD_EQUAL(ok, 1);
+    int w = 0, h = 0;
+    MUint32 *pixelsRead = PnmIo::readImage(fileName, &w, &h);
+    SHOULD_BE_TRUE(pixelsRead != NULL);
+    SHOULD_EQUAL(w, viewCrop.getWidth());
+    SHOULD_EQUAL(h, viewCrop.getHeight());
+    int numDif = 0;
+    for (int y = 0; y < h; y++)
+      for (int x = 0; x < w; x++)
+        numDif += ((pixelsRead[x + y * w] & 0xff) !=
+          viewCrop.getVoxel(x, y, 9)) ? 1 : 0;
+    SHOULD_EQUAL(numDif, 0);
+    remove(fileName);
+
+    delete [] pixelsRead;
+    delete [] pixelsB;
+    delete [] pixelsA;
+    delete volCrop;
+    delete vol;
+  }
+  END_IT
+
+  IT("min size texture crops by non zero channel")
+  {
+    KtxTexture *vol = M_NEW(KtxTexture);
+    vol->create3D(16, 12, 10, 4);
+    MUint32 *pixels = (MUint32*)vol->getData();
+    // green channel set in two voxels, red everywhere
+    for (int i = 0; i < 16 * 12 * 10; i++)
+      pixels[i] = 0x7f;
+    pixels[3 + 4 * 16 + 2 * 16 * 12] |= 0x2000;
+    pixels[9 + 7 * 16 + 5 * 16 * 12] |= 0x4000;
+
+    KtxTexture *volMin = M_NEW(KtxTexture);
+    KtxError err = volMin->createMinSizeTexture(vol, 1);
+    SHOULD_BE_TRUE(err == KTX_ERROR_OK);
+    SHOULD_EQUAL(volMin->getWidth(), 7);
+    SHOULD_EQUAL(volMin->getHeight(), 4);
+    SHOULD_EQUAL(volMin->getDepth(), 4);
+    const MUint32 *pixelsMin = (const MUint32*)volMin->getData();
+    SHOULD_EQUAL(pixelsMin[0], 0x207f);
+    SHOULD_EQUAL(pixelsMin[6 + 3 * 7 + 3 * 7 * 4], 0x407f);
+
+    delete volMin;
+    delete vol;
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testOrthoSlices, "void testOrthoSlices()")
+  IT("slab of all slices matches voxels for every axis")
+  {
+    const int X_DIM = 71;
+    const int Y_DIM = 45;
+    const int Z_DIM = 23;
+    KtxTexture *vol = M_NEW(KtxTexture);
+    vol->create3D(X_DIM, Y_DIM, Z_DIM, 1);
+    MUint8 *pixels = vol->getData();
+    for (int i = 0; i < X_DIM * Y_DIM * Z_DIM; i++)
+      pixels[i] = (MUint8)(i * 31 + (i >> 7));
+
+    MUint8 *slab = M_NEW(MUint8[X_DIM * Y_DIM * Z_DIM]);
+    for (int a = 0; a < KTX_SLICE_AXIS_COUNT; a++)
+    {
+      const KtxSliceAxis axis = (KtxSliceAxis)a;
+      const int dimAxis = (a == 0) ? X_DIM : ((a == 1) ? Y_DIM : Z_DIM);
+      int w, h;
+      vol->getSliceSize(axis, w, h);
+      SHOULD_EQUAL(w * h * dimAxis, X_DIM * Y_DIM * Z_DIM);
+      int ok = vol->getSlab(axis, 0, dimAxis, slab);
+      SHOULD_EQUAL(ok, 1);
+
+      int numDif = 0;
+      for (int k = 0; k < dimAxis; k++)
+        for (int v = 0; v < h; v++)
+          for (int u = 0; u < w; u++)
+          {
+            int x = u, y = v, z = k;
+            if (axis == KTX_SLICE_AXIS_X)
+            {
+              x = k; y = u; z = v;
+            }
+            else if (axis == KTX_SLICE_AXIS_Y)
+            {
+              y = k; z = v;
+            }
+            const MUint8 valSrc = pixels[x + y * X_DIM + z * X_DIM * Y_DIM];
+            numDif += (slab[u + v * w + k * w * h] != valSrc) ? 1 : 0;
+          }
+      SHOULD_EQUAL(numDif, 0);
+    }
+    delete [] slab;
+    delete vol;
+  }
+  END_IT
+
+  IT("batch of slices equals single slices")
+  {
+    const int DIM = 40;
+    KtxTexture *vol = M_NEW(KtxTexture);
+    vol->createAsSingleSphere(DIM);
+    const int indices[] = { 5, 0, 20, 5, DIM - 1 };
+    const int NUM_SLICES = sizeof(indices) / sizeof(indices[0]);
+    MUint8 *slices = M_NEW(MUint8[NUM_SLICES * DIM * DIM]);
+    MUint8 *slice = M_NEW(MUint8[DIM * DIM]);
+
+    for (int a = 0; a < KTX_SLICE_AXIS_COUNT; a++)
+    {
+      const KtxSliceAxis axis = (KtxSliceAxis)a;
+      int ok = vol->getSlices(axis, indices, NUM_SLICES, slices);
+      SHOULD_EQUAL(ok, 1);
+      int numDif = 0;
+      for (int k = 0; k < NUM_SLICES; k++)
+      {
+        vol->getSlice(axis, indices[k], slice);
+        numDif += memcmp(slice, slices + k * DIM * DIM, DIM * DIM) ? 1 : 0;
+      }
+      SHOULD_EQUAL(numDif, 0);
+      ok = vol->getSlice(axis, DIM, slice);
+      SHOULD_EQUAL(ok, -1);
+    }
+    delete [] slice;
+    delete [] slices;
+    delete vol;
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testReslice, "void testReslice()")
+  IT("axial plane equals axial slice for every filter")
+  {
+    const int DIM = 40;
+    const int Z_SLICE = 17;
+    KtxTexture *vol = M_NEW(KtxTexture);
+    vol->createAsSingleSphere(DIM);
+    MUint8 *slice = M_NEW(MUint8[DIM * DIM]);
+    MUint8 *image = M_NEW(MUint8[DIM * DIM]);
+    vol->getSlice(KTX_SLICE_AXIS_Z, Z_SLICE, slice);
+
+    ReslicePlane plane;
+    V3f normal(0.0f, 0.0f, 2.0f);
+    int ok = Reslicer::createPlane(vol, normal, 2.0f * Z_SLICE, DIM, DIM,
+      1.0f, plane);
+    SHOULD_EQUAL(ok, 1);
+    for (int f = RESAMPLE_FILTER_NEAREST; f <= RESAMPLE_FILTER_CUBIC; f++)
+    {
+      ok = Reslicer::reslice(vol, plane, (ResampleFilter)f, DIM, DIM, image);
+      SHOULD_EQUAL(ok, 1);
+      SHOULD_EQUAL(memcmp(image, slice, DIM * DIM), 0);
+    }
+    ok = Reslicer::reslice(vol, plane, RESAMPLE_FILTER_LANCZOS, DIM, DIM,
+      image);
+    SHOULD_EQUAL(ok, -1);
+
+    delete [] image;
+    delete [] slice;
+    delete vol;
+  }
+  END_IT
+
+  IT("oblique plane over linear ramp gives ramp values")
+  {
+    const int DIM = 32;
+    KtxTexture *vol = M_NEW(KtxTexture);
+    vol->create3D(DIM, DIM, DIM, 1);
+    MUint8 *pixels = vol->getData();
+    for (int z = 0; z < DIM; z++)
+      for (int y = 0; y < DIM; y++)
+        for (int x = 0; x < DIM; x++)
+          pixels[x + y * DIM + z * DIM * DIM] = (MUint8)(x + 2 * y + 4 * z);
+
+    const int W = 37;
+    const int H = 29;
+    const MUint8 VAL_OUTSIDE = 255;
+    ReslicePlane plane;
+    V3f normal(1.0f, 2.0f, 3.0f);
+    Reslicer::createPlane(vol, normal, 60.0f, W, H, 0.7f, plane);
+    MUint8 *image = M_NEW(MUint8[W * H]);
+    Reslicer::reslice(vol, plane, RESAMPLE_FILTER_LINEAR, W, H, image,
+      VAL_OUTSIDE);
+
+    int numInside = 0;
+    int numBad = 0;
+    for (int v = 0; v < H; v++)
+      for (int u = 0; u < W; u++)
+      {
+        const float x = plane.m_origin.x + u * plane.m_axisU.x +
+          v * plane.m_axisV.x;
+        const float y = plane.m_origin.y + u * plane.m_axisU.y +
+          v * plane.m_axisV.y;
+        const float z = plane.m_origin.z + u * plane.m_axisU.z +
+          v * plane.m_axisV.z;
+        const int isInside = (x >= 0.0f) && (y >= 0.0f) && (z >= 0.0f) &&
+          (x <= DIM - 1) && (y <= DIM - 1) && (z <= DIM - 1);
+        const int isOutside = (x < -0.5f) || (y < -0.5f) || (z < -0.5f) ||
+          (x > DIM - 0.5f) || (y > DIM - 0.5f) || (z > DIM - 0.5f);
+        const MUint8 val = image[u + v * W];
+        if (isInside)
+        {
+          const float valRamp = x + 2.0f * y + 4.0f * z;
+          numInside++;
+          numBad += (fabsf(val - valRamp) > 1.0f) ? 1 : 0;
+        }
+        if (isOutside)
+          numBad += (val != VAL_OUTSIDE) ? 1 : 0;
+      }
+    SHOULD_BE_TRUE(numInside > W * H / 4);
+    SHOULD_EQUAL(numBad, 0);
+
+    // reformat goes to Downsample2d as is
+    MUint32 *imageArgb = M_NEW(MUint32[W * H]);
+    int ok = Reslicer::resliceArgb(vol, plane, RESAMPLE_FILTER_LINEAR, W, H,
+      imageArgb, VAL_OUTSIDE);
+    SHOULD_EQUAL(ok, 1);
+    SHOULD_EQUAL((int)(imageArgb[W * H / 2] & 0xff), image[W * H / 2]);
+    Downsample2d *downSampler = M_NEW(Downsample2d);
+    ok = downSampler->create(W, H, imageArgb, W / 2, H / 2);
+    SHOULD_EQUAL(ok, 1);
+    ok = downSampler->performDownSamplingAll();
+    SHOULD_EQUAL(ok, 1);
+
+    delete downSampler;
+    delete [] imageArgb;
+    delete [] image;
+    delete vol;
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testReorient, "void testReorient()")
+  IT("every permutation and flip moves voxels as expected")
+  {
+    const int DIMS[3] = { 37, 21, 13 };
+    const int NUM_VOXELS = DIMS[0] * DIMS[1] * DIMS[2];
+    MUint8 *pixelsSrc = M_NEW(MUint8[NUM_VOXELS]);
+    for (int i = 0; i < NUM_VOXELS; i++)
+      pixelsSrc[i] = (MUint8)(i * 13 + (i >> 8));
+    const int perms[6][3] =
+    {
+      { 0, 1, 2 }, { 1, 0, 2 }, { 0, 2, 1 },
+      { 2, 1, 0 }, { 1, 2, 0 }, { 2, 0, 1 }
+    };
+
+    int numDif = 0;
+    KtxTexture *vol = M_NEW(KtxTexture);
+    for (int p = 0; p < 6; p++)
+    {
+      for (int f = 0; f < 8; f++)
+      {
+        const int flips[3] = { f & 1, (f >> 1) & 1, (f >> 2) & 1 };
+        vol->destroy();
+        vol->create3D(DIMS[0], DIMS[1], DIMS[2], 1);
+        memcpy(vol->getData(), pixelsSrc, NUM_VOXELS);
+        int ok = vol->reorient(perms[p], flips);
+        SHOULD_EQUAL(ok, 1);
+        SHOULD_EQUAL(vol->getWidth(), DIMS[perms[p][0]]);
+        SHOULD_EQUAL(vol->getHeight(), DIMS[perms[p][1]]);
+        SHOULD_EQUAL(vol->getDepth(), DIMS[perms[p][2]]);
+
+        const MUint8 *pixelsDst = vol->getData();
+        int d[3];
+        for (d[2] = 0; d[2] < vol->getDepth(); d[2]++)
+          for (d[1] = 0; d[1] < vol->getHeight(); d[1]++)
+            for (d[0] = 0; d[0] < vol->getWidth(); d[0]++)
+            {
+              int s[3];
+              for (int k = 0; k < 3; k++)
+              {
+                const int dim = DIMS[perms[p][k]];
+                s[perms[p][k]] = flips[k] ? (dim - 1 - d[k]) : d[k];
+              }
+              const int offSrc = s[0] + (s[1] + s[2] * DIMS[1]) * DIMS[0];
+              const int offDst = d[0] +
+                (d[1] + d[2] * vol->getHeight()) * vol->getWidth();
+              numDif += (pixelsDst[offDst] != pixelsSrc[offSrc]) ? 1 : 0;
+            }
+      }   // for (f)
+    }     // for (p)
+    SHOULD_EQUAL(numDif, 0);
+
+    const int permBad[3] = { 0, 0, 2 };
+    const int flipsNone[3] = { 0, 0, 0 };
+    SHOULD_EQUAL(vol->reorient(permBad, flipsNone), -1);
+    delete vol;
+    delete [] pixelsSrc;
+  }
+  END_IT
+
+  IT("bounding box key data is permuted and mirrored, saved and loaded")
+  {
+    const char *fileName = "test_reorient_bbox.ktx";
+    KtxTexture *vol = M_NEW(KtxTexture);
+    vol->create3D(8, 6, 4, 1);
+    vol->setKeyDataBbox(V3f(1.0f, 2.0f, 3.0f), V3f(9.0f, 8.0f, 7.0f));
+    const int perm[3] = { 2, 0, 1 };
+    const int flips[3] = { 0, 1, 0 };
+    SHOULD_EQUAL(vol->reorient(perm, flips), 1);
+    FILE *file = fopen(fileName, "wb");
+    KtxError err = vol->saveToFileContent(file);
+    fclose(file);
+    SHOULD_BE_TRUE(err == KTX_ERROR_OK);
+    delete vol;
+
+    vol = M_NEW(KtxTexture);
+    file = fopen(fileName, "rb");
+    err = vol->loadFromFileContent(file);
+    fclose(file);
+    remove(fileName);
+    SHOULD_BE_TRUE(err == KTX_ERROR_OK);
+    const KtxKeyData *keyData = vol->getKeyData();
+    SHOULD_BE_TRUE(keyData->m_dataType == KTX_KEY_DATA_BBOX);
+    const V3f *box = reinterpret_cast<const V3f*>(keyData->m_buffer);
+    // z, x, y of source, new y is mirrored source x
+    SHOULD_EQUAL(box[0].x, 3.0f);
+    SHOULD_EQUAL(box[0].y, -9.0f);
+    SHOULD_EQUAL(box[0].z, 2.0f);
+    SHOULD_EQUAL(box[1].x, 7.0f);
+    SHOULD_EQUAL(box[1].y, -1.0f);
+    SHOULD_EQUAL(box[1].z, 8.0f);
+    SHOULD_EQUAL(vol->getBoxSize()->y, 8.0f);
+    delete vol;
+  }
+  END_IT
+
+  IT("in place transpose of square slices and inverse permutation restore")
+  {
+    const int DIM = 150;
+    const int DEPTH = 7;
+    KtxTexture *vol = M_NEW(KtxTexture);
+    vol->create3D(DIM, DIM, DEPTH, 1);
+    MUint8 *pixels = vol->getData();
+    for (int i = 0; i < DIM * DIM * DEPTH; i++)
+      pixels[i] = (MUint8)(i * 7 + (i >> 9));
+    const MUint8 *pixelsBefore = vol->getData();
+    MUint8 *pixelsCopy = M_NEW(MUint8[DIM * DIM * DEPTH]);
+    memcpy(pixelsCopy, pixels, DIM * DIM * DEPTH);
+
+    const int permXy[3] = { 1, 0, 2 };
+    const int flipsXz[3] = { 1, 0, 1 };
+    vol->reorient(permXy, flipsXz);
+    // done in place
+    SHOULD_EQUAL(vol->getData() == pixelsBefore, true);
+    const int x = 17, y = 131, z = 2;
+    const MUint8 valExpected = pixelsCopy[y + (DIM - 1 - x) * DIM +
+      (DEPTH - 1 - z) * DIM * DIM];
+    SHOULD_EQUAL(vol->getData()[x + y * DIM + z * DIM * DIM], valExpected);
+
+    // transpose of flipped result is undone by same call with swapped flips
+    const int flipsBack[3] = { 0, 1, 1 };
+    vol->reorient(permXy, flipsBack);
+    SHOULD_EQUAL(memcmp(vol->getData(), pixelsCopy, DIM * DIM * DEPTH), 0);
+
+    // cyclic permutation, applied 3 times, gives source volume
+    const int permCycle[3] = { 1, 2, 0 };
+    const int flipsNone[3] = { 0, 0, 0 };
+    for (int i = 0; i < 3; i++)
+      vol->reorient(permCycle, flipsNone);
+    SHOULD_EQUAL(vol->getWidth(), DIM);
+    SHOULD_EQUAL(vol->getDepth(), DEPTH);
+    SHOULD_EQUAL(memcmp(vol->getData(), pixelsCopy, DIM * DIM * DEPTH), 0);
+    delete [] pixelsCopy;
+    delete vol;
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testGaussRecursive, "void testGaussRecursive()")
+  IT("step edge along every axis is smoothed as by gauss kernel")
+  {
+    const int DIM_LONG = 96;
+    const int DIM_SHORT = 6;
+    const float SIGMA = 6.0f;
+    const int VAL_STEP = 200;
+    KtxTexture *vol = M_NEW(KtxTexture);
+    int numWrong = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+      int dims[3] = { DIM_SHORT, DIM_SHORT, DIM_SHORT };
+      dims[axis] = DIM_LONG;
+      vol->destroy();
+      vol->create3D(dims[0], dims[1], dims[2], 1);
+      MUint8 *pixels = vol->getData();
+      int v[3];
+      for (v[2] = 0; v[2] < dims[2]; v[2]++)
+        for (v[1] = 0; v[1] < dims[1]; v[1]++)
+          for (v[0] = 0; v[0] < dims[0]; v[0]++)
+            *pixels++ = (v[axis] >= DIM_LONG / 2) ? VAL_STEP : 0;
+
+      int ok = vol->gaussSmoothRecursive(SIGMA);
+      SHOULD_EQUAL(ok, 1);
+      pixels = vol->getData();
+      for (v[2] = 0; v[2] < dims[2]; v[2]++)
+        for (v[1] = 0; v[1] < dims[1]; v[1]++)
+          for (v[0] = 0; v[0] < dims[0]; v[0]++)
+          {
+            // step convolved with gauss: scaled normal distribution
+            const float t = (v[axis] - (DIM_LONG / 2 - 0.5f)) / SIGMA;
+            const float valExpected =
+              VAL_STEP * 0.5f * (float)erfc(-t / sqrtf(2.0f));
+            const float dif = fabsf(*pixels++ - valExpected);
+            numWrong += (dif > 4.0f) ? 1 : 0;
+          }
+    }   // for (axis)
+    SHOULD_EQUAL(numWrong, 0);
+    SHOULD_EQUAL(vol->gaussSmoothRecursive(0.3f), -1);
+    delete vol;
+  }
+  END_IT
+
+  IT("recursive gauss of view does not depend on threads and is in place")
+  {
+    const int DIM = 50;
+    KtxTexture *vol = M_NEW(KtxTexture);
+    vol->createAsSingleSphere(DIM);
+    MUint8 *pixels = vol->getData();
+    for (int i = 0; i < DIM * DIM * DIM; i++)
+      pixels[i] = (MUint8)(pixels[i] ^ ((i * 37) & 63));
+
+    VolumeView viewAll, viewCrop;
+    viewAll.createFromTexture(vol);
+    V3d vMin, vSize;
+    vMin.x = 3; vMin.y = 5; vMin.z = 7;
+    vSize.x = 41; vSize.y = 33; vSize.z = 29;
+    viewCrop.createAsCrop(viewAll, vMin, vSize);
+    const size_t numVoxels = viewCrop.getNumVoxels();
+    MUint8 *pixelsA = M_NEW(MUint8[numVoxels]);
+    MUint8 *pixelsB = M_NEW(MUint8[numVoxels]);
+
+    const int numThreadsPrev = Parallel::getNumThreads();
+    Parallel::setNumThreads(1);
+    VolumeTools::performGaussRecursive(viewCrop, 4.0f, pixelsA);
+    Parallel::setNumThreads(4);
+    KtxTexture *volCrop = M_NEW(KtxTexture);
+    viewCrop.materialize(volCrop);
+    volCrop->gaussSmoothRecursive(4.0f);
+    Parallel::setNumThreads(numThreadsPrev);
+    SHOULD_EQUAL(memcmp(pixelsA, volCrop->getData(), numVoxels), 0);
+
+    // large radius of direct filter goes to recursive one
+    viewCrop.copyTo(pixelsB);
+    VolumeTools::performGaussRecursive(pixelsB, vSize.x, vSize.y, vSize.z,
+      0.5f * 10, pixelsB);
+    viewCrop.materialize(volCrop);
+    SHOULD_EQUAL(volCrop->gaussSmooth(10, 0.5f), 1);
+    SHOULD_EQUAL(memcmp(pixelsB, volCrop->getData(), numVoxels), 0);
+    // sigma too small for recursive filter
+    SHOULD_EQUAL(volCrop->gaussSmooth(10, 0.01f), -1);
+
+    delete volCrop;
+    delete [] pixelsB;
+    delete [] pixelsA;
+    delete vol;
+  }
+  END_IT
+END_DESCRIBE
+
+static MUint8 _getRankBrute(MUint8 *samples, const int numSamples,
+  const float percentile)
+{
+  // insertion sort, windows are small
+  for (int i = 1; i < numSamples; i++)
+  {
+    const MUint8 val = samples[i];
+    int j = i - 1;
+    for (; (j >= 0) && (samples[j] > val); j--)
+      samples[j + 1] = samples[j];
+    samples[j + 1] = val;
+  }
+  return samples[(int)(percentile * (numSamples - 1) + 0.5f)];
+}
+
+static int _clampTest(const int v, const int dim)
+{
+  return (v < 0) ? 0 : ((v >= dim) ? (dim - 1) : v);
+}
+
+DESCRIBE(testRankFilter, "void testRankFilter()")
+  IT("2d median and percentile equal sorted window values")
+  {
+    const int W_SRC = 83;
+    const int H_SRC = 61;
+    MUint8 *pixelsSrc = M_NEW(MUint8[W_SRC * H_SRC]);
+    srand(38);
+    for (int i = 0; i < W_SRC * H_SRC; i++)
+      pixelsSrc[i] = (MUint8)(((i % W_SRC) * 2) ^ (rand() & 0x3f));
+    // network (radius 1) and sliding histogram, same size and reduced
+    const int radii[] = { 1, 1, 3, 5, 2, 9 };
+    const int widthsDst[] = { 83, 29, 83, 37, 41, 8 };
+    const float percentiles[] = { 0.5f, 0.25f, 0.5f, 0.9f, 0.0f, 0.5f };
+    MUint8 *pixelsDst = M_NEW(MUint8[W_SRC * H_SRC]);
+    MUint8 window[19 * 19];
+    int numWrong = 0;
+    for (int t = 0; t < 6; t++)
+    {
+      const int wDst = widthsDst[t];
+      const int hDst = H_SRC * wDst / W_SRC;
+      const int rad = radii[t];
+      int ok = RankFilter::downsample2d(pixelsSrc, W_SRC, H_SRC,
+        pixelsDst, wDst, hDst, rad, percentiles[t]);
+      SHOULD_EQUAL(ok, 1);
+      for (int cy = 0; cy < hDst; cy++)
+        for (int cx = 0; cx < wDst; cx++)
+        {
+          const int xSrc = W_SRC * cx / wDst;
+          const int ySrc = H_SRC * cy / hDst;
+          int n = 0;
+          for (int dy = -rad; dy <= rad; dy++)
+            for (int dx = -rad; dx <= rad; dx++)
+              window[n++] = pixelsSrc[_clampTest(xSrc + dx, W_SRC) +
+                _clampTest(ySrc + dy, H_SRC) * W_SRC];
+          const MUint8 valExpected =
+            _getRankBrute(window, n, percentiles[t]);
+          numWrong += (pixelsDst[cx + cy * wDst] != valExpected) ? 1 : 0;
+        }
+    }   // for (t)
+    SHOULD_EQUAL(numWrong, 0);
+    int ok = RankFilter::downsample2d(pixelsSrc, W_SRC, H_SRC, pixelsDst,
+      W_SRC + 1, H_SRC, 1, 0.5f);
+    SHOULD_EQUAL(ok, -1);
+
+    // Downsample2d wrapper
+    MUint32 *pixelsArgb = M_NEW(MUint32[W_SRC * H_SRC]);
+    for (int i = 0; i < W_SRC * H_SRC; i++)
+      pixelsArgb[i] = 0xff000000 | pixelsSrc[i];
+    Downsample2d downSampler;
+    downSampler.create(W_SRC, H_SRC, pixelsArgb, 20, 14);
+    downSampler.setMedianRadius(4);
+    SHOULD_EQUAL(downSampler.performMedian(), 1);
+    RankFilter::downsample2d(pixelsSrc, W_SRC, H_SRC, pixelsDst, 20, 14, 4,
+      0.5f);
+    numWrong = 0;
+    for (int i = 0; i < 20 * 14; i++)
+    {
+      const int val = (int)(downSampler.getImageMedian()[i] * 255.0f + 0.5f);
+      numWrong += (val != pixelsDst[i]) ? 1 : 0;
+    }
+    SHOULD_EQUAL(numWrong, 0);
+    downSampler.destroy();
+    delete [] pixelsArgb;
+    delete [] pixelsDst;
+    delete [] pixelsSrc;
+  }
+  END_IT
+
+  IT("volume median equals sorted window values")
+  {
+    const int DIM = 23;
+    const int DIM_DST = 9;
+    const int RAD = 2;
+    KtxTexture *vol = M_NEW(KtxTexture);
+    vol->create3D(DIM, DIM, DIM, 1);
+    MUint8 *pixels = vol->getData();
+    srand(383);
+    for (int i = 0; i < DIM * DIM * DIM; i++)
+      pixels[i] = (MUint8)((i / DIM) + (rand() & 0x1f));
+    MUint8 *pixelsCopy = M_NEW(MUint8[DIM * DIM * DIM]);
+    memcpy(pixelsCopy, pixels, DIM * DIM * DIM);
+
+    int ok = vol->scaleDownMedian(DIM_DST, DIM_DST, DIM_DST, RAD, 0.5f);
+    SHOULD_EQUAL(ok, 1);
+    SHOULD_EQUAL(vol->getWidth(), DIM_DST);
+    MUint8 window[5 * 5 * 5];
+    int numWrong = 0;
+    for (int cz = 0; cz < DIM_DST; cz++)
+      for (int cy = 0; cy < DIM_DST; cy++)
+        for (int cx = 0; cx < DIM_DST; cx++)
+        {
+          const int xSrc = DIM * cx / DIM_DST;
+          const int ySrc = DIM * cy / DIM_DST;
+          const int zSrc = DIM * cz / DIM_DST;
+          int n = 0;
+          for (int dz = -RAD; dz <= RAD; dz++)
+            for (int dy = -RAD; dy <= RAD; dy++)
+              for (int dx = -RAD; dx <= RAD; dx++)
+                window[n++] = pixelsCopy[_clampTest(xSrc + dx, DIM) +
+                  (_clampTest(ySrc + dy, DIM) +
+                  _clampTest(zSrc + dz, DIM) * DIM) * DIM];
+          const MUint8 valExpected = _getRankBrute(window, n, 0.5f);
+          const MUint8 val =
+            vol->getData()[cx + (cy + cz * DIM_DST) * DIM_DST];
+          numWrong += (val != valExpected) ? 1 : 0;
+        }
+    SHOULD_EQUAL(numWrong, 0);
+    delete [] pixelsCopy;
+    delete vol;
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testLabelDownsample, "void testLabelDownsample()")
+  IT("destination voxel is most frequent label of block")
+  {
+    const int DIM_SRC = 30;
+    // 2 * 2 * 2 blocks (pairs compare) and 3 * 3 * 3, 5 * 5 * 5 (histogram)
+    const int dimsDst[] = { 15, 10, 6 };
+    KtxTexture *vol = M_NEW(KtxTexture);
+    MUint8 *pixelsSrc = M_NEW(MUint8[DIM_SRC * DIM_SRC * DIM_SRC]);
+    srand(39);
+    for (int i = 0; i < DIM_SRC * DIM_SRC * DIM_SRC; i++)
+      pixelsSrc[i] = (MUint8)(((rand() & 3) == 0) ? (rand() % 5) : 200);
+    int numWrong = 0;
+    for (int t = 0; t < 3; t++)
+    {
+      const int dimDst = dimsDst[t];
+      const int block = DIM_SRC / dimDst;
+      vol->destroy();
+      vol->create3D(DIM_SRC, DIM_SRC, DIM_SRC, 1);
+      memcpy(vol->getData(), pixelsSrc, DIM_SRC * DIM_SRC * DIM_SRC);
+      int ok = vol->scaleDownLabels(dimDst, dimDst, dimDst);
+      SHOULD_EQUAL(ok, 1);
+      for (int zDst = 0; zDst < dimDst; zDst++)
+        for (int yDst = 0; yDst < dimDst; yDst++)
+          for (int xDst = 0; xDst < dimDst; xDst++)
+          {
+            int counts[256];
+            memset(counts, 0, sizeof(counts));
+            for (int z = zDst * block; z < zDst * block + block; z++)
+              for (int y = yDst * block; y < yDst * block + block; y++)
+                for (int x = xDst * block; x < xDst * block + block; x++)
+                  counts[pixelsSrc[x + (y + z * DIM_SRC) * DIM_SRC]]++;
+            int valBest = 0;
+            for (int v = 1; v < 256; v++)
+              valBest = (counts[v] > counts[valBest]) ? v : valBest;
+            const MUint8 val =
+              vol->getData()[xDst + (yDst + zDst * dimDst) * dimDst];
+            numWrong += (val != valBest) ? 1 : 0;
+          }
+    }   // for (t)
+    SHOULD_EQUAL(numWrong, 0);
+    delete [] pixelsSrc;
+    delete vol;
+  }
+  END_IT
+
+  IT("label mip chain levels are scaled down previous levels")
+  {
+    KtxTexture *vol = M_NEW(KtxTexture);
+    vol->create3D(37, 20, 9, 1);
+    MUint8 *pixels = vol->getData();
+    for (int i = 0; i < 37 * 20 * 9; i++)
+      pixels[i] = (MUint8)((i / 5) % 7 * 30);
+    const int numLevels = vol->getNumMipLevelsMax();
+    SHOULD_EQUAL(numLevels, 6);
+    const size_t sizeChain = vol->getMipChainSize(numLevels);
+    SHOULD_EQUAL(sizeChain, (size_t)(37 * 20 * 9 + 18 * 10 * 4 + 9 * 5 * 2 +
+      4 * 2 * 1 + 2 * 1 * 1 + 1));
+    MUint8 *chain = M_NEW(MUint8[sizeChain]);
+    int ok = vol->createLabelMipChain(numLevels, chain);
+    SHOULD_EQUAL(ok, 1);
+    SHOULD_EQUAL(vol->createLabelMipChain(numLevels + 1, chain), -1);
+
+    size_t offsLevel[8];
+    for (int level = 0; level < numLevels; level++)
+      offsLevel[level] = vol->getMipChainSize(level);
+    int numDif = memcmp(chain, vol->getData(), vol->getDataSize()) ? 1 : 0;
+    for (int level = 1; level < numLevels; level++)
+    {
+      const int w = vol->getWidth();
+      const int h = vol->getHeight();
+      const int d = vol->getDepth();
+      vol->scaleDownLabels((w > 1) ? w / 2 : 1, (h > 1) ? h / 2 : 1,
+        (d > 1) ? d / 2 : 1);
+      numDif += memcmp(vol->getData(), chain + offsLevel[level],
+        vol->getDataSize()) ? 1 : 0;
+    }
+    SHOULD_EQUAL(numDif, 0);
+    delete [] chain;
+    delete vol;
+  }
+  END_IT
+END_DESCRIBE
+
+// Linear model (a, b) of guided filter window around (x, y)
+static void _getGuidedModel(const float *pixels, const int w, const int h,
+  const int x, const int y, const int rad, const float eps, double *a,
+  double *b)
+{
+  double sum = 0.0, sum2 = 0.0;
+  for (int dy = -rad; dy <= rad; dy++)
+    for (int dx = -rad; dx <= rad; dx++)
+    {
+      const double val = pixels[_clampTest(x + dx, w) +
+        _clampTest(y + dy, h) * w];
+      sum += val;
+      sum2 += val * val;
+    }
+  const double num = (2 * rad + 1) * (2 * rad + 1);
+  const double mean = sum / num;
+  double variance = sum2 / num - mean * mean;
+  variance = (variance >= 0.0) ? variance : 0.0;
+  *a = variance / (variance + eps);
+  *b = mean - *a * mean;
+}
+
+static void _getGuidedModel3d(const MUint8 *vol, const int *dims,
+  const int *pos, const int rad, const float eps, double *a, double *b)
+{
+  double sum = 0.0, sum2 = 0.0;
+  for (int dz = -rad; dz <= rad; dz++)
+    for (int dy = -rad; dy <= rad; dy++)
+      for (int dx = -rad; dx <= rad; dx++)
+      {
+        const int off = _clampTest(pos[0] + dx, dims[0]) +
+          (_clampTest(pos[1] + dy, dims[1]) +
+          _clampTest(pos[2] + dz, dims[2]) * dims[1]) * dims[0];
+        const double val = vol[off] * (1.0 / 255.0);
+        sum += val;
+        sum2 += val * val;
+      }
+  const double num = (2 * rad + 1) * (2 * rad + 1) * (2 * rad + 1);
+  const double mean = sum / num;
+  double variance = sum2 / num - mean * mean;
+  variance = (variance >= 0.0) ? variance : 0.0;
+  *a = variance / (variance + eps);
+  *b = mean - *a * mean;
+}
+
+DESCRIBE(testGuidedFilter, "void testGuidedFilter()")
+  IT("2d guided filter equals direct window sums and keeps edges")
+  {
+    const int W_SRC = 97;
+    const int H_SRC = 64;
+    const int W_DST = 31;
+    const int H_DST = 20;
+    const int RAD = 3;
+    const float EPS = 0.01f;
+    float *pixelsSrc = M_NEW(float[W_SRC * H_SRC]);
+    srand(40);
+    // noisy dark left half, bright right half
+    for (int i = 0; i < W_SRC * H_SRC; i++)
+    {
+      const float base = ((i % W_SRC) < W_SRC / 2) ? 0.2f : 0.8f;
+      pixelsSrc[i] = base + ((rand() & 0xff) - 128) * (0.03f / 128.0f);
+    }
+    float *pixelsDst = M_NEW(float[W_DST * H_DST]);
+    int ok = GuidedFilter::downsample2d(pixelsSrc, W_SRC, H_SRC, pixelsDst,
+      W_DST, H_DST, RAD, EPS);
+    SHOULD_EQUAL(ok, 1);
+    double errMax = 0.0;
+    for (int cy = 0; cy < H_DST; cy++)
+      for (int cx = 0; cx < W_DST; cx++)
+      {
+        const int xSrc = W_SRC * cx / W_DST;
+        const int ySrc = H_SRC * cy / H_DST;
+        double sumA = 0.0, sumB = 0.0, a, b;
+        for (int dy = -RAD; dy <= RAD; dy++)
+          for (int dx = -RAD; dx <= RAD; dx++)
+          {
+            _getGuidedModel(pixelsSrc, W_SRC, H_SRC,
+              _clampTest(xSrc + dx, W_SRC), _clampTest(ySrc + dy, H_SRC),
+              RAD, EPS, &a, &b);
+            sumA += a;
+            sumB += b;
+          }
+        const double num = (2 * RAD + 1) * (2 * RAD + 1);
+        const double valExpected = sumA / num *
+          pixelsSrc[xSrc + ySrc * W_SRC] + sumB / num;
+        const double err = fabs(pixelsDst[cx + cy * W_DST] - valExpected);
+        errMax = (err > errMax) ? err : errMax;
+      }
+    SHOULD_BE_TRUE(errMax < 1.0e-4);
+
+    // noise is smoothed inside halves, edge stays sharp
+    double devMax = 0.0;
+    for (int cy = 0; cy < H_DST; cy++)
+    {
+      const double dev = fabs(pixelsDst[3 + cy * W_DST] - 0.2);
+      devMax = (dev > devMax) ? dev : devMax;
+    }
+    SHOULD_BE_TRUE(devMax < 0.015);
+    const int xEdge = W_DST / 2;
+    SHOULD_BE_TRUE(pixelsDst[xEdge - 1] < 0.3f);
+    SHOULD_BE_TRUE(pixelsDst[xEdge + 1] > 0.7f);
+
+    ok = GuidedFilter::downsample2d(pixelsSrc, W_SRC, H_SRC, pixelsDst,
+      W_DST, H_DST, RAD, 0.0f);
+    SHOULD_EQUAL(ok, -1);
+
+    // Downsample2d wrapper, auto radius
+    MUint32 *pixelsArgb = M_NEW(MUint32[W_SRC * H_SRC]);
+    for (int i = 0; i < W_SRC * H_SRC; i++)
+    {
+      pixelsSrc[i] = (float)(int)(pixelsSrc[i] * 255.0f) * (1.0f / 255.0f);
+      pixelsArgb[i] = 0xff000000 | (MUint32)(pixelsSrc[i] * 255.0f + 0.5f);
+    }
+    Downsample2d downSampler;
+    downSampler.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+    SHOULD_EQUAL(downSampler.performGuided(), 1);
+    GuidedFilter::downsample2d(pixelsSrc, W_SRC, H_SRC, pixelsDst, W_DST,
+      H_DST, 0, GUIDED_EPS_DEFAULT);
+    errMax = 0.0;
+    for (int i = 0; i < W_DST * H_DST; i++)
+    {
+      const double err = fabs(downSampler.getImageGuided()[i] - pixelsDst[i]);
+      errMax = (err > errMax) ? err : errMax;
+    }
+    SHOULD_BE_TRUE(errMax < 1.0e-5);
+    downSampler.destroy();
+    delete [] pixelsArgb;
+    delete [] pixelsDst;
+    delete [] pixelsSrc;
+  }
+  END_IT
+
+  IT("volume guided downsampling keeps flat areas and edges")
+  {
+    const int DIM = 24;
+    const int DIM_DST = 12;
+    KtxTexture *vol = M_NEW(KtxTexture);
+    vol->create3D(DIM, DIM, DIM, 1);
+    MUint8 *pixels = vol->getData();
+    // two flat halves along z, slices next to edge get small halo
+    for (int i = 0; i < DIM * DIM * DIM; i++)
+      pixels[i] = (i / (DIM * DIM) < DIM / 2) ? 40 : 200;
+    int ok = vol->scaleDownGuided(DIM_DST, DIM_DST, DIM_DST);
+    SHOULD_EQUAL(ok, 1);
+    SHOULD_EQUAL(vol->getWidth(), DIM_DST);
+    SHOULD_EQUAL(vol->getDepth(), DIM_DST);
+    pixels = vol->getData();
+    int numWrong = 0;
+    for (int i = 0; i < DIM_DST * DIM_DST * DIM_DST; i++)
+    {
+      const int valExpected = (i / (DIM_DST * DIM_DST) < DIM_DST / 2) ?
+        40 : 200;
+      numWrong += (abs(pixels[i] - valExpected) > 8) ? 1 : 0;
+    }
+    SHOULD_EQUAL(numWrong, 0);
+    ok = vol->scaleDownGuided(DIM, DIM, DIM);
+    SHOULD_EQUAL(ok, -1);
+    delete vol;
+  }
+  END_IT
+
+  IT("volume filtered by slices equals direct window sums")
+  {
+    // z window (5 slices) is shorter than volume, so rings wrap
+    const int DIMS_SRC[3] = { 23, 17, 19 };
+    const int DIMS_DST[3] = { 9, 7, 8 };
+    const int RAD = 2;
+    const float EPS = 0.02f;
+    const int NUM_SRC = DIMS_SRC[0] * DIMS_SRC[1] * DIMS_SRC[2];
+    const int NUM_DST = DIMS_DST[0] * DIMS_DST[1] * DIMS_DST[2];
+    MUint8 *volSrc = M_NEW(MUint8[NUM_SRC]);
+    MUint8 *volDst = M_NEW(MUint8[NUM_DST]);
+    srand(41);
+    // noisy ball
+    for (int i = 0; i < NUM_SRC; i++)
+    {
+      const int x = i % DIMS_SRC[0] - 11;
+      const int y = i / DIMS_SRC[0] % DIMS_SRC[1] - 8;
+      const int z = i / (DIMS_SRC[0] * DIMS_SRC[1]) - 9;
+      const int base = (x * x + y * y + z * z < 49) ? 180 : 60;
+      volSrc[i] = (MUint8)(base + (rand() & 31) - 16);
+    }
+    int ok = GuidedFilter::downsample3d(volSrc, DIMS_SRC[0], DIMS_SRC[1],
+      DIMS_SRC[2], volDst, DIMS_DST[0], DIMS_DST[1], DIMS_DST[2], RAD, EPS);
+    SHOULD_EQUAL(ok, 1);
+
+    int numWrong = 0;
+    int d[3];
+    for (d[2] = 0; d[2] < DIMS_DST[2]; d[2]++)
+      for (d[1] = 0; d[1] < DIMS_DST[1]; d[1]++)
+        for (d[0] = 0; d[0] < DIMS_DST[0]; d[0]++)
+        {
+          int s[3];
+          for (int k = 0; k < 3; k++)
+            s[k] = DIMS_SRC[k] * d[k] / DIMS_DST[k];
+          double sumA = 0.0, sumB = 0.0, a, b;
+          int w[3];
+          for (w[2] = -RAD; w[2] <= RAD; w[2]++)
+            for (w[1] = -RAD; w[1] <= RAD; w[1]++)
+              for (w[0] = -RAD; w[0] <= RAD; w[0]++)
+              {
+                int pos[3];
+                for (int k = 0; k < 3; k++)
+                  pos[k] = _clampTest(s[k] + w[k], DIMS_SRC[k]);
+                _getGuidedModel3d(volSrc, DIMS_SRC, pos, RAD, EPS, &a, &b);
+                sumA += a;
+                sumB += b;
+              }
+          const double num = (2 * RAD + 1) * (2 * RAD + 1) * (2 * RAD + 1);
+          const int offSrc = s[0] + (s[1] + s[2] * DIMS_SRC[1]) *
+            DIMS_SRC[0];
+          const double valExpected = (sumA / num * volSrc[offSrc] *
+            (1.0 / 255.0) + sumB / num) * 255.0;
+          const int offDst = d[0] + (d[1] + d[2] * DIMS_DST[1]) *
+            DIMS_DST[0];
+          numWrong += (fabs(volDst[offDst] - valExpected) > 0.52) ? 1 : 0;
+        }
+    SHOULD_EQUAL(numWrong, 0);
+    delete [] volDst;
+    delete [] volSrc;
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testPolyphase, "void testPolyphase()")
+  IT("phase tables give true centers and kernel weights")
+  {
+    // exact periods (100 -> 35 repeats every 7) and quantized phases
+    const int dimsSrc[] = { 100, 512, 1000, 64 };
+    const int dimsDst[] = { 35, 179, 999, 64 };
+    const int numPhasesExpected[] = { 7, 179, POLY_MAX_PHASES, 1 };
+    const float KOEF = 0.3f;
+    const int RAD = 4;
+    for (int t = 0; t < 4; t++)
+    {
+      PolyphaseTaps taps;
+      int ok = taps.create(dimsSrc[t], dimsDst[t], RAD, KOEF);
+      SHOULD_EQUAL(ok, 1);
+      SHOULD_EQUAL(taps.getNumPhases(), numPhasesExpected[t]);
+      SHOULD_EQUAL(taps.getNumTaps(), 2 * RAD + 2);
+      const float errCenter = (numPhasesExpected[t] == POLY_MAX_PHASES) ?
+        (0.5f / POLY_MAX_PHASES + 1.0e-4f) : 1.0e-4f;
+      float errMax = 0.0f, errWeightMax = 0.0f;
+      for (int d = 0; d < dimsDst[t]; d++)
+      {
+        const float center = (d + 0.5f) * dimsSrc[t] / dimsDst[t] - 0.5f;
+        const float err = fabsf(taps.getCenter(d) - center);
+        errMax = (err > errMax) ? err : errMax;
+        const float *weights = taps.getWeights(d);
+        for (int k = 0; k < taps.getNumTaps(); k++)
+        {
+          const float dist = taps.getFirst(d) + k - taps.getCenter(d);
+          const float w = (fabsf(dist) <= RAD) ?
+            expf(-dist * dist * KOEF) : 0.0f;
+          const float errW = fabsf(weights[k] - w);
+          errWeightMax = (errW > errWeightMax) ? errW : errWeightMax;
+        }
+      }   // for (d)
+      SHOULD_BE_TRUE(errMax < errCenter);
+      SHOULD_BE_TRUE(errWeightMax < 1.0e-5f);
+    }     // for (t)
+  }
+  END_IT
+
+  IT("gauss and bilateral are centered at fractional source position")
+  {
+    const int W_SRC = 160;
+    const int H_SRC = 120;
+    const int W_DST = (int)(W_SRC * 0.35f);
+    const int H_DST = (int)(H_SRC * 0.35f);
+    const float SLOPE = 0.004f;
+    // linear ramp: symmetric kernels return ramp value at kernel center
+    MUint32 *pixelsArgb = M_NEW(MUint32[W_SRC * H_SRC]);
+    for (int y = 0; y < H_SRC; y++)
+      for (int x = 0; x < W_SRC; x++)
+        pixelsArgb[x + y * W_SRC] = 0xff000000 | (MUint32)x;
+    Downsample2d downSampler;
+    int ok = downSampler.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+    SHOULD_EQUAL(ok, 1);
+    float *pixelsSrc = downSampler.getImageSrc();
+    for (int i = 0; i < W_SRC * H_SRC; i++)
+      pixelsSrc[i] = (i % W_SRC) * SLOPE;
+    ok = downSampler.performDownSamplingAll();
+    SHOULD_EQUAL(ok, 1);
+    float *pixelsSlow = M_NEW(float[W_DST * H_DST]);
+    float *pixelsFast = M_NEW(float[W_DST * H_DST]);
+    downSampler.performGaussSlow(pixelsSrc, pixelsSlow);
+    downSampler.performGaussFast(pixelsSrc, pixelsFast);
+    float errSlowFast = 0.0f, errGauss = 0.0f, errBilateral = 0.0f;
+    for (int cy = 0; cy < H_DST; cy++)
+      for (int cx = 0; cx < W_DST; cx++)
+      {
+        const int off = cx + cy * W_DST;
+        float err = fabsf(pixelsSlow[off] - pixelsFast[off]);
+        errSlowFast = (err > errSlowFast) ? err : errSlowFast;
+        const float xCenter = (cx + 0.5f) * W_SRC / W_DST - 0.5f;
+        // far from left and right borders
+        if ((xCenter < 9.0f) || (xCenter > W_SRC - 10.0f))
+          continue;
+        const float valExpected = xCenter * SLOPE;
+        err = fabsf(pixelsFast[off] - valExpected);
+        errGauss = (err > errGauss) ? err : errGauss;
+        err = fabsf(downSampler.getImageBilaterail()[off] - valExpected);
+        errBilateral = (err > errBilateral) ? err : errBilateral;
+      }
+    SHOULD_BE_TRUE(errSlowFast < 1.0e-5f);
+    SHOULD_BE_TRUE(errGauss < 1.0e-4f);
+    SHOULD_BE_TRUE(errBilateral < 1.0e-4f);
+    downSampler.destroy();
+    delete [] pixelsFast;
+    delete [] pixelsSlow;
+    delete [] pixelsArgb;
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testPyramid, "void testPyramid()")
+  IT("every pyramid level equals downsampling of previous level")
+  {
+    const int W = 150;
+    const int H = 97;
+    const int NUM_LEVELS = 4;
+    MUint32 *pixelsArgb = M_NEW(MUint32[W * H]);
+    srand(42);
+    for (int i = 0; i < W * H; i++)
+      pixelsArgb[i] = 0xff000000 | (MUint32)((i % W + (rand() & 0x3f)) & 0xff);
+    for (int m = 0; m < 2; m++)
+    {
+      const DsPyramidMethod method = (m == 0) ? DS_PYRAMID_GAUSS :
+        DS_PYRAMID_ADVANCED;
+      Downsample2d downSampler;
+      int ok = downSampler.create(W, H, pixelsArgb, W / 2, H / 2);
+      SHOULD_EQUAL(ok, 1);
+      ok = downSampler.performPyramid(NUM_LEVELS, method);
+      SHOULD_EQUAL(ok, 1);
+      SHOULD_EQUAL(downSampler.getNumPyramidLevels(), NUM_LEVELS);
+      SHOULD_EQUAL(downSampler.getWidthPyramid(3), 9);
+      SHOULD_EQUAL(downSampler.getHeightPyramid(3), 6);
+
+      // the same steps by single level instances
+      const float *pixelsPrev = downSampler.getImageSrc();
+      int wPrev = W;
+      int hPrev = H;
+      float errMax = 0.0f;
+      for (int level = 0; level < NUM_LEVELS; level++)
+      {
+        const int w = downSampler.getWidthPyramid(level);
+        const int h = downSampler.getHeightPyramid(level);
+        SHOULD_EQUAL(w, wPrev / 2);
+        SHOULD_EQUAL(h, hPrev / 2);
+        Downsample2d downSamplerLevel;
+        downSamplerLevel.create(wPrev, hPrev, pixelsArgb, w, h);
+        memcpy(downSamplerLevel.getImageSrc(), pixelsPrev,
+          wPrev * hPrev * sizeof(float));
+        const float *pixelsExpected;
+        if (method == DS_PYRAMID_GAUSS)
+        {
+          downSamplerLevel.performGaussFast(downSamplerLevel.getImageSrc(),
+            downSamplerLevel.getImageGauss());
+          pixelsExpected = downSamplerLevel.getImageGauss();
+        }
+        else
+        {
+          downSamplerLevel.performDownSamplingAll();
+          pixelsExpected = downSamplerLevel.getImageDownSampled();
+        }
+        const float *pixelsLevel = downSampler.getImagePyramid(level);
+        for (int i = 0; i < w * h; i++)
+        {
+          const float err = fabsf(pixelsLevel[i] - pixelsExpected[i]);
+          errMax = (err > errMax) ? err : errMax;
+        }
+        pixelsPrev = pixelsLevel;
+        wPrev = w;
+        hPrev = h;
+      }   // for (level)
+      SHOULD_BE_TRUE(errMax < 1.0e-6f);
+    }     // for (m)
+    Downsample2d downSampler;
+    downSampler.create(W, H, pixelsArgb, W / 2, H / 2);
+    SHOULD_EQUAL(downSampler.performPyramid(0), 0);
+    SHOULD_EQUAL(downSampler.performPyramid(DS_MAX_PYRAMID_LEVELS + 1), 0);
+
+    // arena gives memory for the largest pyramid only
+    MemArena arena;
+    SHOULD_EQUAL(arena.create(1024 * 1024), 1);
+    Downsample2d downSamplerArena;
+    downSamplerArena.create(W, H, pixelsArgb, W / 2, H / 2, &arena);
+    SHOULD_EQUAL(downSamplerArena.performPyramid(3), 1);
+    const size_t usedLargest = arena.getUsed();
+    for (int numLevels = 1; numLevels <= 3; numLevels++)
+    {
+      SHOULD_EQUAL(downSamplerArena.performPyramid(numLevels), 1);
+      SHOULD_EQUAL(downSamplerArena.getNumPyramidLevels(), numLevels);
+    }
+    SHOULD_EQUAL(arena.getUsed(), usedLargest);
+    delete [] pixelsArgb;
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testStack, "void testStack()")
+  IT("stack methods equal single slice downsampling")
+  {
+    const int W_SRC = 70;
+    const int H_SRC = 50;
+    const int W_DST = 24;
+    const int H_DST = 17;
+    const int NUM_SLICES = 6;
+    const int NUM_SRC = W_SRC * H_SRC;
+    const int NUM_DST = W_DST * H_DST;
+    KtxTexture *vol = M_NEW(KtxTexture);
+    vol->create3D(W_SRC, H_SRC, NUM_SLICES, 1);
+    MUint8 *slicesSrc = vol->getData();
+    srand(43);
+    for (int i = 0; i < NUM_SRC * NUM_SLICES; i++)
+      slicesSrc[i] = (MUint8)(((i % W_SRC) * 3 + (i / NUM_SRC) * 20 +
+        (rand() & 0x1f)) & 0xff);
+    MUint8 *slicesDst = M_NEW(MUint8[NUM_DST * NUM_SLICES]);
+    MUint32 *pixelsArgb = M_NEW(MUint32[NUM_SRC]);
+    Downsample2d downSamplerStack;
+    downSamplerStack.setMedianRadius(2);
+    for (int m = 0; m <= DS_METHOD_COUNT; m++)
+    {
+      // last pass is gauss without interleaving
+      const DsMethod method = (m < DS_METHOD_COUNT) ? (DsMethod)m :
+        DS_METHOD_GAUSS;
+      downSamplerStack.setStackInterleave((m < DS_METHOD_COUNT) ? 1 : 0);
+      int ok = (m & 1) ?
+        downSamplerStack.performStack(vol, slicesDst, W_DST, H_DST, method) :
+        downSamplerStack.performStack(slicesSrc, W_SRC, H_SRC, NUM_SLICES,
+          slicesDst, W_DST, H_DST, method);
+      SHOULD_EQUAL(ok, 1);
+      int numWrong = 0;
+      for (int s = 0; s < NUM_SLICES; s++)
+      {
+        for (int i = 0; i < NUM_SRC; i++)
+          pixelsArgb[i] = 0xff000000 | slicesSrc[s * NUM_SRC + i];
+        Downsample2d downSampler;
+        downSampler.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+        downSampler.setMedianRadius(2);
+        const float *pixels = NULL;
+        switch (method)
+        {
+          case DS_METHOD_SUBSAMPLE:
+          case DS_METHOD_BILATERAL:
+          case DS_METHOD_ADVANCED:
+            downSampler.performDownSamplingAll();
+            pixels = (method == DS_METHOD_SUBSAMPLE) ?
+              downSampler.getImageSubSample() :
+              ((method == DS_METHOD_BILATERAL) ?
+              downSampler.getImageBilaterail() :
+              downSampler.getImageDownSampled());
+            break;
+          case DS_METHOD_GAUSS:
+            downSampler.performGaussFast(downSampler.getImageSrc(),
+              downSampler.getImageGauss());
+            pixels = downSampler.getImageGauss();
+            break;
+          case DS_METHOD_MEDIAN:
+            downSampler.performMedian();
+            pixels = downSampler.getImageMedian();
+            break;
+          default:
+            downSampler.performGuided();
+            pixels = downSampler.getImageGuided();
+            break;
+        }
+        for (int i = 0; i < NUM_DST; i++)
+        {
+          const int valExpected = (int)(pixels[i] * 255.0f + 0.5f);
+          numWrong += (abs(slicesDst[s * NUM_DST + i] - valExpected) > 1) ?
+            1 : 0;
+        }
+      }   // for (s)
+      SHOULD_EQUAL(numWrong, 0);
+    }     // for (m)
+    SHOULD_EQUAL(downSamplerStack.performStack(slicesSrc, W_SRC, H_SRC, 0,
+      slicesDst, W_DST, H_DST, DS_METHOD_GAUSS), 0);
+    delete [] pixelsArgb;
+    delete [] slicesDst;
+    delete vol;
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testFixedPoint, "void testFixedPoint()")
+  IT("fixed point methods are close to float ones")
+  {
+    const int W_SRC = 93;
+    const int H_SRC = 61;
+    const int W_DST = 40;
+    const int H_DST = 25;
+    const int NUM_SRC = W_SRC * H_SRC;
+    const int NUM_DST = W_DST * H_DST;
+    MUint32 *pixelsArgb = M_NEW(MUint32[NUM_SRC]);
+    srand(44);
+    // smooth ramps, noise and step edge
+    for (int i = 0; i < NUM_SRC; i++)
+    {
+      const int x = i % W_SRC;
+      const int y = i / W_SRC;
+      const int val = ((x < W_SRC / 2) ? (x + y) : (200 - y)) +
+        (rand() & 0x1f);
+      pixelsArgb[i] = 0xff000000 | (val & 0xff);
+    }
+    Downsample2d downSamplerFloat, downSamplerFixed;
+    downSamplerFloat.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+    downSamplerFixed.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+    downSamplerFixed.setFixedPoint(1);
+    SHOULD_EQUAL(downSamplerFixed.getFixedPoint(), 1);
+    downSamplerFloat.performDownSamplingAll();
+    downSamplerFixed.performDownSamplingAll();
+
+    const float *imagesFloat[3] = {
+      downSamplerFloat.getImageGauss(),
+      downSamplerFloat.getImageBilaterail(),
+      downSamplerFloat.getImageDownSampled()
+    };
+    const float *imagesFixed[3] = {
+      downSamplerFixed.getImageGauss(),
+      downSamplerFixed.getImageBilaterail(),
+      downSamplerFixed.getImageDownSampled()
+    };
+    for (int m = 0; m < 3; m++)
+    {
+      int errMax = 0;
+      for (int i = 0; i < NUM_DST; i++)
+      {
+        const int valFloat = (int)(imagesFloat[m][i] * 255.0f + 0.5f);
+        const int valFixed = (int)(imagesFixed[m][i] * 255.0f + 0.5f);
+        const int err = abs(valFloat - valFixed);
+        errMax = (err > errMax) ? err : errMax;
+      }
+      SHOULD_BE_TRUE(errMax <= 1);
+    }
+    delete [] pixelsArgb;
+  }
+  END_IT
+
+  IT("fixed point stack is close to float stack")
+  {
+    const int W_SRC = 70;
+    const int H_SRC = 50;
+    const int W_DST = 24;
+    const int H_DST = 17;
+    const int NUM_SLICES = 5;
+    const int NUM_SRC = W_SRC * H_SRC;
+    const int NUM_DST = W_DST * H_DST;
+    MUint8 *slicesSrc = M_NEW(MUint8[NUM_SRC * NUM_SLICES]);
+    MUint8 *slicesFloat = M_NEW(MUint8[NUM_DST * NUM_SLICES]);
+    MUint8 *slicesFixed = M_NEW(MUint8[NUM_DST * NUM_SLICES]);
+    srand(45);
+    for (int i = 0; i < NUM_SRC * NUM_SLICES; i++)
+      slicesSrc[i] = (MUint8)(((i % W_SRC) * 3 + (i / NUM_SRC) * 20 +
+        (rand() & 0x3f)) & 0xff);
+    Downsample2d downSampler;
+    const DsMethod methods[3] = {
+      DS_METHOD_GAUSS, DS_METHOD_BILATERAL, DS_METHOD_ADVANCED
+    };
+    for (int m = 0; m < 3; m++)
+    {
+      downSampler.setFixedPoint(0);
+      int ok = downSampler.performStack(slicesSrc, W_SRC, H_SRC, NUM_SLICES,
+        slicesFloat, W_DST, H_DST, methods[m]);
+      SHOULD_EQUAL(ok, 1);
+      downSampler.setFixedPoint(1);
+      ok = downSampler.performStack(slicesSrc, W_SRC, H_SRC, NUM_SLICES,
+        slicesFixed, W_DST, H_DST, methods[m]);
+      SHOULD_EQUAL(ok, 1);
+      int errMax = 0;
+      for (int i = 0; i < NUM_DST * NUM_SLICES; i++)
+      {
+        const int err = abs(slicesFloat[i] - slicesFixed[i]);
+        errMax = (err > errMax) ? err : errMax;
+      }
+      SHOULD_BE_TRUE(errMax <= 1);
+    }
+    delete [] slicesFixed;
+    delete [] slicesFloat;
+    delete [] slicesSrc;
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testHalfStorage, "void testHalfStorage()")
+  IT("convert floats to 16 bits and back")
+  {
+    SHOULD_EQUAL(HalfFloat::fromFloat(1.0f, HALF_FORMAT_FP16), 0x3c00);
+    SHOULD_EQUAL(HalfFloat::fromFloat(-2.0f, HALF_FORMAT_FP16), 0xc000);
+    SHOULD_EQUAL(HalfFloat::fromFloat(65504.0f, HALF_FORMAT_FP16), 0x7bff);
+    SHOULD_EQUAL(HalfFloat::fromFloat(65520.0f, HALF_FORMAT_FP16), 0x7c00);
+    // smallest subnormal, half of it rounds to even (zero)
+    SHOULD_EQUAL(HalfFloat::fromFloat(5.9604645e-8f, HALF_FORMAT_FP16), 1);
+    SHOULD_EQUAL(HalfFloat::fromFloat(2.9802322e-8f, HALF_FORMAT_FP16), 0);
+    // 1 + 2 ^ -11 is tie between 1 and 1 + 2 ^ -10
+    SHOULD_EQUAL(HalfFloat::fromFloat(1.00048828f, HALF_FORMAT_FP16), 0x3c00);
+    SHOULD_EQUAL(HalfFloat::fromFloat(1.0f, HALF_FORMAT_BFLOAT16), 0x3f80);
+    SHOULD_EQUAL(HalfFloat::fromFloat(1.00390625f, HALF_FORMAT_BFLOAT16),
+      0x3f80);
+    SHOULD_BE_TRUE(HalfFloat::toFloat(0x3555, HALF_FORMAT_FP16) ==
+      0.333251953125f);
+    SHOULD_BE_TRUE(HalfFloat::toFloat(0x0001, HALF_FORMAT_FP16) ==
+      5.9604645e-8f);
+    SHOULD_BE_TRUE(HalfFloat::toFloat(0x3eab, HALF_FORMAT_BFLOAT16) ==
+      0.333984375f);
+
+    // rows (hardware part and tail) are the same as scalar conversion
+    const int NUM = 37;
+    float vals[NUM], valsBack[NUM];
+    MUint16 halves[NUM];
+    int numWrong = 0;
+    for (int f = 0; f < 2; f++)
+    {
+      const HalfFormat format = (f == 0) ? HALF_FORMAT_FP16 :
+        HALF_FORMAT_BFLOAT16;
+      int i;
+      for (i = 0; i < NUM; i++)
+        vals[i] = (i - 10) * 0.37f + i * i * 3.1f;
+      // rounding ties, subnormal, overflow and negative zero
+      vals[1] = 1.00048828f;
+      vals[3] = 1.5f * 5.9604645e-8f;
+      vals[5] = 65520.0f;
+      vals[7] = -0.0f;
+      HalfFloat::fromFloatRow(vals, halves, NUM, format);
+      HalfFloat::toFloatRow(halves, valsBack, NUM, format);
+      for (i = 0; i < NUM; i++)
+      {
+        numWrong += (halves[i] != HalfFloat::fromFloat(vals[i], format)) ?
+          1 : 0;
+        numWrong += (valsBack[i] != HalfFloat::toFloat(halves[i], format)) ?
+          1 : 0;
+      }
+    }
+    SHOULD_EQUAL(numWrong, 0);
+  }
+  END_IT
+
+  IT("16 bit storage gives results close to float storage")
+  {
+    const int W_SRC = 93;
+    const int H_SRC = 61;
+    const int W_DST = 40;
+    const int H_DST = 25;
+    const int NUM_SRC = W_SRC * H_SRC;
+    const int NUM_DST = W_DST * H_DST;
+    MUint32 *pixelsArgb = M_NEW(MUint32[NUM_SRC]);
+    srand(46);
+    for (int i = 0; i < NUM_SRC; i++)
+    {
+      const int x = i % W_SRC;
+      const int y = i / W_SRC;
+      const int val = ((x < W_SRC / 2) ? (x + y) : (200 - y)) +
+        (rand() & 0x1f);
+      pixelsArgb[i] = 0xff000000 | (val & 0xff);
+    }
+    Downsample2d downSamplerFloat;
+    downSamplerFloat.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+    downSamplerFloat.performDownSamplingAll();
+    downSamplerFloat.performMedian();
+    downSamplerFloat.performGuided();
+    downSamplerFloat.performPyramid(2);
+    for (int s = DS_STORAGE_FP16; s <= DS_STORAGE_BFLOAT16; s++)
+    {
+      Downsample2d downSampler;
+      downSampler.setStorage((DsStorage)s);
+      SHOULD_EQUAL(downSampler.getStorage(), s);
+      SHOULD_EQUAL(downSampler.create(W_SRC, H_SRC, pixelsArgb, W_DST,
+        H_DST), 1);
+      SHOULD_BE_TRUE(downSampler.getImageSrc() == NULL);
+      SHOULD_EQUAL(downSampler.performDownSamplingAll(), 1);
+      SHOULD_EQUAL(downSampler.performMedian(), 1);
+      SHOULD_EQUAL(downSampler.performGuided(), 1);
+      SHOULD_EQUAL(downSampler.performPyramid(2), 1);
+      // methods without 16 bit images are exact
+      float errExact = 0.0f;
+      float errAdvanced = 0.0f;
+      int i;
+      for (i = 0; i < NUM_DST; i++)
+      {
+        const float errs[4] = {
+          downSampler.getImageSubSample()[i] -
+            downSamplerFloat.getImageSubSample()[i],
+          downSampler.getImageBilaterail()[i] -
+            downSamplerFloat.getImageBilaterail()[i],
+          downSampler.getImageMedian()[i] -
+            downSamplerFloat.getImageMedian()[i],
+          downSampler.getImageGuided()[i] -
+            downSamplerFloat.getImageGuided()[i]
+        };
+        for (int k = 0; k < 4; k++)
+          errExact = (fabsf(errs[k]) > errExact) ? fabsf(errs[k]) : errExact;
+        const float err = fabsf(downSampler.getImageDownSampled()[i] -
+          downSamplerFloat.getImageDownSampled()[i]);
+        errAdvanced = (err > errAdvanced) ? err : errAdvanced;
+      }
+      const int numLevel = downSampler.getWidthPyramid(1) *
+        downSampler.getHeightPyramid(1);
+      for (i = 0; i < numLevel; i++)
+      {
+        const float err = fabsf(downSampler.getImagePyramid(1)[i] -
+          downSamplerFloat.getImagePyramid(1)[i]);
+        errAdvanced = (err > errAdvanced) ? err : errAdvanced;
+      }
+      SHOULD_BE_TRUE(errExact < 1.0e-6f);
+      // restored image precision: 11 bits FP16, 8 bits bfloat16
+      SHOULD_BE_TRUE(errAdvanced < ((s == DS_STORAGE_FP16) ? 0.2f : 1.0f) /
+        255.0f);
+    }
+    delete [] pixelsArgb;
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testColor, "void testColor()")
+  IT("colour channels of grey image are the same as grey results")
+  {
+    const int W_SRC = 71;
+    const int H_SRC = 53;
+    const int W_DST = 30;
+    const int H_DST = 21;
+    const int NUM_SRC = W_SRC * H_SRC;
+    const int NUM_DST = W_DST * H_DST;
+    MUint32 *pixelsArgb = M_NEW(MUint32[NUM_SRC]);
+    srand(47);
+    for (int i = 0; i < NUM_SRC; i++)
+    {
+      const int x = i % W_SRC;
+      const int y = i / W_SRC;
+      const MUint32 val = (((x < W_SRC / 3) ? (2 * x + y) : (180 - y)) +
+        (rand() & 0x1f)) & 0xff;
+      pixelsArgb[i] = 0xff000000 | (val << 16) | (val << 8) | val;
+    }
+    Downsample2d downSamplerGrey;
+    downSamplerGrey.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+    downSamplerGrey.performDownSamplingAll();
+    for (int w = DS_COLOR_WEIGHTS_LUMA; w <= DS_COLOR_WEIGHTS_VECTOR; w++)
+    {
+      Downsample2d downSampler;
+      downSampler.setNumChannels(3);
+      downSampler.setColorWeights((DsColorWeights)w);
+      SHOULD_EQUAL(downSampler.getNumChannels(), 3);
+      SHOULD_EQUAL(downSampler.create(W_SRC, H_SRC, pixelsArgb, W_DST,
+        H_DST), 1);
+      SHOULD_EQUAL(downSampler.performDownSamplingAll(), 1);
+      float errMax = 0.0f;
+      for (int c = 0; c < 3; c++)
+      {
+        for (int i = 0; i < NUM_DST; i++)
+        {
+          const int off = c * NUM_DST + i;
+          const float errs[4] = {
+            downSampler.getImageColorSubSample()[off] -
+              downSamplerGrey.getImageSubSample()[i],
+            downSampler.getImageColorGauss()[off] -
+              downSamplerGrey.getImageGauss()[i],
+            downSampler.getImageColorBilateral()[off] -
+              downSamplerGrey.getImageBilaterail()[i],
+            downSampler.getImageColorDownSampled()[off] -
+              downSamplerGrey.getImageDownSampled()[i]
+          };
+          for (int k = 0; k < 4; k++)
+            errMax = (fabsf(errs[k]) > errMax) ? fabsf(errs[k]) : errMax;
+        }
+      }
+      SHOULD_BE_TRUE(errMax < 1.0e-4f);
+    }
+    delete [] pixelsArgb;
+  }
+  END_IT
+
+  IT("vector weights keep edge between colours of equal luminance")
+  {
+    const int W_SRC = 64;
+    const int H_SRC = 48;
+    const int W_DST = 16;
+    const int H_DST = 12;
+    const int NUM_SRC = W_SRC * H_SRC;
+    const int NUM_DST = W_DST * H_DST;
+    MUint32 *pixelsArgb = M_NEW(MUint32[NUM_SRC]);
+    // red (luminance 76.2) and grey 76 halves
+    for (int i = 0; i < NUM_SRC; i++)
+      pixelsArgb[i] = ((i % W_SRC) < W_SRC / 2) ? 0xffff0000 : 0xff4c4c4c;
+    float errs[2];
+    for (int w = DS_COLOR_WEIGHTS_LUMA; w <= DS_COLOR_WEIGHTS_VECTOR; w++)
+    {
+      Downsample2d downSampler;
+      downSampler.setNumChannels(3);
+      downSampler.setColorWeights((DsColorWeights)w);
+      downSampler.setSigmaBilateralVal(0.1f);
+      SHOULD_EQUAL(downSampler.create(W_SRC, H_SRC, pixelsArgb, W_DST,
+        H_DST), 1);
+      SHOULD_EQUAL(downSampler.performDownSamplingAll(), 1);
+      // red channel difference from subsampled (sharp) image
+      errs[w] = 0.0f;
+      for (int i = 0; i < NUM_DST; i++)
+        errs[w] += fabsf(downSampler.getImageColorBilateral()[i] -
+          downSampler.getImageColorSubSample()[i]);
+    }
+    SHOULD_BE_TRUE(errs[DS_COLOR_WEIGHTS_VECTOR] * 4.0f <
+      errs[DS_COLOR_WEIGHTS_LUMA]);
+    delete [] pixelsArgb;
+  }
+  END_IT
+
+  IT("pack colour image into ARGB pixels")
+  {
+    const int W = 8;
+    const int H = 6;
+    const int NUM = W * H;
+    MUint32 pixelsArgb[NUM], pixelsDst[NUM];
+    for (int i = 0; i < NUM; i++)
+      pixelsArgb[i] = ((MUint32)(i * 5) << 24) | ((MUint32)(i * 3) << 16) |
+        ((MUint32)(255 - i) << 8) | (MUint32)(i * 2);
+    Downsample2d downSampler;
+    downSampler.setNumChannels(4);
+    SHOULD_EQUAL(downSampler.create(W, H, pixelsArgb, W, H), 1);
+    SHOULD_EQUAL(downSampler.performDownSamplingAll(), 1);
+    downSampler.packImageArgb(downSampler.getImageColorSubSample(),
+      pixelsDst);
+    int numWrong = 0;
+    for (int i = 0; i < NUM; i++)
+      numWrong += (pixelsDst[i] != pixelsArgb[i]) ? 1 : 0;
+    SHOULD_EQUAL(numWrong, 0);
+
+    // colour needs float storage
+    Downsample2d downSamplerHalf;
+    downSamplerHalf.setNumChannels(3);
+    downSamplerHalf.setStorage(DS_STORAGE_FP16);
+    SHOULD_EQUAL(downSamplerHalf.create(W, H, pixelsArgb, W, H), 0);
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testFlatRegions, "void testFlatRegions()")
+  IT("uniform image gives its value by every advanced method path")
+  {
+    const int W_SRC = 64;
+    const int H_SRC = 48;
+    const int W_DST = 20;
+    const int H_DST = 15;
+    const int NUM_SRC = W_SRC * H_SRC;
+    const int NUM_DST = W_DST * H_DST;
+    const int NUM_SLICES = 3;
+    MUint32 *pixelsArgb = M_NEW(MUint32[NUM_SRC]);
+    MUint8 *slicesSrc = M_NEW(MUint8[NUM_SRC * NUM_SLICES]);
+    MUint8 *slicesDst = M_NEW(MUint8[NUM_DST * NUM_SLICES]);
+    int i;
+    for (i = 0; i < NUM_SRC; i++)
+      pixelsArgb[i] = 0xff000000 | 100;
+    for (i = 0; i < NUM_SRC * NUM_SLICES; i++)
+      slicesSrc[i] = 100;
+    // flat test off: windows equal to restored image take gauss value
+    for (int tolerance = -1; tolerance <= 0; tolerance++)
+    {
+      for (int fixedPoint = 0; fixedPoint <= 1; fixedPoint++)
+      {
+        Downsample2d downSampler;
+        downSampler.setFlatTolerance(tolerance);
+        downSampler.setFixedPoint(fixedPoint);
+        SHOULD_EQUAL(downSampler.getFlatTolerance(), tolerance);
+        SHOULD_EQUAL(downSampler.create(W_SRC, H_SRC, pixelsArgb, W_DST,
+          H_DST), 1);
+        SHOULD_EQUAL(downSampler.performDownSamplingAll(), 1);
+        SHOULD_EQUAL(downSampler.performPyramid(2), 1);
+        int numWrong = 0;
+        for (i = 0; i < NUM_DST; i++)
+        {
+          const float val = downSampler.getImageDownSampled()[i];
+          numWrong += (fabsf(val * 255.0f - 100.0f) < 1.0e-3f) ? 0 : 1;
+        }
+        for (i = 0; i < W_SRC * H_SRC / 16; i++)
+        {
+          const float val = downSampler.getImagePyramid(1)[i];
+          numWrong += (fabsf(val * 255.0f - 100.0f) < 1.0e-3f) ? 0 : 1;
+        }
+        SHOULD_EQUAL(numWrong, 0);
+        SHOULD_EQUAL(downSampler.performStack(slicesSrc, W_SRC, H_SRC,
+          NUM_SLICES, slicesDst, W_DST, H_DST, DS_METHOD_ADVANCED), 1);
+        for (i = 0; i < NUM_DST * NUM_SLICES; i++)
+          numWrong += (slicesDst[i] == 100) ? 0 : 1;
+        SHOULD_EQUAL(numWrong, 0);
+      }
+    }
+    // colour image
+    for (i = 0; i < NUM_SRC; i++)
+      pixelsArgb[i] = 0xff204060;
+    Downsample2d downSamplerColor;
+    downSamplerColor.setNumChannels(3);
+    SHOULD_EQUAL(downSamplerColor.create(W_SRC, H_SRC, pixelsArgb, W_DST,
+      H_DST), 1);
+    SHOULD_EQUAL(downSamplerColor.performDownSamplingAll(), 1);
+    MUint32 *pixelsDst = M_NEW(MUint32[NUM_DST]);
+    downSamplerColor.packImageArgb(
+      downSamplerColor.getImageColorDownSampled(), pixelsDst);
+    int numWrongColor = 0;
+    for (i = 0; i < NUM_DST; i++)
+      numWrongColor += (pixelsDst[i] == 0xff204060) ? 0 : 1;
+    SHOULD_EQUAL(numWrongColor, 0);
+    delete [] pixelsDst;
+    delete [] slicesDst;
+    delete [] slicesSrc;
+    delete [] pixelsArgb;
+  }
+  END_IT
+
+  IT("flat windows give the same result as adaptive filter")
+  {
+    const int W_SRC = 120;
+    const int H_SRC = 90;
+    const int W_DST = 37;
+    const int H_DST = 29;
+    const int NUM_SRC = W_SRC * H_SRC;
+    const int NUM_DST = W_DST * H_DST;
+    MUint32 *pixelsArgb = M_NEW(MUint32[NUM_SRC]);
+    // slice like image: textured disk on flat background
+    srand(48);
+    int i;
+    for (i = 0; i < NUM_SRC; i++)
+    {
+      const int dx = (i % W_SRC) - W_SRC / 2;
+      const int dy = (i / W_SRC) - H_SRC / 2;
+      const int val = (dx * dx + dy * dy < 30 * 30) ?
+        (120 + dx + (rand() & 0x1f)) : 7;
+      pixelsArgb[i] = 0xff000000 | val;
+    }
+    for (int fixedPoint = 0; fixedPoint <= 1; fixedPoint++)
+    {
+      Downsample2d downSamplerRef;
+      downSamplerRef.setFlatTolerance(-1);
+      downSamplerRef.setFixedPoint(fixedPoint);
+      downSamplerRef.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+      downSamplerRef.performDownSamplingAll();
+      Downsample2d downSampler;
+      downSampler.setFixedPoint(fixedPoint);
+      downSampler.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+      SHOULD_EQUAL(downSampler.performDownSamplingAll(), 1);
+      float errMax = 0.0f;
+      for (i = 0; i < NUM_DST; i++)
+      {
+        const float err = fabsf(downSampler.getImageDownSampled()[i] -
+          downSamplerRef.getImageDownSampled()[i]);
+        errMax = (err > errMax) ? err : errMax;
+      }
+      SHOULD_BE_TRUE(errMax < 1.0e-5f);
+    }
+    delete [] pixelsArgb;
+  }
+  END_IT
+
+  IT("noise below tolerance is taken as flat")
+  {
+    const int W_SRC = 96;
+    const int H_SRC = 64;
+    const int W_DST = 24;
+    const int H_DST = 16;
+    const int NUM_SRC = W_SRC * H_SRC;
+    const int NUM_DST = W_DST * H_DST;
+    MUint32 *pixelsArgb = M_NEW(MUint32[NUM_SRC]);
+    srand(49);
+    for (int i = 0; i < NUM_SRC; i++)
+      pixelsArgb[i] = 0xff000000 | (MUint32)(50 + (rand() % 3) - 1);
+    Downsample2d downSampler;
+    downSampler.setFlatTolerance(2);
+    downSampler.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+    SHOULD_EQUAL(downSampler.performDownSamplingAll(), 1);
+    float errMax = 0.0f;
+    for (int i = 0; i < NUM_DST; i++)
+    {
+      const float err = fabsf(downSampler.getImageDownSampled()[i] * 255.0f -
+        50.0f);
+      errMax = (err > errMax) ? err : errMax;
+    }
+    SHOULD_BE_TRUE(errMax < 0.5f);
+    delete [] pixelsArgb;
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testRegion, "void testRegion()")
+  IT("regions give the same values as whole image methods")
+  {
+    const int W_SRC = 301;
+    const int H_SRC = 223;
+    const int W_DST = 150;
+    const int H_DST = 97;
+    const int NUM_SRC = W_SRC * H_SRC;
+    MUint32 *pixelsArgb = M_NEW(MUint32[NUM_SRC]);
+    srand(50);
+    for (int i = 0; i < NUM_SRC; i++)
+    {
+      const int dx = (i % W_SRC) - W_SRC / 3;
+      const int dy = (i / W_SRC) - H_SRC / 2;
+      const int val = (dx * dx + dy * dy < 70 * 70) ?
+        (90 + dy + (rand() & 0x3f)) : 12;
+      pixelsArgb[i] = 0xff000000 | val;
+    }
+    // viewport pans over image
+    const int NUM_VIEWS = 3;
+    const int views[NUM_VIEWS][4] = {
+      { 10, 5, 50, 40 }, { 40, 30, 70, 60 }, { 100, 60, 50, 37 }
+    };
+    for (int s = DS_STORAGE_FLOAT; s <= DS_STORAGE_FP16; s++)
+    {
+      Downsample2d downSamplerAll;
+      downSamplerAll.setStorage((DsStorage)s);
+      downSamplerAll.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+      downSamplerAll.performDownSamplingAll();
+      Downsample2d downSampler;
+      downSampler.setStorage((DsStorage)s);
+      downSampler.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+      const DsMethod methods[4] = { DS_METHOD_SUBSAMPLE, DS_METHOD_GAUSS,
+        DS_METHOD_BILATERAL, DS_METHOD_ADVANCED };
+      const float *imagesAll[4] = { downSamplerAll.getImageSubSample(),
+        downSamplerAll.getImageGauss(), downSamplerAll.getImageBilaterail(),
+        downSamplerAll.getImageDownSampled() };
+      int m, v;
+      for (m = 3; m >= 0; m--)
+      {
+        for (v = 0; v < NUM_VIEWS; v++)
+        {
+          const int *view = views[v];
+          SHOULD_EQUAL(downSampler.performRegion(methods[m], view[0],
+            view[1], view[2], view[3]), 1);
+        }
+      }
+      // getters keep region tiles and compute the rest
+      float *images[4] = { downSampler.getImageSubSample(),
+        downSampler.getImageGauss(), downSampler.getImageBilaterail(),
+        downSampler.getImageDownSampled() };
+      int numWrong = 0;
+      for (m = 3; m >= 0; m--)
+      {
+        for (v = 0; v < NUM_VIEWS; v++)
+        {
+          const int *view = views[v];
+          for (int y = view[1]; y < view[1] + view[3]; y++)
+          {
+            for (int x = view[0]; x < view[0] + view[2]; x++)
+            {
+              const float err = fabsf(images[m][x + y * W_DST] -
+                imagesAll[m][x + y * W_DST]);
+              numWrong += (err < 1.0e-6f) ? 0 : 1;
+            }
+          }
+        }   // for (v)
+      }     // for (m)
+      SHOULD_EQUAL(numWrong, 0);
+    }
+    delete [] pixelsArgb;
+  }
+  END_IT
+
+  IT("computed tiles are reused until invalidated")
+  {
+    const int W_SRC = 200;
+    const int H_SRC = 160;
+    const int W_DST = 100;
+    const int H_DST = 80;
+    const int NUM_SRC = W_SRC * H_SRC;
+    MUint32 *pixelsArgb = M_NEW(MUint32[NUM_SRC]);
+    for (int i = 0; i < NUM_SRC; i++)
+      pixelsArgb[i] = 0xff000000 | (MUint32)((i % W_SRC + i / W_SRC) & 0xff);
+    Downsample2d downSampler;
+    downSampler.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+    SHOULD_EQUAL(downSampler.performRegion(DS_METHOD_BILATERAL, 0, 0, 10,
+      10), 1);
+    float *pixelsBil = downSampler.getImageBilaterail();
+    const float val = pixelsBil[5 + 5 * W_DST];
+    // changed value stays: tile is not computed again
+    pixelsBil[5 + 5 * W_DST] = -1.0f;
+    SHOULD_EQUAL(downSampler.performRegion(DS_METHOD_BILATERAL, 2, 2, 70,
+      70), 1);
+    SHOULD_BE_TRUE(pixelsBil[5 + 5 * W_DST] == -1.0f);
+    downSampler.invalidateTiles();
+    SHOULD_EQUAL(downSampler.performRegion(DS_METHOD_BILATERAL, 2, 2, 70,
+      70), 1);
+    SHOULD_BE_TRUE(pixelsBil[5 + 5 * W_DST] == val);
+
+    // not supported
+    SHOULD_EQUAL(downSampler.performRegion(DS_METHOD_MEDIAN, 0, 0, 10,
+      10), 0);
+    SHOULD_EQUAL(downSampler.performRegion(DS_METHOD_GAUSS, 95, 0, 10,
+      10), 0);
+    SHOULD_EQUAL(downSampler.performRegion(DS_METHOD_GAUSS, 0, 0, 0,
+      10), 0);
+    Downsample2d downSamplerColor;
+    downSamplerColor.setNumChannels(3);
+    downSamplerColor.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+    SHOULD_EQUAL(downSamplerColor.performRegion(DS_METHOD_GAUSS, 0, 0, 10,
+      10), 0);
+    delete [] pixelsArgb;
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testLazy, "void testLazy()")
+  IT("getters compute methods invalidated by parameter setters only")
+  {
+    const int W_SRC = 160;
+    const int H_SRC = 120;
+    const int W_DST = 70;
+    const int H_DST = 50;
+    const int NUM_SRC = W_SRC * H_SRC;
+    const int NUM_DST = W_DST * H_DST;
+    MUint32 *pixelsArgb = M_NEW(MUint32[NUM_SRC]);
+    srand(49);
+    for (int i = 0; i < NUM_SRC; i++)
+    {
+      const int val = ((i % W_SRC) < W_SRC / 2) ? 40 : 200;
+      pixelsArgb[i] = 0xff000000 | (MUint32)(val + (rand() & 0x1f));
+    }
+    Downsample2d downSamplerAll;
+    downSamplerAll.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+    downSamplerAll.performDownSamplingAll();
+    Downsample2d downSampler;
+    downSampler.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+
+    // first access computes
+    float *pixelsSub = downSampler.getImageSubSample();
+    float *pixelsGauss = downSampler.getImageGauss();
+    float *pixelsBil = downSampler.getImageBilaterail();
+    float *pixelsDown = downSampler.getImageDownSampled();
+    int numWrong = 0;
+    int i;
+    for (i = 0; i < NUM_DST; i++)
+    {
+      numWrong += (pixelsSub[i] == downSamplerAll.getImageSubSample()[i]) ?
+        0 : 1;
+      numWrong += (fabsf(pixelsGauss[i] -
+        downSamplerAll.getImageGauss()[i]) < 1.0e-5f) ? 0 : 1;
+      numWrong += (pixelsBil[i] ==
+        downSamplerAll.getImageBilaterail()[i]) ? 0 : 1;
+      numWrong += (pixelsDown[i] ==
+        downSamplerAll.getImageDownSampled()[i]) ? 0 : 1;
+    }
+    SHOULD_EQUAL(numWrong, 0);
+
+    // marks are kept while images are valid
+    const float MARK = -1.0f;
+    pixelsSub[0] = pixelsGauss[0] = pixelsBil[0] = pixelsDown[0] = MARK;
+    downSampler.setSigmaBilateralVal(downSampler.getSigmaBilateralVal());
+    downSampler.setFlatTolerance(downSampler.getFlatTolerance());
+    SHOULD_EQUAL(downSampler.updateDownSamplingAll(), 1);
+    SHOULD_BE_TRUE(downSampler.getImageBilaterail()[0] == MARK);
+    SHOULD_BE_TRUE(downSampler.getImageDownSampled()[0] == MARK);
+
+    // bilateral sigma change recomputes bilateral only
+    downSampler.setSigmaBilateralVal(0.1f);
+    SHOULD_EQUAL(downSampler.updateDownSamplingAll(), 1);
+    SHOULD_BE_TRUE(downSampler.getImageSubSample()[0] == MARK);
+    SHOULD_BE_TRUE(downSampler.getImageGauss()[0] == MARK);
+    SHOULD_BE_TRUE(downSampler.getImageDownSampled()[0] == MARK);
+    SHOULD_BE_TRUE(pixelsBil[0] != MARK);
+    downSamplerAll.setSigmaBilateralVal(0.1f);
+    numWrong = 0;
+    for (i = 0; i < NUM_DST; i++)
+      numWrong += (pixelsBil[i] ==
+        downSamplerAll.getImageBilaterail()[i]) ? 0 : 1;
+    SHOULD_EQUAL(numWrong, 0);
+
+    // fixed point changes all methods except subsample
+    pixelsBil[0] = MARK;
+    downSampler.setFixedPoint(1);
+    SHOULD_BE_TRUE(downSampler.getImageSubSample()[0] == MARK);
+    SHOULD_BE_TRUE(downSampler.getImageGauss()[0] != MARK);
+    SHOULD_BE_TRUE(downSampler.getImageBilaterail()[0] != MARK);
+    SHOULD_BE_TRUE(downSampler.getImageDownSampled()[0] != MARK);
+
+    // median and guided parameters
+    float *pixelsMedian = downSampler.getImageMedian();
+    float *pixelsGuided = downSampler.getImageGuided();
+    pixelsMedian[0] = pixelsGuided[0] = MARK;
+    downSampler.setMedianPercentile(0.25f);
+    SHOULD_BE_TRUE(downSampler.getImageMedian()[0] != MARK);
+    SHOULD_BE_TRUE(downSampler.getImageGuided()[0] == MARK);
+    downSampler.setGuidedEps(0.02f);
+    SHOULD_BE_TRUE(downSampler.getImageGuided()[0] != MARK);
+
+    // failed method gives NULL and is computed again on next access
+    downSampler.setMedianPercentile(2.0f);
+    SHOULD_BE_TRUE(downSampler.getImageMedian() == NULL);
+    SHOULD_BE_TRUE(downSampler.getImageMedian() == NULL);
+    downSampler.setMedianPercentile(0.5f);
+    SHOULD_BE_TRUE(downSampler.getImageMedian() == pixelsMedian);
+
+    // explicit invalidation
+    pixelsSub[0] = MARK;
+    downSampler.invalidateTiles();
+    SHOULD_BE_TRUE(downSampler.getImageSubSample()[0] != MARK);
+    delete [] pixelsArgb;
+  }
+  END_IT
+END_DESCRIBE
+
+DESCRIBE(testUpdateSource, "void testUpdateSource()")
+  IT("source rect update gives the same images as new create")
+  {
+    const int W_SRC = 301;
+    const int H_SRC = 223;
+    const int W_DST = 150;
+    const int H_DST = 97;
+    const int NUM_SRC = W_SRC * H_SRC;
+    const int NUM_DST = W_DST * H_DST;
+    MUint32 *pixelsArgb = M_NEW(MUint32[NUM_SRC]);
+    srand(51);
+    for (int i = 0; i < NUM_SRC; i++)
+    {
+      const int val = ((i % W_SRC) * 3 + (i / W_SRC) + (rand() & 0x1f)) &
+        0xff;
+      pixelsArgb[i] = 0xff000000 | val;
+    }
+    // redaction box, then new rows at bottom
+    const int NUM_RECTS = 2;
+    const int rects[NUM_RECTS][4] = {
+      { 120, 60, 40, 25 }, { 0, H_SRC - 15, W_SRC, 15 }
+    };
+    const float MARK = -1.0f;
+    for (int s = DS_STORAGE_FLOAT; s <= DS_STORAGE_FP16; s++)
+    {
+      Downsample2d downSampler;
+      downSampler.setStorage((DsStorage)s);
+      downSampler.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+      float *images[4] = { downSampler.getImageSubSample(),
+        downSampler.getImageGauss(), downSampler.getImageBilaterail(),
+        downSampler.getImageDownSampled() };
+      int m;
+      // far pixel is not computed again
+      for (m = 0; m < 4; m++)
+        images[m][0] = MARK;
+      for (int r = 0; r < NUM_RECTS; r++)
+      {
+        const int *rect = rects[r];
+        for (int y = rect[1]; y < rect[1] + rect[3]; y++)
+          for (int x = rect[0]; x < rect[0] + rect[2]; x++)
+            pixelsArgb[x + y * W_SRC] = 0xff000000 | ((r == 0) ? 0 : 0xf0);
+        SHOULD_EQUAL(downSampler.updateSource(pixelsArgb, rect[0], rect[1],
+          rect[2], rect[3]), 1);
+
+        Downsample2d downSamplerAll;
+        downSamplerAll.setStorage((DsStorage)s);
+        downSamplerAll.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+        downSamplerAll.performDownSamplingAll();
+        const float *imagesAll[4] = { downSamplerAll.getImageSubSample(),
+          downSamplerAll.getImageGauss(),
+          downSamplerAll.getImageBilaterail(),
+          downSamplerAll.getImageDownSampled() };
+        int numWrong = 0;
+        for (m = 0; m < 4; m++)
+        {
+          SHOULD_BE_TRUE(images[m][0] == MARK);
+          for (int i = 1; i < NUM_DST; i++)
+          {
+            const float err = fabsf(images[m][i] - imagesAll[m][i]);
+            numWrong += (err < 1.0e-6f) ? 0 : 1;
+          }
+        }
+        SHOULD_EQUAL(numWrong, 0);
+      } // for (r)
+      // restore source for next storage
+      srand(51);
+      for (int i = 0; i < NUM_SRC; i++)
+      {
+        const int val = ((i % W_SRC) * 3 + (i / W_SRC) + (rand() & 0x1f)) &
+          0xff;
+        pixelsArgb[i] = 0xff000000 | val;
+      }
+    } // for (s)
+    delete [] pixelsArgb;
+  }
+  END_IT
+
+  IT("partial, colour and wrong updates")
+  {
+    const int W_SRC = 200;
+    const int H_SRC = 160;
+    const int W_DST = 90;
+    const int H_DST = 70;
+    const int NUM_SRC = W_SRC * H_SRC;
+    const int NUM_DST = W_DST * H_DST;
+    MUint32 *pixelsArgb = M_NEW(MUint32[NUM_SRC]);
+    int i;
+    for (i = 0; i < NUM_SRC; i++)
+      pixelsArgb[i] = 0xff000000 | (MUint32)(((i % W_SRC) * 7) & 0xff) |
+        ((MUint32)((i / W_SRC) & 0xff) << 16);
+    Downsample2d downSampler;
+    downSampler.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+    Downsample2d downSamplerColor;
+    downSamplerColor.setNumChannels(3);
+    downSamplerColor.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+    SHOULD_EQUAL(downSampler.performRegion(DS_METHOD_ADVANCED, 0, 0, 30,
+      30), 1);
+    downSamplerColor.getImageColorDownSampled();
+
+    for (int y = 10; y < 40; y++)
+      for (int x = 5; x < 25; x++)
+        pixelsArgb[x + y * W_SRC] = 0xff102030;
+    SHOULD_EQUAL(downSampler.updateSource(pixelsArgb, 5, 10, 20, 30), 1);
+    SHOULD_EQUAL(downSamplerColor.updateSource(pixelsArgb, 5, 10, 20, 30),
+      1);
+    Downsample2d downSamplerAll;
+    downSamplerAll.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+    downSamplerAll.performDownSamplingAll();
+    Downsample2d downSamplerColorAll;
+    downSamplerColorAll.setNumChannels(3);
+    downSamplerColorAll.create(W_SRC, H_SRC, pixelsArgb, W_DST, H_DST);
+    downSamplerColorAll.performDownSamplingAll();
+    const float *pixelsDown = downSampler.getImageDownSampled();
+    const float *pixelsDownAll = downSamplerAll.getImageDownSampled();
+    const float *pixelsColor = downSamplerColor.getImageColorDownSampled();
+    const float *pixelsColorAll =
+      downSamplerColorAll.getImageColorDownSampled();
+    int numWrong = 0;
+    for (i = 0; i < NUM_DST; i++)
+      numWrong += (fabsf(pixelsDown[i] - pixelsDownAll[i]) < 1.0e-6f) ?
+        0 : 1;
+    for (i = 0; i < 3 * NUM_DST; i++)
+      numWrong += (pixelsColor[i] == pixelsColorAll[i]) ? 0 : 1;
+    SHOULD_EQUAL(numWrong, 0);
+
+    SHOULD_EQUAL(downSampler.updateSource(pixelsArgb, 190, 0, 20, 10), 0);
+    SHOULD_EQUAL(downSampler.updateSource(pixelsArgb, 0, 0, 0, 10), 0);
+    SHOULD_EQUAL(downSampler.updateSource(NULL, 0, 0, 10, 10), 0);
+    delete [] pixelsArgb;
+  }
+  END_IT
+END_DESCRIBE
+
 
 // ****************************************************************************
 // Main test launcher
@@ -408,6 +3023,29 @@ END_DESCRIBE
 
 DEFINE_DESCRIPTION(testLoadImage)
 DEFINE_DESCRIPTION(testLoadVolume)
+DEFINE_DESCRIPTION(testKtxSize64)
+DEFINE_DESCRIPTION(testResampleVolume)
+DEFINE_DESCRIPTION(testMemTrackStats)
+DEFINE_DESCRIPTION(testMemArena)
+DEFINE_DESCRIPTION(testPnmIo)
+DEFINE_DESCRIPTION(testVolumeView)
+DEFINE_DESCRIPTION(testOrthoSlices)
+DEFINE_DESCRIPTION(testReslice)
+DEFINE_DESCRIPTION(testReorient)
+DEFINE_DESCRIPTION(testGaussRecursive)
+DEFINE_DESCRIPTION(testRankFilter)
+DEFINE_DESCRIPTION(testLabelDownsample)
+DEFINE_DESCRIPTION(testGuidedFilter)
+DEFINE_DESCRIPTION(testPolyphase)
+DEFINE_DESCRIPTION(testPyramid)
+DEFINE_DESCRIPTION(testStack)
+DEFINE_DESCRIPTION(testFixedPoint)
+DEFINE_DESCRIPTION(testHalfStorage)
+DEFINE_DESCRIPTION(testColor)
+DEFINE_DESCRIPTION(testFlatRegions)
+DEFINE_DESCRIPTION(testRegion)
+DEFINE_DESCRIPTION(testLazy)
+DEFINE_DESCRIPTION(testUpdateSource)
 
 int  main(int argc, char *argv)
 {
@@ -423,6 +3061,29 @@ int  main(int argc, char *argv)
   int res = 0;
   res += CSpec_Run(DESCRIPTION(testLoadImage),  CSpec_NewOutputVerbose());
   res += CSpec_Run(DESCRIPTION(testLoadVolume), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testKtxSize64), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testResampleVolume), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testMemTrackStats), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testMemArena), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testPnmIo), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testVolumeView), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testOrthoSlices), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testReslice), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testReorient), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testGaussRecursive), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testRankFilter), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testLabelDownsample), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testGuidedFilter), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testPolyphase), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testPyramid), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testStack), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testFixedPoint), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testHalfStorage), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testColor), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testFlatRegions), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testRegion), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testLazy), CSpec_NewOutputVerbose());
+  res += CSpec_Run(DESCRIPTION(testUpdateSource), CSpec_NewOutputVerbose());
 
   int memAllocatedSize = MemTrackGetSize(NULL);
   MemTrackStop();
@@ -0,0 +1,290 @@
+// ****************************************************************************
+// File: arena.cpp
+// Purpose: Linear (frame) allocator for pipeline temporary buffers
+// ****************************************************************************
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "memtrack.h"
+#include "arena.h"
+
+// ****************************************************************************
+// Defines
+// ****************************************************************************
+
+// main block grows with this granularity
+#define MEM_ARENA_GROW_STEP         (1024 * 1024)
+
+// large page size used when OS can not tell it
+#define MEM_ARENA_HUGE_PAGE_SIZE    (2 * 1024 * 1024)
+
+#define MEM_ARENA_ALIGN_UP(s)       \
+  (((s) + MEM_ARENA_ALIGN - 1) & ~(size_t)(MEM_ARENA_ALIGN - 1))
+
+// ****************************************************************************
+// Types
+// ****************************************************************************
+
+// Header of block allocated outside of main arena block
+struct MemArenaOverflow
+{
+  MemArenaOverflow   *m_next;
+  MUint8             *m_raw;
+  size_t              m_size;
+};
+
+// ****************************************************************************
+// Vars
+// ****************************************************************************
+
+static thread_local MemArena  *s_arenaCurrent = NULL;
+
+// ****************************************************************************
+// Methods
+// ****************************************************************************
+
+static MUint8 *_allocHugePages(size_t *sizeBytes)
+{
+#if defined(_WIN32)
+  // needs "Lock pages in memory" privilege, fails without it
+  size_t pageSize = (size_t)GetLargePageMinimum();
+  if (pageSize == 0)
+    return NULL;
+  *sizeBytes = (*sizeBytes + pageSize - 1) & ~(pageSize - 1);
+  void *p = VirtualAlloc(NULL, *sizeBytes,
+    MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+  return (MUint8*)p;
+#else
+  const size_t pageSize = MEM_ARENA_HUGE_PAGE_SIZE;
+  *sizeBytes = (*sizeBytes + pageSize - 1) & ~(pageSize - 1);
+  void *p = mmap(NULL, *sizeBytes, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return NULL;
+#if defined(MADV_HUGEPAGE)
+  madvise(p, *sizeBytes, MADV_HUGEPAGE);
+#endif
+  return (MUint8*)p;
+#endif
+}
+
+static void _freeHugePages(MUint8 *p, const size_t sizeBytes)
+{
+#if defined(_WIN32)
+  USE_PARAM(sizeBytes);
+  VirtualFree(p, 0, MEM_RELEASE);
+#else
+  munmap(p, sizeBytes);
+#endif
+}
+
+MemArena::MemArena()
+{
+  m_blockRaw      = NULL;
+  m_block         = NULL;
+  m_capacity      = 0;
+  m_used          = 0;
+  m_usedOverflow  = 0;
+  m_highWater     = 0;
+  m_useHugePages  = 0;
+  m_isHugePages   = 0;
+  m_overflow      = NULL;
+  m_numOverflow   = 0;
+}
+
+MemArena::~MemArena()
+{
+  destroy();
+}
+
+int MemArena::allocateBlock(const size_t capacityBytes)
+{
+  assert(m_blockRaw == NULL);
+  size_t sizeBytes = capacityBytes;
+  if (m_useHugePages)
+  {
+    m_blockRaw = _allocHugePages(&sizeBytes);
+    m_isHugePages = (m_blockRaw != NULL) ? 1 : 0;
+  }
+  if (m_blockRaw != NULL)
+  {
+    m_block = m_blockRaw;
+  }
+  else
+  {
+    sizeBytes = MEM_ARENA_ALIGN_UP(capacityBytes);
+    m_blockRaw = M_NEW(MUint8[sizeBytes + MEM_ARENA_ALIGN]);
+    if (m_blockRaw == NULL)
+      return -1;
+    m_block = (MUint8*)MEM_ARENA_ALIGN_UP((size_t)m_blockRaw);
+  }
+  m_capacity = sizeBytes;
+  MemTrackArenaReserve((long long)m_capacity);
+  return 1;
+}
+
+void MemArena::releaseBlock()
+{
+  if (m_blockRaw == NULL)
+    return;
+  if (m_isHugePages)
+    _freeHugePages(m_blockRaw, m_capacity);
+  else
+    delete [] m_blockRaw;
+  MemTrackArenaReserve(-(long long)m_capacity);
+  m_blockRaw    = NULL;
+  m_block       = NULL;
+  m_capacity    = 0;
+  m_isHugePages = 0;
+}
+
+int MemArena::create(const size_t capacityBytes, const int useHugePages)
+{
+  destroy();
+  m_useHugePages = useHugePages;
+  return allocateBlock(capacityBytes);
+}
+
+void MemArena::destroy()
+{
+  MemArenaMarker markerEmpty = { 0, 0 };
+  rewind(markerEmpty);
+  releaseBlock();
+  m_highWater = 0;
+}
+
+void *MemArena::allocate(const size_t numBytes)
+{
+  const size_t sizeBytes = MEM_ARENA_ALIGN_UP((numBytes > 0) ? numBytes : 1);
+  MUint8 *p;
+  if (m_used + sizeBytes <= m_capacity)
+  {
+    p = m_block + m_used;
+    m_used += sizeBytes;
+  }
+  else
+  {
+    // header is placed just before aligned user data
+    const size_t sizeHead = MEM_ARENA_ALIGN_UP(sizeof(MemArenaOverflow));
+    MUint8 *raw = M_NEW(MUint8[sizeHead + sizeBytes + MEM_ARENA_ALIGN]);
+    if (raw == NULL)
+      return NULL;
+    p = (MUint8*)MEM_ARENA_ALIGN_UP((size_t)raw + sizeHead);
+    MemArenaOverflow *over = (MemArenaOverflow*)(p - sizeHead);
+    over->m_raw  = raw;
+    over->m_next = m_overflow;
+    over->m_size = sizeBytes;
+    m_overflow = over;
+    m_numOverflow++;
+    m_usedOverflow += sizeBytes;
+  }
+  const size_t used = m_used + m_usedOverflow;
+  if (used > m_highWater)
+  {
+    m_highWater = used;
+    MemTrackArenaUse((long long)used);
+  }
+  return p;
+}
+
+MemArenaMarker MemArena::getMarker() const
+{
+  MemArenaMarker marker;
+  marker.m_used         = m_used;
+  marker.m_numOverflow  = m_numOverflow;
+  return marker;
+}
+
+void MemArena::rewind(const MemArenaMarker &marker)
+{
+  assert(marker.m_used <= m_used);
+  while (m_numOverflow > marker.m_numOverflow)
+  {
+    MemArenaOverflow *over = m_overflow;
+    m_overflow = over->m_next;
+    m_usedOverflow -= over->m_size;
+    m_numOverflow--;
+    delete [] over->m_raw;
+  }
+  m_used = marker.m_used;
+}
+
+int MemArena::reset()
+{
+  MemArenaMarker markerEmpty = { 0, 0 };
+  rewind(markerEmpty);
+  if (m_highWater <= m_capacity)
+    return 1;
+  // last job did not fit: grow block, so next one does
+  size_t capacityNew = (m_highWater + MEM_ARENA_GROW_STEP - 1) /
+    MEM_ARENA_GROW_STEP * MEM_ARENA_GROW_STEP;
+  releaseBlock();
+  return allocateBlock(capacityNew);
+}
+
+MemArena *MemArena::getCurrent()
+{
+  return s_arenaCurrent;
+}
+
+void MemArena::setCurrent(MemArena *arena)
+{
+  s_arenaCurrent = arena;
+}
+
+MemArenaScope::MemArenaScope(MemArena *arena)
+{
+  m_arena     = arena;
+  m_arenaPrev = MemArena::getCurrent();
+  m_marker    = arena->getMarker();
+  MemArena::setCurrent(arena);
+}
+
+MemArenaScope::~MemArenaScope()
+{
+  if ((m_marker.m_used == 0) && (m_marker.m_numOverflow == 0))
+    m_arena->reset();
+  else
+    m_arena->rewind(m_marker);
+  MemArena::setCurrent(m_arenaPrev);
+}
+
+MemArenaFrame::MemArenaFrame()
+{
+  m_arena = MemArena::getCurrent();
+  if (m_arena != NULL)
+    m_marker = m_arena->getMarker();
+  m_numHeapBlocks = 0;
+}
+
+MemArenaFrame::~MemArenaFrame()
+{
+  if (m_arena != NULL)
+    m_arena->rewind(m_marker);
+  for (int i = 0; i < m_numHeapBlocks; i++)
+    delete [] m_heapBlocks[i];
+}
+
+void *MemArenaFrame::allocate(const size_t numBytes)
+{
+  if (m_arena != NULL)
+    return m_arena->allocate(numBytes);
+  assert(m_numHeapBlocks < MEM_ARENA_FRAME_MAX_HEAP);
+  if (m_numHeapBlocks >= MEM_ARENA_FRAME_MAX_HEAP)
+    return NULL;
+  MUint8 *p = M_NEW(MUint8[numBytes]);
+  if (p != NULL)
+    m_heapBlocks[m_numHeapBlocks++] = p;
+  return p;
+}
@@ -0,0 +1,142 @@
+// ****************************************************************************
+// File: arena.h
+// Purpose: Linear (frame) allocator for pipeline temporary buffers
+// ****************************************************************************
+
+#ifndef  __arena_h
+#define  __arena_h
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include <stddef.h>
+
+#include "mtypes.h"
+
+// ****************************************************************************
+// Defines
+// ****************************************************************************
+
+// alignment of every block returned by arena
+#define MEM_ARENA_ALIGN               64
+
+// max heap blocks per frame, when no arena is active
+#define MEM_ARENA_FRAME_MAX_HEAP      4
+
+// ****************************************************************************
+// Types
+// ****************************************************************************
+
+struct MemArenaOverflow;
+
+//! Arena state, returned by getMarker() and restored by rewind()
+typedef struct tagMemArenaMarker
+{
+  size_t    m_used;
+  int       m_numOverflow;
+} MemArenaMarker;
+
+// ****************************************************************************
+// Class
+// ****************************************************************************
+
+/**
+* \class MemArena single memory block, allocated once and reused by jobs.
+* Allocation only moves an offset, memory is released all at once by
+* reset(). Requests not fitting into block go to separate overflow blocks,
+* then on reset() main block grows up to high water mark, so next job of
+* the same size runs without any heap calls.
+* Arena is not thread safe: use one arena per worker thread.
+*/
+
+class MemArena
+{
+public:
+  MemArena();
+  ~MemArena();
+
+  /*!
+   * \brief Allocate main block
+   * \param capacityBytes Initial block size
+   * \param useHugePages Try to use OS large pages (fallback to usual heap)
+   * \return 1 if ok, -1 if no memory
+   */
+  int           create(const size_t capacityBytes, const int useHugePages = 0);
+  void          destroy();
+
+  //! MEM_ARENA_ALIGN aligned memory, NULL if no memory
+  void         *allocate(const size_t numBytes);
+
+  MemArenaMarker getMarker() const;
+  //! Release everything allocated after marker was taken
+  void          rewind(const MemArenaMarker &marker);
+  //! Release all, grow main block if previous job did not fit into it
+  int           reset();
+
+  size_t        getCapacity() const   { return m_capacity;  }
+  size_t        getUsed() const       { return m_used + m_usedOverflow; }
+  size_t        getHighWater() const  { return m_highWater; }
+  int           isHugePages() const   { return m_isHugePages; }
+
+  //! Arena used by MemArenaFrame in current thread (NULL if none)
+  static MemArena *getCurrent();
+  static void      setCurrent(MemArena *arena);
+
+private:
+  int           allocateBlock(const size_t capacityBytes);
+  void          releaseBlock();
+
+  MUint8             *m_blockRaw;
+  MUint8             *m_block;
+  size_t              m_capacity;
+  size_t              m_used;
+  size_t              m_usedOverflow;
+  size_t              m_highWater;
+  int                 m_useHugePages;
+  int                 m_isHugePages;
+  MemArenaOverflow   *m_overflow;
+  int                 m_numOverflow;
+};
+
+/**
+* \class MemArenaScope makes arena current for a job in this thread.
+* On exit arena is rewound to its state on entry (reset if it was empty)
+* and previous current arena is restored.
+*/
+
+class MemArenaScope
+{
+public:
+  MemArenaScope(MemArena *arena);
+  ~MemArenaScope();
+
+private:
+  MemArena         *m_arena;
+  MemArena         *m_arenaPrev;
+  MemArenaMarker    m_marker;
+};
+
+/**
+* \class MemArenaFrame temporary buffers of one function call.
+* Buffers come from current arena if it is set, from heap otherwise.
+* All frame buffers are released when frame goes out of scope.
+*/
+
+class MemArenaFrame
+{
+public:
+  MemArenaFrame();
+  ~MemArenaFrame();
+
+  //! MEM_ARENA_ALIGN aligned in arena, NULL if no memory
+  void             *allocate(const size_t numBytes);
+
+private:
+  MemArena         *m_arena;
+  MemArenaMarker    m_marker;
+  MUint8           *m_heapBlocks[MEM_ARENA_FRAME_MAX_HEAP];
+  int               m_numHeapBlocks;
+};
+
+#endif
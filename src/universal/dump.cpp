@@ -14,7 +14,9 @@
 #include <math.h>
 #include <memory.h>
 #include <string.h>
+#if defined(_WIN32)
 #include <io.h>
+#endif
 #include <assert.h>
 
 #include "memtrack.h"
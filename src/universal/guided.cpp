@@ -0,0 +1,485 @@
+// ****************************************************************************
+// File: guided.cpp
+// Purpose: Edge preserving downsampling by guided filter
+//
+// Based on
+// K.He, J.Sun, X.Tang, "Guided Image Filtering", 2010
+// ****************************************************************************
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include <stdio.h>
+#include <memory.h>
+#include <assert.h>
+
+#include "arena.h"
+#include "parallel.h"
+#include "guided.h"
+
+// ****************************************************************************
+// Defines
+// ****************************************************************************
+
+// floats of line part processed by one box pass item
+#define GUIDED_STRIP              256
+// narrowest strip (cache line) when lines are few
+#define GUIDED_STRIP_MIN          16
+// slice rows per item of per voxel passes
+#define GUIDED_ROWS               8
+
+// ****************************************************************************
+// Types
+// ****************************************************************************
+
+// Source image (float) or volume (bytes)
+struct GuidedJob
+{
+  const float  *m_srcFloat;
+  const MUint8 *m_srcBytes;
+  int           m_dimsSrc[3];
+  int           m_dimsDst[3];
+  int           m_radius[3];
+  float         m_eps;
+};
+
+// One box pass: lines go along axis with step strideAlong, every line
+// element is a row of rowLen contiguous floats (1 for x pass). Groups are
+// independent sets of lines (slices for y pass, rows for x pass).
+struct BoxPassJob
+{
+  const float  *m_src;
+  float        *m_dst;
+  int           m_numAlong;
+  size_t        m_strideAlong;
+  int           m_rowLen;
+  int           m_numGroups;
+  size_t        m_strideGroup;
+  int           m_radius;
+  int           m_stripLen;
+  int           m_numStrips;
+};
+
+// Volume goes slice by slice through 3 stages: xy box means of I and
+// I * I (P, Q), linear model a, b of window from z means of P, Q and
+// its xy box means (A, B), destination rows from z means of A, B.
+// Every stage keeps its slices in rings of 2 * rz + 2: z window and
+// slice leaving running z sums of P, Q.
+struct GuidedSliceJob
+{
+  const GuidedJob *m_job;
+  size_t        m_xyDim;
+  int           m_ringLen;
+  float        *m_ringP;
+  float        *m_ringQ;
+  float        *m_ringA;
+  float        *m_ringB;
+  // running z sums of P, Q (NULL without z window)
+  double       *m_sumP;
+  double       *m_sumQ;
+  // ring offsets of z window slices, slices entering and leaving sums
+  size_t       *m_window;
+  int           m_numWindow;
+  size_t        m_offAdd;
+  size_t        m_offSub;
+  // slice of current stage
+  int           m_z;
+  int           m_zDst;
+  float        *m_dstFloat;
+  MUint8       *m_dstBytes;
+};
+
+// ****************************************************************************
+// Box filter
+// ****************************************************************************
+
+static void _boxPassCallback(
+                              void       *userData,
+                              const int   itemStart,
+                              const int   itemEnd
+                            )
+{
+  const BoxPassJob *job = (const BoxPassJob*)userData;
+  const int     rad = job->m_radius;
+  const int     num = job->m_numAlong;
+  const size_t  stride = job->m_strideAlong;
+  const double  scale = 1.0 / (2 * rad + 1);
+  // running sums in double: no drift along long lines
+  double sums[GUIDED_STRIP];
+  for (int item = itemStart; item < itemEnd; item++)
+  {
+    const int group = item / job->m_numStrips;
+    const int xStart = (item % job->m_numStrips) * job->m_stripLen;
+    const int len = (job->m_rowLen - xStart < job->m_stripLen) ?
+      (job->m_rowLen - xStart) : job->m_stripLen;
+    const size_t off = group * job->m_strideGroup + xStart;
+    const float *src = job->m_src + off;
+    float *dst = job->m_dst + off;
+    int i, x;
+
+    for (x = 0; x < len; x++)
+      sums[x] = 0.0;
+    for (i = -rad; i <= rad; i++)
+    {
+      const float *row = src + clampIndex(i, num) * stride;
+      for (x = 0; x < len; x++)
+        sums[x] += row[x];
+    }
+    for (i = 0; i < num; i++)
+    {
+      float *rowDst = dst + i * stride;
+      const float *rowAdd = src + clampIndex(i + rad + 1, num) * stride;
+      const float *rowSub = src + clampIndex(i - rad, num) * stride;
+      for (x = 0; x < len; x++)
+      {
+        rowDst[x] = (float)(sums[x] * scale);
+        sums[x] += (double)rowAdd[x] - rowSub[x];
+      }
+    }   // for (i)
+  }     // for (item)
+}
+
+static void _boxPass(
+                      const float  *src,
+                      float        *dst,
+                      const int     numAlong,
+                      const size_t  strideAlong,
+                      const int     rowLen,
+                      const int     numGroups,
+                      const size_t  strideGroup,
+                      const int     radius
+                    )
+{
+  BoxPassJob job;
+  job.m_src         = src;
+  job.m_dst         = dst;
+  job.m_numAlong    = numAlong;
+  job.m_strideAlong = strideAlong;
+  job.m_rowLen      = rowLen;
+  job.m_numGroups   = numGroups;
+  job.m_strideGroup = strideGroup;
+  job.m_radius      = radius;
+  // y pass of one slice has few strips: narrow them to feed all threads
+  const int numItemsMin = Parallel::getNumThreads() * 4;
+  int stripLen = GUIDED_STRIP;
+  while ((stripLen > GUIDED_STRIP_MIN) &&
+    (numGroups * ((rowLen + stripLen - 1) / stripLen) < numItemsMin))
+    stripLen >>= 1;
+  job.m_stripLen    = stripLen;
+  job.m_numStrips   = (rowLen + stripLen - 1) / stripLen;
+  const int numItems = numGroups * job.m_numStrips;
+  // x pass has many short items
+  const int itemsPerChunk = (rowLen == 1) ? 64 : 1;
+  Parallel::forRange(numItems, _boxPassCallback, &job, itemsPerChunk);
+}
+
+// Box mean of one slice in xy, in place: x pass slice -> tmp, y pass
+// tmp -> slice
+static void _boxSlice(const GuidedJob *job, float *slice, float *tmp)
+{
+  const int xDim = job->m_dimsSrc[0];
+  const int yDim = job->m_dimsSrc[1];
+  _boxPass(slice, tmp, xDim, 1, 1, yDim, xDim, job->m_radius[0]);
+  _boxPass(tmp, slice, yDim, xDim, xDim, 1, 0, job->m_radius[1]);
+}
+
+// ****************************************************************************
+// Guided filter
+// ****************************************************************************
+
+static inline float _getSrc(const GuidedJob *job, const size_t off)
+{
+  return job->m_srcFloat ? job->m_srcFloat[off] :
+    (job->m_srcBytes[off] * (1.0f / 255.0f));
+}
+
+static inline float *_getRingSlice(const GuidedSliceJob *sj, float *ring,
+  const int z)
+{
+  return ring + (size_t)(z % sj->m_ringLen) * sj->m_xyDim;
+}
+
+static inline size_t _getRingOffset(const GuidedSliceJob *sj, const int z)
+{
+  const int zClamped = clampIndex(z, sj->m_job->m_dimsSrc[2]);
+  return (size_t)(zClamped % sj->m_ringLen) * sj->m_xyDim;
+}
+
+// Ring offsets of z window slices around slice z, borders replicated
+static void _setWindow(GuidedSliceJob *sj, const int z)
+{
+  const int rad = sj->m_job->m_radius[2];
+  for (int d = -rad; d <= rad; d++)
+    sj->m_window[d + rad] = _getRingOffset(sj, z + d);
+  sj->m_offAdd = _getRingOffset(sj, z + rad);
+  sj->m_offSub = _getRingOffset(sj, z - rad - 1);
+}
+
+// I and I * I of rows of slice m_z to P and Q rings
+static void _loadRowsCallback(
+                                void       *userData,
+                                const int   rowStart,
+                                const int   rowEnd
+                              )
+{
+  const GuidedSliceJob *sj = (const GuidedSliceJob*)userData;
+  const GuidedJob *job = sj->m_job;
+  const size_t  xDim = job->m_dimsSrc[0];
+  const size_t  offSlice = (size_t)sj->m_z * sj->m_xyDim;
+  float *sliceP = _getRingSlice(sj, sj->m_ringP, sj->m_z);
+  float *sliceQ = _getRingSlice(sj, sj->m_ringQ, sj->m_z);
+  for (size_t i = rowStart * xDim; i < rowEnd * xDim; i++)
+  {
+    const float val = _getSrc(job, offSlice + i);
+    sliceP[i] = val;
+    sliceQ[i] = val * val;
+  }
+}
+
+// Linear model a, b of rows of slice m_z to A and B rings, from z window
+// means of P and Q. Running sums start with full window at slice 0.
+static void _modelRowsCallback(
+                                void       *userData,
+                                const int   rowStart,
+                                const int   rowEnd
+                              )
+{
+  const GuidedSliceJob *sj = (const GuidedSliceJob*)userData;
+  const GuidedJob *job = sj->m_job;
+  const size_t  xDim = job->m_dimsSrc[0];
+  const double  scale = 1.0 / sj->m_numWindow;
+  float *sliceA = _getRingSlice(sj, sj->m_ringA, sj->m_z);
+  float *sliceB = _getRingSlice(sj, sj->m_ringB, sj->m_z);
+  for (size_t i = rowStart * xDim; i < rowEnd * xDim; i++)
+  {
+    double sumP = 0.0, sumQ = 0.0;
+    if (sj->m_sumP && (sj->m_z > 0))
+    {
+      sumP = sj->m_sumP[i] + sj->m_ringP[sj->m_offAdd + i] -
+        sj->m_ringP[sj->m_offSub + i];
+      sumQ = sj->m_sumQ[i] + sj->m_ringQ[sj->m_offAdd + i] -
+        sj->m_ringQ[sj->m_offSub + i];
+    }
+    else
+    {
+      for (int d = 0; d < sj->m_numWindow; d++)
+      {
+        sumP += sj->m_ringP[sj->m_window[d] + i];
+        sumQ += sj->m_ringQ[sj->m_window[d] + i];
+      }
+    }
+    if (sj->m_sumP)
+    {
+      sj->m_sumP[i] = sumP;
+      sj->m_sumQ[i] = sumQ;
+    }
+    const float mean = (float)(sumP * scale);
+    float variance = (float)(sumQ * scale) - mean * mean;
+    variance = (variance >= 0.0f) ? variance : 0.0f;
+    const float a = variance / (variance + job->m_eps);
+    sliceA[i] = a;
+    sliceB[i] = mean - a * mean;
+  }
+}
+
+// Destination rows of slice m_zDst: z window means of A and B (means of
+// models covering pixel) applied to source pixel of slice m_z
+static void _outputRowsCallback(
+                                  void       *userData,
+                                  const int   yDstStart,
+                                  const int   yDstEnd
+                                )
+{
+  const GuidedSliceJob *sj = (const GuidedSliceJob*)userData;
+  const GuidedJob *job = sj->m_job;
+  const int     xDimSrc = job->m_dimsSrc[0];
+  const int     xDimDst = job->m_dimsDst[0];
+  const size_t  offSlice = (size_t)sj->m_z * sj->m_xyDim;
+  const double  scale = 1.0 / sj->m_numWindow;
+  for (int yDst = yDstStart; yDst < yDstEnd; yDst++)
+  {
+    const int ySrc = job->m_dimsSrc[1] * yDst / job->m_dimsDst[1];
+    size_t indDst = ((size_t)sj->m_zDst * job->m_dimsDst[1] + yDst) *
+      xDimDst;
+    for (int xDst = 0; xDst < xDimDst; xDst++, indDst++)
+    {
+      const size_t off = (size_t)ySrc * xDimSrc + xDimSrc * xDst / xDimDst;
+      double sumA = 0.0, sumB = 0.0;
+      for (int d = 0; d < sj->m_numWindow; d++)
+      {
+        sumA += sj->m_ringA[sj->m_window[d] + off];
+        sumB += sj->m_ringB[sj->m_window[d] + off];
+      }
+      const float val = (float)(sumA * scale) * _getSrc(job, offSlice + off) +
+        (float)(sumB * scale);
+      if (sj->m_dstFloat)
+      {
+        sj->m_dstFloat[indDst] = val;
+        continue;
+      }
+      float valByte = val * 255.0f + 0.5f;
+      valByte = (valByte >= 0.0f) ? valByte : 0.0f;
+      valByte = (valByte <= 255.0f) ? valByte : 255.0f;
+      sj->m_dstBytes[indDst] = (MUint8)valByte;
+    }   // for (xDst)
+  }     // for (yDst)
+}
+
+static int _performGuided(GuidedJob *job, float *pixelsDstFloat,
+  MUint8 *pixelsDstBytes)
+{
+  const int zDim = job->m_dimsSrc[2];
+  const int radZ = job->m_radius[2];
+  GuidedSliceJob sj;
+  sj.m_job = job;
+  sj.m_xyDim = (size_t)job->m_dimsSrc[0] * job->m_dimsSrc[1];
+  sj.m_numWindow = 2 * radZ + 1;
+  sj.m_ringLen = (sj.m_numWindow + 1 < zDim) ? (sj.m_numWindow + 1) : zDim;
+  sj.m_dstFloat = pixelsDstFloat;
+  sj.m_dstBytes = pixelsDstBytes;
+  sj.m_zDst = 0;
+
+  // without z window A, B slices replace P, Q slices of same z and
+  // there are no running sums
+  const int     numRings = (radZ > 0) ? 4 : 2;
+  const int     numSums = (radZ > 0) ? 2 : 0;
+  const size_t  ringSize = sj.m_ringLen * sj.m_xyDim;
+  MemArenaFrame frame;
+  double *sums = (double*)frame.allocate(numSums * sj.m_xyDim *
+    sizeof(double) + (numRings * ringSize + sj.m_xyDim) * sizeof(float));
+  sj.m_window = (size_t*)frame.allocate(sj.m_numWindow * sizeof(size_t));
+  if (!sums || !sj.m_window)
+    return -1;
+  sj.m_sumP = (radZ > 0) ? sums : NULL;
+  sj.m_sumQ = (radZ > 0) ? (sums + sj.m_xyDim) : NULL;
+  float *slices = (float*)(sums + numSums * sj.m_xyDim);
+  float *sliceTmp = slices + numRings * ringSize;
+  sj.m_ringP = slices;
+  sj.m_ringQ = slices + ringSize;
+  sj.m_ringA = (radZ > 0) ? (slices + 2 * ringSize) : sj.m_ringP;
+  sj.m_ringB = (radZ > 0) ? (slices + 3 * ringSize) : sj.m_ringQ;
+
+  // Model of slice t - radZ needs P, Q of slices t - 2 * radZ - 1 .. t,
+  // destination from slice t - 2 * radZ needs A, B up to t - radZ
+  const int yDim = job->m_dimsSrc[1];
+  for (int t = 0; t < zDim + 2 * radZ; t++)
+  {
+    if (t < zDim)
+    {
+      sj.m_z = t;
+      Parallel::forRange(yDim, _loadRowsCallback, &sj, GUIDED_ROWS);
+      _boxSlice(job, _getRingSlice(&sj, sj.m_ringP, t), sliceTmp);
+      _boxSlice(job, _getRingSlice(&sj, sj.m_ringQ, t), sliceTmp);
+    }
+    const int zModel = t - radZ;
+    if ((zModel >= 0) && (zModel < zDim))
+    {
+      sj.m_z = zModel;
+      _setWindow(&sj, zModel);
+      Parallel::forRange(yDim, _modelRowsCallback, &sj, GUIDED_ROWS);
+      _boxSlice(job, _getRingSlice(&sj, sj.m_ringA, zModel), sliceTmp);
+      _boxSlice(job, _getRingSlice(&sj, sj.m_ringB, zModel), sliceTmp);
+    }
+    const int zOut = t - 2 * radZ;
+    if ((zOut >= 0) && (sj.m_zDst < job->m_dimsDst[2]) &&
+      (zOut == zDim * sj.m_zDst / job->m_dimsDst[2]))
+    {
+      sj.m_z = zOut;
+      _setWindow(&sj, zOut);
+      Parallel::forRange(job->m_dimsDst[1], _outputRowsCallback, &sj,
+        GUIDED_ROWS);
+      sj.m_zDst++;
+    }
+  }   // for (t)
+  assert(sj.m_zDst == job->m_dimsDst[2]);
+  return 1;
+}
+
+static int _setupJob(GuidedJob *job, const int numDims, const int radius,
+  const float eps)
+{
+  if (eps <= 0.0f)
+    return -1;
+  job->m_eps = eps;
+  int rad = radius;
+  int k;
+  for (k = 0; k < 3; k++)
+  {
+    if ((job->m_dimsDst[k] <= 0) || (job->m_dimsDst[k] > job->m_dimsSrc[k]))
+      return -1;
+    if ((radius == 0) && (k < numDims))
+    {
+      const int radAxis =
+        GuidedFilter::getAutoRadius(job->m_dimsSrc[k], job->m_dimsDst[k]);
+      rad = (radAxis > rad) ? radAxis : rad;
+    }
+  }
+  if (rad < 1)
+    return -1;
+  for (k = 0; k < 3; k++)
+    job->m_radius[k] = (k < numDims) ? rad : 0;
+  return 1;
+}
+
+// ****************************************************************************
+// Methods
+// ****************************************************************************
+
+int GuidedFilter::getAutoRadius(const int dimSrc, const int dimDst)
+{
+  const int ratio = (dimSrc + dimDst - 1) / dimDst;
+  return (ratio >= 1) ? ratio : 1;
+}
+
+int GuidedFilter::downsample2d(
+                                const float *pixelsSrc,
+                                const int    wSrc,
+                                const int    hSrc,
+                                float       *pixelsDst,
+                                const int    wDst,
+                                const int    hDst,
+                                const int    radius,
+                                const float  eps
+                              )
+{
+  GuidedJob job;
+  job.m_srcFloat = pixelsSrc;
+  job.m_srcBytes = NULL;
+  job.m_dimsSrc[0] = wSrc;
+  job.m_dimsSrc[1] = hSrc;
+  job.m_dimsSrc[2] = 1;
+  job.m_dimsDst[0] = wDst;
+  job.m_dimsDst[1] = hDst;
+  job.m_dimsDst[2] = 1;
+  if (_setupJob(&job, 2, radius, eps) < 0)
+    return -1;
+  return _performGuided(&job, pixelsDst, NULL);
+}
+
+int GuidedFilter::downsample3d(
+                                const MUint8 *volSrc,
+                                const int     xDimSrc,
+                                const int     yDimSrc,
+                                const int     zDimSrc,
+                                MUint8       *volDst,
+                                const int     xDimDst,
+                                const int     yDimDst,
+                                const int     zDimDst,
+                                const int     radius,
+                                const float   eps
+                              )
+{
+  GuidedJob job;
+  job.m_srcFloat = NULL;
+  job.m_srcBytes = volSrc;
+  job.m_dimsSrc[0] = xDimSrc;
+  job.m_dimsSrc[1] = yDimSrc;
+  job.m_dimsSrc[2] = zDimSrc;
+  job.m_dimsDst[0] = xDimDst;
+  job.m_dimsDst[1] = yDimDst;
+  job.m_dimsDst[2] = zDimDst;
+  if (_setupJob(&job, 3, radius, eps) < 0)
+    return -1;
+  return _performGuided(&job, NULL, volDst);
+}
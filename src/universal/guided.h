@@ -0,0 +1,80 @@
+// ****************************************************************************
+// File: guided.h
+// Purpose: Edge preserving downsampling by guided filter
+// ****************************************************************************
+
+#ifndef  __guided_h
+#define  __guided_h
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include "mtypes.h"
+
+// ****************************************************************************
+// Defines
+// ****************************************************************************
+
+// default regularization, for values in [0..1]: edges with deviation
+// larger than sqrt(eps) are kept
+#define GUIDED_EPS_DEFAULT        0.01f
+
+// ****************************************************************************
+// Class
+// ****************************************************************************
+
+/**
+* \class GuidedFilter downsampling by self guided filter (He, Sun, Tang).
+* Every source pixel gets linear model q = a * I + b from window means of
+* I and I * I, destination pixel is window mean of models applied to
+* source pixel I(xSrc, ySrc). Window means are separable sliding box sums
+* with replicated borders, so cost per pixel does not depend on radius.
+* Volume is filtered slice by slice: besides destination it takes
+* 4 * (2 * rz + 2) + 5 float slices, rz is z radius (about 4 floats per
+* source voxel if volume is not thicker than 2 * rz + 2). Image takes
+* 3 float images. Lines of every box pass and rows of every slice are
+* split between worker threads.
+*/
+
+class GuidedFilter
+{
+public:
+  //! Radius of size ratio (at least 1): box means of linear models then
+  //! reach neighbour destination pixels, so texture between is smoothed
+  static int  getAutoRadius(const int dimSrc, const int dimDst);
+
+  /*!
+   * \brief Downsample float image (values in [0..1]).
+   *   Destination pixel (x, y) is filter result at source pixel
+   *   (wSrc * x / wDst, hSrc * y / hDst), the same as Downsample2d.
+   * \param radius Window radius, 0 is auto (by size ratio)
+   * \param eps Regularization: larger eps smooths stronger edges
+   * \return 1 if ok, -1 if parameters are wrong or no memory
+   */
+  static int  downsample2d(
+                            const float *pixelsSrc,
+                            const int    wSrc,
+                            const int    hSrc,
+                            float       *pixelsDst,
+                            const int    wDst,
+                            const int    hDst,
+                            const int    radius,
+                            const float  eps
+                          );
+  //! Same for 8 bit volume, eps is for values scaled to [0..1]
+  static int  downsample3d(
+                            const MUint8 *volSrc,
+                            const int     xDimSrc,
+                            const int     yDimSrc,
+                            const int     zDimSrc,
+                            MUint8       *volDst,
+                            const int     xDimDst,
+                            const int     yDimDst,
+                            const int     zDimDst,
+                            const int     radius,
+                            const float   eps
+                          );
+};
+
+#endif
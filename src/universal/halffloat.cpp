@@ -0,0 +1,173 @@
+// ****************************************************************************
+// File: halffloat.cpp
+// Purpose: 16 bit float (FP16, bfloat16) conversions for compact images
+// ****************************************************************************
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include <stdio.h>
+#include <memory.h>
+
+#include "halffloat.h"
+
+// F16C comes with AVX2 on all x86 cpus
+#if defined(__F16C__) || defined(__AVX2__)
+#define HALF_USE_F16C
+#include <immintrin.h>
+#endif
+
+// ****************************************************************************
+// Scalar conversions
+// ****************************************************************************
+
+static MUint16 _fromFloatFp16(const float val)
+{
+  MUint32 bits;
+  memcpy(&bits, &val, sizeof(bits));
+  const MUint32 sign = (bits >> 16) & 0x8000;
+  const MUint32 absBits = bits & 0x7fffffff;
+  MUint32 half, rem, halfWay;
+
+  // infinity, NaN (quiet, with upper payload bits)
+  if (absBits > 0x7f800000)
+    return (MUint16)(sign | 0x7e00 | ((absBits >> 13) & 0x3ff));
+  if (absBits == 0x7f800000)
+    return (MUint16)(sign | 0x7c00);
+  // from 65520 on rounds to infinity
+  if (absBits >= 0x477ff000)
+    return (MUint16)(sign | 0x7c00);
+  if (absBits < 0x38800000)
+  {
+    // below 2 ^ -14: subnormal half, up to 2 ^ -25 rounds to 0
+    if (absBits <= 0x33000000)
+      return (MUint16)sign;
+    const int shift = 126 - (int)(absBits >> 23);
+    const MUint32 mant = (absBits & 0x7fffff) | 0x800000;
+    half = mant >> shift;
+    rem = mant & ((1 << shift) - 1);
+    halfWay = 1 << (shift - 1);
+  }
+  else
+  {
+    // rebias exponent from 127 to 15, carry of rounding may go to exponent
+    half = (absBits - 0x38000000) >> 13;
+    rem = absBits & 0x1fff;
+    halfWay = 0x1000;
+  }
+  if ((rem > halfWay) || ((rem == halfWay) && (half & 1)))
+    half++;
+  return (MUint16)(sign | half);
+}
+
+static float _toFloatFp16(const MUint16 val)
+{
+  const MUint32 sign = (MUint32)(val & 0x8000) << 16;
+  const MUint32 exponent = (val >> 10) & 0x1f;
+  const MUint32 mant = val & 0x3ff;
+  MUint32 bits;
+  if (exponent == 0)
+  {
+    // zero or subnormal: mant * 2 ^ -24
+    const float valAbs = mant * (1.0f / 16777216.0f);
+    return sign ? -valAbs : valAbs;
+  }
+  if (exponent == 31)
+    bits = sign | 0x7f800000 | (mant << 13) | (mant ? 0x400000 : 0);
+  else
+    bits = sign | ((exponent + 112) << 23) | (mant << 13);
+  float res;
+  memcpy(&res, &bits, sizeof(res));
+  return res;
+}
+
+static MUint16 _fromFloatBfloat16(const float val)
+{
+  MUint32 bits;
+  memcpy(&bits, &val, sizeof(bits));
+  // NaN must not round to infinity
+  if ((bits & 0x7fffffff) > 0x7f800000)
+    return (MUint16)((bits >> 16) | 0x40);
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return (MUint16)(bits >> 16);
+}
+
+static float _toFloatBfloat16(const MUint16 val)
+{
+  const MUint32 bits = (MUint32)val << 16;
+  float res;
+  memcpy(&res, &bits, sizeof(res));
+  return res;
+}
+
+// ****************************************************************************
+// Methods
+// ****************************************************************************
+
+MUint16 HalfFloat::fromFloat(const float val, const HalfFormat format)
+{
+  return (format == HALF_FORMAT_FP16) ? _fromFloatFp16(val) :
+    _fromFloatBfloat16(val);
+}
+
+float HalfFloat::toFloat(const MUint16 val, const HalfFormat format)
+{
+  return (format == HALF_FORMAT_FP16) ? _toFloatFp16(val) :
+    _toFloatBfloat16(val);
+}
+
+void HalfFloat::fromFloatRow(
+                              const float      *src,
+                              MUint16          *dst,
+                              const int         num,
+                              const HalfFormat  format
+                            )
+{
+  int i = 0;
+  if (format == HALF_FORMAT_BFLOAT16)
+  {
+    for (; i < num; i++)
+      dst[i] = _fromFloatBfloat16(src[i]);
+    return;
+  }
+#if defined(HALF_USE_F16C)
+  for (; i + 8 <= num; i += 8)
+    _mm_storeu_si128((__m128i*)(dst + i),
+      _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+  for (; i < num; i++)
+    dst[i] = _fromFloatFp16(src[i]);
+}
+
+void HalfFloat::toFloatRow(
+                            const MUint16    *src,
+                            float            *dst,
+                            const int         num,
+                            const HalfFormat  format
+                          )
+{
+  int i = 0;
+  if (format == HALF_FORMAT_BFLOAT16)
+  {
+    for (; i < num; i++)
+      dst[i] = _toFloatBfloat16(src[i]);
+    return;
+  }
+#if defined(HALF_USE_F16C)
+  for (; i + 8 <= num; i += 8)
+    _mm256_storeu_ps(dst + i,
+      _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+#endif
+  for (; i < num; i++)
+    dst[i] = _toFloatFp16(src[i]);
+}
+
+int HalfFloat::isHardware()
+{
+#if defined(HALF_USE_F16C)
+  return 1;
+#else
+  return 0;
+#endif
+}
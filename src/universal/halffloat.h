@@ -0,0 +1,61 @@
+// ****************************************************************************
+// File: halffloat.h
+// Purpose: 16 bit float (FP16, bfloat16) conversions for compact images
+// ****************************************************************************
+
+#ifndef  __halffloat_h
+#define  __halffloat_h
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include "mtypes.h"
+
+// ****************************************************************************
+// Types
+// ****************************************************************************
+
+enum HalfFormat
+{
+  // IEEE 754 half: 10 bit mantissa, range up to 65504
+  HALF_FORMAT_FP16      = 0,
+  // upper half of float: 7 bit mantissa, float range
+  HALF_FORMAT_BFLOAT16  = 1
+};
+
+// ****************************************************************************
+// Class
+// ****************************************************************************
+
+/**
+* \class HalfFloat converts floats to 16 bit storage and back.
+* Conversion to 16 bits rounds to nearest even, NaN stays NaN, FP16
+* overflow goes to infinity. Row conversions use F16C instructions
+* for FP16 if compiled with them (gcc -mf16c, msvc /arch:AVX2), results
+* are the same as of scalar code.
+*/
+
+class HalfFloat
+{
+public:
+  static MUint16  fromFloat(const float val, const HalfFormat format);
+  static float    toFloat(const MUint16 val, const HalfFormat format);
+
+  static void     fromFloatRow(
+                                const float      *src,
+                                MUint16          *dst,
+                                const int         num,
+                                const HalfFormat  format
+                              );
+  static void     toFloatRow(
+                              const MUint16    *src,
+                              float            *dst,
+                              const int         num,
+                              const HalfFormat  format
+                            );
+  //! 1 if row conversions of FP16 use F16C instructions
+  static int      isHardware();
+};
+
+#endif
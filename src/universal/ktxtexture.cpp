@@ -6,6 +6,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <memory.h>
 #include <math.h>
 #include <string.h>
@@ -13,7 +14,12 @@
 
 
 #include "memtrack.h"
+#include "arena.h"
+#include "parallel.h"
 #include "ktxtexture.h"
+#include "volview.h"
+#include "volume.h"
+#include "rankfilter.h"
 
 // ****************************************************************************
 // Defines
@@ -48,6 +54,50 @@ static char *s_ktxTextureErrMessages[KTX_ERROR_COUNT] =
 // Methods
 // ****************************************************************************
 
+// Bytes per voxel of uncompressed format
+static int _getBytesPerPixel(const MUint32 glFormat)
+{
+  return (glFormat == KTX_GL_RED) ? 1 : ((glFormat == KTX_GL_RGB) ? 3 : 4);
+}
+
+// Number of voxels. Sizes and offsets are size_t everywhere:
+// 2048^3 volume does not fit into int
+static size_t _getNumVoxels(const KtxHeader &header)
+{
+  size_t numVoxels = header.m_pixelWidth;
+  if (header.m_pixelHeight > 0)
+    numVoxels *= header.m_pixelHeight;
+  if (header.m_pixelDepth > 0)
+    numVoxels *= header.m_pixelDepth;
+  return numVoxels;
+}
+
+// fwrite / fread of huge block in single call fails with some C runtimes,
+// so volume is streamed by slabs
+static int _writeBySlabs(FILE *file, const MUint8 *data, const size_t size)
+{
+  for (size_t off = 0; off < size; off += KTX_IO_SLAB_BYTES)
+  {
+    const size_t sizeSlab = (size - off < KTX_IO_SLAB_BYTES) ?
+      (size - off) : KTX_IO_SLAB_BYTES;
+    if (fwrite(data + off, 1, sizeSlab, file) != sizeSlab)
+      return -1;
+  }
+  return 1;
+}
+
+static int _readBySlabs(FILE *file, MUint8 *data, const size_t size)
+{
+  for (size_t off = 0; off < size; off += KTX_IO_SLAB_BYTES)
+  {
+    const size_t sizeSlab = (size - off < KTX_IO_SLAB_BYTES) ?
+      (size - off) : KTX_IO_SLAB_BYTES;
+    if (fread(data + off, 1, sizeSlab, file) != sizeSlab)
+      return -1;
+  }
+  return 1;
+}
+
 const char *KtxTextureGetErrorString(const KtxError err)
 {
   return s_ktxTextureErrMessages[ (int)err ];
@@ -78,7 +128,7 @@ void   KtxTexture::destroy()
 
 KtxError KtxTexture::createAs1ByteCopy(const KtxTexture *tex)
 {
-  int   sizeVolume;
+  size_t  sizeVolume;
   const MUint32 *src;
 
   // create 1 byte per pixel texture from 1/3/4 bpp texture
@@ -93,11 +143,7 @@ KtxError KtxTexture::createAs1ByteCopy(const KtxTexture *tex)
   m_header.m_glInternalFormat      = KTX_GL_R8_EXT;
   m_header.m_glBaseInternalFormat  = KTX_GL_RED;
 
-  sizeVolume = m_header.m_pixelWidth;
-  if (m_header.m_pixelHeight > 0)
-    sizeVolume *= m_header.m_pixelHeight;
-  if (m_header.m_pixelDepth > 0)
-    sizeVolume *= m_header.m_pixelDepth;
+  sizeVolume = _getNumVoxels(m_header);
 
   if (m_data != NULL)
    delete [] m_data;
@@ -113,7 +159,7 @@ KtxError KtxTexture::createAs1ByteCopy(const KtxTexture *tex)
   {
     src = (const MUint32 *)tex->m_data;
     MUint8 *dst = (MUint8*)m_data;
-    for (int i = 0; i < (int)sizeVolume; i++)
+    for (size_t i = 0; i < sizeVolume; i++)
     {
       MUint32 val32 = src[i];
       val32 >>= 24;
@@ -132,16 +178,12 @@ KtxError KtxTexture::createAs1ByteCopy(const KtxTexture *tex)
 
 KtxError KtxTexture::createAsCopy(const KtxTexture *tex)
 {
-  int   sizeVolume;
+  size_t  sizeVolume;
 
   // create 1 byte per pixel texture from 1/3/4 bpp texture
   memcpy(&m_header, &tex->m_header, sizeof(KtxHeader));
 
-  sizeVolume = m_header.m_pixelWidth;
-  if (m_header.m_pixelHeight > 0)
-    sizeVolume *= m_header.m_pixelHeight;
-  if (m_header.m_pixelDepth > 0)
-    sizeVolume *= m_header.m_pixelDepth;
+  sizeVolume = _getNumVoxels(m_header);
 
   if (tex->m_header.m_glFormat == KTX_GL_RED)
     sizeVolume *= 1;
@@ -170,7 +212,7 @@ KtxError KtxTexture::createAsCopy(const KtxTexture *tex)
 
 KtxError KtxTexture::create1D(const int xDim, const int bytesPerPixel)
 {
-  int     sizeVolume;
+  size_t  sizeVolume;
 
   memcpy(m_header.m_id, s_ktxIdFile, sizeof(s_ktxIdFile));
   m_header.m_endianness             = 0x04030201;
@@ -221,7 +263,7 @@ KtxError KtxTexture::create1D(const int xDim, const int bytesPerPixel)
     }
   }       // switch
 
-  sizeVolume = xDim * bytesPerPixel;
+  sizeVolume = (size_t)xDim * bytesPerPixel;
   m_data = M_NEW( MUint8[sizeVolume] );
   if (!m_data)
     return KTX_ERROR_NO_MEMORY;
@@ -237,7 +279,7 @@ KtxError KtxTexture::create2D(
                               const int bytesPerPixel
                              )
 {
-  int     sizeVolume;
+  size_t  sizeVolume;
 
   memcpy(m_header.m_id, s_ktxIdFile, sizeof(s_ktxIdFile));
   m_header.m_endianness             = 0x04030201;
@@ -288,7 +330,7 @@ KtxError KtxTexture::create2D(
     }
   }       // switch
 
-  sizeVolume = xDim * yDim * bytesPerPixel;
+  sizeVolume = (size_t)xDim * yDim * bytesPerPixel;
   m_data = M_NEW( MUint8[sizeVolume] );
   if (!m_data)
     return KTX_ERROR_NO_MEMORY;
@@ -305,7 +347,7 @@ KtxError KtxTexture::create3D(
                               const int bytesPerPixel
                              )
 {
-  int     sizeVolume;
+  size_t  sizeVolume;
 
   memcpy(m_header.m_id, s_ktxIdFile, sizeof(s_ktxIdFile));
   m_header.m_endianness             = 0x04030201;
@@ -356,7 +398,7 @@ KtxError KtxTexture::create3D(
     }
   }       // switch
 
-  sizeVolume = xDim * yDim * zDim * bytesPerPixel;
+  sizeVolume = (size_t)xDim * yDim * zDim * bytesPerPixel;
   m_data = M_NEW( MUint8[sizeVolume] );
   if (!m_data)
     return KTX_ERROR_NO_MEMORY;
@@ -368,9 +410,9 @@ KtxError KtxTexture::create3D(
 
 KtxError KtxTexture::saveToFileContent(FILE *file)
 {
-  int   sizeVolume, bytesPerPixel;
-  int   numBytesWritten;
-  static char strKeyBuf[sizeof(int) * 2 + 8 * 2 + sizeof(V3f) * 2 + 8];
+  size_t  sizeVolume;
+  int     numBytesWritten;
+  char strKeyBuf[sizeof(int) * 2 + 8 * 2 + sizeof(V3f) * 2 + 8];
 
   if ((unsigned char)m_header.m_id[0] != s_ktxIdFile[0])
     return KTX_ERROR_BROKEN_CONTENT;
@@ -436,14 +478,8 @@ KtxError KtxTexture::saveToFileContent(FILE *file)
   }
 
 
-  bytesPerPixel   = 
-    (m_header.m_glFormat == KTX_GL_RED)?
-    1 : ((m_header.m_glFormat == KTX_GL_RGB)? 3: 4);
-  sizeVolume      = m_header.m_pixelWidth * bytesPerPixel;
-  if (m_header.m_pixelHeight > 0)
-    sizeVolume *= m_header.m_pixelHeight;
-  if (m_header.m_pixelDepth > 0)
-    sizeVolume *= m_header.m_pixelDepth;
+  sizeVolume = _getNumVoxels(m_header) *
+    _getBytesPerPixel(m_header.m_glFormat);
 
   // write header to dest buffer
   numBytesWritten = (int)fwrite(&m_header, 1, sizeof(m_header), file );
@@ -463,15 +499,22 @@ KtxError KtxTexture::saveToFileContent(FILE *file)
   }   // if exists key data
 
   // write volume size to dest buffer
-  numBytesWritten = (int)fwrite(&sizeVolume, 1, sizeof(sizeVolume), file);
-  if (numBytesWritten != sizeof(sizeVolume))
+  const MUint64 sizeVolume64 = (MUint64)sizeVolume;
+  const MUint32 sizeVolume32 = (sizeVolume64 < (MUint64)KTX_IMAGE_SIZE_64) ?
+    (MUint32)sizeVolume64 : KTX_IMAGE_SIZE_64;
+  numBytesWritten = (int)fwrite(&sizeVolume32, 1, sizeof(sizeVolume32), file);
+  if (numBytesWritten != sizeof(sizeVolume32))
     return KTX_ERROR_WRITE;
-
+  if (sizeVolume32 == KTX_IMAGE_SIZE_64)
+  {
+    numBytesWritten = (int)fwrite(&sizeVolume64, 1, sizeof(sizeVolume64), file);
+    if (numBytesWritten != sizeof(sizeVolume64))
+      return KTX_ERROR_WRITE;
+  }
 
   // write image bits
   assert(m_data != NULL);
-  numBytesWritten = (int)fwrite(m_data, 1, sizeVolume, file);
-  if (numBytesWritten != sizeVolume)
+  if (_writeBySlabs(file, m_data, sizeVolume) < 0)
     return KTX_ERROR_WRITE;
 
   return KTX_ERROR_OK;
@@ -495,9 +538,6 @@ KtxError KtxTexture::loadFromFileContent(FILE *file)
   xDim = (int)m_header.m_pixelWidth;
   yDim = (int)m_header.m_pixelHeight;
   zDim = (int)m_header.m_pixelDepth;
-  USE_PARAM(xDim);
-  USE_PARAM(yDim);
-  USE_PARAM(zDim);
 
   m_isCompressed = 0;
   bytesPerVoxel = 0;
@@ -525,8 +565,6 @@ KtxError KtxTexture::loadFromFileContent(FILE *file)
   }
   else
     return KTX_ERROR_WRONG_FORMAT;
-  //volSize = xDim * yDim * zDim * bytesPerVoxel;
-  USE_PARAM(bytesPerVoxel);
 
   if (m_header.m_bytesOfKeyValueData > 0)
   {
@@ -545,7 +583,7 @@ KtxError KtxTexture::loadFromFileContent(FILE *file)
     V3f vBoxMin, vBoxMax;
 
     // parse user data
-    static char strName[64];
+    char strName[64];
     char *src;
     src = userData;
     while (src - userData < (int)m_header.m_bytesOfKeyValueData)
@@ -611,13 +649,30 @@ KtxError KtxTexture::loadFromFileContent(FILE *file)
     delete[] userData;
   }
 
-  // read size
-  //numReadedBytes = (int)file.read( (char*)&m_dataSize, sizeof(m_dataSize) );
-  numReadedBytes = (int)fread(&m_dataSize, 1, sizeof(m_dataSize), file);
-  if (numReadedBytes != sizeof(m_dataSize))
+  // read size: 32 bit, or marker and 64 bit size for large volumes
+  MUint32 sizeVolume32;
+  MUint64 sizeVolume64;
+  numReadedBytes = (int)fread(&sizeVolume32, 1, sizeof(sizeVolume32), file);
+  if (numReadedBytes != sizeof(sizeVolume32))
     return KTX_ERROR_WRONG_FORMAT;
-  if (m_dataSize > 1024 * 1024 * 512)
+  sizeVolume64 = sizeVolume32;
+  if (sizeVolume32 == KTX_IMAGE_SIZE_64)
+  {
+    numReadedBytes = (int)fread(&sizeVolume64, 1, sizeof(sizeVolume64), file);
+    if (numReadedBytes != sizeof(sizeVolume64))
+      return KTX_ERROR_WRONG_FORMAT;
+  }
+  // size should match dimensions, compressed data is not larger than
+  // 1 byte per voxel
+  const MUint64 sizeExpected = (MUint64)xDim *
+    ((yDim > 0) ? yDim : 1) * ((zDim > 0) ? zDim : 1) * bytesPerVoxel;
+  if (m_isCompressed && (sizeVolume64 > sizeExpected))
     return KTX_ERROR_WRONG_FORMAT;
+  if (!m_isCompressed && (sizeVolume64 != sizeExpected))
+    return KTX_ERROR_WRONG_FORMAT;
+  if (sizeVolume64 != (MUint64)(size_t)sizeVolume64)
+    return KTX_ERROR_NO_MEMORY;
+  m_dataSize = (size_t)sizeVolume64;
 
   if (m_data)
     delete [] m_data;
@@ -625,9 +680,7 @@ KtxError KtxTexture::loadFromFileContent(FILE *file)
   m_data = M_NEW(MUint8[m_dataSize]);
   if (m_data == NULL)
     return KTX_ERROR_NO_MEMORY;
-  //numReadedBytes = (int)file.read( (char*)m_data, m_dataSize);
-  numReadedBytes = (int)fread(m_data, 1, m_dataSize, file);
-  if (numReadedBytes != m_dataSize)
+  if (_readBySlabs(file, m_data, m_dataSize) < 0)
     return KTX_ERROR_WRONG_SIZE;
 
   
@@ -658,7 +711,7 @@ KtxError    KtxTexture::enlargeByMinSize()
   int yDimSrc = getHeight();
   int zDimSrc = getDepth();
 
-  int numPixelsDst = xDimDst * yDimDst * zDimDst;
+  size_t numPixelsDst = (size_t)xDimDst * yDimDst * zDimDst;
   MUint32 *pixelsDst = M_NEW(MUint32[numPixelsDst]);
   if (pixelsDst == NULL)
     return KTX_ERROR_NO_MEMORY;
@@ -666,7 +719,7 @@ KtxError    KtxTexture::enlargeByMinSize()
   // Clear with background
   MUint32 *pixelsSrc = (MUint32*)m_data;
   MUint32 valBackground = pixelsSrc[0];
-  for (int i = 0; i < numPixelsDst; i++)
+  for (size_t i = 0; i < numPixelsDst; i++)
   {
     pixelsDst[i] = valBackground;
   }
@@ -677,16 +730,16 @@ KtxError    KtxTexture::enlargeByMinSize()
   for (z = 0; z < zDimSrc; z++)
   {
     int zDst = z + vBoxMin->z;
-    int zDstOff = zDst * xDimDst * yDimDst;
+    size_t zDstOff = (size_t)zDst * xDimDst * yDimDst;
     for (y = 0; y < yDimSrc; y++)
     {
       int yDst = y + vBoxMin->y;
-      int yDstOff = yDst * xDimDst;
+      size_t yDstOff = (size_t)yDst * xDimDst;
       for (x = 0; x < xDimSrc; x++)
       {
         MUint32 val = *pixelsSrc++;
         int xDst = x + vBoxMin->x;
-        int off = xDst + yDstOff + zDstOff;
+        size_t off = xDst + yDstOff + zDstOff;
         pixelsDst[off] = val;
       }   // for (x)
     }     // for (y)
@@ -700,6 +753,7 @@ KtxError    KtxTexture::enlargeByMinSize()
   // assign new pixels array
   delete[] m_data;
   m_data = (MUint8*)pixelsDst;
+  m_dataSize = numPixelsDst * sizeof(MUint32);
   return KTX_ERROR_OK;
 }
 
@@ -749,8 +803,8 @@ static void _copyAndAlignTexture(
                                   const int     zDimDst
                                 )
 {
-  int   xyzDimDst;
-  int   x, y, z;
+  size_t  xyzDimDst, i;
+  int     x, y, z;
 
   int xDimSrc2 = xDimSrc / 2;
   int yDimSrc2 = yDimSrc / 2;
@@ -760,14 +814,14 @@ static void _copyAndAlignTexture(
   int yDimDst2 = yDimDst / 2;
   int zDimDst2 = zDimDst / 2;
 
-  xyzDimDst = xDimDst * yDimDst * zDimDst;
+  xyzDimDst = (size_t)xDimDst * yDimDst * zDimDst;
 
-  int xyzDimSrc = xDimSrc * yDimSrc * zDimSrc;
-  int numBlacks = 0;
-  int numWhites = 0;
-  for (x = 0; x < xyzDimSrc; x++)
+  size_t xyzDimSrc = (size_t)xDimSrc * yDimSrc * zDimSrc;
+  size_t numBlacks = 0;
+  size_t numWhites = 0;
+  for (i = 0; i < xyzDimSrc; i++)
   {
-    MUint32 val = (MUint32)pixelsSrc[x];
+    MUint32 val = (MUint32)pixelsSrc[i];
     if (val <= 32)
       numBlacks++;
     if (val >= 256 - 32)
@@ -782,18 +836,18 @@ static void _copyAndAlignTexture(
 
   memset((char*)pixelsDst, valBackground, xyzDimDst);
 
-  int indSrc = 0;
+  size_t indSrc = 0;
   for (z = 0; z < zDimSrc; z++)
   {
     int zDst = z - zDimSrc2 + zDimDst2;
-    int zOff = zDst * (xDimDst * yDimDst);
+    size_t zOff = (size_t)zDst * xDimDst * yDimDst;
     for (y = 0; y < yDimSrc; y++)
     {
       int yDst = y - yDimSrc2 + yDimDst2;
-      int yOff = yDst * xDimDst;
+      size_t yOff = (size_t)yDst * xDimDst;
       for (x = 0; x < xDimSrc; x++)
       {
-        int   offDst;
+        size_t  offDst;
 
         MUint8 val = pixelsSrc[indSrc++];
         int xDst = x - xDimSrc2 + xDimDst2;
@@ -806,7 +860,7 @@ static void _copyAndAlignTexture(
 
 KtxError  KtxTexture::createAs1ByteCopyPowerOfTwo(const KtxTexture *tex)
 {
-  int   sizeVolume;
+  size_t  sizeVolume;
 
   // create 1 byte per pixel texture from 1/3/4 bpp texture
   memcpy(&m_header.m_id, &tex->m_header, sizeof(KtxHeader));
@@ -827,11 +881,7 @@ KtxError  KtxTexture::createAs1ByteCopyPowerOfTwo(const KtxTexture *tex)
   m_header.m_glInternalFormat     = KTX_GL_R8_EXT;
   m_header.m_glBaseInternalFormat = KTX_GL_RED;
 
-  sizeVolume = m_header.m_pixelWidth;
-  if (m_header.m_pixelHeight > 0)
-    sizeVolume *= m_header.m_pixelHeight;
-  if (m_header.m_pixelDepth > 0)
-    sizeVolume *= m_header.m_pixelDepth;
+  sizeVolume = _getNumVoxels(m_header);
 
   if (m_data != NULL)
     delete[] m_data;
@@ -872,7 +922,7 @@ KtxError  KtxTexture::createAs1ByteCopyScaledDown(
                                                    const int scaleDownTimes
                                                  )
 {
-  int   sizeVolume;
+  size_t  sizeVolume;
 
   // create 1 byte per pixel texture from 1/3/4 bpp texture
   memcpy(&m_header.m_id, &tex->m_header, sizeof(KtxHeader));
@@ -889,11 +939,7 @@ KtxError  KtxTexture::createAs1ByteCopyScaledDown(
   m_header.m_glInternalFormat = KTX_GL_R8_EXT;        // GL_R8_EXT, GL_R8 (0x8229)
   m_header.m_glBaseInternalFormat = KTX_GL_RED;
 
-  sizeVolume = m_header.m_pixelWidth;
-  if (m_header.m_pixelHeight > 0)
-    sizeVolume *= m_header.m_pixelHeight;
-  if (m_header.m_pixelDepth > 0)
-    sizeVolume *= m_header.m_pixelDepth;
+  sizeVolume = _getNumVoxels(m_header);
 
   if (m_data != NULL)
     delete[] m_data;
@@ -919,7 +965,7 @@ KtxError  KtxTexture::createAs1ByteCopyScaledDown(
   MUint8 *pixelsDst = getData();
 
   int x, y, z;
-  int indDst = 0;
+  size_t indDst = 0;
   for (z = 0; z < zDimDst; z++)
   {
     int zSrcMin = z * scaleDownTimes;
@@ -942,7 +988,8 @@ KtxError  KtxTexture::createAs1ByteCopyScaledDown(
           {
             for (xx = xSrcMin; xx < xSrcMax; xx++)
             {
-              int offSrc = xx + (yy * xDimSrc) + (zz * xDimSrc * yDimSrc);
+              size_t offSrc = xx + ((size_t)yy * xDimSrc) +
+                ((size_t)zz * xDimSrc * yDimSrc);
               sum += (MUint32)pixelsSrc[offSrc];
               numPixels++;
             }
@@ -1002,14 +1049,10 @@ KtxError  KtxTexture::createMask(
   int xDim = getWidth();
   int yDim = getHeight();
   int zDim = getDepth();
-  int xyDim = xDim * yDim;
-  int xyzDim = xDim * yDim* zDim;
+  size_t xyDim = (size_t)xDim * yDim;
+  size_t xyzDim = xyDim * zDim;
 
-  MUint8 *pixelsBina = M_NEW(MUint8[xyzDim]);
-  if (!pixelsBina)
-    return KTX_ERROR_NO_MEMORY;
-
-  static V3d offRing[128];
+  V3d offRing[128];
   int             numPixelsInRing;
   int             i, j;
   int             x, y, z;
@@ -1038,28 +1081,19 @@ KtxError  KtxTexture::createMask(
   }     // for (j)
 
 
-  const MUint8  *pixelsSrc = tex->getData();
-  MUint8        *pixelsDst = getData();
-  int indDst;
+  // Binarization and dilatation are done in place, without second volume.
+  // Voxels added by dilatation are marked with MASK_VAL_ADDED first, so
+  // only original object voxels (255) are checked in neighbourhood
+  const MUint8 MASK_VAL_ADDED = 1;
+  MUint8 *pixelsDst = getData();
+  size_t indDst;
 
-  indDst = 0;
-  for (z = 0; z < zDim; z++)
+  for (indDst = 0; indDst < xyzDim; indDst++)
   {
-    for (y = 0; y < yDim; y++)
-    {
-      for (x = 0; x < xDim; x++)
-      {
-        MUint32 valDst;
-        MUint32 val = (MUint32)pixelsSrc[indDst];
-
-        // binarize by barrier
-        valDst = (val <= (MUint32)valBarrier)? 0: 255;
-
-        pixelsBina[indDst] = (MUint8)valDst;
-        indDst++;
-      }   // for (x)
-    }     // for (y)
-  }       // for (z)
+    MUint32 val = (MUint32)pixelsDst[indDst];
+    // binarize by barrier
+    pixelsDst[indDst] = (val <= (MUint32)valBarrier)? 0: 255;
+  }
 
   // Dilatation
 
@@ -1070,9 +1104,8 @@ KtxError  KtxTexture::createMask(
     {
       for (x = 0; x < xDim; x++)
       {
-        if (pixelsBina[indDst])
+        if (pixelsDst[indDst])
         {
-          pixelsDst[indDst] = pixelsBina[indDst];
           indDst++;
           continue;
         }
@@ -1090,20 +1123,25 @@ KtxError  KtxTexture::createMask(
             continue;
           if ( (zDst < 0) || (zDst >= zDim) )
             continue;
-          int offNeigh = xDst + (yDst * xDim) + (zDst * xyDim);
-          if (pixelsBina[offNeigh])
+          size_t offNeigh = xDst + ((size_t)yDst * xDim) + (zDst * xyDim);
+          if (pixelsDst[offNeigh] == 255)
           {
             hasNeibObject = 1;
             break;
           }
         }     // for (i) all neighbours in 3d sphere
 
-        pixelsDst[indDst] = (hasNeibObject)? 255: 0;
+        if (hasNeibObject)
+          pixelsDst[indDst] = MASK_VAL_ADDED;
         indDst++;
       }   // for (x)
     }     // for (y)
   }       // for (z)
-  delete[] pixelsBina;
+  for (indDst = 0; indDst < xyzDim; indDst++)
+  {
+    if (pixelsDst[indDst] == MASK_VAL_ADDED)
+      pixelsDst[indDst] = 255;
+  }
 
   return KTX_ERROR_OK;
 }
@@ -1119,14 +1157,15 @@ static void _boxFilter3d(
                           const int radius
                         )
 {
-  static MUint32  history[MAX_BOX_LEN];
+  MUint32         history[MAX_BOX_LEN];
   int             boxLen = radius + radius + 1;
-  int             x, y, z, dr, offLine, xyDim, zOff;
+  int             x, y, z, dr, offLine;
+  size_t          xyDim, zOff;
   int             multFast;
 
   assert(boxLen <= MAX_BOX_LEN);
 
-  xyDim = xDim * yDim;
+  xyDim = (size_t)xDim * yDim;
   multFast = (int)(512.0f * 1.0f / (float)boxLen);
   // horizontals processing
   for (z = 0, zOff = 0; z < zDim; z++, zOff += xyDim)
@@ -1263,13 +1302,14 @@ void  KtxTexture::clearBorder()
   int xDim = m_header.m_pixelWidth;
   int yDim = m_header.m_pixelHeight;
   int zDim = m_header.m_pixelDepth;
-  int xyzDim = xDim * yDim * zDim;
+  size_t xyzDim = (size_t)xDim * yDim * zDim;
+  size_t i;
 
-  int numBlacks = 0;
-  int numWhites = 0;
-  for (x = 0; x < xyzDim; x++)
+  size_t numBlacks = 0;
+  size_t numWhites = 0;
+  for (i = 0; i < xyzDim; i++)
   {
-    MUint32 val = (MUint32)m_data[x];
+    MUint32 val = (MUint32)m_data[i];
     if (val <= 32)
       numBlacks++;
     if (val >= 256 - 32)
@@ -1283,7 +1323,7 @@ void  KtxTexture::clearBorder()
     valBackground = 255;
 
 
-  int indDst = 0;
+  size_t indDst = 0;
   for (z = 0; z < zDim; z++)
   {
     int isBorderZ = ((z == 0) || (z == zDim -1))? 1: 0;
@@ -1308,10 +1348,10 @@ void  KtxTexture::binarizeByBarrier(
                                     const MUint8 valGreat
                                    )
 {
-  int   xyzDim = m_header.m_pixelWidth *
+  size_t  xyzDim = (size_t)m_header.m_pixelWidth *
     m_header.m_pixelHeight *
     m_header.m_pixelDepth;
-  int i;
+  size_t  i;
   for (i = 0; i < xyzDim; i++)
   {
     MUint8 val = m_data[i];
@@ -1360,7 +1400,8 @@ static __inline float _getIntensityClamped(
   int   xx = (x < 0) ? 0 : ((x >= xDimSrc) ? (xDimSrc - 1) : x);
   int   yy = (y < 0) ? 0 : ((y >= yDimSrc) ? (yDimSrc - 1) : y);
   int   zz = (z < 0) ? 0 : ((z >= zDimSrc) ? (zDimSrc - 1) : z);
-  return (float)volData[xx + yy * xDimSrc + zz * xDimSrc * yDimSrc];
+  return (float)volData[xx + (size_t)yy * xDimSrc +
+    (size_t)zz * xDimSrc * yDimSrc];
 }
 
 
@@ -1504,79 +1545,79 @@ static void _getBicubicIntensity(
   *valIntensity = (MUint8)res;
 }
 
-static void _scaleDownTextureSmooth(
-                              const MUint8 *pixelsSrc,
-                              const int xDimSrc, const int yDimSrc, const int zDimSrc,
-                              MUint8 *pixelsDst,
-                              const int xDimDst, const int yDimDst, const int zDimDst
-                            )
+// Smooth (bicubic) resampling of destination row (y, z).
+// Down and up scale keep their original coordinate rounding.
+static void _scaleRowSmooth(
+                            const MUint8 *pixelsSrc,
+                            const int xDimSrc, const int yDimSrc, const int zDimSrc,
+                            MUint8 *rowDst,
+                            const int xDimDst, const int yDimDst, const int zDimDst,
+                            const int y, const int z,
+                            const int isScaleDown
+                          )
 {
-  int x, y, z;
+  int x;
 
-  float xStep = 1.0f / xDimDst;
-  float yStep = 1.0f / yDimDst;
-  float zStep = 1.0f / zDimDst;
-  int indDst = 0;
-  for (z = 0; z < zDimDst; z++)
+  if (isScaleDown)
   {
-    float tz = z * zStep;
-    for (y = 0; y < yDimDst; y++)
+    float xStep = 1.0f / xDimDst;
+    float ty = y * (1.0f / yDimDst);
+    float tz = z * (1.0f / zDimDst);
+    for (x = 0; x < xDimDst; x++)
     {
-      float ty = y * yStep;
-      for (x = 0; x < xDimDst; x++)
-      {
-        float tx = x * xStep;
-        MUint8 val;
-        _getBicubicIntensity(pixelsSrc, xDimSrc, yDimSrc, zDimSrc, tx, ty, tz, &val);
-        pixelsDst[indDst++] = val;
-      }
+      float tx = x * xStep;
+      _getBicubicIntensity(pixelsSrc, xDimSrc, yDimSrc, zDimSrc, tx, ty, tz, &rowDst[x]);
+    }
+  }
+  else
+  {
+    float ty = (float)y / yDimDst;
+    float tz = (float)z / zDimDst;
+    for (x = 0; x < xDimDst; x++)
+    {
+      float tx = (float)x / xDimDst;
+      _getBicubicIntensity(pixelsSrc, xDimSrc, yDimSrc, zDimSrc, tx, ty, tz, &rowDst[x]);
     }
   }
 }
 
-void  _scaleUpTextureSmooth(
-                        const MUint8    *volTextureSrc,
-                        const int       xDimSrc,
-                        const int       yDimSrc,
-                        const int       zDimSrc,
-                        MUint8          *volTextureDst,
-                        const int       xDimDst,
-                        const int       yDimDst,
-                        const int       zDimDst
-                      )
+static void _scaleDownTextureSmooth(
+                              const MUint8 *pixelsSrc,
+                              const int xDimSrc, const int yDimSrc, const int zDimSrc,
+                              MUint8 *pixelsDst,
+                              const int xDimDst, const int yDimDst, const int zDimDst
+                            )
 {
-  int   offDst, x, y, z;
+  int y, z;
 
-  assert( (xDimSrc < xDimDst) || (yDimSrc < yDimDst) || (zDimSrc < zDimDst));
-
-  offDst = 0;
+  size_t indDst = 0;
   for (z = 0; z < zDimDst; z++)
   {
-    float tz = (float)z / zDimDst;
     for (y = 0; y < yDimDst; y++)
     {
-      float ty = (float)y / yDimDst;
-      for (x = 0; x < xDimDst; x++)
-      {
-        float tx = (float)x / xDimDst;
-        MUint8 val;
-        _getBicubicIntensity(volTextureSrc, xDimSrc, yDimSrc, zDimSrc, tx, ty, tz, &val);
-        volTextureDst[offDst] = val;
-        // next voxel dst
-        offDst++;
-      }     // for (x)
-    }       // for (y)
-  }         // for (z)
+      _scaleRowSmooth(
+                      pixelsSrc,
+                      xDimSrc, yDimSrc, zDimSrc,
+                      pixelsDst + indDst,
+                      xDimDst, yDimDst, zDimDst,
+                      y, z, 1
+                    );
+      indDst += xDimDst;
+    }
+  }
 }
 
-static void _scaleDownTextureRough(
-                                    const MUint8 *pixelsSrc,
-                                    const int xDimSrc, const int yDimSrc, const int zDimSrc,
-                                    MUint8 *pixelsDst,
-                                    const int xDimDst, const int yDimDst, const int zDimDst
-                                  )
+// Rough down scale of destination row (y, z): average of non zero
+// source voxels inside destination voxel box
+static void _scaleRowDownRough(
+                                const MUint8 *pixelsSrc,
+                                const int xDimSrc, const int yDimSrc, const int zDimSrc,
+                                MUint8 *rowDst,
+                                const int xDimDst, const int yDimDst, const int zDimDst,
+                                const int y, const int z
+                              )
 {
-  int x, y, z;
+  int x;
 
   assert(xDimDst <= xDimSrc);
   assert(yDimDst <= yDimSrc);
@@ -1586,57 +1627,52 @@ static void _scaleDownTextureRough(
   float yScale = (float)yDimSrc / yDimDst;
   float zScale = (float)zDimSrc / zDimDst;
 
-  int indDst = 0;
-  for (z = 0; z < zDimDst; z++)
+  int zSrcMin = (int)((z + 0) * zScale);
+  int zSrcMax = (int)((z + 1) * zScale);
+  int ySrcMin = (int)((y + 0) * yScale);
+  int ySrcMax = (int)((y + 1) * yScale);
+  for (x = 0; x < xDimDst; x++)
   {
-    int zSrcMin = (int)((z + 0) * zScale);
-    int zSrcMax = (int)((z + 1) * zScale);
-    for (y = 0; y < yDimDst; y++)
+    int xSrcMin = (int)((x + 0) * xScale);
+    int xSrcMax = (int)((x + 1) * xScale);
+
+    int xx, yy, zz;
+    MUint32 sum = 0;
+    int numPixels = 0;
+    for (zz = zSrcMin; zz < zSrcMax; zz++)
     {
-      int ySrcMin = (int)((y + 0) * yScale);
-      int ySrcMax = (int)((y + 1) * yScale);
-      for (x = 0; x < xDimDst; x++)
+      size_t zSrcOff = (size_t)zz * xDimSrc * yDimSrc;
+      for (yy = ySrcMin; yy < ySrcMax; yy++)
       {
-        int xSrcMin = (int)((x + 0) * xScale);
-        int xSrcMax = (int)((x + 1) * xScale);
-
-        int xx, yy, zz;
-        MUint32 sum = 0;
-        int numPixels = 0;
-        for (zz = zSrcMin; zz < zSrcMax; zz++)
+        size_t ySrcOff = (size_t)yy * xDimSrc;
+        for (xx = xSrcMin; xx < xSrcMax; xx++)
         {
-          int zSrcOff = zz * xDimSrc * yDimSrc;
-          for (yy = ySrcMin; yy < ySrcMax; yy++)
-          {
-            int ySrcOff = yy * xDimSrc;
-            for (xx = xSrcMin; xx < xSrcMax; xx++)
-            {
-              int offSrc = xx + ySrcOff + zSrcOff;
-              MUint32 valSrc = (MUint32)pixelsSrc[offSrc];
-              if (valSrc == 0)
-                continue;
-              sum += valSrc;
-              numPixels++;
-            }
-          }
+          size_t offSrc = xx + ySrcOff + zSrcOff;
+          MUint32 valSrc = (MUint32)pixelsSrc[offSrc];
+          if (valSrc == 0)
+            continue;
+          sum += valSrc;
+          numPixels++;
         }
-        MUint8 val = 0;
-        if (numPixels > 0)
-          val = (MUint8)(sum / (MUint32)numPixels);
-        pixelsDst[indDst++] = val;
       }
     }
-  }
+    MUint8 val = 0;
+    if (numPixels > 0)
+      val = (MUint8)(sum / (MUint32)numPixels);
+    rowDst[x] = val;
+  }   // for (x)
 }
 
-static void _scaleUpTextureRough(
-                                  const MUint8 *pixelsSrc,
-                                  const int xDimSrc, const int yDimSrc, const int zDimSrc,
-                                  MUint8 *pixelsDst,
-                                  const int xDimDst, const int yDimDst, const int zDimDst
-                                )
+// Rough up scale of destination row (y, z): nearest source voxel
+static void _scaleRowUpRough(
+                              const MUint8 *pixelsSrc,
+                              const int xDimSrc, const int yDimSrc, const int zDimSrc,
+                              MUint8 *rowDst,
+                              const int xDimDst, const int yDimDst, const int zDimDst,
+                              const int y, const int z
+                            )
 {
-  int x, y, z;
+  int x;
 
   assert(xDimDst >= xDimSrc);
   assert(yDimDst >= yDimSrc);
@@ -1646,26 +1682,134 @@ static void _scaleUpTextureRough(
   float yScale = (float)yDimSrc / yDimDst;
   float zScale = (float)zDimSrc / zDimDst;
 
-  int indDst = 0;
-  for (z = 0; z < zDimDst; z++)
+  int zSrc = (int)((z + 0) * zScale);
+  int ySrc = (int)((y + 0) * yScale);
+  const MUint8 *rowSrc = pixelsSrc + (size_t)zSrc * xDimSrc * yDimSrc +
+    (size_t)ySrc * xDimSrc;
+  for (x = 0; x < xDimDst; x++)
   {
-    int zSrc = (int)((z + 0) * zScale);
-    int zOffSrc = zSrc * xDimSrc * yDimSrc;
-    for (y = 0; y < yDimDst; y++)
+    int xSrc = (int)((x + 0) * xScale);
+    rowDst[x] = rowSrc[xSrc];
+  }
+}
+
+// ****************************************************************************
+// Scale and align to power of two in one pass
+// ****************************************************************************
+
+// Resampled box is written straight into its centered place inside
+// power of two volume, pad is filled after with background value
+struct ScaleAlignJob
+{
+  const MUint8 *m_pixelsSrc;
+  int           m_xDimSrc, m_yDimSrc, m_zDimSrc;
+  // resampled box size and its offset inside final volume
+  int           m_xDimDst, m_yDimDst, m_zDimDst;
+  int           m_xOffDst, m_yOffDst, m_zOffDst;
+  MUint8       *m_pixelsFinal;
+  int           m_xDimFinal, m_yDimFinal, m_zDimFinal;
+  int           m_isScaleDown;
+  int           m_useSmooth;
+  // dark / bright voxels per resampled slice, to select background
+  size_t       *m_numBlacks;
+  size_t       *m_numWhites;
+  MUint8        m_valBackground;
+};
+
+static void _scaleAlignCallback(
+                                void       *userData,
+                                const int   zStart,
+                                const int   zEnd
+                              )
+{
+  const ScaleAlignJob *job = (const ScaleAlignJob*)userData;
+  const size_t xyDimFinal = (size_t)job->m_xDimFinal * job->m_yDimFinal;
+  int y, z, x;
+
+  for (z = zStart; z < zEnd; z++)
+  {
+    size_t numBlacks = 0;
+    size_t numWhites = 0;
+    MUint8 *sliceDst = job->m_pixelsFinal +
+      (size_t)(z + job->m_zOffDst) * xyDimFinal;
+    for (y = 0; y < job->m_yDimDst; y++)
     {
-      int ySrc = (int)((y + 0) * yScale);
-      int yOffSrc = ySrc * xDimSrc;
-      for (x = 0; x < xDimDst; x++)
+      MUint8 *rowDst = sliceDst +
+        (size_t)(y + job->m_yOffDst) * job->m_xDimFinal + job->m_xOffDst;
+      if (job->m_useSmooth)
+        _scaleRowSmooth(
+                        job->m_pixelsSrc,
+                        job->m_xDimSrc, job->m_yDimSrc, job->m_zDimSrc,
+                        rowDst,
+                        job->m_xDimDst, job->m_yDimDst, job->m_zDimDst,
+                        y, z, job->m_isScaleDown
+                      );
+      else if (job->m_isScaleDown)
+        _scaleRowDownRough(
+                            job->m_pixelsSrc,
+                            job->m_xDimSrc, job->m_yDimSrc, job->m_zDimSrc,
+                            rowDst,
+                            job->m_xDimDst, job->m_yDimDst, job->m_zDimDst,
+                            y, z
+                          );
+      else
+        _scaleRowUpRough(
+                          job->m_pixelsSrc,
+                          job->m_xDimSrc, job->m_yDimSrc, job->m_zDimSrc,
+                          rowDst,
+                          job->m_xDimDst, job->m_yDimDst, job->m_zDimDst,
+                          y, z
+                        );
+      for (x = 0; x < job->m_xDimDst; x++)
       {
-        int xSrc = (int)((x + 0) * xScale);
-        int offSrc = xSrc + yOffSrc + zOffSrc;
-        MUint8 val = pixelsSrc[offSrc];
-        pixelsDst[indDst++] = val;
+        MUint32 val = (MUint32)rowDst[x];
+        if (val <= 32)
+          numBlacks++;
+        if (val >= 256 - 32)
+          numWhites++;
       }
-    }
-  }
+    }   // for (y)
+    job->m_numBlacks[z] = numBlacks;
+    job->m_numWhites[z] = numWhites;
+  }     // for (z)
 }
 
+static void _padAlignCallback(
+                              void       *userData,
+                              const int   zStart,
+                              const int   zEnd
+                            )
+{
+  const ScaleAlignJob *job = (const ScaleAlignJob*)userData;
+  const int     xDimFinal = job->m_xDimFinal;
+  const size_t  xyDimFinal = (size_t)xDimFinal * job->m_yDimFinal;
+  const MUint8  valBackground = job->m_valBackground;
+  const int     xEnd = job->m_xOffDst + job->m_xDimDst;
+  const int     yEnd = job->m_yOffDst + job->m_yDimDst;
+  const int     zEndDst = job->m_zOffDst + job->m_zDimDst;
+  int y, z;
+
+  for (z = zStart; z < zEnd; z++)
+  {
+    MUint8 *sliceDst = job->m_pixelsFinal + (size_t)z * xyDimFinal;
+    if ((z < job->m_zOffDst) || (z >= zEndDst))
+    {
+      memset(sliceDst, valBackground, xyDimFinal);
+      continue;
+    }
+    for (y = 0; y < job->m_yDimFinal; y++)
+    {
+      MUint8 *rowDst = sliceDst + (size_t)y * xDimFinal;
+      if ((y < job->m_yOffDst) || (y >= yEnd))
+      {
+        memset(rowDst, valBackground, xDimFinal);
+        continue;
+      }
+      memset(rowDst, valBackground, job->m_xOffDst);
+      memset(rowDst + xEnd, valBackground, xDimFinal - xEnd);
+    }   // for (y)
+  }     // for (z)
+}
 
 KtxError  KtxTexture::createAs1BytePowerByMaxSide(
                                                     const KtxTexture   *tex,
@@ -1695,64 +1839,65 @@ KtxError  KtxTexture::createAs1BytePowerByMaxSide(
   if (isDstCubeTexture)
     yDimDst = zDimDst = xDimDst;
 
-  MUint8 *pixelsSmall = M_NEW(MUint8[xDimDst * yDimDst * zDimDst]);
-  if (pixelsSmall == NULL)
-    return KTX_ERROR_NO_MEMORY;
-
-  const MUint8 *pixelsSrc = tex->getData();
-  if (
-        (xDimSrc >= xDimDst) && 
-        (yDimSrc >= yDimDst) &&
-        (zDimSrc >= zDimDst) 
-    )
-  {
-    if (useSmoothInterpolation)
-      _scaleDownTextureSmooth(
-                        pixelsSrc,
-                        xDimSrc, yDimSrc, zDimSrc,
-                        pixelsSmall,
-                        xDimDst, yDimDst, zDimDst
-                      );
-    else
-      _scaleDownTextureRough(
-                        pixelsSrc,
-                        xDimSrc, yDimSrc, zDimSrc,
-                        pixelsSmall,
-                        xDimDst, yDimDst, zDimDst
-                      );
-  }
-  else
-  {
-    if (useSmoothInterpolation)
-      _scaleUpTextureSmooth(
-                            pixelsSrc,
-                            xDimSrc, yDimSrc, zDimSrc,
-                            pixelsSmall,
-                            xDimDst, yDimDst, zDimDst
-                          );
-    else
-      _scaleUpTextureRough(
-                            pixelsSrc,
-                            xDimSrc, yDimSrc, zDimSrc,
-                            pixelsSmall,
-                            xDimDst, yDimDst, zDimDst
-                          );
-  }
-
   int xDimFinal = _getLargeEqualPowerOfTwo(xDimDst);
   int yDimFinal = _getLargeEqualPowerOfTwo(yDimDst);
   int zDimFinal = _getLargeEqualPowerOfTwo(zDimDst);
 
-  MUint8 *pixelsFinal = M_NEW(MUint8[xDimFinal * yDimFinal* zDimFinal]);
+  // Resampled voxels go directly into power of two volume:
+  // no intermediate volume and no extra copy pass
+  MUint8 *pixelsFinal =
+    M_NEW(MUint8[(size_t)xDimFinal * yDimFinal * zDimFinal]);
   if (pixelsFinal == NULL)
     return KTX_ERROR_NO_MEMORY;
-  _copyAndAlignTexture(
-                        pixelsSmall,
-                        xDimDst, yDimDst, zDimDst,
-                        pixelsFinal,
-                        xDimFinal, yDimFinal, zDimFinal
-                      );
-  delete[] pixelsSmall;
+  size_t *numBlacks = M_NEW(size_t[zDimDst + 1]);
+  size_t *numWhites = M_NEW(size_t[zDimDst + 1]);
+  if ((numBlacks == NULL) || (numWhites == NULL))
+  {
+    if (numBlacks)
+      delete[] numBlacks;
+    if (numWhites)
+      delete[] numWhites;
+    delete[] pixelsFinal;
+    return KTX_ERROR_NO_MEMORY;
+  }
+
+  ScaleAlignJob job;
+  job.m_pixelsSrc   = tex->getData();
+  job.m_xDimSrc     = xDimSrc;
+  job.m_yDimSrc     = yDimSrc;
+  job.m_zDimSrc     = zDimSrc;
+  job.m_xDimDst     = xDimDst;
+  job.m_yDimDst     = yDimDst;
+  job.m_zDimDst     = zDimDst;
+  // center resampled box the same way as _copyAndAlignTexture
+  job.m_xOffDst     = xDimFinal / 2 - xDimDst / 2;
+  job.m_yOffDst     = yDimFinal / 2 - yDimDst / 2;
+  job.m_zOffDst     = zDimFinal / 2 - zDimDst / 2;
+  job.m_pixelsFinal = pixelsFinal;
+  job.m_xDimFinal   = xDimFinal;
+  job.m_yDimFinal   = yDimFinal;
+  job.m_zDimFinal   = zDimFinal;
+  job.m_isScaleDown = (
+                        (xDimSrc >= xDimDst) &&
+                        (yDimSrc >= yDimDst) &&
+                        (zDimSrc >= zDimDst)
+                      ) ? 1 : 0;
+  job.m_useSmooth   = useSmoothInterpolation;
+  job.m_numBlacks   = numBlacks;
+  job.m_numWhites   = numWhites;
+  Parallel::forRange(zDimDst, _scaleAlignCallback, &job);
+
+  size_t numBlacksAll = 0;
+  size_t numWhitesAll = 0;
+  for (int z = 0; z < zDimDst; z++)
+  {
+    numBlacksAll += numBlacks[z];
+    numWhitesAll += numWhites[z];
+  }
+  delete[] numBlacks;
+  delete[] numWhites;
+  job.m_valBackground = (numBlacksAll > numWhitesAll) ? 0 : 255;
+  Parallel::forRange(zDimFinal, _padAlignCallback, &job);
 
   // create 1 byte per pixel texture from 1/3/4 bpp texture
   memcpy(&m_header.m_id, &tex->m_header, sizeof(KtxHeader));
@@ -1770,12 +1915,10 @@ KtxError  KtxTexture::createAs1BytePowerByMaxSide(
   m_header.m_glBaseInternalFormat = KTX_GL_RED;
 
 
-  int sizeVolume = m_header.m_pixelWidth;
-  if (m_header.m_pixelHeight > 0)
-    sizeVolume *= m_header.m_pixelHeight;
-  if (m_header.m_pixelDepth > 0)
-    sizeVolume *= m_header.m_pixelDepth;
+  size_t sizeVolume = _getNumVoxels(m_header);
 
+  if (m_data != NULL)
+    delete[] m_data;
   m_data = pixelsFinal;
   m_isCompressed = 0;
   m_dataSize = sizeVolume;
@@ -1790,7 +1933,7 @@ KtxError  KtxTexture::createAs1ByteLessSize(
                                             const int zDimDst
                                           )
 {
-  int   sizeVolume;
+  size_t  sizeVolume;
 
   // create 1 byte per pixel texture from 1/3/4 bpp texture
   memcpy(&m_header.m_id, &tex->m_header, sizeof(KtxHeader));
@@ -1807,11 +1950,7 @@ KtxError  KtxTexture::createAs1ByteLessSize(
   m_header.m_glInternalFormat = KTX_GL_R8_EXT;        // GL_R8_EXT, GL_R8 (0x8229)
   m_header.m_glBaseInternalFormat = KTX_GL_RED;
 
-  sizeVolume = m_header.m_pixelWidth;
-  if (m_header.m_pixelHeight > 0)
-    sizeVolume *= m_header.m_pixelHeight;
-  if (m_header.m_pixelDepth > 0)
-    sizeVolume *= m_header.m_pixelDepth;
+  sizeVolume = _getNumVoxels(m_header);
 
   if (m_data != NULL)
     delete[] m_data;
@@ -1845,7 +1984,7 @@ KtxError  KtxTexture::createAs1ByteLessSize(
 
 KtxError  KtxTexture::createAsSingleSphere(const int dim)
 {
-  int   sizeVolume;
+  size_t  sizeVolume;
 
   int xDim = dim;
   int yDim = dim;
@@ -1876,11 +2015,7 @@ KtxError  KtxTexture::createAsSingleSphere(const int dim)
   int memSize = sizeof(KtxKeyData);       // for happy cppcheck
   memset(keyDataPtr, 0, memSize);
 
-  sizeVolume = m_header.m_pixelWidth;
-  if (m_header.m_pixelHeight > 0)
-    sizeVolume *= m_header.m_pixelHeight;
-  if (m_header.m_pixelDepth > 0)
-    sizeVolume *= m_header.m_pixelDepth;
+  sizeVolume = _getNumVoxels(m_header);
 
   if (m_data != NULL)
     delete[] m_data;
@@ -1898,7 +2033,7 @@ KtxError  KtxTexture::createAsSingleSphere(const int dim)
   const float KOEF_ROUGH = 0.05f;
 
   int x, y, z;
-  int indDst = 0;
+  size_t indDst = 0;
   float radius = (float)(dim / 2);
   for (z = 0; z < zDim; z++)
   {
@@ -1945,54 +2080,22 @@ KtxError  KtxTexture::createMinSizeTexture(const KtxTexture *tex, const int inde
 
   // bbox
   V3d    vBoxMin, vBoxMax;
+  VolumeView viewSrc, viewBox;
+  viewSrc.createFromTexture(tex);
+  if (!viewSrc.getNonZeroBox(vBoxMin, vBoxMax, indexChannel))
+    return KTX_ERROR_WRONG_SIZE;
+  viewBox.createAsBox(viewSrc, vBoxMin, vBoxMax);
 
-  vBoxMin.x = vBoxMin.y = vBoxMin.z = 1<<24;
-  vBoxMax.x = vBoxMax.y = vBoxMax.z = 0;
-
-  int bitShift = indexChannel * 8;
-  int x, y, z;
-  const MUint32 *pixelsSrc = (MUint32*)tex->getData();
-  for (z = 0; z < zDimSrc; z++)
-  {
-    for (y = 0; y < yDimSrc; y++)
-    {
-      for (x = 0; x < xDimSrc; x++)
-      {
-        MUint32 val = *pixelsSrc;
-        // check G component
-        if ((val >> bitShift) & 0xff)
-        {
-          if (x < vBoxMin.x)
-            vBoxMin.x = x;
-          if (y < vBoxMin.y)
-            vBoxMin.y = y;
-          if (z < vBoxMin.z)
-            vBoxMin.z = z;
-
-          if (x > vBoxMax.x)
-            vBoxMax.x = x;
-          if (y > vBoxMax.y)
-            vBoxMax.y = y;
-          if (z > vBoxMax.z)
-            vBoxMax.z = z;
-        }
-
-        pixelsSrc++;
-      }     // for (x)
-    }       // for (y)
-  }         // for (z)
-
-  int xDimDst = vBoxMax.x - vBoxMin.x + 1;
-  int yDimDst = vBoxMax.y - vBoxMin.y + 1;
-  int zDimDst = vBoxMax.z - vBoxMin.z + 1;
-
+  int xDimDst = viewBox.getWidth();
+  int yDimDst = viewBox.getHeight();
+  int zDimDst = viewBox.getDepth();
 
   memcpy(&m_header.m_id, &tex->m_header, sizeof(KtxHeader));
   m_header.m_pixelWidth   = xDimDst;
   m_header.m_pixelHeight  = yDimDst;
   m_header.m_pixelDepth   = zDimDst;
 
-  int sizeVolume = xDimDst * yDimDst * zDimDst;
+  size_t sizeVolume = (size_t)xDimDst * yDimDst * zDimDst;
   sizeVolume *= bpp;
 
   if (m_data != NULL)
@@ -2004,28 +2107,8 @@ KtxError  KtxTexture::createMinSizeTexture(const KtxTexture *tex, const int inde
   m_isCompressed = 0;
   m_dataSize = sizeVolume;
 
-  // Copy pixels
-  MUint32 *pixelsDst = (MUint32*)m_data;
-  pixelsSrc = (MUint32*)tex->getData();
-
-  for (z = 0; z < zDimDst; z++)
-  {
-    int zSrc = z + vBoxMin.z;
-    int zSrcOff = zSrc * xDimSrc * yDimSrc;
-    for (y = 0; y < yDimDst; y++)
-    {
-      int ySrc = y + vBoxMin.y;
-      int ySrcOff = ySrc * xDimSrc;
-      for (x = 0; x < xDimDst; x++)
-      {
-        int xSrc = x + vBoxMin.x;
-
-        int off = xSrc + ySrcOff + zSrcOff;
-        *pixelsDst = pixelsSrc[off];
-        pixelsDst++;
-      }     // for (x)
-    }       // for (y)
-  }         // for (z)
+  // Copy pixels row by row
+  viewBox.copyTo(m_data);
 
   // Setup user data
   V3d vSize;
@@ -2064,7 +2147,7 @@ void  KtxTexture::fillValZGreater(const int zTop, const MUint8 valToFill)
   int z;
   for (z = zTop; z < zDim; z++)
   {
-    int zOff = z * xDim * yDim;
+    size_t zOff = (size_t)z * xyDim;
     for (int i = 0; i < xyDim; i++)
     {
       m_data[zOff + i] = valToFill;
@@ -2082,13 +2165,13 @@ void  KtxTexture::fillZeroYGreater(const int yClipMax)
   assert(yClipMax < yDim);
   for (int z = 0; z < zDim; z++)
   {
-    int zOff = z * xDim * yDim;
+    size_t zOff = (size_t)z * xDim * yDim;
     for (int y = 0; y < yDim; y++)
     {
       int yOff = y * xDim;
       for (int x = 0; x < xDim; x++)
       {
-        int off = x + yOff + zOff;
+        size_t off = x + yOff + zOff;
         if (y >= yClipMax)
           m_data[off] = 0;
       }   // for (x)
@@ -2096,19 +2179,29 @@ void  KtxTexture::fillZeroYGreater(const int yClipMax)
   }       // for (z)
 }
 
-void  KtxTexture::gaussSmooth(const int gaussNeigh, const float gaussSigma)
+int   KtxTexture::gaussSmooth(const int gaussNeigh, const float gaussSigma)
 {
+  if (gaussNeigh > KTX_GAUSS_MAX_NEIGH)
+    return gaussSmoothRecursive(gaussSigma * gaussNeigh);
   int xDim          = getWidth();
   int yDim          = getHeight();
   int zDim          = getDepth();
-  int xyzDim        = xDim * yDim * zDim;
-  MUint8 *pixelsDst = M_NEW(MUint8[xyzDim]);
-  memset(pixelsDst, 0, xyzDim);
+  size_t xyDim      = (size_t)xDim * yDim;
+
+  // Result slice cz needs source slices [cz - gaussNeigh, cz + gaussNeigh].
+  // It is kept in ring of (gaussNeigh + 1) slices and written back to
+  // volume when source slice cz is not read anymore, so temporary memory
+  // is a slab of slices, not a copy of whole volume.
+  const int numSlicesRing = gaussNeigh + 1;
+  MemArenaFrame frame;
+  MUint8 *slicesRing = (MUint8*)frame.allocate(xyDim * numSlicesRing);
+  if (!slicesRing)
+    return -1;
 
   const   float gaussKoef = 1.0f / (2.0f * gaussSigma * gaussSigma);
 
-  const   int   MAX_NEIGHS = 2 * 6 + 1;
-  static  float koefs[MAX_NEIGHS * MAX_NEIGHS * MAX_NEIGHS];
+  const   int   MAX_NEIGHS = 2 * KTX_GAUSS_MAX_NEIGH + 1;
+  float koefs[MAX_NEIGHS * MAX_NEIGHS * MAX_NEIGHS];
 
   int     dx, dy, dz;
   int     offKoef = 0;
@@ -2139,39 +2232,61 @@ void  KtxTexture::gaussSmooth(const int gaussNeigh, const float gaussSigma)
   } // for (i)
 
   int cx, cy, cz;
-  for (cz = gaussNeigh; cz < zDim - gaussNeigh; cz++)
+  for (cz = 0; cz < zDim; cz++)
   {
-    int zOff = cz * xDim * yDim;
-    for (cy = gaussNeigh; cy < yDim - gaussNeigh; cy++)
+    MUint8 *sliceDst = slicesRing + (cz % numSlicesRing) * xyDim;
+    // border voxels are cleared
+    memset(sliceDst, 0, xyDim);
+    const int isInner = (cz >= gaussNeigh) && (cz < zDim - gaussNeigh);
+    const MUint8 *sliceSrc = m_data + (size_t)cz * xyDim;
+    for (cy = gaussNeigh; (cy < yDim - gaussNeigh) && isInner; cy++)
     {
       int yOff = cy * xDim;
       for (cx = gaussNeigh; cx < xDim - gaussNeigh; cx++)
       {
-        int off = zOff + yOff + cx;
+        const MUint8 *src = sliceSrc + yOff + cx;
         float valSum = 0.0f;
 
         offKoef = 0;
         for (dz = -gaussNeigh; dz <= +gaussNeigh; dz++)
         {
-          int dzOff = dz * xDim * yDim;
+          const ptrdiff_t dzOff = dz * (ptrdiff_t)xyDim;
           for (dy = -gaussNeigh; dy <= +gaussNeigh; dy++)
           {
             int dyOff = dy * xDim;
             for (dx = -gaussNeigh; dx <= +gaussNeigh; dx++)
             {
               float w = koefs[offKoef ++];
-              valSum += w * (float)m_data[off + dx + dyOff + dzOff];
+              valSum += w * (float)src[dx + dyOff + dzOff];
             }   // for (dx)
           }     // for (dy)
         }       // for (dz)
         valSum = (valSum <= 255.0f) ? valSum: 255.0f;
         MUint8 vSum = (MUint8)valSum;
-        pixelsDst[off] = vSum;
+        sliceDst[yOff + cx] = vSum;
       }   // for (cx)
     }     // for (cy)
+
+    // source slice (cz - gaussNeigh) is not used by next slices
+    const int zDone = cz - gaussNeigh;
+    if (zDone >= 0)
+      memcpy(m_data + (size_t)zDone * xyDim,
+        slicesRing + (zDone % numSlicesRing) * xyDim, xyDim);
   }       // for (cz)
-  memcpy(m_data, pixelsDst, xyzDim);
-  delete [] pixelsDst;
+  // write back the rest of ring
+  for (cz = (zDim > gaussNeigh) ? (zDim - gaussNeigh) : 0; cz < zDim; cz++)
+    memcpy(m_data + (size_t)cz * xyDim,
+      slicesRing + (cz % numSlicesRing) * xyDim, xyDim);
+  return 1;
+}
+
+int KtxTexture::gaussSmoothRecursive(const float sigma)
+{
+  if (m_header.m_glFormat != KTX_GL_RED)
+    return -1;
+  // filter reads whole source before writing result
+  return VolumeTools::performGaussRecursive(m_data, getWidth(), getHeight(),
+    getDepth(), sigma, m_data);
 }
 
 static int _scaleTextureDown(
@@ -2188,17 +2303,18 @@ static int _scaleTextureDown(
   const int ACC_BITS = 10;
   const int ACC_HALF = 1 << (ACC_BITS - 1);
   int       xStep, yStep, zStep;
-  int       indDst;
+  size_t    indDst;
   int       xDst, yDst, zDst;
   int       zSrcAccL, zSrcAccH;
-  int       x, y, z, zOff, yOff;
-  int       xyDimSrc;
+  int       x, y, z;
+  size_t    zOff, yOff;
+  size_t    xyDimSrc;
 
   assert(xDimSrc > xDimDst);
   assert(yDimSrc > yDimDst);
   assert(zDimSrc > zDimDst);
 
-  xyDimSrc = xDimSrc * yDimSrc;
+  xyDimSrc = (size_t)xDimSrc * yDimSrc;
 
   xStep = (xDimSrc << ACC_BITS) / xDimDst;
   yStep = (yDimSrc << ACC_BITS) / yDimDst;
@@ -2230,11 +2346,12 @@ static int _scaleTextureDown(
         int     numPixels = 0;
         for (z = zSrcL, zOff = zSrcL * xyDimSrc; z < zSrcH; z++, zOff += xyDimSrc)
         {
-          for (y = ySrcL, yOff = ySrcL * xDimSrc; y < ySrcH; y++, yOff += xDimSrc)
+          for (y = ySrcL, yOff = (size_t)ySrcL * xDimSrc; y < ySrcH;
+            y++, yOff += xDimSrc)
           {
             for (x = xSrcL; x < xSrcH; x++)
             {
-              int offSrc = x + yOff + zOff;
+              size_t offSrc = x + yOff + zOff;
               sum += (MUint32)volTextureSrc[offSrc];
               numPixels++;
             }   // for (x)
@@ -2254,27 +2371,95 @@ int KtxTexture::scaleDownToSize(const int xDimDst, const int yDimDst, const int
   int xDimSrc = getWidth();
   int yDimSrc = getHeight();
   int zDimSrc = getDepth();
-  int numPixelsDst = xDimDst * yDimDst * zDimDst;
-  MUint8 *pixelsDst = M_NEW(MUint8[numPixelsDst]);
-  if (!pixelsDst)
-    return -1;
-  _scaleTextureDown(m_data, xDimSrc, yDimSrc, zDimSrc, xDimDst, yDimDst, zDimDst, pixelsDst);
-  delete [] m_data;
-  m_data = pixelsDst;
+  size_t numPixelsDst = (size_t)xDimDst * yDimDst * zDimDst;
+  // each destination voxel only reads source voxels at the same or larger
+  // offset, so down scale is done in place, without temporary volume
+  _scaleTextureDown(m_data, xDimSrc, yDimSrc, zDimSrc, xDimDst, yDimDst, zDimDst, m_data);
+  m_dataSize = numPixelsDst;
   m_header.m_pixelWidth   = xDimDst;
   m_header.m_pixelHeight  = yDimDst;
   m_header.m_pixelDepth   = zDimDst;
   return 1;
 }
 
+void KtxTexture::replaceData(
+                              MUint8     *dataNew,
+                              const int   xDim,
+                              const int   yDim,
+                              const int   zDim
+                             )
+{
+  delete [] m_data;
+  m_data = dataNew;
+  m_dataSize = (size_t)xDim * yDim * zDim;
+  m_header.m_pixelWidth   = xDim;
+  m_header.m_pixelHeight  = yDim;
+  m_header.m_pixelDepth   = zDim;
+}
+
+int KtxTexture::scaleDownMedian(
+                                const int   xDimDst,
+                                const int   yDimDst,
+                                const int   zDimDst,
+                                const int   radius,
+                                const float percentile
+                               )
+{
+  if (m_header.m_glFormat != KTX_GL_RED)
+    return -1;
+  if ((xDimDst <= 0) || (yDimDst <= 0) || (zDimDst <= 0))
+    return -1;
+  // windows of neighbour voxels overlap: result goes to new volume
+  size_t numPixelsDst = (size_t)xDimDst * yDimDst * zDimDst;
+  MUint8 *dataNew = M_NEW(MUint8[numPixelsDst]);
+  if (!dataNew)
+    return -1;
+  int ok = RankFilter::downsample3d(m_data, getWidth(), getHeight(),
+    getDepth(), dataNew, xDimDst, yDimDst, zDimDst, radius, percentile);
+  if (ok < 0)
+  {
+    delete [] dataNew;
+    return -1;
+  }
+  replaceData(dataNew, xDimDst, yDimDst, zDimDst);
+  return 1;
+}
+
+int KtxTexture::scaleDownGuided(
+                                const int   xDimDst,
+                                const int   yDimDst,
+                                const int   zDimDst,
+                                const int   radius,
+                                const float eps
+                               )
+{
+  if (m_header.m_glFormat != KTX_GL_RED)
+    return -1;
+  if ((xDimDst <= 0) || (yDimDst <= 0) || (zDimDst <= 0))
+    return -1;
+  size_t numPixelsDst = (size_t)xDimDst * yDimDst * zDimDst;
+  MUint8 *dataNew = M_NEW(MUint8[numPixelsDst]);
+  if (!dataNew)
+    return -1;
+  int ok = GuidedFilter::downsample3d(m_data, getWidth(), getHeight(),
+    getDepth(), dataNew, xDimDst, yDimDst, zDimDst, radius, eps);
+  if (ok < 0)
+  {
+    delete [] dataNew;
+    return -1;
+  }
+  replaceData(dataNew, xDimDst, yDimDst, zDimDst);
+  return 1;
+}
+
 int KtxTexture::convertTo4bpp()
 {
-  int numPixels = getWidth() * getHeight() * getDepth();
+  size_t numPixels = (size_t)getWidth() * getHeight() * getDepth();
   MUint8 *dataNew = M_NEW(MUint8[numPixels * 4]);
   if (!dataNew)
     return -1;
   MUint32 *pixelsDst = (MUint32*)dataNew;
-  for (int i = 0; i < numPixels; i++)
+  for (size_t i = 0; i < numPixels; i++)
   {
     MUint32 val = (MUint32)m_data[i];
     val = val | (val << 8) | (val << 16) | (val << 24);
@@ -2282,6 +2467,7 @@ int KtxTexture::convertTo4bpp()
   } // for (i)
   delete [] m_data;
   m_data = dataNew;
+  m_dataSize = numPixels * 4;
   m_header.m_glFormat = KTX_GL_RGBA;
   m_header.m_glInternalFormat = KTX_GL_RGBA;
   m_header.m_glBaseInternalFormat = KTX_GL_RGBA;
@@ -2313,7 +2499,7 @@ int KtxTexture::getBoundingBox(V3d &vMin, V3d &vMax) const
     {
       for (z = 0; (z < zDim) && isEdge; z++)
       {
-        int off = vMin.x + y * xDim + z * xDim * yDim;
+        size_t off = vMin.x + y * xDim + (size_t)z * xDim * yDim;
         MUint8 val = m_data[off];
         if (val >= VAL_BACK_BARRIER)
           isEdge = 0;
@@ -2327,7 +2513,7 @@ int KtxTexture::getBoundingBox(V3d &vMin, V3d &vMax) const
     {
       for (z = 0; (z < zDim) && isEdge; z++)
       {
-        int off = vMax.x + y * xDim + z * xDim * yDim;
+        size_t off = vMax.x + y * xDim + (size_t)z * xDim * yDim;
         MUint8 val = m_data[off];
         if (val >= VAL_BACK_BARRIER)
           isEdge = 0;
@@ -2342,7 +2528,7 @@ int KtxTexture::getBoundingBox(V3d &vMin, V3d &vMax) const
     {
       for (z = 0; (z < zDim) && isEdge; z++)
       {
-        int off = x + (vMin.y * xDim) + (z * xDim * yDim);
+        size_t off = x + (vMin.y * xDim) + ((size_t)z * xDim * yDim);
         MUint8 val = m_data[off];
         if (val >= VAL_BACK_BARRIER)
           isEdge = 0;
@@ -2356,7 +2542,7 @@ int KtxTexture::getBoundingBox(V3d &vMin, V3d &vMax) const
     {
       for (z = 0; (z < zDim) && isEdge; z++)
       {
-        int off = x + (vMax.y * xDim) + (z * xDim * yDim);
+        size_t off = x + (vMax.y * xDim) + ((size_t)z * xDim * yDim);
         MUint8 val = m_data[off];
         if (val >= VAL_BACK_BARRIER)
           isEdge = 0;
@@ -2371,7 +2557,7 @@ int KtxTexture::getBoundingBox(V3d &vMin, V3d &vMax) const
     {
       for (y = 0; (y < yDim) && isEdge; y++)
       {
-        int off = x + (y * xDim) + (vMin.z * xDim * yDim);
+        size_t off = x + (y * xDim) + ((size_t)vMin.z * xDim * yDim);
         MUint8 val = m_data[off];
         if (val >= VAL_BACK_BARRIER)
           isEdge = 0;
@@ -2384,7 +2570,7 @@ int KtxTexture::getBoundingBox(V3d &vMin, V3d &vMax) const
     {
       for (y = 0; (y < yDim) && isEdge; y++)
       {
-        int off = x + (y * xDim) + (vMax.z * xDim * yDim);
+        size_t off = x + (y * xDim) + ((size_t)vMax.z * xDim * yDim);
         MUint8 val = m_data[off];
         if (val >= VAL_BACK_BARRIER)
           isEdge = 0;
@@ -2398,7 +2584,7 @@ int KtxTexture::getHorSliceSymmetry(const int z, float &xSym, float &ySym)
 {
   const int xDim = getWidth();
   const int yDim = getHeight();
-  int offSlice = z * xDim * yDim;
+  size_t offSlice = (size_t)z * xDim * yDim;
 
   V3d vMin, vMax;
   getBoundingBox(vMin, vMax);
@@ -2522,80 +2708,792 @@ int KtxTexture::getHorSliceSymmetry(const int z, float &xSym, float &ySym)
   return 1;
 }
 
-int KtxTexture::scaleUpZ(const int zNew)
+int KtxTexture::scaleUpZ(const int zNew, const ResampleFilter filter)
 {
+  assert(zNew > getDepth());
+  return rescale(getWidth(), getHeight(), zNew, filter);
+}
+
+int   KtxTexture::rescale(
+                          const int             xNew,
+                          const int             yNew,
+                          const int             zNew,
+                          const ResampleFilter  filter
+                         )
+{
+  // only 1 byte texture are supported for this operation now
+  assert(getGlFormat() == KTX_GL_RED);
   const int xDim = getWidth();
   const int yDim = getHeight();
-  const int xyDim = xDim * yDim;
   const int zDim = getDepth();
-  assert(zNew > (int)zDim);
-  const int divRest = zNew % zDim;
-  assert(divRest == 0);
 
-  MUint8 *pixelsNew = M_NEW(MUint8[xDim * yDim * zNew]);
+  // result that fits into current data is built in frame temporary
+  // and copied back, so m_data is not reallocated
+  const size_t sizeNew = (size_t)xNew * yNew * zNew;
+  const int isInPlace = (sizeNew <= m_dataSize) ? 1 : 0;
+  MemArenaFrame frame;
+  MUint8 *pixelsNew = (isInPlace) ?
+    (MUint8*)frame.allocate(sizeNew) : M_NEW(MUint8[sizeNew]);
   if (!pixelsNew)
     return -1;
-  int iDst = 0;
-  int zDst;
-  for (zDst = 0; zDst < zNew; zDst++)
-  {
-    int zSrc    = zDim * zDst / zNew;
-    int zRatio  = (zDim * zDst) % zNew;
-    zRatio      = 1024 * zRatio / zNew;
-    int zNext   = zSrc + 1;
-    if (zNext >= zDim)
-      zNext = zSrc;
-    const int zOff = zSrc * xyDim;
-    const int zOffNext = zNext * xyDim;
-    for (int i = 0; i < xyDim; i++)
+  const int ok = Resampler3d::resample(
+                                        m_data, xDim, yDim, zDim,
+                                        pixelsNew, xNew, yNew, zNew,
+                                        filter
+                                      );
+  if (ok < 0)
+  {
+    if (!isInPlace)
+      delete [] pixelsNew;
+    return -1;
+  }
+  if (isInPlace)
+  {
+    memcpy(m_data, pixelsNew, sizeNew);
+  }
+  else
+  {
+    delete [] m_data;
+    m_data = pixelsNew;
+  }
+  m_dataSize = sizeNew;
+  setWidth(xNew);
+  setHeight(yNew);
+  setDepth(zNew);
+  return 1;
+}
+
+KtxError  KtxTexture::createAsResampled(
+                                        const KtxTexture     *tex,
+                                        const int             xDimDst,
+                                        const int             yDimDst,
+                                        const int             zDimDst,
+                                        const ResampleFilter  filter
+                                       )
+{
+  if (tex->m_header.m_glFormat != KTX_GL_RED)
+    return KTX_ERROR_WRONG_FORMAT;
+
+  memcpy(&m_header, &tex->m_header, sizeof(KtxHeader));
+  memcpy(&m_keyData, &tex->m_keyData, sizeof(KtxKeyData));
+  m_header.m_pixelWidth   = xDimDst;
+  m_header.m_pixelHeight  = yDimDst;
+  m_header.m_pixelDepth   = zDimDst;
+
+  const size_t sizeVolume = (size_t)xDimDst * yDimDst * zDimDst;
+  if (m_data != NULL)
+    delete[] m_data;
+  m_data = M_NEW(MUint8[sizeVolume]);
+  if (!m_data)
+    return KTX_ERROR_NO_MEMORY;
+  m_isCompressed = 0;
+  m_dataSize = sizeVolume;
+
+  const int ok = Resampler3d::resample(
+                                        tex->getData(),
+                                        tex->getWidth(),
+                                        tex->getHeight(),
+                                        tex->getDepth(),
+                                        m_data, xDimDst, yDimDst, zDimDst,
+                                        filter
+                                      );
+  return (ok < 0) ? KTX_ERROR_NO_MEMORY : KTX_ERROR_OK;
+}
+
+// ****************************************************************************
+// Orthogonal slices
+// ****************************************************************************
+
+struct SliceJob
+{
+  const MUint8 *m_pixelsSrc;
+  int           m_xDim, m_yDim, m_zDim;
+  KtxSliceAxis  m_axis;
+  // slice positions: m_indices[k] or m_indexStart + k for slab
+  const int    *m_indices;
+  int           m_indexStart;
+  int           m_numSlices;
+  MUint8       *m_pixelsDst;
+  size_t        m_sliceSize;
+};
+
+static int _getSliceIndex(const SliceJob *job, const int k)
+{
+  return (job->m_indices != NULL) ? job->m_indices[k] : job->m_indexStart + k;
+}
+
+// Axial slices: every slice is one continuous block
+static void _sliceZCallback(
+                            void       *userData,
+                            const int   kStart,
+                            const int   kEnd
+                          )
+{
+  const SliceJob *job = (const SliceJob*)userData;
+  for (int k = kStart; k < kEnd; k++)
+  {
+    const int z = _getSliceIndex(job, k);
+    memcpy(job->m_pixelsDst + k * job->m_sliceSize,
+      job->m_pixelsSrc + (size_t)z * job->m_sliceSize, job->m_sliceSize);
+  }
+}
+
+// Coronal and sagittal slices: source slice z gives row z of every
+// destination slice, so volume is read once for any number of slices
+static void _sliceXyCallback(
+                              void       *userData,
+                              const int   zStart,
+                              const int   zEnd
+                            )
+{
+  const SliceJob *job = (const SliceJob*)userData;
+  const int     xDim = job->m_xDim;
+  const int     yDim = job->m_yDim;
+  const int     numSlices = job->m_numSlices;
+  const size_t  sliceSize = job->m_sliceSize;
+  int y, z, k;
+
+  for (z = zStart; z < zEnd; z++)
+  {
+    const MUint8 *sliceSrc = job->m_pixelsSrc + (size_t)z * xDim * yDim;
+    if (job->m_axis == KTX_SLICE_AXIS_Y)
+    {
+      // rows are continuous in source and destination
+      MUint8 *rowDst = job->m_pixelsDst + (size_t)z * xDim;
+      for (k = 0; k < numSlices; k++, rowDst += sliceSize)
+      {
+        const int ySrc = _getSliceIndex(job, k);
+        memcpy(rowDst, sliceSrc + (size_t)ySrc * xDim, xDim);
+      }
+      continue;
+    }
+    // sagittal: transpose source slice (y, x) -> rows (x, y) by tiles.
+    // Destination slices are far apart (often power of two distance),
+    // so tile is transposed in local buffer and written by row parts.
+    MUint8 *rowsDst = job->m_pixelsDst + (size_t)z * yDim;
+    for (int yTile = 0; yTile < yDim; yTile += KTX_SLICE_TILE)
     {
-      // mix zSrc and zNext layers ith zRatio
-      MUint32 valSrc   = (MUint32)m_data[zOff + i];
-      MUint32 valNext  = (MUint32)m_data[zOffNext + i];
+      const int numRows = (yTile + KTX_SLICE_TILE < yDim) ?
+        KTX_SLICE_TILE : (yDim - yTile);
+      for (int kTile = 0; kTile < numSlices; kTile += KTX_SLICE_TILE)
+      {
+        const int numTile = (kTile + KTX_SLICE_TILE < numSlices) ?
+          KTX_SLICE_TILE : (numSlices - kTile);
+        int     xSrc[KTX_SLICE_TILE];
+        MUint8  tile[KTX_SLICE_TILE * KTX_SLICE_TILE];
+        for (k = 0; k < numTile; k++)
+          xSrc[k] = _getSliceIndex(job, kTile + k);
+        for (y = 0; y < numRows; y++)
+        {
+          const MUint8 *rowSrc = sliceSrc + (size_t)(yTile + y) * xDim;
+          for (k = 0; k < numTile; k++)
+            tile[k * KTX_SLICE_TILE + y] = rowSrc[xSrc[k]];
+        }
+        MUint8 *dst = rowsDst + kTile * sliceSize + yTile;
+        for (k = 0; k < numTile; k++, dst += sliceSize)
+          memcpy(dst, tile + k * KTX_SLICE_TILE, numRows);
+      }     // for (kTile)
+    }       // for (yTile)
+  }         // for (z)
+}
 
-      MUint32 valNew = (valSrc * (1024 - zRatio) + valNext * zRatio) >> 10;
-      pixelsNew[iDst++] = (MUint8)valNew;
-    }   // for (i) all in xyDim
-  }     // for (z)
-  delete [] m_data;
-  m_data = pixelsNew;
-  setDepth(zNew);
+static int _extractSlices(SliceJob *job)
+{
+  const int dimAxis = (job->m_axis == KTX_SLICE_AXIS_X) ? job->m_xDim :
+    ((job->m_axis == KTX_SLICE_AXIS_Y) ? job->m_yDim : job->m_zDim);
+  for (int k = 0; k < job->m_numSlices; k++)
+  {
+    const int index = _getSliceIndex(job, k);
+    if ((index < 0) || (index >= dimAxis))
+      return -1;
+  }
+  if (job->m_axis == KTX_SLICE_AXIS_Z)
+    Parallel::forRange(job->m_numSlices, _sliceZCallback, job);
+  else
+    Parallel::forRange(job->m_zDim, _sliceXyCallback, job);
   return 1;
 }
 
-int   KtxTexture::rescale(const int xNew, const int yNew, const int zNew)
+void KtxTexture::getSliceSize(const KtxSliceAxis axis, int &w, int &h) const
 {
-  const int xDim = getWidth();
-  const int yDim = getHeight();
-  const int xyDim = xDim * yDim;
-  const int zDim = getDepth();
+  switch (axis)
+  {
+    case KTX_SLICE_AXIS_X:
+      w = getHeight();
+      h = getDepth();
+      break;
+    case KTX_SLICE_AXIS_Y:
+      w = getWidth();
+      h = getDepth();
+      break;
+    case KTX_SLICE_AXIS_Z:
+      w = getWidth();
+      h = getHeight();
+      break;
+    default:
+      assert(axis < -5555);
+      w = h = 0;
+  }
+}
 
-  MUint8 *pixelsNew = M_NEW(MUint8[xNew * yNew * zNew]);
-  if (!pixelsNew)
+int KtxTexture::getSlice(
+                          const KtxSliceAxis axis,
+                          const int index,
+                          MUint8 *pixelsDst
+                        ) const
+{
+  return getSlab(axis, index, 1, pixelsDst);
+}
+
+int KtxTexture::getSlab(
+                        const KtxSliceAxis axis,
+                        const int indexStart,
+                        const int numSlices,
+                        MUint8 *pixelsDst
+                       ) const
+{
+  if ((m_header.m_glFormat != KTX_GL_RED) || (numSlices <= 0))
     return -1;
+  int w, h;
+  getSliceSize(axis, w, h);
+
+  SliceJob job;
+  job.m_pixelsSrc   = m_data;
+  job.m_xDim        = getWidth();
+  job.m_yDim        = getHeight();
+  job.m_zDim        = getDepth();
+  job.m_axis        = axis;
+  job.m_indices     = NULL;
+  job.m_indexStart  = indexStart;
+  job.m_numSlices   = numSlices;
+  job.m_pixelsDst   = pixelsDst;
+  job.m_sliceSize   = (size_t)w * h;
+  return _extractSlices(&job);
+}
 
-  int offDst = 0;
-  int xDst, yDst, zDst;
-  for (zDst = 0; zDst < zNew; zDst++)
+int KtxTexture::getSlices(
+                          const KtxSliceAxis axis,
+                          const int *indices,
+                          const int numSlices,
+                          MUint8 *pixelsDst
+                         ) const
+{
+  if ((m_header.m_glFormat != KTX_GL_RED) || (numSlices <= 0))
+    return -1;
+  int w, h;
+  getSliceSize(axis, w, h);
+
+  SliceJob job;
+  job.m_pixelsSrc   = m_data;
+  job.m_xDim        = getWidth();
+  job.m_yDim        = getHeight();
+  job.m_zDim        = getDepth();
+  job.m_axis        = axis;
+  job.m_indices     = indices;
+  job.m_indexStart  = 0;
+  job.m_numSlices   = numSlices;
+  job.m_pixelsDst   = pixelsDst;
+  job.m_sliceSize   = (size_t)w * h;
+  return _extractSlices(&job);
+}
+
+// ****************************************************************************
+// Reorientation
+// ****************************************************************************
+
+// Destination box is halved by largest side until it is below this size,
+// then copied directly: source and destination parts of box stay in cache
+// whatever strides are (cache oblivious blocking)
+#define KTX_REORIENT_LEAF_VOXELS    (16 * 16 * 16)
+
+struct ReorientJob
+{
+  const MUint8 *m_pixelsSrc;
+  MUint8       *m_pixelsDst;
+  // destination dimensions
+  int           m_dims[3];
+  // source offset of destination voxel (0, 0, 0) and source step along
+  // every destination axis (negative for flipped axes)
+  ptrdiff_t     m_offStart;
+  ptrdiff_t     m_steps[3];
+  // in place passes
+  int           m_flips[3];
+};
+
+static void _reorientBox(const ReorientJob *job, const int *boxMin,
+  const int *boxMax)
+{
+  const int sizeX = boxMax[0] - boxMin[0];
+  const int sizeY = boxMax[1] - boxMin[1];
+  const int sizeZ = boxMax[2] - boxMin[2];
+  if ((size_t)sizeX * sizeY * sizeZ > KTX_REORIENT_LEAF_VOXELS)
   {
-    const int zSrc = zDim * zDst / zNew;
-    for (yDst = 0; yDst < yNew; yDst++)
+    // split largest side
+    int axis = (sizeX >= sizeY) ? 0 : 1;
+    axis = (sizeZ > ((axis == 0) ? sizeX : sizeY)) ? 2 : axis;
+    const int mid = (boxMin[axis] + boxMax[axis]) / 2;
+    int boxMid[3] = { boxMax[0], boxMax[1], boxMax[2] };
+    boxMid[axis] = mid;
+    _reorientBox(job, boxMin, boxMid);
+    int boxMin2[3] = { boxMin[0], boxMin[1], boxMin[2] };
+    boxMin2[axis] = mid;
+    _reorientBox(job, boxMin2, boxMax);
+    return;
+  }
+
+  const size_t xDimDst = job->m_dims[0];
+  const size_t xyDimDst = xDimDst * job->m_dims[1];
+  const ptrdiff_t stepX = job->m_steps[0];
+  for (int z = boxMin[2]; z < boxMax[2]; z++)
+  {
+    for (int y = boxMin[1]; y < boxMax[1]; y++)
     {
-      const int ySrc = yDim * yDst / yNew;
-      for (xDst = 0; xDst < xNew; xDst++)
+      const MUint8 *src = job->m_pixelsSrc + job->m_offStart +
+        boxMin[0] * stepX + y * job->m_steps[1] + z * job->m_steps[2];
+      MUint8 *dst = job->m_pixelsDst + boxMin[0] + y * xDimDst +
+        z * xyDimDst;
+      for (int x = 0; x < sizeX; x++, src += stepX)
+        dst[x] = *src;
+    }   // for (y)
+  }     // for (z)
+}
+
+static void _reorientCallback(
+                              void       *userData,
+                              const int   zStart,
+                              const int   zEnd
+                            )
+{
+  const ReorientJob *job = (const ReorientJob*)userData;
+  const int boxMin[3] = { 0, 0, zStart };
+  const int boxMax[3] = { job->m_dims[0], job->m_dims[1], zEnd };
+  _reorientBox(job, boxMin, boxMax);
+}
+
+// In place transposition of square slices by tiles (x, y) <-> (y, x)
+static void _transposeSlicesCallback(
+                                      void       *userData,
+                                      const int   zStart,
+                                      const int   zEnd
+                                    )
+{
+  const ReorientJob *job = (const ReorientJob*)userData;
+  const int     dim = job->m_dims[0];
+  const size_t  xyDim = (size_t)dim * dim;
+  for (int z = zStart; z < zEnd; z++)
+  {
+    MUint8 *slice = job->m_pixelsDst + z * xyDim;
+    for (int yTile = 0; yTile < dim; yTile += KTX_SLICE_TILE)
+    {
+      const int yEnd = (yTile + KTX_SLICE_TILE < dim) ?
+        (yTile + KTX_SLICE_TILE) : dim;
+      for (int xTile = yTile; xTile < dim; xTile += KTX_SLICE_TILE)
       {
-        const int xSrc = xDim * xDst / xNew;
-        const int offSrc = xSrc + ySrc * xDim + zSrc * xyDim;
-        const MUint8 val = m_data[offSrc];
-        pixelsNew[offDst++] = val;
+        const int xEnd = (xTile + KTX_SLICE_TILE < dim) ?
+          (xTile + KTX_SLICE_TILE) : dim;
+        for (int y = yTile; y < yEnd; y++)
+        {
+          // diagonal tile: only upper triangle
+          const int xFirst = (xTile == yTile) ? (y + 1) : xTile;
+          MUint8 *row = slice + (size_t)y * dim;
+          for (int x = xFirst; x < xEnd; x++)
+          {
+            MUint8 *other = slice + (size_t)x * dim + y;
+            const MUint8 val = row[x];
+            row[x] = *other;
+            *other = val;
+          }
+        }   // for (y)
+      }     // for (xTile)
+    }       // for (yTile)
+  }         // for (z)
+}
+
+// In place flips: every voxel is swapped with its mirror once.
+// Called for z in [0, (zDim + 1) / 2) if z is flipped, all slices otherwise
+static void _flipCallback(
+                          void       *userData,
+                          const int   zStart,
+                          const int   zEnd
+                        )
+{
+  const ReorientJob *job = (const ReorientJob*)userData;
+  const int     xDim = job->m_dims[0];
+  const int     yDim = job->m_dims[1];
+  const int     zDim = job->m_dims[2];
+  const size_t  xyDim = (size_t)xDim * yDim;
+  const int     flipX = job->m_flips[0];
+
+  for (int z = zStart; z < zEnd; z++)
+  {
+    const int zMirror = job->m_flips[2] ? (zDim - 1 - z) : z;
+    for (int y = 0; y < yDim; y++)
+    {
+      const int yMirror = job->m_flips[1] ? (yDim - 1 - y) : y;
+      // pair of rows is processed from lower one
+      if ((z == zMirror) && (y > yMirror))
+        continue;
+      MUint8 *rowA = job->m_pixelsDst + z * xyDim + (size_t)y * xDim;
+      MUint8 *rowB = job->m_pixelsDst + zMirror * xyDim +
+        (size_t)yMirror * xDim;
+      if (rowA == rowB)
+      {
+        for (int x = 0; flipX && (x < xDim / 2); x++)
+        {
+          const MUint8 val = rowA[x];
+          rowA[x] = rowA[xDim - 1 - x];
+          rowA[xDim - 1 - x] = val;
+        }
+        continue;
+      }
+      for (int x = 0; x < xDim; x++)
+      {
+        const int xMirror = flipX ? (xDim - 1 - x) : x;
+        const MUint8 val = rowA[x];
+        rowA[x] = rowB[xMirror];
+        rowB[xMirror] = val;
+      }
+    }   // for (y)
+  }     // for (z)
+}
+
+int KtxTexture::reorient(const int *permutation, const int *flips)
+{
+  if (m_header.m_glFormat != KTX_GL_RED)
+    return -1;
+  int usedAxes = 0;
+  for (int k = 0; k < 3; k++)
+  {
+    if ((permutation[k] < 0) || (permutation[k] > 2))
+      return -1;
+    usedAxes |= 1 << permutation[k];
+  }
+  if (usedAxes != 7)
+    return -1;
+
+  const int dimsSrc[3] = { getWidth(), getHeight(), getDepth() };
+  const ptrdiff_t stepsSrc[3] =
+  {
+    1, (ptrdiff_t)dimsSrc[0], (ptrdiff_t)dimsSrc[0] * dimsSrc[1]
+  };
+  ReorientJob job;
+  job.m_pixelsSrc = m_data;
+  job.m_pixelsDst = m_data;
+  job.m_offStart = 0;
+  for (int k = 0; k < 3; k++)
+  {
+    const int axisSrc = permutation[k];
+    job.m_dims[k] = dimsSrc[axisSrc];
+    job.m_flips[k] = flips[k] ? 1 : 0;
+    job.m_steps[k] = flips[k] ? -stepsSrc[axisSrc] : stepsSrc[axisSrc];
+    if (flips[k])
+      job.m_offStart += (ptrdiff_t)(dimsSrc[axisSrc] - 1) * stepsSrc[axisSrc];
+  }
+  const int isIdentity = (permutation[0] == 0) && (permutation[1] == 1);
+  const int isTransposeXy = (permutation[0] == 1) && (permutation[1] == 0) &&
+    (dimsSrc[0] == dimsSrc[1]);
+
+  if ((permutation[2] == 2) && (isIdentity || isTransposeXy))
+  {
+    // z stays z and slices keep their size: no new volume is needed
+    if (isTransposeXy)
+      Parallel::forRange(job.m_dims[2], _transposeSlicesCallback, &job);
+    const int numSlicesFlip = job.m_flips[2] ?
+      ((job.m_dims[2] + 1) / 2) : job.m_dims[2];
+    if (job.m_flips[0] || job.m_flips[1] || job.m_flips[2])
+      Parallel::forRange(numSlicesFlip, _flipCallback, &job);
+  }
+  else
+  {
+    MUint8 *pixelsNew = M_NEW(MUint8[m_dataSize]);
+    if (pixelsNew == NULL)
+      return -1;
+    job.m_pixelsDst = pixelsNew;
+    Parallel::forRange(job.m_dims[2], _reorientCallback, &job);
+    delete [] m_data;
+    m_data = pixelsNew;
+  }
+
+  m_header.m_pixelWidth   = job.m_dims[0];
+  m_header.m_pixelHeight  = job.m_dims[1];
+  m_header.m_pixelDepth   = job.m_dims[2];
+  const float boxSize[3] = { m_boxSize.x, m_boxSize.y, m_boxSize.z };
+  m_boxSize.x = boxSize[permutation[0]];
+  m_boxSize.y = boxSize[permutation[1]];
+  m_boxSize.z = boxSize[permutation[2]];
+
+  // key data box follows axes, flipped axis mirrors box around 0
+  if (m_keyData.m_dataType == KTX_KEY_DATA_BBOX)
+  {
+    V3f *box = reinterpret_cast<V3f*>(m_keyData.m_buffer);
+    const float boxMin[3] = { box[0].x, box[0].y, box[0].z };
+    const float boxMax[3] = { box[1].x, box[1].y, box[1].z };
+    float dstMin[3], dstMax[3];
+    for (int k = 0; k < 3; k++)
+    {
+      const int a = permutation[k];
+      dstMin[k] = flips[k] ? -boxMax[a] : boxMin[a];
+      dstMax[k] = flips[k] ? -boxMin[a] : boxMax[a];
+    }
+    setKeyDataBbox(V3f(dstMin[0], dstMin[1], dstMin[2]),
+      V3f(dstMax[0], dstMax[1], dstMax[2]));
+  }
+  if (m_keyData.m_dataType == KTX_KEY_DATA_MIN_SIZE)
+  {
+    V3d *box = reinterpret_cast<V3d*>(m_keyData.m_buffer);
+    const int boxMin[3] = { box[0].x, box[0].y, box[0].z };
+    const int boxSize[3] = { box[1].x, box[1].y, box[1].z };
+    int dstMin[3], dstSize[3];
+    for (int k = 0; k < 3; k++)
+    {
+      const int a = permutation[k];
+      dstMin[k] = flips[k] ? -(boxMin[a] + boxSize[a]) : boxMin[a];
+      dstSize[k] = boxSize[a];
+    }
+    V3d vMin = { dstMin[0], dstMin[1], dstMin[2] };
+    V3d vSize = { dstSize[0], dstSize[1], dstSize[2] };
+    setKeyDataMinSize(vMin, vSize);
+  }
+  return 1;
+}
+
+// ****************************************************************************
+// Label (segmentation) volumes downsampling
+// ****************************************************************************
+
+// fixed point position of source block borders, as in _scaleTextureDown
+#define KTX_LABEL_ACC_BITS      10
+// blocks up to this size (8 bytes of MUint64) find mode by comparing bytes
+#define KTX_LABEL_SMALL_BLOCK   8
+
+struct LabelJob
+{
+  const MUint8 *m_pixelsSrc;
+  MUint8       *m_pixelsDst;
+  int           m_dimsSrc[3];
+  int           m_dimsDst[3];
+};
+
+// Source block [L, H) of destination index, the same as _scaleTextureDown
+static inline void _getLabelBlock(const int dimSrc, const int dimDst,
+  const int indDst, int &srcL, int &srcH)
+{
+  const int step = (dimSrc << KTX_LABEL_ACC_BITS) / dimDst;
+  const int accL = (1 << (KTX_LABEL_ACC_BITS - 1)) + indDst * step;
+  srcL = accL >> KTX_LABEL_ACC_BITS;
+  srcH = (accL + step) >> KTX_LABEL_ACC_BITS;
+  srcH = (srcH <= dimSrc) ? srcH : dimSrc;
+}
+
+// Most frequent value, smallest one of equally frequent values.
+// Block values are packed into 64 bit word and every value counts equal
+// bytes of word at once (SIMD within register), without branches.
+static inline MUint8 _getModeSmall(const MUint8 *vals, const int num)
+{
+  const MUint64 BYTES_ONE   = 0x0101010101010101ULL;
+  const MUint64 BYTES_LOW7  = 0x7f7f7f7f7f7f7f7fULL;
+  const MUint64 BYTES_HIGH  = 0x8080808080808080ULL;
+  assert(num <= KTX_LABEL_SMALL_BLOCK);
+  MUint64 packed;
+  memcpy(&packed, vals, sizeof(packed));
+  const MUint64 maskUsed = (num == 8) ? BYTES_HIGH :
+    (BYTES_HIGH & ((1ULL << (8 * num)) - 1));
+  int countBest = 0;
+  int valBest = 0;
+  for (int i = 0; i < num; i++)
+  {
+    // high bit is set in bytes equal to vals[i]
+    const MUint64 dif = packed ^ (vals[i] * BYTES_ONE);
+    MUint64 isZero = (dif & BYTES_LOW7) + BYTES_LOW7;
+    isZero = ~(isZero | dif | BYTES_LOW7) & maskUsed;
+    const int count = (int)(((isZero >> 7) * BYTES_ONE) >> 56);
+    const int isBetter = (count > countBest) ||
+      ((count == countBest) && (vals[i] < valBest));
+    countBest = isBetter ? count : countBest;
+    valBest = isBetter ? vals[i] : valBest;
+  }
+  return (MUint8)valBest;
+}
+
+static void _scaleLabelsCallback(
+                                  void       *userData,
+                                  const int   zStart,
+                                  const int   zEnd
+                                )
+{
+  const LabelJob *job = (const LabelJob*)userData;
+  const int     xDimSrc = job->m_dimsSrc[0];
+  const size_t  xyDimSrc = (size_t)xDimSrc * job->m_dimsSrc[1];
+  // histogram of large blocks: only used bins are cleared after block
+  MUint32 counts[256];
+  memset(counts, 0, sizeof(counts));
+  MUint8 vals[KTX_LABEL_SMALL_BLOCK];
+  memset(vals, 0, sizeof(vals));
+
+  MUint8 *dst = job->m_pixelsDst +
+    (size_t)zStart * job->m_dimsDst[0] * job->m_dimsDst[1];
+  for (int zDst = zStart; zDst < zEnd; zDst++)
+  {
+    int zL, zH;
+    _getLabelBlock(job->m_dimsSrc[2], job->m_dimsDst[2], zDst, zL, zH);
+    for (int yDst = 0; yDst < job->m_dimsDst[1]; yDst++)
+    {
+      int yL, yH;
+      _getLabelBlock(job->m_dimsSrc[1], job->m_dimsDst[1], yDst, yL, yH);
+      for (int xDst = 0; xDst < job->m_dimsDst[0]; xDst++)
+      {
+        int xL, xH;
+        _getLabelBlock(xDimSrc, job->m_dimsDst[0], xDst, xL, xH);
+        const int numVoxels = (xH - xL) * (yH - yL) * (zH - zL);
+        int x, y, z;
+        if (numVoxels <= KTX_LABEL_SMALL_BLOCK)
+        {
+          int n = 0;
+          for (z = zL; z < zH; z++)
+            for (y = yL; y < yH; y++)
+            {
+              const MUint8 *row = job->m_pixelsSrc + z * xyDimSrc +
+                (size_t)y * xDimSrc;
+              for (x = xL; x < xH; x++)
+                vals[n++] = row[x];
+            }
+          *dst++ = _getModeSmall(vals, n);
+          continue;
+        }
+        MUint32 countBest = 0;
+        int valBest = 0;
+        for (z = zL; z < zH; z++)
+          for (y = yL; y < yH; y++)
+          {
+            const MUint8 *row = job->m_pixelsSrc + z * xyDimSrc +
+              (size_t)y * xDimSrc;
+            for (x = xL; x < xH; x++)
+            {
+              const MUint8 val = row[x];
+              const MUint32 count = ++counts[val];
+              if ((count > countBest) ||
+                  ((count == countBest) && (val < valBest)))
+              {
+                countBest = count;
+                valBest = val;
+              }
+            }   // for (x)
+          }
+        *dst++ = (MUint8)valBest;
+        for (z = zL; z < zH; z++)
+          for (y = yL; y < yH; y++)
+          {
+            const MUint8 *row = job->m_pixelsSrc + z * xyDimSrc +
+              (size_t)y * xDimSrc;
+            for (x = xL; x < xH; x++)
+              counts[row[x]] = 0;
+          }
       }   // for (xDst)
     }     // for (yDst)
   }       // for (zDst)
-  delete [] m_data;
-  m_data = pixelsNew;
-  setWidth(xNew);
-  setHeight(yNew);
-  setDepth(zNew);
+}
+
+static void _scaleLabelsDown(
+                              const MUint8 *pixelsSrc,
+                              const int    *dimsSrc,
+                              MUint8       *pixelsDst,
+                              const int    *dimsDst
+                            )
+{
+  LabelJob job;
+  job.m_pixelsSrc = pixelsSrc;
+  job.m_pixelsDst = pixelsDst;
+  for (int k = 0; k < 3; k++)
+  {
+    assert(dimsDst[k] <= dimsSrc[k]);
+    job.m_dimsSrc[k] = dimsSrc[k];
+    job.m_dimsDst[k] = dimsDst[k];
+  }
+  Parallel::forRange(dimsDst[2], _scaleLabelsCallback, &job);
+}
+
+int KtxTexture::scaleDownLabels(
+                                const int xDimDst,
+                                const int yDimDst,
+                                const int zDimDst
+                               )
+{
+  if (m_header.m_glFormat != KTX_GL_RED)
+    return -1;
+  const int dimsSrc[3] = { getWidth(), getHeight(), getDepth() };
+  const int dimsDst[3] = { xDimDst, yDimDst, zDimDst };
+  for (int k = 0; k < 3; k++)
+  {
+    if ((dimsDst[k] <= 0) || (dimsDst[k] > dimsSrc[k]))
+      return -1;
+  }
+  size_t numPixelsDst = (size_t)xDimDst * yDimDst * zDimDst;
+  MUint8 *dataNew = M_NEW(MUint8[numPixelsDst]);
+  if (!dataNew)
+    return -1;
+  _scaleLabelsDown(m_data, dimsSrc, dataNew, dimsDst);
+  replaceData(dataNew, xDimDst, yDimDst, zDimDst);
+  return 1;
+}
+
+static void _getMipDims(const int *dims, const int level, int *dimsMip)
+{
+  for (int k = 0; k < 3; k++)
+  {
+    dimsMip[k] = dims[k] >> level;
+    dimsMip[k] = (dimsMip[k] >= 1) ? dimsMip[k] : 1;
+  }
+}
+
+int KtxTexture::getNumMipLevelsMax() const
+{
+  int dimMax = getWidth();
+  dimMax = (getHeight() > dimMax) ? getHeight() : dimMax;
+  dimMax = (getDepth() > dimMax) ? getDepth() : dimMax;
+  int numLevels = 1;
+  while ((dimMax >> numLevels) > 0)
+    numLevels++;
+  return numLevels;
+}
+
+size_t KtxTexture::getMipChainSize(const int numLevels) const
+{
+  const int dims[3] = { getWidth(), getHeight(), getDepth() };
+  size_t numBytes = 0;
+  for (int level = 0; level < numLevels; level++)
+  {
+    int dimsMip[3];
+    _getMipDims(dims, level, dimsMip);
+    numBytes += (size_t)dimsMip[0] * dimsMip[1] * dimsMip[2];
+  }
+  return numBytes;
+}
+
+int KtxTexture::createLabelMipChain(
+                                    const int  numLevels,
+                                    MUint8    *pixelsDst
+                                   ) const
+{
+  if (m_header.m_glFormat != KTX_GL_RED)
+    return -1;
+  if ((numLevels < 1) || (numLevels > getNumMipLevelsMax()))
+    return -1;
+  const int dims[3] = { getWidth(), getHeight(), getDepth() };
+  memcpy(pixelsDst, m_data, (size_t)dims[0] * dims[1] * dims[2]);
+  // every level is mode of previous one, read from chain itself
+  const MUint8 *pixelsPrev = pixelsDst;
+  int dimsPrev[3] = { dims[0], dims[1], dims[2] };
+  for (int level = 1; level < numLevels; level++)
+  {
+    MUint8 *pixelsLevel = pixelsDst + getMipChainSize(level);
+    int dimsMip[3];
+    _getMipDims(dims, level, dimsMip);
+    _scaleLabelsDown(pixelsPrev, dimsPrev, pixelsLevel, dimsMip);
+    pixelsPrev = pixelsLevel;
+    dimsPrev[0] = dimsMip[0];
+    dimsPrev[1] = dimsMip[1];
+    dimsPrev[2] = dimsMip[2];
+  }   // for (level)
   return 1;
 }
 
@@ -14,6 +14,8 @@
 #include <stdio.h>
 
 #include "mtypes.h"
+#include "guided.h"
+#include "resample.h"
 
 // ****************************************************************************
 // Defines
@@ -34,6 +36,20 @@
 #define   KTX_GL_COMPRESSED_RGB_S3TC_DXT1_EXT   0x83F0
 #define   KTX_GL_COMPRESSED_RGBA_S3TC_DXT5_EXT  0x83F3
 
+//! imageSize field value, which means "64 bit size follows".
+// Standard KTX image size is 32 bit, volumes of 4 GB and more are written
+// with this marker and MUint64 size after it.
+#define   KTX_IMAGE_SIZE_64     0xffffffff
+
+//! Volumes are read / written by parts of this size, not by single call
+#define   KTX_IO_SLAB_BYTES     (64 * 1024 * 1024)
+
+//! Tile side of blocked transposition, used for strided (sagittal) slices
+#define   KTX_SLICE_TILE        64
+
+//! Max neighbourhood radius of direct gaussSmooth
+#define   KTX_GAUSS_MAX_NEIGH   6
+
 // ****************************************************************************
 // Class
 // ****************************************************************************
@@ -110,6 +126,19 @@ enum KtxKeyDataType
   KTX_KEY_DATA_MIN_SIZE   = 2,
 };
 
+//! Axis orthogonal to extracted slice
+enum KtxSliceAxis
+{
+  //! sagittal: x = const, slice is yDim * zDim
+  KTX_SLICE_AXIS_X        = 0,
+  //! coronal: y = const, slice is xDim * zDim
+  KTX_SLICE_AXIS_Y        = 1,
+  //! axial: z = const, slice is xDim * yDim
+  KTX_SLICE_AXIS_Z        = 2,
+
+  KTX_SLICE_AXIS_COUNT
+};
+
 #define KEY_DATA_BUFFER_SIZE    ((4 * 3) * 8)
 
 /** \class KtxKeyData
@@ -146,6 +175,8 @@ public:
    * \brief Save volumetric texture to KTX file.
    *   More details about KTX format can be found here:
    *   https://www.khronos.org/opengles/sdk/tools/KTX/file_format_spec/
+   *   Image size of 4 GB and more is written as KTX_IMAGE_SIZE_64 and
+   *   64 bit size.
    * \param file Opened file to write texture content
    * \return OK if everythiong fine, or error code, please, see KtxError
    */
@@ -209,8 +240,26 @@ public:
 
   void            clearBorder();
 
-  int             scaleUpZ(const int zNew);
-  int             rescale(const int xNew, const int yNew, const int zNew);
+  //! resample z to any greater size (not only integer multiples)
+  int             scaleUpZ(
+                            const int zNew,
+                            const ResampleFilter filter = RESAMPLE_FILTER_LINEAR
+                          );
+  //! resample all axes with any (non integer) ratios
+  int             rescale(
+                          const int xNew,
+                          const int yNew,
+                          const int zNew,
+                          const ResampleFilter filter = RESAMPLE_FILTER_NEAREST
+                         );
+  //! out of place version of rescale (1 byte per voxel only)
+  KtxError        createAsResampled(
+                                    const KtxTexture     *tex,
+                                    const int             xDimDst,
+                                    const int             yDimDst,
+                                    const int             zDimDst,
+                                    const ResampleFilter  filter
+                                   );
 
   KtxError        createAsCopy(const KtxTexture *tex);
   KtxError        createAsSingleSphere(const int dim);
@@ -219,12 +268,61 @@ public:
   int             getBoundingBox(V3d &vMin, V3d &vMax) const;
   int             getHorSliceSymmetry(const int z, float &xSym, float &ySym);
 
+  //! orthogonal slice width and height (1 byte per voxel textures)
+  void            getSliceSize(
+                                const KtxSliceAxis axis,
+                                int &w,
+                                int &h
+                              ) const;
+  /*!
+   * \brief Copy orthogonal slice
+   * \param axis Axis orthogonal to slice
+   * \param index Slice position along axis
+   * \param pixelsDst Destination of w * h pixels, see getSliceSize
+   * \return 1 if ok, -1 if index is outside or format is not 1 bpp
+   */
+  int             getSlice(
+                            const KtxSliceAxis axis,
+                            const int index,
+                            MUint8 *pixelsDst
+                          ) const;
+  //! slab of numSlices consecutive slices from indexStart, slice after slice
+  int             getSlab(
+                          const KtxSliceAxis axis,
+                          const int indexStart,
+                          const int numSlices,
+                          MUint8 *pixelsDst
+                         ) const;
+  //! any set of slices by single pass over volume.
+  //! Slice k is written to pixelsDst + k * w * h
+  int             getSlices(
+                            const KtxSliceAxis axis,
+                            const int *indices,
+                            const int numSlices,
+                            MUint8 *pixelsDst
+                           ) const;
+
   //! fill with zeros
   void            fillZeroYGreater(const int yClipMax);
   void            fillValZGreater(const int z, const MUint8 valToFill);
 
-  //! gauss smooth
-  void            gaussSmooth(const int gaussNeigh, const float gaussSigma);
+  /*!
+   * \brief Direct gauss smooth, cost is (2 * gaussNeigh + 1) ^ 3 per voxel.
+   *   gaussSigma is relative to gaussNeigh. Radius above
+   *   KTX_GAUSS_MAX_NEIGH is done by gaussSmoothRecursive with the same
+   *   sigma in voxels.
+   * \return 1 if ok, -1 if no memory or recursive filter fails
+   */
+  int             gaussSmooth(const int gaussNeigh, const float gaussSigma);
+  /*!
+   * \brief Recursive (IIR) gauss smooth, see
+   *   VolumeTools::performGaussRecursive. Cost does not depend on sigma,
+   *   peak temporary memory is twice the texture size.
+   * \param sigma Sigma in voxels, not less than VOL_IIR_SIGMA_MIN (0.5)
+   * \return 1 if ok, -1 if sigma is too small, format is not 1 bpp or
+   *   no memory
+   */
+  int             gaussSmoothRecursive(const float sigma);
 
   //! scale down to size
   int             scaleDownToSize(
@@ -232,8 +330,77 @@ public:
                                   const int yDimDst,
                                   const int zDimDst
                                  );
+  /*!
+   * \brief Scale down by window percentile (median by default), see
+   *   RankFilter::downsample3d. Source texture should be 1 bpp.
+   * \param radius Window radius, 0 is auto (by size ratio)
+   * \return 1 if ok, -1 if parameters are wrong or no memory
+   */
+  int             scaleDownMedian(
+                                  const int   xDimDst,
+                                  const int   yDimDst,
+                                  const int   zDimDst,
+                                  const int   radius = 0,
+                                  const float percentile = 0.5f
+                                 );
+  /*!
+   * \brief Scale down label (segmentation) volume: destination voxel is
+   *   the most frequent label of its source block (smallest label if
+   *   several are equally frequent), so no new label values appear.
+   *   Blocks are the same as in scaleDownToSize. Slabs of destination
+   *   slices are processed by worker threads.
+   * \return 1 if ok, -1 if format is not 1 bpp, size is wrong or no memory
+   */
+  int             scaleDownLabels(
+                                  const int xDimDst,
+                                  const int yDimDst,
+                                  const int zDimDst
+                                 );
+  //! Number of mip levels down to 1 * 1 * 1
+  int             getNumMipLevelsMax() const;
+  //! Bytes of levels [0, numLevels) of 1 bpp mip chain.
+  //! Level k size is max(1, dim >> k) for every axis.
+  size_t          getMipChainSize(const int numLevels) const;
+  /*!
+   * \brief Write label mip chain: level 0 is this volume, every next level
+   *   is scaleDownLabels of previous one. Levels follow each other
+   *   without gaps, in KTX mip order.
+   * \param pixelsDst getMipChainSize(numLevels) bytes
+   * \return 1 if ok, -1 if format is not 1 bpp or numLevels is wrong
+   */
+  int             createLabelMipChain(
+                                      const int  numLevels,
+                                      MUint8    *pixelsDst
+                                     ) const;
+  /*!
+   * \brief Edge preserving scale down by guided filter, see
+   *   GuidedFilter::downsample3d. Source texture should be 1 bpp.
+   * \param radius Window radius, 0 is auto (by size ratio)
+   * \param eps Regularization for voxel values scaled to [0..1]
+   * \return 1 if ok, -1 if parameters are wrong or no memory
+   */
+  int             scaleDownGuided(
+                                  const int   xDimDst,
+                                  const int   yDimDst,
+                                  const int   zDimDst,
+                                  const int   radius = 0,
+                                  const float eps = GUIDED_EPS_DEFAULT
+                                 );
   //! convert format from 1bpp to 4bpp
   int             convertTo4bpp();
+  /*!
+   * \brief Permute and flip axes (1 byte per voxel textures)
+   *   Destination axis k is source axis permutation[k], reversed if
+   *   flips[k] != 0. For example LPS to RAS is permutation {0, 1, 2}
+   *   with flips {1, 1, 0}.
+   *   Runs in place if z stays z and x, y are not swapped or slices are
+   *   square, otherwise by cache oblivious copy to new volume.
+   *   Box size and key data box are permuted too, box of flipped axis
+   *   is mirrored around 0.
+   * \return 1 if ok, -1 if permutation is wrong, format is not 1 bpp
+   *   or no memory
+   */
+  int             reorient(const int *permutation, const int *flips);
 
   //! get texture width (x size)
   int            getWidth() const    { return m_header.m_pixelWidth;     }
@@ -244,7 +411,7 @@ public:
   //! get texture pixels
   MUint8        *getData() const     { return m_data;                    }
   MUint32        getGlFormat() const { return m_header.m_glFormat;       }
-  int            getDataSize() const { return m_dataSize;                }
+  size_t         getDataSize() const { return m_dataSize;                }
 
   void           setData(MUint8 *dataMemNew) { m_data = dataMemNew; }
 
@@ -281,7 +448,7 @@ public:
   //! pixels data
   MUint8       *m_data;
   //! Size in memory, bytes. Can be != to linear size, for compressed formats.
-  int           m_dataSize;
+  size_t        m_dataSize;
   //! Flag for compressed texture (default is 0)
   int           m_isCompressed;
   //! Optional key data
@@ -292,6 +459,9 @@ public:
 protected:
 private:
   KtxError    enlargeByMinSize();
+  //! Take 1 byte per voxel volume of new size instead of own data
+  void        replaceData(MUint8 *dataNew, const int xDim, const int yDim,
+                          const int zDim);
 };
 
 const char *KtxTextureGetErrorString(const KtxError err);
@@ -17,6 +17,10 @@
 #include <string.h>
 #include <signal.h>
 
+#include <atomic>
+#include <mutex>
+#include <new>
+
 #include "mtypes.h"
 #include "memtrack.h"
 
@@ -27,13 +31,21 @@
 
 #define MEMORY_BLOCK_MAGIC      9999
 
+// block has extended header with ring link and source location
+#define MEMORY_BLOCK_TRACKED    1
+// block size is accounted in totals (allocated while tracker active)
+#define MEMORY_BLOCK_COUNTED    2
+
+#define MEMORY_ALIGN            16
+#define MEMORY_ALIGN_UP(s)      \
+  (((s) + MEMORY_ALIGN - 1) & ~(size_t)(MEMORY_ALIGN - 1))
+
 //#define TRACE_MEM_DEBUG
 
 //  **********************************************************
 //  Types
 //  **********************************************************
 
-#pragma pack(push, 2)
 typedef struct tagMemRingPart
 {
   struct tagMemRingPart *m_next;
@@ -45,43 +57,83 @@ typedef struct tagMemRingLock
   MemRingPart   m_link;
 } MemRingLock;
 
+struct MemShard;
+
+// Placed just before user data of every block
+typedef struct tagMemBlockTag
+{
+  MUint32     m_magic;              // magic number
+  MUint32     m_flags;              // MEMORY_BLOCK_xxx
+  MUint64     m_size;               // user block size
+} MemBlockTag;
+
+// Placed before MemBlockTag only for sampled (tracked) blocks
 typedef struct tagMemBlockHeader
 {
-  int         m_magic;              // magic number
-  int         m_size;               // block size
-  MemRingPart m_part;               // link to next block
+  MemRingPart m_part;               // link to next block in shard ring
+  MemShard   *m_shard;              // shard owning the ring
   char        m_srcFileName[32];
   int         m_srcLine;
 } MemBlockHeader;
 
-typedef struct tagMemBlock
+#define MEMORY_TAG_SIZE         MEMORY_ALIGN_UP(sizeof(MemBlockTag))
+#define MEMORY_HEADER_SIZE      MEMORY_ALIGN_UP(sizeof(MemBlockHeader))
+
+// Per thread statistics and ring of tracked blocks.
+// Blocks can be freed by other thread, so ring is guarded by mutex.
+// Shards are never deleted: blocks may outlive its thread.
+struct MemShard
+{
+  std::mutex                m_lock;
+  MemRingLock               m_ring;
+  std::atomic<long long>    m_numAllocs;
+  std::atomic<long long>    m_numFrees;
+  std::atomic<long long>    m_numBlocksTracked;
+  std::atomic<long long>    m_sizeClassAllocs[MEM_TRACK_NUM_SIZE_CLASSES];
+  MemShard                 *m_nextShard;
+};
+
+// Per thread state
+struct MemThreadState
 {
-  MemBlockHeader    m_header;       // used for free (and total memory size accounting)
-  int               m_data[1];      // some actual data
-} MemBlock;
-#pragma pack(pop)
+  MemShard       *m_shard;
+  unsigned int    m_sampleCounter;
+  unsigned int    m_trashX;
+  unsigned int    m_trashY;
+  unsigned int    m_trashZ;
+};
 
 //  **********************************************************
 //  Vars
 //  **********************************************************
-static int              s_memorySizeTotal = 0;
-static int              s_memorySizePeak = 0;
-static MemRingLock      s_memRingLock;
-static int              s_memRingLockInit = 0;
-static int              s_flagMemTrackActive = 0;
 
-static unsigned int     s_trashX = 0x6537495;
-static unsigned int     s_trashY = 0xa56e78d6;
-static unsigned int     s_trashZ = 0x645d4e2;
+static std::atomic<long long>   s_memorySizeTotal(0);
+static std::atomic<long long>   s_memorySizePeak(0);
+static std::atomic<int>         s_flagMemTrackActive(0);
+static std::atomic<long long>   s_arenaBytesReserved(0);
+static std::atomic<long long>   s_arenaBytesHighWater(0);
+#if defined(_DEEP_DEBUG)
+static std::atomic<int>         s_sampleRate(1);
+static std::atomic<int>         s_fillTrash(1);
+#else
+static std::atomic<int>         s_sampleRate(0);
+static std::atomic<int>         s_fillTrash(0);
+#endif
+
+static std::mutex               s_shardsLock;
+static MemShard                *s_shardsFirst = NULL;
+
+static thread_local MemThreadState  s_threadState =
+{
+  NULL, 0, 0x6537495, 0xa56e78d6, 0x645d4e2
+};
 
 //  **********************************************************
 //  Func
 //  **********************************************************
 
-
-#if defined(_DEEP_DEBUG)
-
-void * operator new(size_t nSize, char *fileName, int lineNumber)   throw()
+void * operator new(size_t nSize, const char *fileName, int lineNumber)
+  throw()
 {
   void    *pMem;
 
@@ -89,7 +141,8 @@ void * operator new(size_t nSize, char *fileName, int lineNumber)   throw()
   return pMem;
 }
 
-void * operator new[](size_t nSize, char *fileName, int lineNumber) throw()
+void * operator new[](size_t nSize, const char *fileName, int lineNumber)
+  throw()
 {
   void    *pMem;
 
@@ -98,18 +151,23 @@ void * operator new[](size_t nSize, char *fileName, int lineNumber) throw()
 }
 
 
-void * operator new(size_t nSize)   throw()
+// usual new throws, only M_NEW form returns NULL
+void * operator new(size_t nSize)
 {
   void    *pMem;
 
   pMem = M_MALLOC(nSize);
+  if (pMem == NULL)
+    throw std::bad_alloc();
   return pMem;
 }
-void * operator new[](size_t nSize) throw()
+void * operator new[](size_t nSize)
 {
   void    *pMem;
 
   pMem = M_MALLOC(nSize);
+  if (pMem == NULL)
+    throw std::bad_alloc();
   return pMem;
 }
 
@@ -122,22 +180,16 @@ void operator delete[](void * pMem) throw()
   M_FREE(pMem);
 }
 
-void operator delete(void * pMem, char * sFileName, int nStr)     throw()
+void operator delete(void * pMem, const char *, int)     throw()
 {
-  USE_PARAM(sFileName);
-  USE_PARAM(nStr);
   M_FREE(pMem);
 }
 
-void operator delete[](void * pMem, char * sFileName, int nStr)   throw()
+void operator delete[](void * pMem, const char *, int)   throw()
 {
-  USE_PARAM(sFileName);
-  USE_PARAM(nStr);
   M_FREE(pMem);
 }
 
-#endif
-
 
 __inline static void _memRingLockInitizlize(MemRingLock *lock)
 {
@@ -201,28 +253,82 @@ __inline static int _memRingPartIsInRing(const MemRingPart *part)
   return (part->m_next != NULL) && (part->m_prev != NULL);
 }
 
-static void _memoryFillTrash(int *pMemory, const int memSizeBytes)
+static void _memoryFillTrash(int *pMemory, const MUint64 memSizeBytes)
 {
-  int           seed, memSizeInts, i;
-  time_t        timer;
+  MemThreadState *state = &s_threadState;
+  int             seed;
+  MUint64         memSizeInts, i;
+  time_t          timer;
 
   // init trash keys
   time(&timer);
   seed = (int)timer & 0xffff;
 
   memSizeInts = memSizeBytes >> 2;
-  memSizeInts--;
-  if (memSizeInts <= 0)
+  if (memSizeInts <= 1)
     return;
+  memSizeInts--;
   for (i = 0; i < memSizeInts; i++)
   {
-    pMemory[i] = (s_trashX << 8) ^ seed;
-    s_trashX ^= s_trashX << 16;
-    s_trashX ^= s_trashX >> 5;
-    s_trashX ^= s_trashX << 1;
-    unsigned int t = s_trashX; s_trashX = s_trashY;
-    s_trashY = s_trashZ;
-    s_trashZ = t ^ s_trashX ^ s_trashY;
+    pMemory[i] = (state->m_trashX << 8) ^ seed;
+    state->m_trashX ^= state->m_trashX << 16;
+    state->m_trashX ^= state->m_trashX >> 5;
+    state->m_trashX ^= state->m_trashX << 1;
+    unsigned int t = state->m_trashX;
+    state->m_trashX = state->m_trashY;
+    state->m_trashY = state->m_trashZ;
+    state->m_trashZ = t ^ state->m_trashX ^ state->m_trashY;
+  }
+}
+
+static int _memSizeClass(const MUint64 memSize)
+{
+  int k = 0;
+  MUint64 s = memSize >> 1;
+  while (s && (k < MEM_TRACK_NUM_SIZE_CLASSES - 1))
+  {
+    s >>= 1;
+    k++;
+  }
+  return k;
+}
+
+static MemShard *_memGetShard()
+{
+  MemThreadState *state = &s_threadState;
+  if (state->m_shard != NULL)
+    return state->m_shard;
+
+  // not via operator new: it is routed back to this module
+  void *mem = malloc(sizeof(MemShard));
+  if (mem == NULL)
+    return NULL;
+  MemShard *shard = new(mem) MemShard;
+  _memRingLockInitizlize(&shard->m_ring);
+  shard->m_numAllocs = 0;
+  shard->m_numFrees = 0;
+  shard->m_numBlocksTracked = 0;
+  for (int k = 0; k < MEM_TRACK_NUM_SIZE_CLASSES; k++)
+    shard->m_sizeClassAllocs[k] = 0;
+  {
+    std::lock_guard<std::mutex> guard(s_shardsLock);
+    shard->m_nextShard = s_shardsFirst;
+    s_shardsFirst = shard;
+  }
+  state->m_shard = shard;
+  return shard;
+}
+
+static void _memAddTotal(const long long memSize)
+{
+  const long long total = s_memorySizeTotal.fetch_add(memSize,
+    std::memory_order_relaxed) + memSize;
+  long long peak = s_memorySizePeak.load(std::memory_order_relaxed);
+  while (total > peak)
+  {
+    if (s_memorySizePeak.compare_exchange_weak(peak, total,
+      std::memory_order_relaxed))
+      break;
   }
 }
 
@@ -232,24 +338,33 @@ void  *MemTrackAllocate(
                           const int srcFileLine
                        )
 {
-  void        *p;
-  MemBlock    *block;
-  size_t      sizeAlloc;
+  char        *block;
+  MemBlockTag *tag;
+  MemShard    *shard;
+  size_t      sizeAlloc, sizeHeader;
+  int         isTracked;
   const char  *src, *srcEnd;
   char        *dst;
 
-  if (!s_flagMemTrackActive)
+  // Every block gets small tag, so it can be released correctly
+  // even if tracker state changed between allocate and free
+  shard = NULL;
+  isTracked = 0;
+  if (s_flagMemTrackActive.load(std::memory_order_relaxed))
   {
-    return malloc(memSize);
-  }
-  if (!s_memRingLockInit)
-  {
-    s_memRingLockInit = 1;
-    _memRingLockInitizlize(&s_memRingLock);
+    shard = _memGetShard();
+    const unsigned int rate = s_sampleRate.load(std::memory_order_relaxed);
+    isTracked = (shard != NULL) && (rate > 0) &&
+      (++s_threadState.m_sampleCounter >= rate);
+    if (isTracked)
+      s_threadState.m_sampleCounter = 0;
   }
 
-  sizeAlloc = memSize + sizeof(MemBlockHeader) + sizeof(int);
-  block = (MemBlock*)malloc(sizeAlloc);
+  sizeHeader = (isTracked) ? MEMORY_HEADER_SIZE : 0;
+  sizeAlloc = sizeHeader + MEMORY_TAG_SIZE + memSize;
+  if (isTracked)
+    sizeAlloc += sizeof(int);
+  block = (char*)malloc(sizeAlloc);
   if (block == NULL)
     return NULL;
 
@@ -258,13 +373,26 @@ void  *MemTrackAllocate(
     src = NULL;
 #endif
 
-  s_memorySizeTotal += (int)memSize;
-  if (s_memorySizeTotal > s_memorySizePeak)
-    s_memorySizePeak = s_memorySizeTotal;
-
-  block->m_header.m_magic = MEMORY_BLOCK_MAGIC;
-  block->m_header.m_size  = (int)memSize;
-  _memRingLockAddPart(&s_memRingLock, &block->m_header.m_part);
+  tag = (MemBlockTag*)
+    (block + sizeHeader + MEMORY_TAG_SIZE - sizeof(MemBlockTag));
+  tag->m_magic  = MEMORY_BLOCK_MAGIC;
+  tag->m_flags  = 0;
+  tag->m_size   = (MUint64)memSize;
+  void *p = block + sizeHeader + MEMORY_TAG_SIZE;
+  if (shard == NULL)
+    return p;
+
+  tag->m_flags |= MEMORY_BLOCK_COUNTED;
+  _memAddTotal((long long)memSize);
+  shard->m_numAllocs.fetch_add(1, std::memory_order_relaxed);
+  shard->m_sizeClassAllocs[_memSizeClass(memSize)].fetch_add(1,
+    std::memory_order_relaxed);
+  if (!isTracked)
+    return p;
+
+  tag->m_flags |= MEMORY_BLOCK_TRACKED;
+  MemBlockHeader *header = (MemBlockHeader*)block;
+  header->m_shard = shard;
 
   // copy src file name: find end
   for (src = srcFileName; src[0] != 0; src++)
@@ -272,21 +400,21 @@ void  *MemTrackAllocate(
   }
   srcEnd = src;
   src--;
-  while ( (src[-1] != '\\') && (src[-1] != '/') && (srcEnd - src < 32) )
+  while ( (src > srcFileName) && (src[-1] != '\\') && (src[-1] != '/') &&
+    (srcEnd - src < 31) )
     src--;
-  for (dst = block->m_header.m_srcFileName; src[0] != 0; src++, dst++)
+  for (dst = header->m_srcFileName; src[0] != 0; src++, dst++)
   {
     *dst = *src;
   }
   *dst = 0;
-  assert(dst - block->m_header.m_srcFileName < 32);
-
+  assert(dst - header->m_srcFileName < 32);
 
   // copy src file line
-  block->m_header.m_srcLine = srcFileLine;
+  header->m_srcLine = srcFileLine;
 
-  p = &block->m_data[0];
-  _memoryFillTrash((int*)p, (int)memSize);
+  if (s_fillTrash)
+    _memoryFillTrash((int*)p, memSize);
 
   // mark end of block
   {
@@ -294,12 +422,18 @@ void  *MemTrackAllocate(
     *pEnd = MEMORY_BLOCK_MAGIC;
   }
 
+  {
+    std::lock_guard<std::mutex> guard(shard->m_lock);
+    _memRingLockAddPart(&shard->m_ring, &header->m_part);
+  }
+  shard->m_numBlocksTracked.fetch_add(1, std::memory_order_relaxed);
+
   return p;
 }
 
 
 #ifdef TRACE_MEM_DEBUG
-static int s_sumLarge = 0;
+static long long s_sumLarge = 0;
 static int _detectLargeMemoryBlocksCallback(const void *memPtr,
                                             const int memSize,
                                             const char *fileNameSrc,
@@ -319,13 +453,7 @@ static int _detectLargeMemoryBlocksCallback(const void *memPtr,
 
 void  MemTrackFree(void *pMemory)
 {
-  MemBlock    *block;
-
-  if (!s_flagMemTrackActive)
-  {
-    free(pMemory);
-    return;
-  }
+  MemBlockTag *tag;
 
 #ifdef TRACE_MEM_DEBUG
   int deepDebugKey = 0;
@@ -333,46 +461,106 @@ void  MemTrackFree(void *pMemory)
     MemTrackForAll( _detectLargeMemoryBlocksCallback );
 #endif
   if (pMemory == NULL)
-  {
-    assert(pMemory != NULL);
     return;
-  }
 
+  // all blocks come from MemTrackAllocate, block without tag is
+  // foreign pointer or overwritten memory
+  tag = (MemBlockTag*)((char*)pMemory - sizeof(MemBlockTag));
+  assert(tag->m_magic == MEMORY_BLOCK_MAGIC);
+  if (tag->m_magic != MEMORY_BLOCK_MAGIC)
+    abort();
 
-  block = (MemBlock*)((char*)pMemory - sizeof(MemBlockHeader));
-  if (block->m_header.m_magic == MEMORY_BLOCK_MAGIC)
+  char *block = (char*)pMemory - MEMORY_TAG_SIZE;
+  if (tag->m_flags & MEMORY_BLOCK_TRACKED)
   {
-    char *p = (char*)&block->m_data[0];
-    int   *pEnd = (int*)( (char*)p + block->m_header.m_size );
+    block -= MEMORY_HEADER_SIZE;
+    MemBlockHeader *header = (MemBlockHeader*)block;
+    int *pEnd = (int*)( (char*)pMemory + tag->m_size );
     assert(pEnd[0] == MEMORY_BLOCK_MAGIC);
     if (pEnd[0] != MEMORY_BLOCK_MAGIC)
     {
       // simulate exceptions
-      *((int*)0) = 0xDEAD;
+      *((volatile int*)0) = 0xDEAD;
       raise(SIGSEGV);
       abort();
     }
 
-    //if (block->m_header.m_size > 6 * 1024 * 1024)
-    //  p = NULL;
-
-
-    _memRingPartRemove(&block->m_header.m_part);
-    _memoryFillTrash((int*)pMemory, block->m_header.m_size);
-    s_memorySizeTotal -= block->m_header.m_size;
-    free(block);
+    MemShard *shard = header->m_shard;
+    {
+      std::lock_guard<std::mutex> guard(shard->m_lock);
+      _memRingPartRemove(&header->m_part);
+    }
+    shard->m_numBlocksTracked.fetch_sub(1, std::memory_order_relaxed);
+    if (s_fillTrash)
+      _memoryFillTrash((int*)pMemory, tag->m_size);
   }
-  else
+  if (tag->m_flags & MEMORY_BLOCK_COUNTED)
   {
-    free(pMemory);
+    s_memorySizeTotal.fetch_sub((long long)tag->m_size,
+      std::memory_order_relaxed);
+    MemShard *shardFree = _memGetShard();
+    if (shardFree != NULL)
+      shardFree->m_numFrees.fetch_add(1, std::memory_order_relaxed);
   }
+  tag->m_magic = 0;
+  free(block);
 }
 
 int       MemTrackGetSize(int *memSizeAllocatedPeak)
 {
   if (memSizeAllocatedPeak != NULL)
-    *memSizeAllocatedPeak = s_memorySizePeak;
-  return s_memorySizeTotal;
+    *memSizeAllocatedPeak = (int)s_memorySizePeak.load();
+  return (int)s_memorySizeTotal.load();
+}
+
+void      MemTrackGetStats(MemTrackStats *stats)
+{
+  memset(stats, 0, sizeof(MemTrackStats));
+  stats->m_bytesCurrent = s_memorySizeTotal.load();
+  stats->m_bytesPeak    = s_memorySizePeak.load();
+  stats->m_arenaBytesReserved   = s_arenaBytesReserved.load();
+  stats->m_arenaBytesHighWater  = s_arenaBytesHighWater.load();
+
+  std::lock_guard<std::mutex> guard(s_shardsLock);
+  for (MemShard *shard = s_shardsFirst; shard; shard = shard->m_nextShard)
+  {
+    stats->m_numAllocs        += shard->m_numAllocs.load();
+    stats->m_numFrees         += shard->m_numFrees.load();
+    stats->m_numBlocksTracked += shard->m_numBlocksTracked.load();
+    for (int k = 0; k < MEM_TRACK_NUM_SIZE_CLASSES; k++)
+      stats->m_sizeClassAllocs[k] += shard->m_sizeClassAllocs[k].load();
+  }
+}
+
+void      MemTrackArenaReserve(const long long bytesDelta)
+{
+  s_arenaBytesReserved.fetch_add(bytesDelta, std::memory_order_relaxed);
+}
+
+void      MemTrackArenaUse(const long long bytesUsed)
+{
+  long long peak = s_arenaBytesHighWater.load(std::memory_order_relaxed);
+  while (bytesUsed > peak)
+  {
+    if (s_arenaBytesHighWater.compare_exchange_weak(peak, bytesUsed,
+      std::memory_order_relaxed))
+      break;
+  }
+}
+
+void      MemTrackSetSampleRate(const int sampleRate)
+{
+  s_sampleRate = (sampleRate > 0) ? sampleRate : 0;
+}
+
+int       MemTrackGetSampleRate()
+{
+  return s_sampleRate.load();
+}
+
+void      MemTrackSetFillTrash(const int fillTrash)
+{
+  s_fillTrash = fillTrash;
 }
 
 int       MemTrackStart()
@@ -383,8 +571,7 @@ int       MemTrackStart()
 int       MemTrackStop()
 {
   s_flagMemTrackActive = 0;
-  s_memRingLockInit = 0;
-  if (s_memorySizeTotal != 0)
+  if (s_memorySizeTotal.load() != 0)
     return 0;
   return 1;
 }
@@ -395,18 +582,24 @@ int MemTrackForAll(MemTrackCallback callback)
   MemRingPart       *part;
   MemRingPart       *term;
   MemBlockHeader    *blockHead;
-  MemBlock          *block;
+  MemBlockTag       *tag;
 
   ok = 1;
-  term = _memRingLockGetTerminator(&s_memRingLock);
-  for (part = _memRingLockGetFirst(&s_memRingLock); part != term; part = _memRingPartGetNext(part) )
+  std::lock_guard<std::mutex> guardShards(s_shardsLock);
+  for (MemShard *shard = s_shardsFirst; shard; shard = shard->m_nextShard)
   {
-    blockHead = _memRingPartGetData(part, MemBlockHeader, m_part);
-    block = (MemBlock*)blockHead;
-    int memSize = blockHead->m_size;
-    void *p = &block->m_data[0];
-    (*callback)(p, memSize, blockHead->m_srcFileName, blockHead->m_srcLine);
+    std::lock_guard<std::mutex> guard(shard->m_lock);
+    term = _memRingLockGetTerminator(&shard->m_ring);
+    for (part = _memRingLockGetFirst(&shard->m_ring); part != term;
+      part = _memRingPartGetNext(part) )
+    {
+      blockHead = _memRingPartGetData(part, MemBlockHeader, m_part);
+      char *p = (char*)blockHead + MEMORY_HEADER_SIZE + MEMORY_TAG_SIZE;
+      tag = (MemBlockTag*)(p - sizeof(MemBlockTag));
+      (*callback)(p, (int)tag->m_size, blockHead->m_srcFileName,
+        blockHead->m_srcLine);
+    }
   }
-  
+
   return ok;
 }
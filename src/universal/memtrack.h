@@ -22,6 +22,21 @@
 
 typedef int (*MemTrackCallback)(const void *memPtr, const int memSize, const char *fileNameSrc, const int fileLineNumber);
 
+// size class k holds allocations with size in [2^k, 2^(k+1))
+#define MEM_TRACK_NUM_SIZE_CLASSES    40
+
+typedef struct tagMemTrackStats
+{
+  long long   m_bytesCurrent;       // bytes allocated now
+  long long   m_bytesPeak;          // max of m_bytesCurrent
+  long long   m_numAllocs;          // number of allocations
+  long long   m_numFrees;           // number of deallocations
+  long long   m_numBlocksTracked;   // live blocks with file/line info
+  long long   m_sizeClassAllocs[MEM_TRACK_NUM_SIZE_CLASSES];
+  long long   m_arenaBytesReserved; // bytes reserved by all arenas now
+  long long   m_arenaBytesHighWater;// max bytes used by single arena
+} MemTrackStats;
+
 
 //  **********************************************************
 //  Functions prototypes
@@ -43,6 +58,23 @@ int       MemTrackGetSize(int *memSizeAllocatedPeak);
 
 int       MemTrackForAll(MemTrackCallback callback);
 
+// Track file/line (and check guards) only for 1 of sampleRate allocations.
+// Totals and histogram are updated for every allocation.
+// 1 tracks everything, 0 only counts: totals, peak, leak size and
+// histogram, cheap enough for release builds. Default is 1 with
+// _DEEP_DEBUG, 0 without it. Can be changed at any time
+void      MemTrackSetSampleRate(const int sampleRate);
+int       MemTrackGetSampleRate();
+// Fill tracked blocks with trash on allocate and free (default is on
+// with _DEEP_DEBUG)
+void      MemTrackSetFillTrash(const int fillTrash);
+void      MemTrackGetStats(MemTrackStats *stats);
+
+// Arena allocators (see arena.h) report reserved memory change and
+// current usage, so arena high water mark appears in MemTrackGetStats
+void      MemTrackArenaReserve(const long long bytesDelta);
+void      MemTrackArenaUse(const long long bytesUsed);
+
 #ifdef    __cplusplus
 }
 #endif  /* __cplusplus */
@@ -52,32 +84,23 @@ int       MemTrackForAll(MemTrackCallback callback);
 //  Defines
 //  **********************************************************
 
-#if defined(_DEEP_DEBUG)
-  #define M_MALLOC(s)     MemTrackAllocate(s, __FILE__, __LINE__)
-  #define M_FREE(p)       MemTrackFree(p)
-#else
-  #define M_MALLOC(s)     malloc(s)
-  #define M_FREE(p)       free(p)
-#endif
-
+// Allocations always go through tracker, it is switched at run time
+// by MemTrackStart / MemTrackStop and MemTrackSetSampleRate
+#define M_MALLOC(s)     MemTrackAllocate(s, __FILE__, __LINE__)
+#define M_FREE(p)       MemTrackFree(p)
 
-#if defined(_DEEP_DEBUG)
-  void *operator new(size_t nSize)      throw();
-  void *operator new[](size_t nSize)    throw();
+void *operator new(size_t nSize);
+void *operator new[](size_t nSize);
 
-  void * operator new(size_t nSize, char * sFileName, int nStr) throw();
-  void * operator new[](size_t nSize, char * sFileName, int nStr) throw();
+void * operator new(size_t nSize, const char * sFileName, int nStr) throw();
+void * operator new[](size_t nSize, const char * sFileName, int nStr) throw();
 
-  #define M_NEW(type)                 new(__FILE__, __LINE__) type
+#define M_NEW(type)                 new(__FILE__, __LINE__) type
 
-  void operator delete(void * pMem)     throw();
-  void operator delete[](void * pMem)   throw();
+void operator delete(void * pMem)     throw();
+void operator delete[](void * pMem)   throw();
 
-  void operator delete(void * pMem, char * sFileName, int nStr)     throw();
-  void operator delete[](void * pMem, char * sFileName, int nStr)   throw();
-
-#else
-  #define M_NEW(type)                 new type
-#endif
+void operator delete(void * pMem, const char * sFileName, int nStr)     throw();
+void operator delete[](void * pMem, const char * sFileName, int nStr)   throw();
 
 #endif
@@ -32,6 +32,16 @@ typedef int                   MInt32;
 typedef short int             MInt16;
 typedef char                  MInt8;
 
+// ****************************************************************************
+// Inline functions
+// ****************************************************************************
+
+//! Index clamped to [0, dim - 1], replicates border of image / volume
+inline int clampIndex(const int v, const int dim)
+{
+  return (v < 0) ? 0 : ((v >= dim) ? (dim - 1) : v);
+}
+
 
 /** \class V2d
 *  \brief Describes 2d point with integer coordinates
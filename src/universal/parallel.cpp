@@ -0,0 +1,105 @@
+// ****************************************************************************
+// File: parallel.cpp
+// Purpose: Split index range processing between worker threads
+// ****************************************************************************
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include <assert.h>
+
+#include <thread>
+#include <atomic>
+#include <vector>
+
+#include "parallel.h"
+
+// ****************************************************************************
+// Defines
+// ****************************************************************************
+
+// chunks per thread, for load balancing
+#define PARALLEL_CHUNKS_PER_THREAD    4
+
+// ****************************************************************************
+// Vars
+// ****************************************************************************
+
+static int                s_numThreads = 0;
+static thread_local int   s_insideParallel = 0;
+
+// ****************************************************************************
+// Methods
+// ****************************************************************************
+
+int Parallel::getNumThreads()
+{
+  if (s_numThreads > 0)
+    return s_numThreads;
+  int numCores = (int)std::thread::hardware_concurrency();
+  return (numCores > 0) ? numCores : 1;
+}
+
+void Parallel::setNumThreads(const int numThreads)
+{
+  s_numThreads = (numThreads > 0) ? numThreads : 0;
+}
+
+static void _runChunks(
+                        std::atomic<int>       *indexNext,
+                        const int               numItems,
+                        const int               chunkSize,
+                        ParallelRangeCallback   callback,
+                        void                   *userData
+                      )
+{
+  s_insideParallel = 1;
+  for (;;)
+  {
+    const int indexStart = indexNext->fetch_add(chunkSize);
+    if (indexStart >= numItems)
+      break;
+    const int indexEnd = (indexStart + chunkSize < numItems) ?
+      (indexStart + chunkSize) : numItems;
+    callback(userData, indexStart, indexEnd);
+  }
+  s_insideParallel = 0;
+}
+
+void Parallel::forRange(
+                        const int             numItems,
+                        ParallelRangeCallback callback,
+                        void                 *userData,
+                        const int             itemsPerChunk
+                       )
+{
+  assert(callback != NULL);
+  if (numItems <= 0)
+    return;
+  const int minChunk = (itemsPerChunk > 0) ? itemsPerChunk : 1;
+  int numThreads = getNumThreads();
+  int maxThreads = (numItems + minChunk - 1) / minChunk;
+  numThreads = (numThreads < maxThreads) ? numThreads : maxThreads;
+  if ((numThreads <= 1) || s_insideParallel)
+  {
+    callback(userData, 0, numItems);
+    return;
+  }
+
+  int chunkSize = numItems / (numThreads * PARALLEL_CHUNKS_PER_THREAD);
+  chunkSize = (chunkSize > minChunk) ? chunkSize : minChunk;
+
+  std::atomic<int> indexNext(0);
+  std::vector<std::thread> workers;
+  workers.reserve(numThreads - 1);
+  for (int t = 1; t < numThreads; t++)
+  {
+    workers.push_back(std::thread(_runChunks, &indexNext, numItems,
+      chunkSize, callback, userData));
+  }
+  // calling thread works too
+  _runChunks(&indexNext, numItems, chunkSize, callback, userData);
+  for (size_t t = 0; t < workers.size(); t++)
+    workers[t].join();
+}
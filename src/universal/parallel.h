@@ -0,0 +1,59 @@
+// ****************************************************************************
+// File: parallel.h
+// Purpose: Split index range processing between worker threads
+// ****************************************************************************
+
+#ifndef  __parallel_h
+#define  __parallel_h
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include "mtypes.h"
+
+// ****************************************************************************
+// Types
+// ****************************************************************************
+
+//! Process items in [indexStart, indexEnd). Called from several threads.
+typedef void (*ParallelRangeCallback)(
+                                      void       *userData,
+                                      const int   indexStart,
+                                      const int   indexEnd
+                                     );
+
+// ****************************************************************************
+// Class
+// ****************************************************************************
+
+/**
+* \class Parallel runs range callbacks on all available cores
+*/
+
+class Parallel
+{
+public:
+  //! Number of threads used by forRange (hardware concurrency by default)
+  static int  getNumThreads();
+  //! Set number of threads. 0 means hardware concurrency.
+  static void setNumThreads(const int numThreads);
+
+  /*!
+   * \brief Call callback for all items in [0, numItems), split into chunks.
+   *   Chunks are handed out dynamically, so uneven work is balanced.
+   *   Nested calls (from inside a callback) are executed serially.
+   * \param numItems Total number of items (slices, rows, ...)
+   * \param callback Function processing a sub range of items
+   * \param userData Passed to callback as is
+   * \param itemsPerChunk Minimal number of items per callback invocation
+   */
+  static void forRange(
+                        const int             numItems,
+                        ParallelRangeCallback callback,
+                        void                 *userData,
+                        const int             itemsPerChunk = 1
+                      );
+};
+
+#endif
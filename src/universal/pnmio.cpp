@@ -0,0 +1,284 @@
+// ****************************************************************************
+// File: pnmio.cpp
+// Purpose: Read / write portable any map (PGM, PPM) and raw images
+// ****************************************************************************
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "memtrack.h"
+#include "pnmio.h"
+#include "volview.h"
+
+// ****************************************************************************
+// Defines
+// ****************************************************************************
+
+// protect from broken headers
+#define PNM_MAX_DIM               (64 * 1024)
+// images are used with int pixel counts (also 4 planes of colour image)
+#define PNM_MAX_PIXELS            ((size_t)INT_MAX / 4)
+
+// ****************************************************************************
+// Methods
+// ****************************************************************************
+
+// Read next header number, skipping white spaces and # comments
+static int _readHeaderInt(FILE *file, int *val)
+{
+  int ch = fgetc(file);
+  for (;;)
+  {
+    if (ch == '#')
+    {
+      while ((ch != '\n') && (ch != EOF))
+        ch = fgetc(file);
+    }
+    else if (isspace(ch))
+    {
+      ch = fgetc(file);
+    }
+    else
+      break;
+  }
+  if (!isdigit(ch))
+    return -1;
+  int v = 0;
+  while (isdigit(ch))
+  {
+    v = v * 10 + (ch - '0');
+    if (v > 0xffffff)
+      return -1;
+    ch = fgetc(file);
+  }
+  // single white space after number is part of header
+  if (!isspace(ch) && (ch != EOF))
+    return -1;
+  *val = v;
+  return 1;
+}
+
+static int _isSizeValid(const int w, const int h)
+{
+  return (w > 0) && (h > 0) && ((size_t)w * h <= PNM_MAX_PIXELS);
+}
+
+static __inline MUint32 _greyToArgb(const MUint32 val)
+{
+  return 0xff000000 | (val << 16) | (val << 8) | val;
+}
+
+MUint32 *PnmIo::readImage(const char *fileName, int *imgOutW, int *imgOutH)
+{
+  FILE *file = fopen(fileName, "rb");
+  if (!file)
+    return NULL;
+  char magic[2];
+  if (fread(magic, 1, 2, file) != 2)
+  {
+    fclose(file);
+    return NULL;
+  }
+  int isBinary, numChannels;
+  if ((magic[0] != 'P') || (magic[1] < '2') || (magic[1] > '6') ||
+      (magic[1] == '4'))
+  {
+    fclose(file);
+    return NULL;
+  }
+  isBinary    = (magic[1] >= '5') ? 1 : 0;
+  numChannels = ((magic[1] == '3') || (magic[1] == '6')) ? 3 : 1;
+
+  int w, h, maxVal;
+  if ((_readHeaderInt(file, &w) < 0) || (_readHeaderInt(file, &h) < 0) ||
+      (_readHeaderInt(file, &maxVal) < 0) ||
+      !_isSizeValid(w, h) || (w > PNM_MAX_DIM) || (h > PNM_MAX_DIM) ||
+      (maxVal <= 0) || (maxVal > 65535))
+  {
+    fclose(file);
+    return NULL;
+  }
+
+  const int numPixels = w * h;
+  const int bytesPerSample = (maxVal > 255) ? 2 : 1;
+  MUint32 *pixels = M_NEW(MUint32[numPixels]);
+  if (!pixels)
+  {
+    fclose(file);
+    return NULL;
+  }
+
+  const int numSamplesLine = w * numChannels;
+  MUint8 *line = NULL;
+  if (isBinary)
+  {
+    line = M_NEW(MUint8[numSamplesLine * bytesPerSample]);
+    if (!line)
+    {
+      delete [] pixels;
+      fclose(file);
+      return NULL;
+    }
+  }
+
+  int ok = 1;
+  int y, x, c;
+  for (y = 0; (y < h) && ok; y++)
+  {
+    if (isBinary)
+    {
+      const size_t lineBytes = numSamplesLine * bytesPerSample;
+      if (fread(line, 1, lineBytes, file) != lineBytes)
+      {
+        ok = 0;
+        break;
+      }
+    }
+    for (x = 0; x < w; x++)
+    {
+      MUint32 sum = 0;
+      for (c = 0; c < numChannels; c++)
+      {
+        int val;
+        if (isBinary)
+        {
+          const int i = x * numChannels + c;
+          val = (bytesPerSample == 2) ?
+            ((line[i * 2] << 8) | line[i * 2 + 1]) : line[i];
+        }
+        else if (fscanf(file, "%d", &val) != 1)
+        {
+          ok = 0;
+          break;
+        }
+        val = (val < maxVal) ? val : maxVal;
+        sum += (MUint32)val;
+      }   // for (c)
+      // scale into [0..255] with rounding
+      const MUint32 valMax = (MUint32)maxVal * numChannels;
+      const MUint32 grey = (sum * 255 + valMax / 2) / valMax;
+      pixels[x + y * w] = _greyToArgb(grey);
+    }     // for (x)
+  }       // for (y)
+  if (line)
+    delete [] line;
+  fclose(file);
+  if (!ok)
+  {
+    delete [] pixels;
+    return NULL;
+  }
+  *imgOutW = w;
+  *imgOutH = h;
+  return pixels;
+}
+
+MUint32 *PnmIo::readRaw(const char *fileName, const int w, const int h)
+{
+  if (!_isSizeValid(w, h))
+    return NULL;
+  FILE *file = fopen(fileName, "rb");
+  if (!file)
+    return NULL;
+  const int numPixels = w * h;
+  MUint8 *grey = M_NEW(MUint8[numPixels]);
+  MUint32 *pixels = M_NEW(MUint32[numPixels]);
+  if (!grey || !pixels)
+  {
+    if (grey)
+      delete [] grey;
+    if (pixels)
+      delete [] pixels;
+    fclose(file);
+    return NULL;
+  }
+  const size_t numRead = fread(grey, 1, numPixels, file);
+  fclose(file);
+  if (numRead != (size_t)numPixels)
+  {
+    delete [] grey;
+    delete [] pixels;
+    return NULL;
+  }
+  for (int i = 0; i < numPixels; i++)
+    pixels[i] = _greyToArgb(grey[i]);
+  delete [] grey;
+  return pixels;
+}
+
+int PnmIo::writeImageGrey(
+                          const char   *fileName,
+                          const MUint8 *pixels,
+                          const int     w,
+                          const int     h
+                         )
+{
+  FILE *file = fopen(fileName, "wb");
+  if (!file)
+    return -1;
+  fprintf(file, "P5\n%d %d\n255\n", w, h);
+  const size_t numPixels = (size_t)w * h;
+  const size_t numWritten = fwrite(pixels, 1, numPixels, file);
+  fclose(file);
+  return (numWritten == numPixels) ? 1 : -1;
+}
+
+int PnmIo::writeImageGrey(
+                          const char       *fileName,
+                          const VolumeView &view,
+                          const int         z
+                         )
+{
+  assert(view.getBytesPerVoxel() == 1);
+  if ((z < 0) || (z >= view.getDepth()))
+    return -1;
+  FILE *file = fopen(fileName, "wb");
+  if (!file)
+    return -1;
+  const int w = view.getWidth();
+  const int h = view.getHeight();
+  fprintf(file, "P5\n%d %d\n255\n", w, h);
+  int ok = 1;
+  for (int y = 0; (y < h) && (ok > 0); y++)
+  {
+    if (fwrite(view.getRow(y, z), 1, w, file) != (size_t)w)
+      ok = -1;
+  }
+  fclose(file);
+  return ok;
+}
+
+int PnmIo::writeImageGrey(
+                          const char   *fileName,
+                          const float  *pixels,
+                          const int     w,
+                          const int     h
+                         )
+{
+  if (!_isSizeValid(w, h))
+    return -1;
+  const int numPixels = w * h;
+  MUint8 *grey = M_NEW(MUint8[numPixels]);
+  if (!grey)
+    return -1;
+  for (int i = 0; i < numPixels; i++)
+  {
+    float val = pixels[i] * 255.0f + 0.5f;
+    val = (val > 0.0f) ? val : 0.0f;
+    val = (val < 255.0f) ? val : 255.0f;
+    grey[i] = (MUint8)val;
+  }
+  const int ok = writeImageGrey(fileName, grey, w, h);
+  delete [] grey;
+  return ok;
+}
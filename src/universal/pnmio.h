@@ -0,0 +1,68 @@
+// ****************************************************************************
+// File: pnmio.h
+// Purpose: Read / write portable any map (PGM, PPM) and raw images
+// ****************************************************************************
+
+#ifndef  __pnmio_h
+#define  __pnmio_h
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include "mtypes.h"
+
+class VolumeView;
+
+// ****************************************************************************
+// Class
+// ****************************************************************************
+
+/**
+* \class PnmIo platform independent image files I/O, used where GDI+
+* based ImageLoader is not available.
+* Images are returned in the same layout as ImageLoader::readBitmap:
+* ARGB pixels, row by row, allocated with M_NEW (caller does delete []).
+*/
+
+class PnmIo
+{
+public:
+  /*!
+   * \brief Read P2, P3, P5 or P6 image. 16 bit samples are reduced to
+   *   8 bits, colour is converted to grey (all channels are the same).
+   * \return pixels or NULL if file is missing or has wrong format
+   *   (also more than INT_MAX / 4 pixels)
+   */
+  static MUint32 *readImage(const char *fileName, int *imgOutW, int *imgOutH);
+  /*!
+   * \brief Read headerless 8 bit grey image of given size
+   * \return pixels or NULL if file is missing, too short or size is
+   *   not positive or above INT_MAX / 4 pixels
+   */
+  static MUint32 *readRaw(const char *fileName, const int w, const int h);
+
+  //! Write P5 image from float pixels in [0..1]. Return 1 if ok, -1 if error
+  static int      writeImageGrey(
+                                  const char   *fileName,
+                                  const float  *pixels,
+                                  const int     w,
+                                  const int     h
+                                );
+  //! Write P5 image from 8 bit pixels. Return 1 if ok, -1 if error
+  static int      writeImageGrey(
+                                  const char   *fileName,
+                                  const MUint8 *pixels,
+                                  const int     w,
+                                  const int     h
+                                );
+  //! Write slice z of 1 bpp volume view as P5 image, rows are written
+  //! directly from view. Return 1 if ok, -1 if error
+  static int      writeImageGrey(
+                                  const char       *fileName,
+                                  const VolumeView &view,
+                                  const int         z
+                                );
+};
+
+#endif
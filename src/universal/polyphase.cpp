@@ -0,0 +1,157 @@
+// ****************************************************************************
+// File: polyphase.cpp
+// Purpose: Polyphase kernel tables for arbitrary downsampling ratios
+// ****************************************************************************
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+
+#include "memtrack.h"
+#include "polyphase.h"
+
+// ****************************************************************************
+// Methods
+// ****************************************************************************
+
+PolyphaseTaps::PolyphaseTaps()
+{
+  m_dimSrc    = 0;
+  m_dimDst    = 0;
+  m_radius    = 0;
+  m_koef      = 0.0f;
+  m_numPhases = 0;
+  m_bases     = NULL;
+  m_phases    = NULL;
+  m_shifts    = NULL;
+  m_weights   = NULL;
+  m_weightsFixed = NULL;
+}
+
+PolyphaseTaps::~PolyphaseTaps()
+{
+  destroy();
+}
+
+void PolyphaseTaps::destroy()
+{
+  if (m_bases)
+    delete [] m_bases;
+  if (m_phases)
+    delete [] m_phases;
+  if (m_shifts)
+    delete [] m_shifts;
+  if (m_weights)
+    delete [] m_weights;
+  if (m_weightsFixed)
+    delete [] m_weightsFixed;
+  m_bases     = NULL;
+  m_phases    = NULL;
+  m_shifts    = NULL;
+  m_weights   = NULL;
+  m_weightsFixed = NULL;
+  m_numPhases = 0;
+}
+
+static int _getGcd(int a, int b)
+{
+  while (b != 0)
+  {
+    const int r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+int PolyphaseTaps::create(
+                          const int   dimSrc,
+                          const int   dimDst,
+                          const int   radius,
+                          const float koef
+                        )
+{
+  if (m_bases && (dimSrc == m_dimSrc) && (dimDst == m_dimDst) &&
+      (radius == m_radius) && (koef == m_koef))
+    return 1;
+  destroy();
+  if ((dimSrc <= 0) || (dimDst <= 0) || (radius < 0))
+    return -1;
+  m_dimSrc  = dimSrc;
+  m_dimDst  = dimDst;
+  m_radius  = radius;
+  m_koef    = koef;
+
+  // center of d is ((2d + 1) * dimSrc - dimDst) / (2 * dimDst), all
+  // remainders of this division are r0 + 2 * gcd * j, j < period
+  const int       gcd = _getGcd(dimSrc, dimDst);
+  const int       period = dimDst / gcd;
+  const long long denom = 2LL * dimDst;
+  const int       step = 2 * gcd;
+  const int       rem0 = (((dimSrc - dimDst) % step) + step) % step;
+  const int       isExact = (period <= POLY_MAX_PHASES) ? 1 : 0;
+  m_numPhases = isExact ? period : POLY_MAX_PHASES;
+
+  const int numTaps = getNumTaps();
+  m_bases   = M_NEW(int[dimDst]);
+  m_phases  = M_NEW(int[dimDst]);
+  m_shifts  = M_NEW(float[m_numPhases]);
+  m_weights = M_NEW(float[m_numPhases * numTaps]);
+  m_weightsFixed = M_NEW(MUint16[m_numPhases * numTaps]);
+  if (!m_bases || !m_phases || !m_shifts || !m_weights || !m_weightsFixed)
+  {
+    destroy();
+    return -1;
+  }
+
+  int d, j;
+  for (d = 0; d < dimDst; d++)
+  {
+    const long long num = (2LL * d + 1) * dimSrc - dimDst;
+    long long base = num / denom;
+    if (base * denom > num)
+      base--;
+    const long long rem = num - base * denom;
+    if (isExact)
+      j = (int)((rem - rem0) / step);
+    else
+    {
+      // nearest quantized phase
+      j = (int)((rem * POLY_MAX_PHASES + dimDst) / denom);
+      if (j == POLY_MAX_PHASES)
+      {
+        j = 0;
+        base++;
+      }
+    }
+    assert((j >= 0) && (j < m_numPhases));
+    m_bases[d] = (int)base;
+    m_phases[d] = j;
+  }   // for (d)
+
+  for (j = 0; j < m_numPhases; j++)
+  {
+    const float shift = isExact ?
+      (float)((double)(rem0 + (long long)step * j) / denom) :
+      (float)j / POLY_MAX_PHASES;
+    m_shifts[j] = shift;
+    float *weights = m_weights + j * numTaps;
+    float weightsSum = 0.0f;
+    int k;
+    for (k = 0; k < numTaps; k++)
+    {
+      const float t = (float)(k - radius) - shift;
+      weights[k] = (fabsf(t) <= (float)radius) ? expf(-t * t * koef) : 0.0f;
+      weightsSum += weights[k];
+    }
+    MUint16 *weightsFixed = m_weightsFixed + j * numTaps;
+    const float scale = (float)(1 << POLY_FIXED_BITS) / weightsSum;
+    for (k = 0; k < numTaps; k++)
+      weightsFixed[k] = (MUint16)(weights[k] * scale + 0.5f);
+  }   // for (j)
+  return 1;
+}
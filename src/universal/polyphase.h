@@ -0,0 +1,96 @@
+// ****************************************************************************
+// File: polyphase.h
+// Purpose: Polyphase kernel tables for arbitrary downsampling ratios
+// ****************************************************************************
+
+#ifndef  __polyphase_h
+#define  __polyphase_h
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include "mtypes.h"
+
+// ****************************************************************************
+// Defines
+// ****************************************************************************
+
+// max number of kernels per axis, longer phase periods are quantized
+#define POLY_MAX_PHASES           256
+// fixed point weights of every phase sum to 1 << POLY_FIXED_BITS
+#define POLY_FIXED_BITS           14
+
+// ****************************************************************************
+// Class
+// ****************************************************************************
+
+/**
+* \class PolyphaseTaps gauss kernel tables of one axis.
+* Destination sample d is centered at source position
+* (d + 0.5) * dimSrc / dimDst - 0.5, split into integer base and sub
+* pixel phase. Phases repeat with period dimDst / gcd(dimSrc, dimDst),
+* one kernel is built per distinct phase (quantized to POLY_MAX_PHASES
+* steps if period is longer). Kernel of phase has getNumTaps() weights
+* exp(-t * t * koef) of source samples first .. first + 2 * radius + 1,
+* t is distance to center, samples with |t| > radius get 0.
+* Weights are not normalized: callers skip samples outside of image
+* and divide by sum of used weights. Fixed point copy of every kernel is
+* normalized to 1 << POLY_FIXED_BITS, for 8 bit integer kernels.
+*/
+
+class PolyphaseTaps
+{
+public:
+  PolyphaseTaps();
+  ~PolyphaseTaps();
+
+  /*!
+   * \brief Build tables. Does nothing if tables are already built
+   *   for the same parameters.
+   * \return 1 if ok, -1 if parameters are wrong or no memory
+   */
+  int           create(
+                        const int   dimSrc,
+                        const int   dimDst,
+                        const int   radius,
+                        const float koef
+                      );
+  void          destroy();
+
+  int           getNumTaps() const    { return 2 * m_radius + 2;  }
+  int           getNumPhases() const  { return m_numPhases;       }
+  int           getRadius() const     { return m_radius;          }
+  //! Source index of first tap of destination sample, may be negative
+  int           getFirst(const int d) const {
+    return m_bases[d] - m_radius;
+  }
+  //! Kernel weights of destination sample
+  const float  *getWeights(const int d) const {
+    return m_weights + m_phases[d] * getNumTaps();
+  }
+  //! Fixed point kernel weights of destination sample
+  const MUint16 *getWeightsFixed(const int d) const {
+    return m_weightsFixed + m_phases[d] * getNumTaps();
+  }
+  //! Source position of destination sample center, the one kernel uses
+  float         getCenter(const int d) const {
+    return m_bases[d] + m_shifts[m_phases[d]];
+  }
+
+private:
+  int           m_dimSrc;
+  int           m_dimDst;
+  int           m_radius;
+  float         m_koef;
+  int           m_numPhases;
+  // per destination sample: integer part of center and phase index
+  int          *m_bases;
+  int          *m_phases;
+  // per phase: fractional part of center in [0..1) and kernel
+  float        *m_shifts;
+  float        *m_weights;
+  MUint16      *m_weightsFixed;
+};
+
+#endif
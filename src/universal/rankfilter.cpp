@@ -0,0 +1,428 @@
+// ****************************************************************************
+// File: rankfilter.cpp
+// Purpose: Median / percentile downsampling of 8 bit images and volumes
+//
+// Sliding histogram is based on
+// S.Perreault, P.Hebert, "Median Filtering in Constant Time", 2007
+// ****************************************************************************
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include <stdio.h>
+#include <memory.h>
+#include <assert.h>
+
+#include <atomic>
+
+#include "arena.h"
+#include "parallel.h"
+#include "rankfilter.h"
+
+// ****************************************************************************
+// Defines
+// ****************************************************************************
+
+// column histogram: fine bins, then coarse bins
+#define RANK_COLUMN_SIZE          (RANK_NUM_BINS + RANK_NUM_COARSE)
+#define RANK_COARSE_SHIFT         4
+
+// destination rows per parallel chunk (column histograms are rebuilt at
+// chunk start)
+#define RANK_ROWS_PER_CHUNK       16
+
+// ****************************************************************************
+// Types
+// ****************************************************************************
+
+struct RankKernel
+{
+  MUint32   m_fine[RANK_NUM_BINS];
+  MUint32   m_coarse[RANK_NUM_COARSE];
+};
+
+struct RankJob
+{
+  const MUint8 *m_pixelsSrc;
+  MUint8       *m_pixelsDst;
+  int           m_dimsSrc[3];
+  int           m_dimsDst[3];
+  int           m_radius;
+  // index of result in sorted window samples
+  int           m_rank;
+  // set by callback without scratch memory
+  std::atomic<int> m_failed;
+};
+
+// ****************************************************************************
+// Histograms
+// ****************************************************************************
+
+static void _kernelClear(RankKernel *kernel)
+{
+  memset(kernel, 0, sizeof(RankKernel));
+}
+
+static inline void _kernelAdd(RankKernel *kernel, const MUint16 *column)
+{
+  int i;
+  for (i = 0; i < RANK_NUM_BINS; i++)
+    kernel->m_fine[i] += column[i];
+  for (i = 0; i < RANK_NUM_COARSE; i++)
+    kernel->m_coarse[i] += column[RANK_NUM_BINS + i];
+}
+
+static inline void _kernelSub(RankKernel *kernel, const MUint16 *column)
+{
+  int i;
+  for (i = 0; i < RANK_NUM_BINS; i++)
+    kernel->m_fine[i] -= column[i];
+  for (i = 0; i < RANK_NUM_COARSE; i++)
+    kernel->m_coarse[i] -= column[RANK_NUM_BINS + i];
+}
+
+// Value with given rank: coarse bins are skipped first, so at most
+// RANK_NUM_COARSE + RANK_NUM_BINS / RANK_NUM_COARSE bins are visited
+static inline MUint8 _kernelGetRank(const RankKernel *kernel, const int rank)
+{
+  MUint32 numBelow = 0;
+  int c = 0;
+  while (numBelow + kernel->m_coarse[c] <= (MUint32)rank)
+    numBelow += kernel->m_coarse[c++];
+  int v = c << RANK_COARSE_SHIFT;
+  while (numBelow + kernel->m_fine[v] <= (MUint32)rank)
+    numBelow += kernel->m_fine[v++];
+  return (MUint8)v;
+}
+
+// Add (sign = +1) or remove (sign = -1) one source row from columns
+static void _columnsAddRow(
+                            MUint16      *columns,
+                            const MUint8 *row,
+                            const int     w,
+                            const int     sign
+                          )
+{
+  for (int x = 0; x < w; x++, columns += RANK_COLUMN_SIZE)
+  {
+    const MUint8 val = row[x];
+    columns[val] = (MUint16)(columns[val] + sign);
+    columns[RANK_NUM_BINS + (val >> RANK_COARSE_SHIFT)] = (MUint16)
+      (columns[RANK_NUM_BINS + (val >> RANK_COARSE_SHIFT)] + sign);
+  }
+}
+
+// Rank of every destination pixel in row from columns histograms:
+// window slides from previous center by removing and adding columns
+static void _rowFromColumns(
+                            const RankJob *job,
+                            const MUint16 *columns,
+                            MUint8        *rowDst
+                          )
+{
+  const int wSrc = job->m_dimsSrc[0];
+  const int wDst = job->m_dimsDst[0];
+  const int rad = job->m_radius;
+  RankKernel kernel;
+  int xPrev = 0;
+  for (int cx = 0; cx < wDst; cx++)
+  {
+    const int xSrc = wSrc * cx / wDst;
+    int x;
+    if ((cx == 0) || (xSrc - xPrev > 2 * rad))
+    {
+      _kernelClear(&kernel);
+      for (x = xSrc - rad; x <= xSrc + rad; x++)
+        _kernelAdd(&kernel, columns + clampIndex(x, wSrc) * RANK_COLUMN_SIZE);
+    }
+    else
+    {
+      for (x = xPrev - rad; x < xSrc - rad; x++)
+        _kernelSub(&kernel, columns + clampIndex(x, wSrc) * RANK_COLUMN_SIZE);
+      for (x = xPrev + rad + 1; x <= xSrc + rad; x++)
+        _kernelAdd(&kernel, columns + clampIndex(x, wSrc) * RANK_COLUMN_SIZE);
+    }
+    rowDst[cx] = _kernelGetRank(&kernel, job->m_rank);
+    xPrev = xSrc;
+  }   // for (cx)
+}
+
+// ****************************************************************************
+// Small windows
+// ****************************************************************************
+
+// branchless compare and swap (min / max), pixel data is not predictable
+#define RANK_SORT2(i, j)  { const int lo = (a[i] < a[j]) ? a[i] : a[j]; \
+  const int hi = (a[i] < a[j]) ? a[j] : a[i]; a[i] = lo; a[j] = hi; }
+
+// Optimal 25 comparators network for 9 values
+static inline void _sort9(int *a)
+{
+  RANK_SORT2(0, 3); RANK_SORT2(1, 7); RANK_SORT2(2, 5); RANK_SORT2(4, 8);
+  RANK_SORT2(0, 7); RANK_SORT2(2, 4); RANK_SORT2(3, 8); RANK_SORT2(5, 6);
+  RANK_SORT2(0, 2); RANK_SORT2(1, 3); RANK_SORT2(4, 5); RANK_SORT2(7, 8);
+  RANK_SORT2(1, 4); RANK_SORT2(3, 6); RANK_SORT2(5, 7);
+  RANK_SORT2(0, 1); RANK_SORT2(2, 4); RANK_SORT2(3, 5); RANK_SORT2(6, 8);
+  RANK_SORT2(2, 3); RANK_SORT2(4, 5); RANK_SORT2(6, 7);
+  RANK_SORT2(1, 2); RANK_SORT2(3, 4); RANK_SORT2(5, 6);
+}
+
+static void _rowsNetwork3x3(const RankJob *job, const int yStart,
+  const int yEnd)
+{
+  const int wSrc = job->m_dimsSrc[0];
+  const int hSrc = job->m_dimsSrc[1];
+  const int wDst = job->m_dimsDst[0];
+  const int hDst = job->m_dimsDst[1];
+  int a[9];
+  for (int cy = yStart; cy < yEnd; cy++)
+  {
+    const int ySrc = hSrc * cy / hDst;
+    const MUint8 *rows[3];
+    for (int t = 0; t < 3; t++)
+      rows[t] = job->m_pixelsSrc +
+        (size_t)clampIndex(ySrc + t - 1, hSrc) * wSrc;
+    MUint8 *rowDst = job->m_pixelsDst + (size_t)cy * wDst;
+    for (int cx = 0; cx < wDst; cx++)
+    {
+      const int xSrc = wSrc * cx / wDst;
+      const int xL = clampIndex(xSrc - 1, wSrc);
+      const int xR = clampIndex(xSrc + 1, wSrc);
+      for (int t = 0; t < 3; t++)
+      {
+        a[t * 3 + 0] = rows[t][xL];
+        a[t * 3 + 1] = rows[t][xSrc];
+        a[t * 3 + 2] = rows[t][xR];
+      }
+      _sort9(a);
+      rowDst[cx] = (MUint8)a[job->m_rank];
+    }   // for (cx)
+  }     // for (cy)
+}
+
+// ****************************************************************************
+// Callbacks
+// ****************************************************************************
+
+static void _rank2dCallback(
+                            void       *userData,
+                            const int   yStart,
+                            const int   yEnd
+                          )
+{
+  RankJob *job = (RankJob*)userData;
+  if (job->m_radius == 1)
+  {
+    _rowsNetwork3x3(job, yStart, yEnd);
+    return;
+  }
+  const int wSrc = job->m_dimsSrc[0];
+  const int hSrc = job->m_dimsSrc[1];
+  const int hDst = job->m_dimsDst[1];
+  const int rad = job->m_radius;
+  MemArenaFrame frame;
+  MUint16 *columns = (MUint16*)frame.allocate(
+    (size_t)wSrc * RANK_COLUMN_SIZE * sizeof(MUint16));
+  if (columns == NULL)
+  {
+    job->m_failed = 1;
+    return;
+  }
+
+  int yPrev = 0;
+  for (int cy = yStart; cy < yEnd; cy++)
+  {
+    const int ySrc = hSrc * cy / hDst;
+    int y;
+    if ((cy == yStart) || (ySrc - yPrev > 2 * rad))
+    {
+      memset(columns, 0, (size_t)wSrc * RANK_COLUMN_SIZE * sizeof(MUint16));
+      for (y = ySrc - rad; y <= ySrc + rad; y++)
+        _columnsAddRow(columns,
+          job->m_pixelsSrc + (size_t)clampIndex(y, hSrc) * wSrc, wSrc, +1);
+    }
+    else
+    {
+      for (y = yPrev - rad; y < ySrc - rad; y++)
+        _columnsAddRow(columns,
+          job->m_pixelsSrc + (size_t)clampIndex(y, hSrc) * wSrc, wSrc, -1);
+      for (y = yPrev + rad + 1; y <= ySrc + rad; y++)
+        _columnsAddRow(columns,
+          job->m_pixelsSrc + (size_t)clampIndex(y, hSrc) * wSrc, wSrc, +1);
+    }
+    _rowFromColumns(job, columns,
+      job->m_pixelsDst + (size_t)cy * job->m_dimsDst[0]);
+    yPrev = ySrc;
+  }   // for (cy)
+}
+
+// Columns of volume hold voxels of (2r + 1) rows of (2r + 1) slices, they
+// slide along y inside destination slice
+static void _columnsAddRow3d(const RankJob *job, MUint16 *columns,
+  const int y, const int zSrc, const int sign)
+{
+  const int xDim = job->m_dimsSrc[0];
+  const int yDim = job->m_dimsSrc[1];
+  const int zDim = job->m_dimsSrc[2];
+  const size_t offY = (size_t)clampIndex(y, yDim) * xDim;
+  for (int z = zSrc - job->m_radius; z <= zSrc + job->m_radius; z++)
+  {
+    const size_t offZ = (size_t)clampIndex(z, zDim) * xDim * yDim;
+    _columnsAddRow(columns, job->m_pixelsSrc + offZ + offY, xDim, sign);
+  }
+}
+
+static void _rank3dCallback(
+                            void       *userData,
+                            const int   zStart,
+                            const int   zEnd
+                          )
+{
+  RankJob *job = (RankJob*)userData;
+  const int xDimSrc = job->m_dimsSrc[0];
+  const int yDimSrc = job->m_dimsSrc[1];
+  const int zDimSrc = job->m_dimsSrc[2];
+  const int xDimDst = job->m_dimsDst[0];
+  const int yDimDst = job->m_dimsDst[1];
+  const int rad = job->m_radius;
+  MemArenaFrame frame;
+  MUint16 *columns = (MUint16*)frame.allocate(
+    (size_t)xDimSrc * RANK_COLUMN_SIZE * sizeof(MUint16));
+  if (columns == NULL)
+  {
+    job->m_failed = 1;
+    return;
+  }
+
+  for (int cz = zStart; cz < zEnd; cz++)
+  {
+    const int zSrc = zDimSrc * cz / job->m_dimsDst[2];
+    int yPrev = 0;
+    for (int cy = 0; cy < yDimDst; cy++)
+    {
+      const int ySrc = yDimSrc * cy / yDimDst;
+      int y;
+      if ((cy == 0) || (ySrc - yPrev > 2 * rad))
+      {
+        memset(columns, 0,
+          (size_t)xDimSrc * RANK_COLUMN_SIZE * sizeof(MUint16));
+        for (y = ySrc - rad; y <= ySrc + rad; y++)
+          _columnsAddRow3d(job, columns, y, zSrc, +1);
+      }
+      else
+      {
+        for (y = yPrev - rad; y < ySrc - rad; y++)
+          _columnsAddRow3d(job, columns, y, zSrc, -1);
+        for (y = yPrev + rad + 1; y <= ySrc + rad; y++)
+          _columnsAddRow3d(job, columns, y, zSrc, +1);
+      }
+      MUint8 *rowDst = job->m_pixelsDst +
+        ((size_t)cz * yDimDst + cy) * xDimDst;
+      _rowFromColumns(job, columns, rowDst);
+      yPrev = ySrc;
+    }   // for (cy)
+  }     // for (cz)
+}
+
+// ****************************************************************************
+// Methods
+// ****************************************************************************
+
+int RankFilter::getAutoRadius(const int dimSrc, const int dimDst)
+{
+  const int ratio = (dimSrc + dimDst - 1) / dimDst;
+  int rad = (ratio + 1) / 2;
+  rad = (rad >= 1) ? rad : 1;
+  return (rad <= RANK_MAX_RADIUS) ? rad : RANK_MAX_RADIUS;
+}
+
+static int _setupJob(
+                      RankJob      *job,
+                      const int     numDims,
+                      const int     radius,
+                      const float   percentile
+                    )
+{
+  int k;
+  for (k = 0; k < numDims; k++)
+  {
+    if ((job->m_dimsDst[k] <= 0) || (job->m_dimsDst[k] > job->m_dimsSrc[k]))
+      return -1;
+  }
+  if ((percentile < 0.0f) || (percentile > 1.0f))
+    return -1;
+  int rad = radius;
+  for (k = 0; (k < numDims) && (radius == 0); k++)
+  {
+    const int radAxis =
+      RankFilter::getAutoRadius(job->m_dimsSrc[k], job->m_dimsDst[k]);
+    rad = (radAxis > rad) ? radAxis : rad;
+  }
+  if ((rad < 1) || (rad > RANK_MAX_RADIUS))
+    return -1;
+  job->m_radius = rad;
+  int numSamples = 1;
+  for (k = 0; k < numDims; k++)
+    numSamples *= 2 * rad + 1;
+  job->m_rank = (int)(percentile * (numSamples - 1) + 0.5f);
+  return 1;
+}
+
+int RankFilter::downsample2d(
+                              const MUint8 *pixelsSrc,
+                              const int     wSrc,
+                              const int     hSrc,
+                              MUint8       *pixelsDst,
+                              const int     wDst,
+                              const int     hDst,
+                              const int     radius,
+                              const float   percentile
+                            )
+{
+  RankJob job;
+  job.m_pixelsSrc = pixelsSrc;
+  job.m_pixelsDst = pixelsDst;
+  job.m_dimsSrc[0] = wSrc;
+  job.m_dimsSrc[1] = hSrc;
+  job.m_dimsSrc[2] = 1;
+  job.m_dimsDst[0] = wDst;
+  job.m_dimsDst[1] = hDst;
+  job.m_dimsDst[2] = 1;
+  if (_setupJob(&job, 2, radius, percentile) < 0)
+    return -1;
+  job.m_failed = 0;
+  Parallel::forRange(hDst, _rank2dCallback, &job, RANK_ROWS_PER_CHUNK);
+  return (job.m_failed) ? -1 : 1;
+}
+
+int RankFilter::downsample3d(
+                              const MUint8 *volSrc,
+                              const int     xDimSrc,
+                              const int     yDimSrc,
+                              const int     zDimSrc,
+                              MUint8       *volDst,
+                              const int     xDimDst,
+                              const int     yDimDst,
+                              const int     zDimDst,
+                              const int     radius,
+                              const float   percentile
+                            )
+{
+  RankJob job;
+  job.m_pixelsSrc = volSrc;
+  job.m_pixelsDst = volDst;
+  job.m_dimsSrc[0] = xDimSrc;
+  job.m_dimsSrc[1] = yDimSrc;
+  job.m_dimsSrc[2] = zDimSrc;
+  job.m_dimsDst[0] = xDimDst;
+  job.m_dimsDst[1] = yDimDst;
+  job.m_dimsDst[2] = zDimDst;
+  if (_setupJob(&job, 3, radius, percentile) < 0)
+    return -1;
+  // (2r + 1) ^ 2 voxels per column should fit into 16 bit counters
+  assert((2 * job.m_radius + 1) * (2 * job.m_radius + 1) < 65536);
+  job.m_failed = 0;
+  Parallel::forRange(zDimDst, _rank3dCallback, &job);
+  return (job.m_failed) ? -1 : 1;
+}
@@ -0,0 +1,81 @@
+// ****************************************************************************
+// File: rankfilter.h
+// Purpose: Median / percentile downsampling of 8 bit images and volumes
+// ****************************************************************************
+
+#ifndef  __rankfilter_h
+#define  __rankfilter_h
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include "mtypes.h"
+
+// ****************************************************************************
+// Defines
+// ****************************************************************************
+
+// number of 8 bit values
+#define RANK_NUM_BINS             256
+// coarse histogram bins, each one covers RANK_NUM_BINS / RANK_NUM_COARSE
+#define RANK_NUM_COARSE           16
+// max window radius: column histogram counts fit into 16 bits
+#define RANK_MAX_RADIUS           64
+
+// ****************************************************************************
+// Class
+// ****************************************************************************
+
+/**
+* \class RankFilter takes percentile (median by default) of window around
+* every destination pixel (voxel). Window of radius r has (2r + 1) ^ 2
+* (^ 3 for volumes) samples, border samples are replicated.
+* Histogram of every source column inside window is kept and slides
+* with destination rows, window histogram slides along row by adding
+* and removing column histograms (Perreault, Hebert), so per pixel cost
+* does not depend on window size in 2d. Percentile is found by coarse then
+* fine histogram. 3 * 3 windows in 2d are sorted by network instead.
+* Destination rows (slices) are processed by worker threads.
+*/
+
+class RankFilter
+{
+public:
+  //! Radius covering source pixels of one destination pixel (at least 1)
+  static int  getAutoRadius(const int dimSrc, const int dimDst);
+
+  /*!
+   * \brief Downsample image by window percentile.
+   *   Destination pixel (x, y) takes window around source pixel
+   *   (wSrc * x / wDst, hSrc * y / hDst), the same as Downsample2d.
+   * \param radius Window radius in [1..RANK_MAX_RADIUS], 0 is auto
+   * \param percentile 0.5 is median, 0 is minimum, 1 is maximum
+   * \return 1 if ok, -1 if parameters are wrong or no memory
+   */
+  static int  downsample2d(
+                            const MUint8 *pixelsSrc,
+                            const int     wSrc,
+                            const int     hSrc,
+                            MUint8       *pixelsDst,
+                            const int     wDst,
+                            const int     hDst,
+                            const int     radius,
+                            const float   percentile
+                          );
+  //! Same for volume, window is cube of (2 * radius + 1) ^ 3 voxels
+  static int  downsample3d(
+                            const MUint8 *volSrc,
+                            const int     xDimSrc,
+                            const int     yDimSrc,
+                            const int     zDimSrc,
+                            MUint8       *volDst,
+                            const int     xDimDst,
+                            const int     yDimDst,
+                            const int     zDimDst,
+                            const int     radius,
+                            const float   percentile
+                          );
+};
+
+#endif
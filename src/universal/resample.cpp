@@ -0,0 +1,473 @@
+// ****************************************************************************
+// File: resample.cpp
+// Purpose: Separable volume resampling with selectable filter kernels
+// ****************************************************************************
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include <stdio.h>
+#include <memory.h>
+#include <math.h>
+#include <assert.h>
+#include <atomic>
+
+#include "memtrack.h"
+#include "arena.h"
+#include "parallel.h"
+#include "resample.h"
+
+// ****************************************************************************
+// Types
+// ****************************************************************************
+
+struct ResampleXyJob
+{
+  const MUint8         *m_pixelsSrc;
+  int                   m_xDimSrc;
+  int                   m_yDimSrc;
+  MUint8               *m_pixelsDst;
+  int                   m_xDimDst;
+  int                   m_yDimDst;
+  const ResampleTaps   *m_tapsX;
+  const ResampleTaps   *m_tapsY;
+  std::atomic<int>      m_failed;
+};
+
+struct ResampleZJob
+{
+  // source is bytes, or float slices made by xy pass of m_jobXy
+  const MUint8         *m_pixelsSrc;
+  const ResampleXyJob  *m_jobXy;
+  MUint8               *m_pixelsDst;
+  int                   m_xyDim;
+  const ResampleTaps   *m_tapsZ;
+  std::atomic<int>      m_failed;
+};
+
+// ****************************************************************************
+// ResampleTaps
+// ****************************************************************************
+
+ResampleTaps::ResampleTaps()
+{
+  m_dimSrc      = 0;
+  m_dimDst      = 0;
+  m_numTaps     = 0;
+  m_isIdentity  = 0;
+  m_indices     = NULL;
+  m_weights     = NULL;
+}
+
+ResampleTaps::~ResampleTaps()
+{
+  destroy();
+}
+
+void ResampleTaps::destroy()
+{
+  if (m_indices)
+    delete [] m_indices;
+  if (m_weights)
+    delete [] m_weights;
+  m_indices   = NULL;
+  m_weights   = NULL;
+  m_numTaps   = 0;
+}
+
+int ResampleTaps::create(
+                          const int             dimSrc,
+                          const int             dimDst,
+                          const ResampleFilter  filter
+                        )
+{
+  destroy();
+  assert(dimSrc > 0);
+  assert(dimDst > 0);
+  m_dimSrc      = dimSrc;
+  m_dimDst      = dimDst;
+  m_isIdentity  = (dimSrc == dimDst) ? 1 : 0;
+
+  const float ratio = (float)dimSrc / dimDst;
+  // stretch kernel on down scale, keep as is on up scale
+  const float filterScale = (ratio > 1.0f) ? ratio : 1.0f;
+  const float radius = Resampler3d::getFilterRadius(filter) * filterScale;
+  const int   radiusInt = (int)ceilf(radius);
+
+  m_numTaps = (filter == RESAMPLE_FILTER_NEAREST) ? 1 : (2 * radiusInt);
+  m_indices = M_NEW(int[dimDst * m_numTaps]);
+  m_weights = M_NEW(float[dimDst * m_numTaps]);
+  if ((m_indices == NULL) || (m_weights == NULL))
+  {
+    destroy();
+    return -1;
+  }
+
+  for (int d = 0; d < dimDst; d++)
+  {
+    int   *indices = m_indices + d * m_numTaps;
+    float *weights = m_weights + d * m_numTaps;
+
+    if (filter == RESAMPLE_FILTER_NEAREST)
+    {
+      int s = (int)((d + 0.5f) * ratio);
+      indices[0] = (s < dimSrc) ? s : (dimSrc - 1);
+      weights[0] = 1.0f;
+      continue;
+    }
+
+    // destination sample center in source coordinates
+    const float center = (d + 0.5f) * ratio - 0.5f;
+    const int   first = (int)floorf(center) - radiusInt + 1;
+    float       weightsSum = 0.0f;
+    for (int t = 0; t < m_numTaps; t++)
+    {
+      const int   s = first + t;
+      const float w = Resampler3d::getFilterWeight(filter,
+        ((float)s - center) / filterScale);
+      indices[t] = (s < 0) ? 0 : ((s >= dimSrc) ? (dimSrc - 1) : s);
+      weights[t] = w;
+      weightsSum += w;
+    }
+    if (weightsSum != 0.0f)
+    {
+      const float scale = 1.0f / weightsSum;
+      for (int t = 0; t < m_numTaps; t++)
+        weights[t] *= scale;
+    }
+    else
+    {
+      // degenerate kernel: take nearest source sample
+      int s = (int)(center + 0.5f);
+      s = (s < 0) ? 0 : ((s >= dimSrc) ? (dimSrc - 1) : s);
+      for (int t = 0; t < m_numTaps; t++)
+      {
+        indices[t] = s;
+        weights[t] = (t == 0) ? 1.0f : 0.0f;
+      }
+    }
+  }   // for (d)
+  return 1;
+}
+
+// ****************************************************************************
+// Filter kernels
+// ****************************************************************************
+
+static __inline float _sinc(const float x)
+{
+  if ((x > -1.0e-6f) && (x < 1.0e-6f))
+    return 1.0f;
+  const float xPi = x * M_PI;
+  return sinf(xPi) / xPi;
+}
+
+float Resampler3d::getFilterRadius(const ResampleFilter filter)
+{
+  switch (filter)
+  {
+    case RESAMPLE_FILTER_NEAREST:  return 0.5f;
+    case RESAMPLE_FILTER_LINEAR:   return 1.0f;
+    case RESAMPLE_FILTER_CUBIC:    return 2.0f;
+    case RESAMPLE_FILTER_LANCZOS:  return 3.0f;
+    default:
+      assert(filter < -5555);
+      return 1.0f;
+  }
+}
+
+float Resampler3d::getFilterWeight(const ResampleFilter filter, const float tIn)
+{
+  const float t = (tIn >= 0.0f) ? tIn : -tIn;
+  switch (filter)
+  {
+    case RESAMPLE_FILTER_NEAREST:
+      return (t < 0.5f) ? 1.0f : 0.0f;
+    case RESAMPLE_FILTER_LINEAR:
+      return (t < 1.0f) ? (1.0f - t) : 0.0f;
+    case RESAMPLE_FILTER_CUBIC:
+    {
+      // Catmull-Rom, the same spline as _cubicHermite in ktxtexture.cpp
+      const float a = -0.5f;
+      if (t < 1.0f)
+        return ((a + 2.0f) * t - (a + 3.0f)) * t * t + 1.0f;
+      if (t < 2.0f)
+        return ((a * t - 5.0f * a) * t + 8.0f * a) * t - 4.0f * a;
+      return 0.0f;
+    }
+    case RESAMPLE_FILTER_LANCZOS:
+    {
+      const float LANCZOS_A = 3.0f;
+      return (t < LANCZOS_A) ? (_sinc(t) * _sinc(t / LANCZOS_A)) : 0.0f;
+    }
+    default:
+      assert(filter < -5555);
+      return 0.0f;
+  }
+}
+
+// ****************************************************************************
+// Passes
+// ****************************************************************************
+
+static __inline void _storeLine(
+                                const float *valsSrc,
+                                MUint8      *pixelsDst,
+                                const int    numPixels
+                               )
+{
+  for (int i = 0; i < numPixels; i++)
+  {
+    float v = valsSrc[i] + 0.5f;
+    v = (v > 0.0f) ? v : 0.0f;
+    v = (v < 255.0f) ? v : 255.0f;
+    pixelsDst[i] = (MUint8)v;
+  }
+}
+
+static void _resampleLineX(
+                            const MUint8        *lineSrc,
+                            float               *lineDst,
+                            const ResampleTaps  *taps
+                          )
+{
+  const int     numTaps = taps->getNumTaps();
+  const int     dimDst  = taps->getDimDst();
+  const int    *indices = taps->getIndices();
+  const float  *weights = taps->getWeights();
+
+  if (numTaps == 1)
+  {
+    for (int x = 0; x < dimDst; x++)
+      lineDst[x] = (float)lineSrc[indices[x]];
+    return;
+  }
+  for (int x = 0; x < dimDst; x++, indices += numTaps, weights += numTaps)
+  {
+    float sum = 0.0f;
+    for (int t = 0; t < numTaps; t++)
+      sum += weights[t] * (float)lineSrc[indices[t]];
+    lineDst[x] = sum;
+  }
+}
+
+// xy pass of source slice z. Result goes to float slice (not clamped)
+// if sliceDst is given, otherwise to bytes of destination slice z.
+static void _resampleSliceXy(
+                              const ResampleXyJob *job,
+                              const int            z,
+                              float               *rows,
+                              float               *accum,
+                              float               *sliceDst
+                            )
+{
+  const int xDimSrc = job->m_xDimSrc;
+  const int yDimSrc = job->m_yDimSrc;
+  const int xDimDst = job->m_xDimDst;
+  const int yDimDst = job->m_yDimDst;
+  const int numTapsY = job->m_tapsY->getNumTaps();
+  const MUint8 *sliceSrc = job->m_pixelsSrc + (size_t)z * xDimSrc * yDimSrc;
+  const size_t  offDst = (size_t)z * xDimDst * yDimDst;
+
+  // x pass: source rows => float rows of destination width
+  for (int y = 0; y < yDimSrc; y++)
+    _resampleLineX(sliceSrc + y * xDimSrc, rows + y * xDimDst, job->m_tapsX);
+
+  // y pass: weighted sum of whole rows, vectorizes along x
+  const int   *indices = job->m_tapsY->getIndices();
+  const float *weights = job->m_tapsY->getWeights();
+  for (int y = 0; y < yDimDst; y++, indices += numTapsY, weights += numTapsY)
+  {
+    float *rowDst = (sliceDst) ? (sliceDst + y * xDimDst) : accum;
+    const float *rowFirst = rows + indices[0] * xDimDst;
+    const float  wFirst   = weights[0];
+    int x;
+    for (x = 0; x < xDimDst; x++)
+      rowDst[x] = wFirst * rowFirst[x];
+    for (int t = 1; t < numTapsY; t++)
+    {
+      const float  w   = weights[t];
+      const float *row = rows + indices[t] * xDimDst;
+      if (w == 0.0f)
+        continue;
+      for (x = 0; x < xDimDst; x++)
+        rowDst[x] += w * row[x];
+    }
+    if (!sliceDst)
+      _storeLine(accum, job->m_pixelsDst + offDst + y * xDimDst, xDimDst);
+  }   // for (y)
+}
+
+static void _resampleXyCallback(
+                                void       *userData,
+                                const int   zStart,
+                                const int   zEnd
+                               )
+{
+  ResampleXyJob *job = (ResampleXyJob*)userData;
+  float *rows   = M_NEW(float[job->m_xDimDst * job->m_yDimSrc]);
+  float *accum  = M_NEW(float[job->m_xDimDst]);
+  if ((rows == NULL) || (accum == NULL))
+  {
+    job->m_failed = 1;
+    if (rows)
+      delete [] rows;
+    if (accum)
+      delete [] accum;
+    return;
+  }
+  for (int z = zStart; z < zEnd; z++)
+    _resampleSliceXy(job, z, rows, accum, NULL);
+  delete [] accum;
+  delete [] rows;
+}
+
+static void _resampleZCallback(
+                                void       *userData,
+                                const int   zStart,
+                                const int   zEnd
+                              )
+{
+  ResampleZJob *job = (ResampleZJob*)userData;
+  const ResampleXyJob *jobXy = job->m_jobXy;
+  const int xyDim = job->m_xyDim;
+  const int numTaps = job->m_tapsZ->getNumTaps();
+  // Source slices of destination slice are numTaps neighbours, so ring
+  // of numTaps + 1 xy resampled slices holds them at (index % ringLen)
+  // and keeps slices shared with next destination slice
+  const int ringLen = numTaps + 1;
+
+  MemArenaFrame frame;
+  float *accum = (float*)frame.allocate(xyDim * sizeof(float));
+  float *ring  = NULL;
+  int   *ringIndices = NULL;
+  float *rows  = NULL;
+  if (jobXy)
+  {
+    ring = (float*)frame.allocate((size_t)ringLen * xyDim * sizeof(float));
+    ringIndices = (int*)frame.allocate(ringLen * sizeof(int));
+    rows = (float*)frame.allocate((size_t)jobXy->m_xDimDst *
+      jobXy->m_yDimSrc * sizeof(float));
+  }
+  if ((accum == NULL) || (jobXy && (!ring || !ringIndices || !rows)))
+  {
+    job->m_failed = 1;
+    return;
+  }
+  for (int k = 0; (k < ringLen) && jobXy; k++)
+    ringIndices[k] = -1;
+
+  for (int z = zStart; z < zEnd; z++)
+  {
+    const int   *indices = job->m_tapsZ->getIndices() + z * numTaps;
+    const float *weights = job->m_tapsZ->getWeights() + z * numTaps;
+    MUint8      *sliceDst = job->m_pixelsDst + (size_t)z * xyDim;
+    int i;
+
+    if ((numTaps == 1) && !jobXy)
+    {
+      memcpy(sliceDst, job->m_pixelsSrc + (size_t)indices[0] * xyDim, xyDim);
+      continue;
+    }
+
+    for (i = 0; i < xyDim; i++)
+      accum[i] = 0.0f;
+    for (int t = 0; t < numTaps; t++)
+    {
+      const float   w = weights[t];
+      const size_t  offSlice = (size_t)indices[t] * xyDim;
+      if ((w == 0.0f) && (t > 0))
+        continue;
+      if (jobXy)
+      {
+        const int slot = indices[t] % ringLen;
+        float *slice = ring + (size_t)slot * xyDim;
+        if (ringIndices[slot] != indices[t])
+        {
+          _resampleSliceXy(jobXy, indices[t], rows, NULL, slice);
+          ringIndices[slot] = indices[t];
+        }
+        for (i = 0; i < xyDim; i++)
+          accum[i] += w * slice[i];
+      }
+      else
+      {
+        const MUint8 *slice = job->m_pixelsSrc + offSlice;
+        for (i = 0; i < xyDim; i++)
+          accum[i] += w * (float)slice[i];
+      }
+    }
+    _storeLine(accum, sliceDst, xyDim);
+  }   // for (z)
+}
+
+// ****************************************************************************
+// Resampler3d
+// ****************************************************************************
+
+int Resampler3d::resample(
+                          const MUint8         *pixelsSrc,
+                          const int             xDimSrc,
+                          const int             yDimSrc,
+                          const int             zDimSrc,
+                          MUint8               *pixelsDst,
+                          const int             xDimDst,
+                          const int             yDimDst,
+                          const int             zDimDst,
+                          const ResampleFilter  filter
+                         )
+{
+  assert(pixelsSrc != pixelsDst);
+  assert((xDimSrc > 0) && (yDimSrc > 0) && (zDimSrc > 0));
+  assert((xDimDst > 0) && (yDimDst > 0) && (zDimDst > 0));
+
+  ResampleTaps tapsX, tapsY, tapsZ;
+  if (tapsX.create(xDimSrc, xDimDst, filter) < 0)
+    return -1;
+  if (tapsY.create(yDimSrc, yDimDst, filter) < 0)
+    return -1;
+  if (tapsZ.create(zDimSrc, zDimDst, filter) < 0)
+    return -1;
+
+  const int needXy = (tapsX.isIdentity() && tapsY.isIdentity()) ? 0 : 1;
+  const int needZ  = tapsZ.isIdentity() ? 0 : 1;
+  if (!needXy && !needZ)
+  {
+    memcpy(pixelsDst, pixelsSrc, (size_t)xDimSrc * yDimSrc * zDimSrc);
+    return 1;
+  }
+
+  ResampleXyJob jobXy;
+  jobXy.m_pixelsSrc = pixelsSrc;
+  jobXy.m_xDimSrc   = xDimSrc;
+  jobXy.m_yDimSrc   = yDimSrc;
+  jobXy.m_pixelsDst = pixelsDst;
+  jobXy.m_xDimDst   = xDimDst;
+  jobXy.m_yDimDst   = yDimDst;
+  jobXy.m_tapsX     = &tapsX;
+  jobXy.m_tapsY     = &tapsY;
+  jobXy.m_failed    = 0;
+  if (!needZ)
+  {
+    Parallel::forRange(zDimSrc, _resampleXyCallback, &jobXy);
+    return (jobXy.m_failed) ? -1 : 1;
+  }
+
+  // With xy pass every z pass worker makes float slices it needs: cubic
+  // and lanczos overshoot is clamped and rounded on final store only, as
+  // by 3d kernel. Slices near chunk borders are made by both neighbour
+  // workers, so every worker gets one long chunk.
+  ResampleZJob job;
+  job.m_pixelsSrc = (needXy) ? NULL : pixelsSrc;
+  job.m_jobXy     = (needXy) ? &jobXy : NULL;
+  job.m_pixelsDst = pixelsDst;
+  job.m_xyDim     = xDimDst * yDimDst;
+  job.m_tapsZ     = &tapsZ;
+  job.m_failed    = 0;
+  const int numThreads = Parallel::getNumThreads();
+  const int itemsPerChunk = (needXy) ?
+    ((zDimDst + numThreads - 1) / numThreads) : 1;
+  Parallel::forRange(zDimDst, _resampleZCallback, &job, itemsPerChunk);
+  return (job.m_failed) ? -1 : 1;
+}
@@ -0,0 +1,116 @@
+// ****************************************************************************
+// File: resample.h
+// Purpose: Separable volume resampling with selectable filter kernels
+// ****************************************************************************
+
+#ifndef  __resample_h
+#define  __resample_h
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include "mtypes.h"
+
+// ****************************************************************************
+// Types
+// ****************************************************************************
+
+/** \enum ResampleFilter
+ *  \brief Reconstruction kernel used for resampling
+ */
+enum ResampleFilter
+{
+  //! Point sampling, no smoothing
+  RESAMPLE_FILTER_NEAREST   = 0,
+  //! Triangle (tent) kernel, radius 1
+  RESAMPLE_FILTER_LINEAR    = 1,
+  //! Catmull-Rom cubic, radius 2
+  RESAMPLE_FILTER_CUBIC     = 2,
+  //! Lanczos windowed sinc, radius 3
+  RESAMPLE_FILTER_LANCZOS   = 3,
+
+  RESAMPLE_FILTER_COUNT
+};
+
+// ****************************************************************************
+// Class
+// ****************************************************************************
+
+/**
+* \class ResampleTaps precalculated source indices and weights for
+* one axis. Each destination sample uses getNumTaps() source samples,
+* indices are already clamped to the source range.
+*/
+
+class ResampleTaps
+{
+public:
+  ResampleTaps();
+  ~ResampleTaps();
+
+  /*!
+   * \brief Build taps for mapping dimSrc samples into dimDst samples.
+   *   Sample centers are aligned: dst (d + 0.5) maps to src (d + 0.5) * ratio.
+   *   For down scaling kernel is stretched by ratio to avoid aliasing.
+   * \return 1 if ok, -1 if no memory
+   */
+  int           create(
+                        const int             dimSrc,
+                        const int             dimDst,
+                        const ResampleFilter  filter
+                      );
+  void          destroy();
+
+  int           getNumTaps() const    { return m_numTaps;   }
+  int           getDimSrc() const     { return m_dimSrc;    }
+  int           getDimDst() const     { return m_dimDst;    }
+  //! m_numTaps source indices per destination sample
+  const int    *getIndices() const    { return m_indices;   }
+  //! m_numTaps normalized weights per destination sample
+  const float  *getWeights() const    { return m_weights;   }
+  //! 1 if destination is exact copy of source
+  int           isIdentity() const    { return m_isIdentity; }
+
+private:
+  int           m_dimSrc;
+  int           m_dimDst;
+  int           m_numTaps;
+  int           m_isIdentity;
+  int          *m_indices;
+  float        *m_weights;
+};
+
+/**
+* \class Resampler3d resize 1 byte per voxel volumes with separable filters.
+* Without z resampling xy pass is done per source slice, distributed
+* between threads slice by slice. Otherwise every thread takes a range
+* of destination slices and keeps ring of (taps + 1) xy resampled float
+* slices for its z pass, so no intermediate volume is allocated.
+*/
+
+class Resampler3d
+{
+public:
+  static float  getFilterRadius(const ResampleFilter filter);
+  static float  getFilterWeight(const ResampleFilter filter, const float t);
+
+  /*!
+   * \brief Resample volume into caller provided destination buffer.
+   *   Source and destination should not overlap.
+   * \return 1 if ok, -1 if no memory
+   */
+  static int    resample(
+                          const MUint8         *pixelsSrc,
+                          const int             xDimSrc,
+                          const int             yDimSrc,
+                          const int             zDimSrc,
+                          MUint8               *pixelsDst,
+                          const int             xDimDst,
+                          const int             yDimDst,
+                          const int             zDimDst,
+                          const ResampleFilter  filter
+                        );
+};
+
+#endif
@@ -0,0 +1,457 @@
+// ****************************************************************************
+// File: reslice.cpp
+// Purpose: Oblique multi planar reconstruction (MPR) of volume texture
+// ****************************************************************************
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include <stdio.h>
+#include <stddef.h>
+#include <math.h>
+#include <assert.h>
+
+#include "memtrack.h"
+#include "arena.h"
+#include "parallel.h"
+#include "reslice.h"
+
+// SSE2 is always present on x64 and on x86 builds with /arch:SSE2
+#if defined(__SSE2__) || defined(_M_X64) || \
+  (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define RESLICE_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+// ****************************************************************************
+// Defines
+// ****************************************************************************
+
+// rows per thread job
+#define RESLICE_ROWS_PER_CHUNK      4
+
+// ****************************************************************************
+// Types
+// ****************************************************************************
+
+struct ResliceJob
+{
+  const MUint8         *m_pixelsSrc;
+  int                   m_xDim;
+  int                   m_yDim;
+  int                   m_zDim;
+  const ReslicePlane   *m_plane;
+  ResampleFilter        m_filter;
+  int                   m_w;
+  MUint8               *m_pixelsDst;
+  MUint8                m_valOutside;
+};
+
+// One axis of sample position, clamped into volume.
+// Linear: i0, i0 + step and fraction in [0..1]
+struct ResliceAxis
+{
+  int     m_i0;
+  float   m_fract;
+};
+
+// ****************************************************************************
+// Sampling
+// ****************************************************************************
+
+static int _isInside(const ResliceJob *job, const V3f &p)
+{
+  return (p.x >= -0.5f) && (p.x <= job->m_xDim - 0.5f) &&
+    (p.y >= -0.5f) && (p.y <= job->m_yDim - 0.5f) &&
+    (p.z >= -0.5f) && (p.z <= job->m_zDim - 0.5f);
+}
+
+// Same operations as SSE2 path, so both give identical pixels
+static void _getAxisLinear(const float c, const int dim, ResliceAxis &axis)
+{
+  const float cMax = (float)(dim - 1);
+  const float iMax = (float)((dim >= 2) ? (dim - 2) : 0);
+  float cc = (c > 0.0f) ? c : 0.0f;
+  cc = (cc < cMax) ? cc : cMax;
+  float i0 = (float)(int)cc;
+  i0 = (i0 < iMax) ? i0 : iMax;
+  axis.m_i0 = (int)i0;
+  axis.m_fract = cc - i0;
+}
+
+static MUint8 _sampleNearest(const ResliceJob *job, const V3f &p)
+{
+  const int x = (int)(p.x + 0.5f);
+  const int y = (int)(p.y + 0.5f);
+  const int z = (int)(p.z + 0.5f);
+  // p is inside, so only upper border can be reached
+  const int xc = (x < job->m_xDim) ? x : (job->m_xDim - 1);
+  const int yc = (y < job->m_yDim) ? y : (job->m_yDim - 1);
+  const int zc = (z < job->m_zDim) ? z : (job->m_zDim - 1);
+  return job->m_pixelsSrc[xc + (size_t)yc * job->m_xDim +
+    (size_t)zc * job->m_xDim * job->m_yDim];
+}
+
+static MUint8 _sampleLinear(const ResliceJob *job, const V3f &p)
+{
+  ResliceAxis ax, ay, az;
+  _getAxisLinear(p.x, job->m_xDim, ax);
+  _getAxisLinear(p.y, job->m_yDim, ay);
+  _getAxisLinear(p.z, job->m_zDim, az);
+
+  const size_t xDim = job->m_xDim;
+  const size_t xyDim = xDim * job->m_yDim;
+  const size_t dx = (job->m_xDim > 1) ? 1 : 0;
+  const size_t dy = (job->m_yDim > 1) ? xDim : 0;
+  const size_t dz = (job->m_zDim > 1) ? xyDim : 0;
+  const MUint8 *src = job->m_pixelsSrc + ax.m_i0 + ay.m_i0 * xDim +
+    az.m_i0 * xyDim;
+
+  const float v000 = src[0],       v100 = src[dx];
+  const float v010 = src[dy],      v110 = src[dy + dx];
+  const float v001 = src[dz],      v101 = src[dz + dx];
+  const float v011 = src[dz + dy], v111 = src[dz + dy + dx];
+
+  const float v00 = v000 + (v100 - v000) * ax.m_fract;
+  const float v10 = v010 + (v110 - v010) * ax.m_fract;
+  const float v01 = v001 + (v101 - v001) * ax.m_fract;
+  const float v11 = v011 + (v111 - v011) * ax.m_fract;
+  const float v0 = v00 + (v10 - v00) * ay.m_fract;
+  const float v1 = v01 + (v11 - v01) * ay.m_fract;
+  const float val = v0 + (v1 - v0) * az.m_fract;
+  return (MUint8)(int)(val + 0.5f);
+}
+
+// Catmull-Rom weights for samples -1, 0, 1, 2
+static void _getCubicWeights(const float t, float *weights)
+{
+  const float t2 = t * t;
+  const float t3 = t2 * t;
+  weights[0] = -0.5f * t3 + t2 - 0.5f * t;
+  weights[1] = 1.5f * t3 - 2.5f * t2 + 1.0f;
+  weights[2] = -1.5f * t3 + 2.0f * t2 + 0.5f * t;
+  weights[3] = 0.5f * t3 - 0.5f * t2;
+}
+
+static void _getCubicIndices(const float c, const int dim, int *indices,
+  float *weights)
+{
+  const float cMax = (float)(dim - 1);
+  float cc = (c > 0.0f) ? c : 0.0f;
+  cc = (cc < cMax) ? cc : cMax;
+  const int i = (int)cc;
+  _getCubicWeights(cc - (float)i, weights);
+  for (int k = 0; k < 4; k++)
+  {
+    int ind = i - 1 + k;
+    ind = (ind > 0) ? ind : 0;
+    indices[k] = (ind < dim) ? ind : (dim - 1);
+  }
+}
+
+static MUint8 _sampleCubic(const ResliceJob *job, const V3f &p)
+{
+  int   ix[4], iy[4], iz[4];
+  float wx[4], wy[4], wz[4];
+  _getCubicIndices(p.x, job->m_xDim, ix, wx);
+  _getCubicIndices(p.y, job->m_yDim, iy, wy);
+  _getCubicIndices(p.z, job->m_zDim, iz, wz);
+
+  const size_t xDim = job->m_xDim;
+  const size_t xyDim = xDim * job->m_yDim;
+  float val = 0.0f;
+  for (int kz = 0; kz < 4; kz++)
+  {
+    float valPlane = 0.0f;
+    for (int ky = 0; ky < 4; ky++)
+    {
+      const MUint8 *row = job->m_pixelsSrc + iz[kz] * xyDim + iy[ky] * xDim;
+      const float valRow = wx[0] * row[ix[0]] + wx[1] * row[ix[1]] +
+        wx[2] * row[ix[2]] + wx[3] * row[ix[3]];
+      valPlane += wy[ky] * valRow;
+    }
+    val += wz[kz] * valPlane;
+  }
+  val = (val > 0.0f) ? val : 0.0f;
+  val = (val < 255.0f) ? val : 255.0f;
+  return (MUint8)(int)(val + 0.5f);
+}
+
+#if defined(RESLICE_USE_SSE2)
+
+// Trilinear samples of row pixels [uStart, uEnd), uEnd - uStart is
+// multiple of 4. Positions are computed from row start for every group,
+// not accumulated, so long rows do not drift.
+static void _resliceRowLinearSse2(
+                                  const ResliceJob *job,
+                                  const V3f        &rowStart,
+                                  const int         uStart,
+                                  const int         uEnd,
+                                  MUint8           *rowDst
+                                 )
+{
+  const V3f    &axisU = job->m_plane->m_axisU;
+  const size_t  xDim = job->m_xDim;
+  const size_t  xyDim = xDim * job->m_yDim;
+  const size_t  dx = (job->m_xDim > 1) ? 1 : 0;
+  const size_t  dy = (job->m_yDim > 1) ? xDim : 0;
+  const size_t  dz = (job->m_zDim > 1) ? xyDim : 0;
+
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 dims[3] =
+  {
+    _mm_set1_ps((float)job->m_xDim),
+    _mm_set1_ps((float)job->m_yDim),
+    _mm_set1_ps((float)job->m_zDim)
+  };
+  const __m128 starts[3] =
+  {
+    _mm_set1_ps(rowStart.x), _mm_set1_ps(rowStart.y), _mm_set1_ps(rowStart.z)
+  };
+  const __m128 steps[3] =
+  {
+    _mm_set1_ps(axisU.x), _mm_set1_ps(axisU.y), _mm_set1_ps(axisU.z)
+  };
+  const int dimsInt[3] = { job->m_xDim, job->m_yDim, job->m_zDim };
+  __m128 cMax[3], iMax[3];
+  for (int a = 0; a < 3; a++)
+  {
+    cMax[a] = _mm_set1_ps((float)(dimsInt[a] - 1));
+    iMax[a] = _mm_set1_ps((float)((dimsInt[a] >= 2) ? (dimsInt[a] - 2) : 0));
+  }
+
+  __m128 fu = _mm_setr_ps((float)uStart, (float)(uStart + 1),
+    (float)(uStart + 2), (float)(uStart + 3));
+  const __m128 four = _mm_set1_ps(4.0f);
+  MUint32 valOutside = job->m_valOutside;
+
+  for (int u = uStart; u < uEnd; u += 4, fu = _mm_add_ps(fu, four))
+  {
+    __m128  fract[3];
+    __m128  inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    MUint32 i0[3][4];
+    for (int a = 0; a < 3; a++)
+    {
+      __m128 c = _mm_add_ps(starts[a], _mm_mul_ps(fu, steps[a]));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(c, _mm_sub_ps(zero, half)));
+      inside = _mm_and_ps(inside, _mm_cmple_ps(c, _mm_sub_ps(dims[a], half)));
+      c = _mm_min_ps(_mm_max_ps(c, zero), cMax[a]);
+      __m128 i0f = _mm_cvtepi32_ps(_mm_cvttps_epi32(c));
+      i0f = _mm_min_ps(i0f, iMax[a]);
+      fract[a] = _mm_sub_ps(c, i0f);
+      _mm_storeu_si128((__m128i*)i0[a], _mm_cvttps_epi32(i0f));
+    }
+
+    // gather 8 corners of 4 samples
+    float corners[8][4];
+    for (int l = 0; l < 4; l++)
+    {
+      const MUint8 *src = job->m_pixelsSrc + i0[0][l] + i0[1][l] * xDim +
+        i0[2][l] * xyDim;
+      corners[0][l] = src[0];
+      corners[1][l] = src[dx];
+      corners[2][l] = src[dy];
+      corners[3][l] = src[dy + dx];
+      corners[4][l] = src[dz];
+      corners[5][l] = src[dz + dx];
+      corners[6][l] = src[dz + dy];
+      corners[7][l] = src[dz + dy + dx];
+    }
+    __m128 v[8];
+    for (int k = 0; k < 8; k++)
+      v[k] = _mm_loadu_ps(corners[k]);
+    const __m128 v00 = _mm_add_ps(v[0], _mm_mul_ps(_mm_sub_ps(v[1], v[0]),
+      fract[0]));
+    const __m128 v10 = _mm_add_ps(v[2], _mm_mul_ps(_mm_sub_ps(v[3], v[2]),
+      fract[0]));
+    const __m128 v01 = _mm_add_ps(v[4], _mm_mul_ps(_mm_sub_ps(v[5], v[4]),
+      fract[0]));
+    const __m128 v11 = _mm_add_ps(v[6], _mm_mul_ps(_mm_sub_ps(v[7], v[6]),
+      fract[0]));
+    const __m128 v0 = _mm_add_ps(v00, _mm_mul_ps(_mm_sub_ps(v10, v00),
+      fract[1]));
+    const __m128 v1 = _mm_add_ps(v01, _mm_mul_ps(_mm_sub_ps(v11, v01),
+      fract[1]));
+    const __m128 val = _mm_add_ps(v0, _mm_mul_ps(_mm_sub_ps(v1, v0),
+      fract[2]));
+
+    MUint32 vals[4], masks[4];
+    _mm_storeu_si128((__m128i*)vals, _mm_cvttps_epi32(_mm_add_ps(val, half)));
+    _mm_storeu_si128((__m128i*)masks, _mm_castps_si128(inside));
+    for (int l = 0; l < 4; l++)
+      rowDst[u + l] = (MUint8)(masks[l] ? vals[l] : valOutside);
+  }   // for (u)
+}
+
+#endif
+
+static void _resliceRowsCallback(
+                                  void       *userData,
+                                  const int   yStart,
+                                  const int   yEnd
+                                )
+{
+  const ResliceJob   *job = (const ResliceJob*)userData;
+  const ReslicePlane *plane = job->m_plane;
+  const int           w = job->m_w;
+
+  for (int y = yStart; y < yEnd; y++)
+  {
+    MUint8 *rowDst = job->m_pixelsDst + (size_t)y * w;
+    V3f rowStart(
+                  plane->m_origin.x + y * plane->m_axisV.x,
+                  plane->m_origin.y + y * plane->m_axisV.y,
+                  plane->m_origin.z + y * plane->m_axisV.z
+                );
+    int u = 0;
+#if defined(RESLICE_USE_SSE2)
+    if (job->m_filter == RESAMPLE_FILTER_LINEAR)
+    {
+      const int uEnd = w & ~3;
+      _resliceRowLinearSse2(job, rowStart, 0, uEnd, rowDst);
+      u = uEnd;
+    }
+#endif
+    for (; u < w; u++)
+    {
+      V3f p(
+            rowStart.x + u * plane->m_axisU.x,
+            rowStart.y + u * plane->m_axisU.y,
+            rowStart.z + u * plane->m_axisU.z
+          );
+      if (!_isInside(job, p))
+      {
+        rowDst[u] = job->m_valOutside;
+        continue;
+      }
+      switch (job->m_filter)
+      {
+        case RESAMPLE_FILTER_NEAREST:
+          rowDst[u] = _sampleNearest(job, p);
+          break;
+        case RESAMPLE_FILTER_LINEAR:
+          rowDst[u] = _sampleLinear(job, p);
+          break;
+        case RESAMPLE_FILTER_CUBIC:
+          rowDst[u] = _sampleCubic(job, p);
+          break;
+        default:
+          assert(job->m_filter < -5555);
+      }
+    }   // for (u)
+  }     // for (y)
+}
+
+// ****************************************************************************
+// Methods
+// ****************************************************************************
+
+int Reslicer::createPlane(
+                          const KtxTexture *tex,
+                          const V3f        &normal,
+                          const float       dist,
+                          const int         w,
+                          const int         h,
+                          const float       pixelSize,
+                          ReslicePlane     &plane
+                         )
+{
+  V3f n(normal);
+  const float len = n.length();
+  if (!n.normalize())
+    return -1;
+  const float d = dist / len;
+
+  // volume center projected to plane
+  V3f center(
+              (tex->getWidth() - 1) * 0.5f,
+              (tex->getHeight() - 1) * 0.5f,
+              (tex->getDepth() - 1) * 0.5f
+            );
+  V3f shift(n);
+  shift.scaleBy(n.dotProduct(center) - d);
+  center.subWith(shift);
+
+  // rows along x projection, or y when plane is nearly sagittal
+  V3f axisU(1.0f, 0.0f, 0.0f);
+  if (fabsf(n.x) > 0.9f)
+    axisU.set(0.0f, 1.0f, 0.0f);
+  V3f proj(n);
+  proj.scaleBy(axisU.dotProduct(n));
+  axisU.subWith(proj);
+  axisU.normalize();
+  V3f axisV;
+  axisV.cross(n, axisU);
+
+  axisU.scaleBy(pixelSize);
+  axisV.scaleBy(pixelSize);
+  plane.m_axisU = axisU;
+  plane.m_axisV = axisV;
+  plane.m_origin = center;
+  V3f offU(axisU), offV(axisV);
+  offU.scaleBy((w - 1) * 0.5f);
+  offV.scaleBy((h - 1) * 0.5f);
+  plane.m_origin.subWith(offU);
+  plane.m_origin.subWith(offV);
+  return 1;
+}
+
+int Reslicer::reslice(
+                      const KtxTexture     *tex,
+                      const ReslicePlane   &plane,
+                      const ResampleFilter  filter,
+                      const int             w,
+                      const int             h,
+                      MUint8               *pixelsDst,
+                      const MUint8          valOutside
+                     )
+{
+  if (tex->getGlFormat() != KTX_GL_RED)
+    return -1;
+  if ((filter != RESAMPLE_FILTER_NEAREST) &&
+      (filter != RESAMPLE_FILTER_LINEAR) &&
+      (filter != RESAMPLE_FILTER_CUBIC))
+    return -1;
+  if ((w <= 0) || (h <= 0))
+    return -1;
+
+  ResliceJob job;
+  job.m_pixelsSrc   = tex->getData();
+  job.m_xDim        = tex->getWidth();
+  job.m_yDim        = tex->getHeight();
+  job.m_zDim        = tex->getDepth();
+  job.m_plane       = &plane;
+  job.m_filter      = filter;
+  job.m_w           = w;
+  job.m_pixelsDst   = pixelsDst;
+  job.m_valOutside  = valOutside;
+  Parallel::forRange(h, _resliceRowsCallback, &job, RESLICE_ROWS_PER_CHUNK);
+  return 1;
+}
+
+int Reslicer::resliceArgb(
+                          const KtxTexture     *tex,
+                          const ReslicePlane   &plane,
+                          const ResampleFilter  filter,
+                          const int             w,
+                          const int             h,
+                          MUint32              *pixelsDst,
+                          const MUint8          valOutside
+                         )
+{
+  const size_t numPixels = (size_t)w * h;
+  MemArenaFrame frame;
+  MUint8 *pixelsGrey = (MUint8*)frame.allocate(numPixels);
+  if (pixelsGrey == NULL)
+    return -1;
+  if (reslice(tex, plane, filter, w, h, pixelsGrey, valOutside) < 0)
+    return -1;
+  for (size_t i = 0; i < numPixels; i++)
+  {
+    const MUint32 val = pixelsGrey[i];
+    pixelsDst[i] = 0xff000000 | (val << 16) | (val << 8) | val;
+  }
+  return 1;
+}
@@ -0,0 +1,94 @@
+// ****************************************************************************
+// File: reslice.h
+// Purpose: Oblique multi planar reconstruction (MPR) of volume texture
+// ****************************************************************************
+
+#ifndef  __reslice_h
+#define  __reslice_h
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include "mtypes.h"
+#include "resample.h"
+#include "ktxtexture.h"
+
+// ****************************************************************************
+// Types
+// ****************************************************************************
+
+/** \struct ReslicePlane
+ *  \brief Output image placement in voxel coordinates.
+ *  Voxel centers are at integer coordinates, pixel (u, v) samples point
+ *  m_origin + u * m_axisU + v * m_axisV.
+ */
+struct ReslicePlane
+{
+  //! center of output pixel (0, 0)
+  V3f     m_origin;
+  //! step to next pixel in row
+  V3f     m_axisU;
+  //! step to next row
+  V3f     m_axisV;
+};
+
+// ****************************************************************************
+// Class
+// ****************************************************************************
+
+/**
+* \class Reslicer samples 1 byte per voxel texture along arbitrary plane.
+* Rows are processed by worker threads, every row steps along m_axisU
+* from its start point. Trilinear rows are processed by 4 pixels with
+* SSE2, where it is available.
+*/
+
+class Reslicer
+{
+public:
+  /*!
+   * \brief Plane from equation dot(normal, p) = dist (voxel coordinates).
+   *   Image center is projection of volume center to plane, rows go along
+   *   x axis projection (or y axis if normal is close to x).
+   * \param pixelSize Pixel size in voxels
+   * \return 1 if ok, -1 if normal is zero
+   */
+  static int  createPlane(
+                          const KtxTexture *tex,
+                          const V3f        &normal,
+                          const float       dist,
+                          const int         w,
+                          const int         h,
+                          const float       pixelSize,
+                          ReslicePlane     &plane
+                         );
+  /*!
+   * \brief Sample plane into w * h 8 bit image
+   * \param filter Nearest, linear (trilinear) or cubic (tricubic
+   *   Catmull-Rom). Lanczos is not supported.
+   * \param valOutside Value of pixels outside of volume
+   * \return 1 if ok, -1 if filter or texture format is not supported
+   */
+  static int  reslice(
+                      const KtxTexture     *tex,
+                      const ReslicePlane   &plane,
+                      const ResampleFilter  filter,
+                      const int             w,
+                      const int             h,
+                      MUint8               *pixelsDst,
+                      const MUint8          valOutside = 0
+                     );
+  //! Same as reslice, grey ARGB output as accepted by Downsample2d::create
+  static int  resliceArgb(
+                          const KtxTexture     *tex,
+                          const ReslicePlane   &plane,
+                          const ResampleFilter  filter,
+                          const int             w,
+                          const int             h,
+                          MUint32              *pixelsDst,
+                          const MUint8          valOutside = 0
+                         );
+};
+
+#endif
@@ -11,6 +11,10 @@
 #include <math.h>
 #include <assert.h>
 
+#include <atomic>
+
+#include "arena.h"
+#include "parallel.h"
 #include "volume.h"
 
 // ****************************************************************************
@@ -69,7 +73,8 @@ int  VolumeTools::performGaussSlow(
                 break;
               const float tx = (float)dx / VOL_GAUSS_RADIUS;
 
-              const int off = x + y * xDim + z * xDim * yDim;
+              const size_t off = x + (size_t)y * xDim +
+                (size_t)z * xDim * yDim;
               const MUint8 val = volPixelsSrc[off];
 
               const float dist2 = tx * tx + ty * ty + tz * tz;
@@ -82,7 +87,8 @@ int  VolumeTools::performGaussSlow(
 
         float valSmoothed = sum / sumWeights;
         valSmoothed = (valSmoothed <= 255.0f) ? valSmoothed : 255.0f;
-        const int offDst = cx + (cy * xDim) + (cz * xDim * yDim);
+        const size_t offDst = cx + (size_t)cy * xDim +
+          (size_t)cz * xDim * yDim;
         volPixelsDst[offDst] = (MUint8)valSmoothed;
       }   // for (cx)
     }     // for (cy)
@@ -98,6 +104,21 @@ int  VolumeTools::performGaussFast(
                                     MUint8        *volPixelsDst
                                   )
 {
+  VolumeView viewSrc;
+  viewSrc.create(volPixelsSrc, xDim, yDim, zDim);
+  return performGaussFast(viewSrc, volPixelsDst);
+}
+
+int  VolumeTools::performGaussFast(
+                                    const VolumeView &viewSrc,
+                                    MUint8           *volPixelsDst
+                                  )
+{
+  assert(viewSrc.getBytesPerVoxel() == 1);
+  const int xDim = viewSrc.getWidth();
+  const int yDim = viewSrc.getHeight();
+  const int zDim = viewSrc.getDepth();
+
   // TODO: this function should be improved in terms of performance
   // 1) Gauss koefficients should be calculated before main volume cycle
   // 2) Constants should be calculated out of internal cycles (remove cycle invariants)
@@ -148,8 +169,7 @@ int  VolumeTools::performGaussFast(
               // TODO: volume offset should be calculated
               // more effective (in terms of constants
               // relative to internal cycle)
-              const int off = x + y * xDim + z * xDim * yDim;
-              const MUint8 val = volPixelsSrc[off];
+              const MUint8 val = viewSrc.getVoxel(x, y, z);
 
               // TODO: dist2, weight should be calcuated
               // more efficient in terms of constant related to internal cycles
@@ -169,10 +189,280 @@ int  VolumeTools::performGaussFast(
         valSmoothed = (valSmoothed <= 255.0f) ? valSmoothed : 255.0f;
         // TODO: offDst should be calculated in a more efficient way:
         // remove repeated constants calculation
-        const int offDst = cx + (cy * xDim) + (cz * xDim * yDim);
+        const size_t offDst = cx + (size_t)cy * xDim +
+          (size_t)cz * xDim * yDim;
         volPixelsDst[offDst] = (MUint8)valSmoothed;
       }   // for (cx)
     }     // for (cy)
   }       // for (cz)
   return 1;
 }
+
+// ****************************************************************************
+// Recursive (IIR) Gauss
+// ****************************************************************************
+
+// Rows of x pass and rows (of xz planes) of z pass per parallel chunk
+#define VOL_IIR_ROWS_PER_CHUNK      16
+
+// Added to voxels before filtering and subtracted after it. Decaying
+// filter tails stay near it instead of going to (very slow) denormals.
+#define VOL_IIR_OFFSET              1.0f
+
+// Result of x and y passes is kept as 8.8 fixed point until z pass
+#define VOL_IIR_FIXED_SCALE         256.0f
+#define VOL_IIR_FIXED_MAX           65535.0f
+
+struct IirGaussJob
+{
+  const VolumeView *m_viewSrc;
+  MUint8           *m_pixelsDst;
+  MUint16          *m_voxels;
+  std::atomic<int>  m_failed;
+  int               m_xDim;
+  int               m_yDim;
+  int               m_zDim;
+  // Young - van Vliet: w[n] = B * x[n] + b1 * w[n-1] + b2 * w[n-2] +
+  // b3 * w[n-3], with b1..b3 already divided by b0
+  float             m_b;
+  float             m_b1;
+  float             m_b2;
+  float             m_b3;
+};
+
+static void _iirCoefs(const float sigma, IirGaussJob *job)
+{
+  const float q = (sigma >= 2.5f) ?
+    (0.98711f * sigma - 0.96330f) :
+    (3.97156f - 4.14554f * sqrtf(1.0f - 0.26891f * sigma));
+  const float q2 = q * q;
+  const float q3 = q2 * q;
+  const float b0 = 1.57825f + 2.44413f * q + 1.4281f * q2 + 0.422205f * q3;
+  job->m_b1 = (2.44413f * q + 2.85619f * q2 + 1.26661f * q3) / b0;
+  job->m_b2 = -(1.4281f * q2 + 1.26661f * q3) / b0;
+  job->m_b3 = 0.422205f * q3 / b0;
+  job->m_b = 1.0f - (job->m_b1 + job->m_b2 + job->m_b3);
+}
+
+// Causal and anticausal filter of numRows (up to VOL_IIR_ROWS_PER_CHUNK)
+// x rows in place. Out of row values are replicated edge values (constant
+// row is not changed). Rows are filtered together: recursion of one row is
+// a chain of dependent operations, independent rows fill the pipeline and
+// inner loop over rows is vectorized.
+static void _iirRows(
+                      const IirGaussJob *job,
+                      float             *rows,
+                      const int          numRows,
+                      const int          xDim
+                    )
+{
+  const float b = job->m_b, b1 = job->m_b1, b2 = job->m_b2, b3 = job->m_b3;
+  float w1[VOL_IIR_ROWS_PER_CHUNK];
+  float w2[VOL_IIR_ROWS_PER_CHUNK];
+  float w3[VOL_IIR_ROWS_PER_CHUNK];
+  int i, r;
+  for (r = 0; r < numRows; r++)
+    w1[r] = w2[r] = w3[r] = rows[r * xDim];
+  for (i = 0; i < xDim; i++)
+  {
+    for (r = 0; r < numRows; r++)
+    {
+      float *val = rows + r * xDim + i;
+      const float w = b * (*val) + b1 * w1[r] + b2 * w2[r] + b3 * w3[r];
+      w3[r] = w2[r];
+      w2[r] = w1[r];
+      w1[r] = w;
+      *val = w;
+    }
+  }
+  for (r = 0; r < numRows; r++)
+    w1[r] = w2[r] = w3[r] = rows[r * xDim + xDim - 1];
+  for (i = xDim - 1; i >= 0; i--)
+  {
+    for (r = 0; r < numRows; r++)
+    {
+      float *val = rows + r * xDim + i;
+      const float w = b * (*val) + b1 * w1[r] + b2 * w2[r] + b3 * w3[r];
+      w3[r] = w2[r];
+      w2[r] = w1[r];
+      w1[r] = w;
+      *val = w;
+    }
+  }
+}
+
+// Same filter applied to num lines at once: line elements are rows of
+// xDim floats, stride floats apart. Inner loops go along x, so they are
+// vectorized by compiler.
+static void _iirLines(
+                      const IirGaussJob *job,
+                      float             *rows,
+                      const int          num,
+                      const size_t       stride,
+                      const int          xDim
+                    )
+{
+  const float b = job->m_b, b1 = job->m_b1, b2 = job->m_b2, b3 = job->m_b3;
+  int i, x;
+  // rows before first one are equal to it, so first row does not change
+  for (i = 1; i < num; i++)
+  {
+    float *row = rows + i * stride;
+    const float *row1 = row - stride;
+    const float *row2 = (i >= 2) ? (row - 2 * stride) : rows;
+    const float *row3 = (i >= 3) ? (row - 3 * stride) : rows;
+    for (x = 0; x < xDim; x++)
+      row[x] = b * row[x] + b1 * row1[x] + b2 * row2[x] + b3 * row3[x];
+  }
+  const float *rowLast = rows + (num - 1) * stride;
+  for (i = num - 2; i >= 0; i--)
+  {
+    float *row = rows + i * stride;
+    const float *row1 = row + stride;
+    const float *row2 = (i + 2 < num) ? (row + 2 * stride) : rowLast;
+    const float *row3 = (i + 3 < num) ? (row + 3 * stride) : rowLast;
+    for (x = 0; x < xDim; x++)
+      row[x] = b * row[x] + b1 * row1[x] + b2 * row2[x] + b3 * row3[x];
+  }
+}
+
+// x and y passes of slices: source voxels to float slice, x rows
+// filtered by groups, then all x lines of slice at once. Result goes to
+// fixed point volume.
+static void _iirPassXyCallback(
+                                void       *userData,
+                                const int   zStart,
+                                const int   zEnd
+                              )
+{
+  IirGaussJob *job = (IirGaussJob*)userData;
+  const int     xDim = job->m_xDim;
+  const int     yDim = job->m_yDim;
+  const size_t  xyDim = (size_t)xDim * yDim;
+  MemArenaFrame frame;
+  float *slice = (float*)frame.allocate(xyDim * sizeof(float));
+  if (slice == NULL)
+  {
+    job->m_failed = 1;
+    return;
+  }
+  for (int z = zStart; z < zEnd; z++)
+  {
+    int y;
+    for (y = 0; y < yDim; y++)
+    {
+      const MUint8 *src = job->m_viewSrc->getRow(y, z);
+      float *row = slice + (size_t)y * xDim;
+      for (int x = 0; x < xDim; x++)
+        row[x] = (float)src[x] + VOL_IIR_OFFSET;
+    }
+    for (y = 0; y < yDim; y += VOL_IIR_ROWS_PER_CHUNK)
+    {
+      const int numRows = (yDim - y < VOL_IIR_ROWS_PER_CHUNK) ?
+        (yDim - y) : VOL_IIR_ROWS_PER_CHUNK;
+      _iirRows(job, slice + (size_t)y * xDim, numRows, xDim);
+    }
+    _iirLines(job, slice, yDim, xDim, xDim);
+
+    MUint16 *dst = job->m_voxels + z * xyDim;
+    for (size_t i = 0; i < xyDim; i++)
+    {
+      float val = (slice[i] - VOL_IIR_OFFSET) * VOL_IIR_FIXED_SCALE + 0.5f;
+      val = (val >= 0.0f) ? val : 0.0f;
+      val = (val <= VOL_IIR_FIXED_MAX) ? val : VOL_IIR_FIXED_MAX;
+      dst[i] = (MUint16)val;
+    }
+  }   // for (z)
+}
+
+// z pass: xz plane from fixed point volume, all x lines of plane at
+// once, then result to bytes
+static void _iirPassZCallback(
+                              void       *userData,
+                              const int   yStart,
+                              const int   yEnd
+                            )
+{
+  IirGaussJob *job = (IirGaussJob*)userData;
+  const int     xDim = job->m_xDim;
+  const int     zDim = job->m_zDim;
+  const size_t  xyDim = (size_t)xDim * job->m_yDim;
+  MemArenaFrame frame;
+  float *plane = (float*)frame.allocate((size_t)xDim * zDim * sizeof(float));
+  if (plane == NULL)
+  {
+    job->m_failed = 1;
+    return;
+  }
+  for (int y = yStart; y < yEnd; y++)
+  {
+    int z, x;
+    for (z = 0; z < zDim; z++)
+    {
+      const MUint16 *src = job->m_voxels + y * (size_t)xDim + z * xyDim;
+      float *row = plane + (size_t)z * xDim;
+      for (x = 0; x < xDim; x++)
+        row[x] = src[x] * (1.0f / VOL_IIR_FIXED_SCALE) + VOL_IIR_OFFSET;
+    }
+    _iirLines(job, plane, zDim, xDim, xDim);
+    for (z = 0; z < zDim; z++)
+    {
+      const float *row = plane + (size_t)z * xDim;
+      MUint8 *dst = job->m_pixelsDst + y * (size_t)xDim + z * xyDim;
+      for (x = 0; x < xDim; x++)
+      {
+        float val = row[x] + (0.5f - VOL_IIR_OFFSET);
+        val = (val >= 0.0f) ? val : 0.0f;
+        val = (val <= 255.0f) ? val : 255.0f;
+        dst[x] = (MUint8)val;
+      }
+    }   // for (z)
+  }     // for (y)
+}
+
+int  VolumeTools::performGaussRecursive(
+                                        const MUint8 *volPixelsSrc,
+                                        const int     xDim,
+                                        const int     yDim,
+                                        const int     zDim,
+                                        const float   sigma,
+                                        MUint8       *volPixelsDst
+                                      )
+{
+  VolumeView viewSrc;
+  viewSrc.create(volPixelsSrc, xDim, yDim, zDim);
+  return performGaussRecursive(viewSrc, sigma, volPixelsDst);
+}
+
+int  VolumeTools::performGaussRecursive(
+                                        const VolumeView &viewSrc,
+                                        const float       sigma,
+                                        MUint8           *volPixelsDst
+                                      )
+{
+  assert(viewSrc.getBytesPerVoxel() == 1);
+  if (sigma < VOL_IIR_SIGMA_MIN)
+    return -1;
+  IirGaussJob job;
+  job.m_viewSrc   = &viewSrc;
+  job.m_pixelsDst = volPixelsDst;
+  job.m_xDim      = viewSrc.getWidth();
+  job.m_yDim      = viewSrc.getHeight();
+  job.m_zDim      = viewSrc.getDepth();
+  _iirCoefs(sigma, &job);
+
+  job.m_failed    = 0;
+
+  // source is read completely by xy pass, so destination may be source
+  MemArenaFrame frame;
+  job.m_voxels = (MUint16*)frame.allocate(viewSrc.getNumVoxels() *
+    sizeof(MUint16));
+  if (job.m_voxels == NULL)
+    return -1;
+  Parallel::forRange(job.m_zDim, _iirPassXyCallback, &job);
+  if (job.m_failed)
+    return -1;
+  Parallel::forRange(job.m_yDim, _iirPassZCallback, &job,
+    VOL_IIR_ROWS_PER_CHUNK);
+  return (job.m_failed) ? -1 : 1;
+}
@@ -12,6 +12,14 @@
 
 #include "mtypes.h"
 #include "image.h"
+#include "volview.h"
+
+// ****************************************************************************
+// Defines
+// ****************************************************************************
+
+// Min sigma (voxels) of recursive Gauss, smaller kernels are not accurate
+#define VOL_IIR_SIGMA_MIN           0.5f
 
 // ****************************************************************************
 // Class
@@ -39,6 +47,37 @@ public:
                                 const int     zDim,
                                 MUint8        *volPixelsDst
                               );
+  //! Same as above, source is any (cropped, strided) 1 bpp view.
+  //! Destination is compact volume of view size.
+  static int  performGaussFast(
+                                const VolumeView &viewSrc,
+                                MUint8           *volPixelsDst
+                              );
+  /*!
+   * \brief Recursive (IIR, Young - van Vliet) Gauss smoothing.
+   *   Cost per voxel does not depend on sigma. x and y passes run per
+   *   slice, z pass per xz plane, both in parallel; y and z passes
+   *   filter whole rows of x at once. Result of x and y passes is kept
+   *   in 8.8 fixed point, so temporary memory is 2 bytes per voxel plus
+   *   float slice and float xz plane per thread.
+   *   Destination may be the same as source.
+   * \param sigma Gauss sigma in voxels, not less than VOL_IIR_SIGMA_MIN
+   * \return 1 if ok, -1 if sigma is too small or no memory
+   */
+  static int  performGaussRecursive(
+                                    const MUint8 *volPixelsSrc,
+                                    const int     xDim,
+                                    const int     yDim,
+                                    const int     zDim,
+                                    const float   sigma,
+                                    MUint8       *volPixelsDst
+                                  );
+  //! Same as above for any 1 bpp view, destination is compact volume
+  static int  performGaussRecursive(
+                                    const VolumeView &viewSrc,
+                                    const float       sigma,
+                                    MUint8           *volPixelsDst
+                                  );
 };
 
 #endif
@@ -0,0 +1,212 @@
+// ****************************************************************************
+// File: volview.cpp
+// Purpose: Non owning strided view into volume voxels (crop without copy)
+// ****************************************************************************
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include <stdio.h>
+#include <memory.h>
+#include <assert.h>
+
+#include "volview.h"
+
+// ****************************************************************************
+// Methods
+// ****************************************************************************
+
+VolumeView::VolumeView()
+{
+  m_origin        = NULL;
+  m_xDim          = 0;
+  m_yDim          = 0;
+  m_zDim          = 0;
+  m_bytesPerVoxel = 1;
+  m_strideY       = 0;
+  m_strideZ       = 0;
+}
+
+void VolumeView::create(
+                        const MUint8 *pixels,
+                        const int     xDim,
+                        const int     yDim,
+                        const int     zDim,
+                        const int     bytesPerVoxel
+                       )
+{
+  m_origin        = pixels;
+  m_xDim          = xDim;
+  m_yDim          = yDim;
+  m_zDim          = zDim;
+  m_bytesPerVoxel = bytesPerVoxel;
+  m_strideY       = (size_t)xDim * bytesPerVoxel;
+  m_strideZ       = m_strideY * yDim;
+}
+
+void VolumeView::createFromTexture(const KtxTexture *tex)
+{
+  const MUint32 format = tex->getGlFormat();
+  const int bpp = (format == KTX_GL_RED) ? 1 : ((format == KTX_GL_RGB) ? 3 : 4);
+  create(tex->getData(), tex->getWidth(), tex->getHeight(), tex->getDepth(),
+    bpp);
+}
+
+int VolumeView::createAsCrop(
+                              const VolumeView &view,
+                              const V3d        &vMin,
+                              const V3d        &vSize
+                            )
+{
+  if ((vSize.x <= 0) || (vSize.y <= 0) || (vSize.z <= 0))
+    return -1;
+  if ((vMin.x < 0) || (vMin.y < 0) || (vMin.z < 0))
+    return -1;
+  if (
+      (vMin.x + vSize.x > view.m_xDim) ||
+      (vMin.y + vSize.y > view.m_yDim) ||
+      (vMin.z + vSize.z > view.m_zDim)
+     )
+    return -1;
+
+  // source may be this view
+  const MUint8 *origin = view.getRow(vMin.y, vMin.z) +
+    (size_t)vMin.x * view.m_bytesPerVoxel;
+  m_bytesPerVoxel = view.m_bytesPerVoxel;
+  m_strideY       = view.m_strideY;
+  m_strideZ       = view.m_strideZ;
+  m_origin        = origin;
+  m_xDim          = vSize.x;
+  m_yDim          = vSize.y;
+  m_zDim          = vSize.z;
+  return 1;
+}
+
+int VolumeView::createAsBox(
+                            const VolumeView &view,
+                            const V3d        &vMin,
+                            const V3d        &vMax
+                           )
+{
+  V3d vSize;
+  vSize.x = vMax.x - vMin.x + 1;
+  vSize.y = vMax.y - vMin.y + 1;
+  vSize.z = vMax.z - vMin.z + 1;
+  return createAsCrop(view, vMin, vSize);
+}
+
+int VolumeView::createAsSlice(const VolumeView &view, const int z)
+{
+  V3d vMin, vSize;
+  vMin.x = vMin.y = 0;
+  vMin.z = z;
+  vSize.x = view.m_xDim;
+  vSize.y = view.m_yDim;
+  vSize.z = 1;
+  return createAsCrop(view, vMin, vSize);
+}
+
+int VolumeView::isCompact() const
+{
+  const size_t bytesRow = (size_t)m_xDim * m_bytesPerVoxel;
+  if ((m_yDim > 1) && (m_strideY != bytesRow))
+    return 0;
+  if ((m_zDim > 1) && (m_strideZ != bytesRow * m_yDim))
+    return 0;
+  return 1;
+}
+
+void VolumeView::copyTo(MUint8 *pixelsDst) const
+{
+  const size_t bytesRow = (size_t)m_xDim * m_bytesPerVoxel;
+  if (isCompact())
+  {
+    memcpy(pixelsDst, m_origin, bytesRow * m_yDim * m_zDim);
+    return;
+  }
+  for (int z = 0; z < m_zDim; z++)
+  {
+    for (int y = 0; y < m_yDim; y++)
+    {
+      memcpy(pixelsDst, getRow(y, z), bytesRow);
+      pixelsDst += bytesRow;
+    }
+  }
+}
+
+KtxError VolumeView::materialize(KtxTexture *texDst) const
+{
+  assert(texDst->getData() != m_origin);
+  texDst->destroy();
+  KtxError err = texDst->create3D(m_xDim, m_yDim, m_zDim, m_bytesPerVoxel);
+  if (err != KTX_ERROR_OK)
+    return err;
+  copyTo(texDst->getData());
+  return KTX_ERROR_OK;
+}
+
+void VolumeView::getHistogram(size_t *histogram) const
+{
+  assert(m_bytesPerVoxel == 1);
+  int x, y, z;
+  for (x = 0; x < 256; x++)
+    histogram[x] = 0;
+  for (z = 0; z < m_zDim; z++)
+  {
+    for (y = 0; y < m_yDim; y++)
+    {
+      const MUint8 *row = getRow(y, z);
+      for (x = 0; x < m_xDim; x++)
+        histogram[row[x]]++;
+    }
+  }
+}
+
+int VolumeView::getNonZeroBox(
+                              V3d       &vMin,
+                              V3d       &vMax,
+                              const int  indexChannel
+                             ) const
+{
+  assert((indexChannel >= 0) && (indexChannel < m_bytesPerVoxel));
+  const int bpp = m_bytesPerVoxel;
+  int x, y, z;
+
+  vMin.x = vMin.y = vMin.z = 1 << 24;
+  vMax.x = vMax.y = vMax.z = -1;
+  for (z = 0; z < m_zDim; z++)
+  {
+    for (y = 0; y < m_yDim; y++)
+    {
+      const MUint8 *row = getRow(y, z) + indexChannel;
+      int xFirst = -1;
+      int xLast = -1;
+      for (x = 0; x < m_xDim; x++)
+      {
+        if (row[(size_t)x * bpp] != 0)
+        {
+          xFirst = x;
+          break;
+        }
+      }
+      if (xFirst < 0)
+        continue;
+      for (x = m_xDim - 1; x >= xFirst; x--)
+      {
+        if (row[(size_t)x * bpp] != 0)
+        {
+          xLast = x;
+          break;
+        }
+      }
+      vMin.x = (xFirst < vMin.x) ? xFirst : vMin.x;
+      vMax.x = (xLast > vMax.x) ? xLast : vMax.x;
+      vMin.y = (y < vMin.y) ? y : vMin.y;
+      vMax.y = (y > vMax.y) ? y : vMax.y;
+      vMin.z = (z < vMin.z) ? z : vMin.z;
+      vMax.z = z;
+    }   // for (y)
+  }     // for (z)
+  return (vMax.x >= 0) ? 1 : 0;
+}
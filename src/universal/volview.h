@@ -0,0 +1,122 @@
+// ****************************************************************************
+// File: volview.h
+// Purpose: Non owning strided view into volume voxels (crop without copy)
+// ****************************************************************************
+
+#ifndef  __volview_h
+#define  __volview_h
+
+// ****************************************************************************
+// Includes
+// ****************************************************************************
+
+#include <stddef.h>
+
+#include "mtypes.h"
+#include "ktxtexture.h"
+
+// ****************************************************************************
+// Class
+// ****************************************************************************
+
+/**
+* \class VolumeView origin, extents and strides of a box inside volume.
+* View does not own voxels: crop and slice views are created without any
+* copy and stay valid while source texture (or buffer) is alive and is not
+* resized. Filters, statistics and writers read voxels row by row through
+* getRow(), materialize() is used only when compact copy is really needed.
+*/
+
+class VolumeView
+{
+public:
+  VolumeView();
+
+  //! Whole compact volume in memory
+  void          create(
+                        const MUint8 *pixels,
+                        const int     xDim,
+                        const int     yDim,
+                        const int     zDim,
+                        const int     bytesPerVoxel = 1
+                      );
+  //! Whole texture (1, 3 or 4 bytes per voxel)
+  void          createFromTexture(const KtxTexture *tex);
+  /*!
+   * \brief Sub box of other view, no voxels are copied
+   * \param view Source view
+   * \param vMin First voxel of box, in source view coordinates
+   * \param vSize Box size
+   * \return 1 if ok, -1 if box is empty or outside of source view
+   */
+  int           createAsCrop(
+                              const VolumeView &view,
+                              const V3d        &vMin,
+                              const V3d        &vSize
+                            );
+  //! Crop by inclusive box [vMin, vMax], as returned by getBoundingBox
+  int           createAsBox(
+                            const VolumeView &view,
+                            const V3d        &vMin,
+                            const V3d        &vMax
+                           );
+  //! Single z slice of other view (depth is 1). Return 1 if ok, -1 if error
+  int           createAsSlice(const VolumeView &view, const int z);
+
+  int           getWidth() const          { return m_xDim; }
+  int           getHeight() const         { return m_yDim; }
+  int           getDepth() const          { return m_zDim; }
+  int           getBytesPerVoxel() const  { return m_bytesPerVoxel; }
+  //! distance between rows, bytes
+  size_t        getStrideY() const        { return m_strideY; }
+  //! distance between slices, bytes
+  size_t        getStrideZ() const        { return m_strideZ; }
+  //! 1 if voxels are one continuous block (no row and slice gaps)
+  int           isCompact() const;
+  //! Number of voxels in view
+  size_t        getNumVoxels() const
+  {
+    return (size_t)m_xDim * m_yDim * m_zDim;
+  }
+
+  //! First voxel of row y in slice z
+  const MUint8 *getRow(const int y, const int z) const
+  {
+    return m_origin + (size_t)y * m_strideY + (size_t)z * m_strideZ;
+  }
+  //! Voxel value, 1 byte per voxel views only
+  MUint8        getVoxel(const int x, const int y, const int z) const
+  {
+    return getRow(y, z)[x];
+  }
+
+  //! Copy voxels into compact buffer of getNumVoxels() * bpp bytes
+  void          copyTo(MUint8 *pixelsDst) const;
+  //! Create compact texture with view voxels
+  KtxError      materialize(KtxTexture *texDst) const;
+
+  //! Histogram of 1 byte voxels: 256 entries
+  void          getHistogram(size_t *histogram) const;
+  /*!
+   * \brief Bounding box of voxels with non zero channel
+   * \param vMin, vMax Inclusive box in view coordinates
+   * \param indexChannel Byte inside voxel to check (0 for 1 bpp views)
+   * \return 1 if found, 0 if all voxels are zero
+   */
+  int           getNonZeroBox(
+                              V3d       &vMin,
+                              V3d       &vMax,
+                              const int  indexChannel = 0
+                             ) const;
+
+private:
+  const MUint8 *m_origin;
+  int           m_xDim;
+  int           m_yDim;
+  int           m_zDim;
+  int           m_bytesPerVoxel;
+  size_t        m_strideY;
+  size_t        m_strideZ;
+};
+
+#endif
@@ -281,8 +281,8 @@ static  BOOL  _mainUpdateFrame(HWND hWnd)
       HCURSOR hCursorOld = SetCursor(s_cursorWait);
       {
         s_updatePressed = 0;
-        // update
-        s_downSampler->performDownSamplingAll();
+        // update methods invalidated by changed parameters only
+        s_downSampler->updateDownSamplingAll();
       }
       SetCursor(hCursorOld);
     } // if need to update